@@ -0,0 +1,780 @@
+/*
+ * art.c: an adaptive radix tree index of nodes, see art.h
+ *
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "art.h"
+
+enum art_type
+{
+    ART_NODE4,
+    ART_NODE16,
+    ART_NODE48,
+    ART_NODE256,
+};
+
+// prefixes up to this long live in the node itself
+#define ART_INLINE_PREFIX 8
+
+// A child is 0 (none), a leaf (a node_t pointer with the low bit set) or
+// an inner node
+typedef uintptr_t art_ref;
+
+struct art_inner
+{
+    uint8_t type;
+    uint16_t num_children;
+    uint32_t prefix_len;
+    uint64_t count; // leaves under this node
+    // bytes every key under this node has at this depth, kept in the node
+    // when they fit so a lookup doesn't miss the cache on them
+    union {
+        uint8_t *ptr;
+        uint8_t bytes[ART_INLINE_PREFIX];
+    } prefix;
+};
+
+// 4 and 16 children keep their key bytes sorted
+struct art_node4
+{
+    struct art_inner h;
+    uint8_t keys[4];
+    art_ref children[4];
+};
+
+struct art_node16
+{
+    struct art_inner h;
+    uint8_t keys[16];
+    art_ref children[16];
+};
+
+struct art_node48
+{
+    struct art_inner h;
+    uint8_t index[256]; // 1 + slot in children of each byte, 0 if none
+    art_ref children[48];
+};
+
+struct art_node256
+{
+    struct art_inner h;
+    art_ref children[256];
+};
+
+struct art_obj
+{
+    art_ref root;
+    uint64_t size;
+    uint64_t bytes; // inner nodes and prefixes that don't fit in them
+};
+
+// a node shrinks to the next smaller type once it is down to this many
+// children, a little below the smaller type's capacity so a node doesn't
+// flip back and forth
+#define ART_SHRINK16 3
+#define ART_SHRINK48 12
+#define ART_SHRINK256 37
+
+static const size_t art_sizes[] = {
+    sizeof(struct art_node4), sizeof(struct art_node16),
+    sizeof(struct art_node48), sizeof(struct art_node256),
+};
+
+static bool is_leaf(art_ref ref)
+{
+    return ref & 1;
+}
+
+static node_t *leaf_of(art_ref ref)
+{
+    return (node_t *) (ref & ~(uintptr_t) 1);
+}
+
+static art_ref make_leaf(node_t *node)
+{
+    return (uintptr_t) node | 1;
+}
+
+static struct art_inner *inner_of(art_ref ref)
+{
+    return (struct art_inner *) ref;
+}
+
+static uint64_t ref_count(art_ref ref)
+{
+    if (ref == 0) {
+        return 0;
+    }
+    return is_leaf(ref) ? 1 : inner_of(ref)->count;
+}
+
+static struct art_inner *new_inner(art_t tree, enum art_type type)
+{
+    struct art_inner *n = calloc(1, art_sizes[type]);
+    assert(n && "memory");
+    n->type = type;
+    tree->bytes += art_sizes[type];
+    return n;
+}
+
+static uint8_t *prefix_of(struct art_inner *n)
+{
+    return n->prefix_len > ART_INLINE_PREFIX ? n->prefix.ptr : n->prefix.bytes;
+}
+
+static void free_prefix(art_t tree, struct art_inner *n)
+{
+    if (n->prefix_len > ART_INLINE_PREFIX) {
+        tree->bytes -= n->prefix_len;
+        free(n->prefix.ptr);
+    }
+}
+
+static void set_prefix(art_t tree, struct art_inner *n, const uint8_t *bytes, uint32_t len)
+{
+    // bytes may point into n's current prefix
+    if (len > ART_INLINE_PREFIX) {
+        uint8_t *prefix = malloc(len);
+        assert(prefix && "memory");
+        memcpy(prefix, bytes, len);
+        free_prefix(tree, n);
+        n->prefix.ptr = prefix;
+        tree->bytes += len;
+    } else {
+        uint8_t prefix[ART_INLINE_PREFIX];
+        memcpy(prefix, bytes, len);
+        free_prefix(tree, n);
+        memcpy(n->prefix.bytes, prefix, len);
+    }
+    n->prefix_len = len;
+}
+
+static void free_inner(art_t tree, struct art_inner *n, bool with_prefix)
+{
+    tree->bytes -= art_sizes[n->type];
+    if (with_prefix) {
+        free_prefix(tree, n);
+    }
+    free(n);
+}
+
+static art_ref *find_child(struct art_inner *n, uint8_t byte)
+{
+    switch (n->type) {
+    case ART_NODE4: {
+        struct art_node4 *n4 = (struct art_node4 *) n;
+        for (uint32_t i = 0; i < n->num_children; ++i) {
+            if (n4->keys[i] == byte) {
+                return &n4->children[i];
+            }
+        }
+        return NULL;
+    }
+    case ART_NODE16: {
+        struct art_node16 *n16 = (struct art_node16 *) n;
+#ifdef __SSE2__
+        // compare all 16 key bytes at once
+        __m128i cmp = _mm_cmpeq_epi8(_mm_set1_epi8((char) byte),
+                _mm_loadu_si128((const __m128i *) n16->keys));
+        uint32_t mask = (uint32_t) _mm_movemask_epi8(cmp) & ((1u << n->num_children) - 1);
+        return mask ? &n16->children[__builtin_ctz(mask)] : NULL;
+#else
+        for (uint32_t i = 0; i < n->num_children; ++i) {
+            if (n16->keys[i] == byte) {
+                return &n16->children[i];
+            }
+        }
+        return NULL;
+#endif
+    }
+    case ART_NODE48: {
+        struct art_node48 *n48 = (struct art_node48 *) n;
+        return n48->index[byte] ? &n48->children[n48->index[byte] - 1] : NULL;
+    }
+    default: {
+        struct art_node256 *n256 = (struct art_node256 *) n;
+        return n256->children[byte] ? &n256->children[byte] : NULL;
+    }
+    }
+}
+
+static art_ref *next_child(struct art_inner *n, uint32_t *pos, uint8_t *byte)
+{
+    // the children in byte order: start with *pos = 0 and call until NULL
+    switch (n->type) {
+    case ART_NODE4:
+    case ART_NODE16: {
+        uint8_t *keys = n->type == ART_NODE4 ? ((struct art_node4 *) n)->keys :
+            ((struct art_node16 *) n)->keys;
+        art_ref *children = n->type == ART_NODE4 ? ((struct art_node4 *) n)->children :
+            ((struct art_node16 *) n)->children;
+        if (*pos >= n->num_children) {
+            return NULL;
+        }
+        *byte = keys[*pos];
+        return &children[(*pos)++];
+    }
+    case ART_NODE48: {
+        struct art_node48 *n48 = (struct art_node48 *) n;
+        while (*pos < 256) {
+            uint32_t b = (*pos)++;
+            if (n48->index[b]) {
+                *byte = (uint8_t) b;
+                return &n48->children[n48->index[b] - 1];
+            }
+        }
+        return NULL;
+    }
+    default: {
+        struct art_node256 *n256 = (struct art_node256 *) n;
+        while (*pos < 256) {
+            uint32_t b = (*pos)++;
+            if (n256->children[b]) {
+                *byte = (uint8_t) b;
+                return &n256->children[b];
+            }
+        }
+        return NULL;
+    }
+    }
+}
+
+static void sorted_insert(uint8_t *keys, art_ref *children, uint32_t num, uint8_t byte, art_ref child)
+{
+    uint32_t i = 0;
+    while (i < num && keys[i] < byte) {
+        ++i;
+    }
+    memmove(keys + i + 1, keys + i, num - i);
+    memmove(children + i + 1, children + i, (num - i) * sizeof(art_ref));
+    keys[i] = byte;
+    children[i] = child;
+}
+
+static struct art_inner *grow(art_t tree, art_ref *ref, struct art_inner *n)
+{
+    // move n's children into the next bigger type, which takes n's place
+    struct art_inner *bigger = new_inner(tree, n->type + 1);
+    bigger->num_children = n->num_children;
+    bigger->prefix_len = n->prefix_len;
+    bigger->prefix = n->prefix;
+    bigger->count = n->count;
+    if (n->type == ART_NODE4) {
+        struct art_node4 *from = (struct art_node4 *) n;
+        struct art_node16 *to = (struct art_node16 *) bigger;
+        memcpy(to->keys, from->keys, sizeof(from->keys));
+        memcpy(to->children, from->children, sizeof(from->children));
+    } else if (n->type == ART_NODE16) {
+        struct art_node16 *from = (struct art_node16 *) n;
+        struct art_node48 *to = (struct art_node48 *) bigger;
+        for (uint32_t i = 0; i < n->num_children; ++i) {
+            to->children[i] = from->children[i];
+            to->index[from->keys[i]] = (uint8_t) (i + 1);
+        }
+    } else {
+        struct art_node48 *from = (struct art_node48 *) n;
+        struct art_node256 *to = (struct art_node256 *) bigger;
+        for (uint32_t b = 0; b < 256; ++b) {
+            if (from->index[b]) {
+                to->children[b] = from->children[from->index[b] - 1];
+            }
+        }
+    }
+    free_inner(tree, n, false);
+    *ref = (art_ref) bigger;
+    return bigger;
+}
+
+static void add_child(art_t tree, art_ref *ref, struct art_inner *n, uint8_t byte, art_ref child)
+{
+    // ref points at n, and is updated if n has to grow
+    if ((n->type == ART_NODE4 && n->num_children == 4) ||
+            (n->type == ART_NODE16 && n->num_children == 16) ||
+            (n->type == ART_NODE48 && n->num_children == 48)) {
+        n = grow(tree, ref, n);
+    }
+    switch (n->type) {
+    case ART_NODE4: {
+        struct art_node4 *n4 = (struct art_node4 *) n;
+        sorted_insert(n4->keys, n4->children, n->num_children, byte, child);
+        break;
+    }
+    case ART_NODE16: {
+        struct art_node16 *n16 = (struct art_node16 *) n;
+        sorted_insert(n16->keys, n16->children, n->num_children, byte, child);
+        break;
+    }
+    case ART_NODE48: {
+        struct art_node48 *n48 = (struct art_node48 *) n;
+        uint32_t slot = 0;
+        while (n48->children[slot]) {
+            ++slot;
+        }
+        n48->children[slot] = child;
+        n48->index[byte] = (uint8_t) (slot + 1);
+        break;
+    }
+    default:
+        ((struct art_node256 *) n)->children[byte] = child;
+        break;
+    }
+    ++n->num_children;
+}
+
+static struct art_inner *shrink(art_t tree, art_ref *ref, struct art_inner *n)
+{
+    // move n's children into the next smaller type, which takes n's place
+    struct art_inner *smaller = new_inner(tree, n->type - 1);
+    smaller->num_children = n->num_children;
+    smaller->prefix_len = n->prefix_len;
+    smaller->prefix = n->prefix;
+    smaller->count = n->count;
+    if (n->type == ART_NODE16) {
+        struct art_node16 *from = (struct art_node16 *) n;
+        struct art_node4 *to = (struct art_node4 *) smaller;
+        memcpy(to->keys, from->keys, n->num_children);
+        memcpy(to->children, from->children, n->num_children * sizeof(art_ref));
+    } else if (n->type == ART_NODE48) {
+        struct art_node48 *from = (struct art_node48 *) n;
+        struct art_node16 *to = (struct art_node16 *) smaller;
+        uint32_t i = 0;
+        for (uint32_t b = 0; b < 256; ++b) {
+            if (from->index[b]) {
+                to->keys[i] = (uint8_t) b;
+                to->children[i++] = from->children[from->index[b] - 1];
+            }
+        }
+    } else {
+        struct art_node256 *from = (struct art_node256 *) n;
+        struct art_node48 *to = (struct art_node48 *) smaller;
+        uint32_t slot = 0;
+        for (uint32_t b = 0; b < 256; ++b) {
+            if (from->children[b]) {
+                to->children[slot] = from->children[b];
+                to->index[b] = (uint8_t) ++slot;
+            }
+        }
+    }
+    free_inner(tree, n, false);
+    *ref = (art_ref) smaller;
+    return smaller;
+}
+
+static void collapse(art_t tree, art_ref *ref, struct art_node4 *n)
+{
+    // n has a single child left: put the child in n's place, taking n's
+    // prefix and the child's byte onto the front of its own prefix
+    art_ref child = n->children[0];
+    if (!is_leaf(child)) {
+        struct art_inner *c = inner_of(child);
+        uint32_t len = n->h.prefix_len + 1 + c->prefix_len;
+        uint8_t *prefix = malloc(len);
+        assert(prefix && "memory");
+        memcpy(prefix, prefix_of(&n->h), n->h.prefix_len);
+        prefix[n->h.prefix_len] = n->keys[0];
+        memcpy(prefix + n->h.prefix_len + 1, prefix_of(c), c->prefix_len);
+        set_prefix(tree, c, prefix, len);
+        free(prefix);
+    }
+    *ref = child;
+    free_inner(tree, &n->h, true);
+}
+
+static void remove_child(art_t tree, art_ref *ref, struct art_inner *n, uint8_t byte)
+{
+    // ref points at n, and is updated if n shrinks or collapses
+    switch (n->type) {
+    case ART_NODE4:
+    case ART_NODE16: {
+        uint8_t *keys = n->type == ART_NODE4 ? ((struct art_node4 *) n)->keys :
+            ((struct art_node16 *) n)->keys;
+        art_ref *children = n->type == ART_NODE4 ? ((struct art_node4 *) n)->children :
+            ((struct art_node16 *) n)->children;
+        uint32_t i = 0;
+        while (keys[i] != byte) {
+            ++i;
+        }
+        memmove(keys + i, keys + i + 1, n->num_children - i - 1);
+        memmove(children + i, children + i + 1, (n->num_children - i - 1) * sizeof(art_ref));
+        break;
+    }
+    case ART_NODE48: {
+        struct art_node48 *n48 = (struct art_node48 *) n;
+        n48->children[n48->index[byte] - 1] = 0;
+        n48->index[byte] = 0;
+        break;
+    }
+    default:
+        ((struct art_node256 *) n)->children[byte] = 0;
+        break;
+    }
+    --n->num_children;
+
+    if ((n->type == ART_NODE16 && n->num_children <= ART_SHRINK16) ||
+            (n->type == ART_NODE48 && n->num_children <= ART_SHRINK48) ||
+            (n->type == ART_NODE256 && n->num_children <= ART_SHRINK256)) {
+        n = shrink(tree, ref, n);
+    }
+    if (n->type == ART_NODE4 && n->num_children == 1) {
+        collapse(tree, ref, (struct art_node4 *) n);
+    }
+}
+
+static bool prefix_matches(struct art_inner *n, const uint8_t *key, size_t len, size_t depth)
+{
+    return depth + n->prefix_len <= len && memcmp(prefix_of(n), key + depth, n->prefix_len) == 0;
+}
+
+static bool leaf_matches(node_t *node, key_type key, size_t len, size_t depth)
+{
+    // the path down to the leaf already matched the first depth bytes; if
+    // that took in the terminating zero, the whole key matched
+    return depth >= len || strcmp((const char*) node->key + depth, (const char*) key + depth) == 0;
+}
+
+art_t art_create(void)
+{
+    art_t tree = calloc(1, sizeof(struct art_obj));
+    assert(tree && "memory");
+    return tree;
+}
+
+static void destroy_ref(art_t tree, art_ref ref)
+{
+    if (ref == 0 || is_leaf(ref)) {
+        return;
+    }
+    struct art_inner *n = inner_of(ref);
+    uint32_t pos = 0;
+    uint8_t byte;
+    art_ref *child;
+    while ((child = next_child(n, &pos, &byte)) != NULL) {
+        destroy_ref(tree, *child);
+    }
+    free_inner(tree, n, true);
+}
+
+void art_destroy(art_t tree)
+{
+    destroy_ref(tree, tree->root);
+    free(tree);
+}
+
+static art_ref *find_ref(art_t tree, key_type key)
+{
+    // the reference to key's leaf, or NULL
+    size_t len = strlen((const char*) key) + 1;
+    art_ref *ref = &tree->root;
+    size_t depth = 0;
+    while (*ref) {
+        if (is_leaf(*ref)) {
+            return leaf_matches(leaf_of(*ref), key, len, depth) ? ref : NULL;
+        }
+        struct art_inner *n = inner_of(*ref);
+        if (!prefix_matches(n, key, len, depth)) {
+            return NULL;
+        }
+        depth += n->prefix_len;
+        ref = find_child(n, key[depth]);
+        if (ref == NULL) {
+            return NULL;
+        }
+        ++depth;
+    }
+    return NULL;
+}
+
+node_t *art_find(art_t tree, key_type key)
+{
+    art_ref *ref = find_ref(tree, key);
+    return ref ? leaf_of(*ref) : NULL;
+}
+
+void art_insert(art_t tree, node_t *node)
+{
+    const uint8_t *key = node->key;
+    size_t len = strlen((const char*) key) + 1;
+    art_ref *ref = &tree->root;
+    size_t depth = 0;
+    ++tree->size;
+    for (;;) {
+        if (*ref == 0) {
+            *ref = make_leaf(node);
+            return;
+        }
+
+        if (is_leaf(*ref)) {
+            // split the leaf into a node holding both keys. The terminating
+            // zeros make sure the keys differ before either ends.
+            assert(depth < len && "key is already in the tree");
+            const uint8_t *other = leaf_of(*ref)->key;
+            uint32_t common = 0;
+            while (other[depth + common] == key[depth + common]) {
+                assert(key[depth + common] != 0 && "key is already in the tree");
+                ++common;
+            }
+            struct art_node4 *n = (struct art_node4 *) new_inner(tree, ART_NODE4);
+            set_prefix(tree, &n->h, key + depth, common);
+            n->h.count = 2;
+            art_ref split = (art_ref) n;
+            add_child(tree, &split, &n->h, other[depth + common], *ref);
+            add_child(tree, &split, &n->h, key[depth + common], make_leaf(node));
+            *ref = split;
+            return;
+        }
+
+        struct art_inner *n = inner_of(*ref);
+        uint32_t p = 0;
+        while (p < n->prefix_len && depth + p < len && prefix_of(n)[p] == key[depth + p]) {
+            ++p;
+        }
+        if (p < n->prefix_len) {
+            // the key leaves n's prefix after p bytes: put a node with the
+            // first p bytes above n
+            struct art_node4 *split = (struct art_node4 *) new_inner(tree, ART_NODE4);
+            set_prefix(tree, &split->h, prefix_of(n), p);
+            split->h.count = n->count + 1;
+            uint8_t n_byte = prefix_of(n)[p];
+            set_prefix(tree, n, prefix_of(n) + p + 1, n->prefix_len - p - 1);
+            art_ref split_ref = (art_ref) split;
+            add_child(tree, &split_ref, &split->h, n_byte, *ref);
+            add_child(tree, &split_ref, &split->h, key[depth + p], make_leaf(node));
+            *ref = split_ref;
+            return;
+        }
+
+        ++n->count;
+        depth += n->prefix_len;
+        art_ref *child = find_child(n, key[depth]);
+        if (child == NULL) {
+            add_child(tree, ref, n, key[depth], make_leaf(node));
+            return;
+        }
+        ref = child;
+        ++depth;
+    }
+}
+
+static node_t *remove_at(art_t tree, art_ref *ref, key_type key, size_t len, size_t depth)
+{
+    if (*ref == 0) {
+        return NULL;
+    }
+    if (is_leaf(*ref)) {
+        node_t *node = leaf_of(*ref);
+        if (!leaf_matches(node, key, len, depth)) {
+            return NULL;
+        }
+        *ref = 0;
+        return node;
+    }
+
+    struct art_inner *n = inner_of(*ref);
+    if (!prefix_matches(n, key, len, depth)) {
+        return NULL;
+    }
+    depth += n->prefix_len;
+    uint8_t byte = key[depth];
+    art_ref *child = find_child(n, byte);
+    if (child == NULL) {
+        return NULL;
+    }
+    node_t *node = remove_at(tree, child, key, len, depth + 1);
+    if (node) {
+        --n->count;
+        if (*child == 0) {
+            remove_child(tree, ref, n, byte);
+        }
+    }
+    return node;
+}
+
+node_t *art_remove(art_t tree, key_type key)
+{
+    node_t *node = remove_at(tree, &tree->root, key, strlen((const char*) key) + 1, 0);
+    if (node) {
+        --tree->size;
+    }
+    return node;
+}
+
+node_t *art_replace(art_t tree, node_t *node)
+{
+    art_ref *ref = find_ref(tree, node->key);
+    if (ref == NULL) {
+        return NULL;
+    }
+    node_t *old = leaf_of(*ref);
+    *ref = make_leaf(node);
+    return old;
+}
+
+uint64_t art_size(art_t tree)
+{
+    return tree->size;
+}
+
+uint64_t art_index_bytes(art_t tree)
+{
+    return tree->bytes;
+}
+
+node_t *art_select(art_t tree, uint64_t rank)
+{
+    if (rank >= tree->size) {
+        return NULL;
+    }
+    art_ref ref = tree->root;
+    while (!is_leaf(ref)) {
+        struct art_inner *n = inner_of(ref);
+        uint32_t pos = 0;
+        uint8_t byte;
+        art_ref *child;
+        while ((child = next_child(n, &pos, &byte)) != NULL) {
+            uint64_t count = ref_count(*child);
+            if (rank < count) {
+                break;
+            }
+            rank -= count;
+        }
+        assert(child && "leaf counts are off");
+        ref = *child;
+    }
+    return leaf_of(ref);
+}
+
+uint64_t art_prefix_range(art_t tree, const uint8_t *prefix, size_t len, uint64_t *first)
+{
+    *first = 0;
+    art_ref ref = tree->root;
+    size_t depth = 0;
+    while (ref) {
+        if (is_leaf(ref)) {
+            return strncmp((const char*) leaf_of(ref)->key, (const char*) prefix, len) == 0;
+        }
+        struct art_inner *n = inner_of(ref);
+        size_t checked = n->prefix_len < len - depth ? n->prefix_len : len - depth;
+        if (memcmp(prefix_of(n), prefix + depth, checked) != 0) {
+            return 0;
+        }
+        if (depth + n->prefix_len >= len) {
+            return n->count; // every key under n starts with prefix
+        }
+        depth += n->prefix_len;
+
+        // count the keys in the children before the one prefix goes on in
+        uint32_t pos = 0;
+        uint8_t byte;
+        art_ref *child;
+        ref = 0;
+        while ((child = next_child(n, &pos, &byte)) != NULL && byte <= prefix[depth]) {
+            if (byte == prefix[depth]) {
+                ref = *child;
+                break;
+            }
+            *first += ref_count(*child);
+        }
+        ++depth;
+    }
+    return 0;
+}
+
+uint64_t art_rank(art_t tree, key_type key)
+{
+    // like art_prefix_range, but the key needn't be in the tree: every
+    // subtree wholly before it counts
+    uint64_t rank = 0;
+    art_ref ref = tree->root;
+    size_t depth = 0;
+    while (ref) {
+        if (is_leaf(ref)) {
+            return rank + (strcmp((const char*) leaf_of(ref)->key, (const char*) key) < 0);
+        }
+        // the keys under n differ after its prefix, so the prefix can't
+        // match past key's terminating zero
+        struct art_inner *n = inner_of(ref);
+        uint8_t *prefix = prefix_of(n);
+        for (uint32_t i = 0; i < n->prefix_len; ++i) {
+            if (prefix[i] != key[depth + i]) {
+                return prefix[i] < key[depth + i] ? rank + n->count : rank;
+            }
+        }
+        depth += n->prefix_len;
+
+        uint32_t pos = 0;
+        uint8_t byte;
+        art_ref *child;
+        ref = 0;
+        while ((child = next_child(n, &pos, &byte)) != NULL && byte <= key[depth]) {
+            if (byte == key[depth]) {
+                ref = *child;
+                break;
+            }
+            rank += ref_count(*child);
+        }
+        ++depth;
+    }
+    return rank;
+}
+
+static bool walk_ref(art_ref ref, uint64_t *skip, bool (*fn)(node_t *node, void *arg), void *arg)
+{
+    // returns false once fn does
+    if (is_leaf(ref)) {
+        if (*skip > 0) {
+            --*skip;
+            return true;
+        }
+        return fn(leaf_of(ref), arg);
+    }
+    struct art_inner *n = inner_of(ref);
+    if (*skip >= n->count) {
+        *skip -= n->count;
+        return true;
+    }
+    uint32_t pos = 0;
+    uint8_t byte;
+    art_ref *child;
+    while ((child = next_child(n, &pos, &byte)) != NULL) {
+        if (!walk_ref(*child, skip, fn, arg)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void art_walk(art_t tree, uint64_t rank, bool (*fn)(node_t *node, void *arg), void *arg)
+{
+    if (tree->root) {
+        walk_ref(tree->root, &rank, fn, arg);
+    }
+}
+
+struct foreach_arg
+{
+    void (*fn)(node_t *node, void *arg);
+    void *arg;
+};
+
+static bool foreach_cb(node_t *node, void *arg)
+{
+    struct foreach_arg *f = arg;
+    f->fn(node, f->arg);
+    return true;
+}
+
+void art_foreach(art_t tree, void (*fn)(node_t *node, void *arg), void *arg)
+{
+    struct foreach_arg f = {fn, arg};
+    art_walk(tree, 0, foreach_cb, &f);
+}
@@ -0,0 +1,72 @@
+/*
+ * art.h: header file for an adaptive radix tree index of nodes
+ *
+ */
+#pragma once
+
+#include <stdbool.h>
+
+#include "node.h"
+
+// An adaptive radix tree (Leis et al., "The Adaptive Radix Tree: ARTful
+// Indexing for Main-Memory Databases") over the bytes of the keys,
+// terminating zero included, so no key is a prefix of another.
+//
+// Inner nodes have 4, 16, 48 or 256 children and grow and shrink between
+// those sizes, and a chain of single-child nodes is collapsed into one
+// node holding the shared bytes as its prefix. So a prefix common to many
+// keys is stored once in the tree rather than once per key, lookups
+// compare a long shared prefix with one memcmp, and the tree holds no
+// hashes. The 16-child node is searched with SSE2 where available.
+//
+// Leaves are the nodes themselves; the tree doesn't copy keys. Keys come
+// out in byte order, and every inner node counts the leaves under it, so
+// the i-th key (art_select) or a prefix's range of keys (art_prefix_range)
+// is found in one walk down the tree.
+//
+// Nothing here is thread safe; the caller serializes all calls.
+typedef struct art_obj *art_t;
+
+art_t art_create(void);
+
+// frees the tree, but not the nodes in it
+void art_destroy(art_t tree);
+
+// returns the node with key, or NULL
+node_t *art_find(art_t tree, key_type key);
+
+// insert a node whose key is not in the tree yet
+void art_insert(art_t tree, node_t *node);
+
+// unlink and return the node with key, or NULL if it isn't in the tree
+node_t *art_remove(art_t tree, key_type key);
+
+// put node in place of the node with the same key, and return that node,
+// or NULL if the key isn't in the tree
+node_t *art_replace(art_t tree, node_t *node);
+
+// number of nodes in the tree
+uint64_t art_size(art_t tree);
+
+// bytes of memory used by the inner nodes and their prefixes
+uint64_t art_index_bytes(art_t tree);
+
+// the node whose key is rank-th in byte order (from 0), or NULL if
+// rank >= art_size
+node_t *art_select(art_t tree, uint64_t rank);
+
+// Set *first to the rank of the first key starting with the len bytes of
+// prefix and return how many keys do (they are all ranked together).
+uint64_t art_prefix_range(art_t tree, const uint8_t *prefix, size_t len, uint64_t *first);
+
+// number of keys in the tree before key in byte order; key itself needn't
+// be in the tree
+uint64_t art_rank(art_t tree, key_type key);
+
+// call fn on the nodes in byte order of their keys, starting with the
+// rank-th one, until fn returns false. fn may free the node it is given
+// but must not change the tree.
+void art_walk(art_t tree, uint64_t rank, bool (*fn)(node_t *node, void *arg), void *arg);
+
+// call fn on every node in the tree, in key order. fn may free the node.
+void art_foreach(art_t tree, void (*fn)(node_t *node, void *arg), void *arg);
@@ -0,0 +1,194 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "art.h"
+#include "art_tests.h"
+
+#define my_assert(value, string) \
+{if (!(value)) { printf("!!!FAILURE!!! %s\n", string);}}
+
+#define NUM_TEST_NODES 5000
+
+static node_t *make_node(uint32_t i)
+{
+    // long keys with long shared prefixes, and some keys that are
+    // prefixes of others
+    char key[64];
+    snprintf(key, sizeof(key), "tenant:%" PRIu32 ":user:%" PRIu32 ":profile%s",
+            i % 7, i, i % 3 ? ":v7" : "");
+    return new_node((key_type) key, &i, sizeof(i));
+}
+
+static void free_node_cb(node_t *node, void *arg)
+{
+    ++*(uint32_t *) arg;
+    free_node(node);
+}
+
+struct order_check
+{
+    const char *last;
+    uint32_t seen;
+    bool sorted;
+};
+
+static bool order_cb(node_t *node, void *arg)
+{
+    struct order_check *check = arg;
+    if (check->last && strcmp(check->last, (const char*) node->key) >= 0) {
+        check->sorted = false;
+    }
+    check->last = (const char*) node->key;
+    ++check->seen;
+    return true;
+}
+
+static void test_art_insert_find_remove()
+{
+    printf("Running art insert/find/remove test\n");
+    art_t tree = art_create();
+    node_t *nodes[NUM_TEST_NODES];
+    for (uint32_t i = 0; i < NUM_TEST_NODES; i++) {
+        nodes[i] = make_node(i);
+        art_insert(tree, nodes[i]);
+    }
+    my_assert(art_size(tree) == NUM_TEST_NODES, "wrong size after inserts");
+    my_assert(art_index_bytes(tree) > 0, "index bytes not counted");
+
+    for (uint32_t i = 0; i < NUM_TEST_NODES; i++) {
+        my_assert(art_find(tree, nodes[i]->key) == nodes[i], "inserted node not found");
+    }
+    my_assert(art_find(tree, (key_type) "tenant:1:user:1") == NULL, "found a prefix of a key");
+    my_assert(art_find(tree, (key_type) "tenant:1:user:1:profile:v7:x") == NULL, "found an extension of a key");
+    my_assert(art_find(tree, (key_type) "") == NULL, "found the empty key");
+
+    // a key that ends where another goes on, looked up from a buffer with
+    // junk after the terminating zero
+    uint32_t zero = 0;
+    node_t *longer = new_node((key_type) "tenant:0:user:0:profile:v7", &zero, sizeof(zero));
+    art_insert(tree, longer);
+    char buf[64];
+    memset(buf, 'x', sizeof(buf));
+    strcpy(buf, "tenant:0:user:0:profile");
+    my_assert(art_find(tree, (key_type) buf) == nodes[0], "lookup read past the end of the key");
+    my_assert(art_remove(tree, longer->key) == longer && art_find(tree, (key_type) buf) == nodes[0],
+            "removing the longer key lost the shorter one");
+    free_node(longer);
+
+    // keys come out sorted, and select agrees with the walk
+    struct order_check check = {NULL, 0, true};
+    art_walk(tree, 0, order_cb, &check);
+    my_assert(check.sorted && check.seen == NUM_TEST_NODES, "walk is not in key order");
+    check.last = (const char*) art_select(tree, 0)->key;
+    check.seen = 0;
+    art_walk(tree, 1, order_cb, &check);
+    my_assert(check.sorted && check.seen == NUM_TEST_NODES - 1, "walk from a rank is off");
+    my_assert(art_select(tree, NUM_TEST_NODES) == NULL, "selected past the end");
+
+    node_t *replacement = make_node(42);
+    my_assert(art_replace(tree, replacement) == nodes[42] && art_find(tree, nodes[42]->key) == replacement,
+            "replace did not swap the node");
+    free_node(nodes[42]);
+    nodes[42] = replacement;
+
+    // remove every other node, which shrinks and collapses inner nodes
+    for (uint32_t i = 0; i < NUM_TEST_NODES; i += 2) {
+        my_assert(art_remove(tree, nodes[i]->key) == nodes[i], "remove returned the wrong node");
+        free_node(nodes[i]);
+    }
+    my_assert(art_remove(tree, (key_type) "tenant:0:user:0:profile") == NULL, "removed a key twice");
+    my_assert(art_size(tree) == NUM_TEST_NODES / 2, "wrong size after removes");
+    for (uint32_t i = 1; i < NUM_TEST_NODES; i += 2) {
+        my_assert(art_find(tree, nodes[i]->key) == nodes[i], "remove lost another node");
+    }
+
+    uint32_t freed = 0;
+    art_foreach(tree, free_node_cb, &freed);
+    my_assert(freed == NUM_TEST_NODES / 2, "foreach missed nodes");
+    art_destroy(tree);
+}
+
+static void test_art_node_sizes()
+{
+    printf("Running art node growth test\n");
+    // one inner node goes through 4, 16, 48 and 256 children and back
+    art_t tree = art_create();
+    node_t *nodes[256];
+    for (uint32_t i = 0; i < 255; i++) {
+        char key[4] = {'k', (char) (i + 1), 0, 0};
+        nodes[i] = new_node((key_type) key, &i, sizeof(i));
+        art_insert(tree, nodes[i]);
+        for (uint32_t j = 0; j <= i; j += 17) {
+            my_assert(art_find(tree, nodes[j]->key) == nodes[j], "lost a node while growing");
+        }
+    }
+    for (uint32_t i = 0; i < 255; i++) {
+        my_assert(art_select(tree, i) == nodes[i], "children out of order");
+    }
+    for (uint32_t i = 0; i < 254; i++) {
+        my_assert(art_remove(tree, nodes[i]->key) == nodes[i], "lost a node while shrinking");
+        free_node(nodes[i]);
+        my_assert(art_find(tree, nodes[254]->key) == nodes[254], "shrinking lost the last node");
+    }
+    my_assert(art_size(tree) == 1, "wrong size after shrinking");
+    my_assert(art_remove(tree, nodes[254]->key) == nodes[254], "could not remove the last node");
+    free_node(nodes[254]);
+    my_assert(art_index_bytes(tree) == 0, "empty tree still has inner nodes");
+    art_destroy(tree);
+}
+
+static void test_art_prefix_range()
+{
+    printf("Running art prefix range test\n");
+    art_t tree = art_create();
+    for (uint32_t i = 0; i < NUM_TEST_NODES; i++) {
+        art_insert(tree, make_node(i));
+    }
+
+    const char *prefixes[] = {"", "tenant:3:", "tenant:3:user:10", "tenant:3:user:1000:profile:v7",
+        "tenant:9", "zzz", "tenant:3:user:1004:profile"};
+    for (uint32_t p = 0; p < sizeof(prefixes) / sizeof(prefixes[0]); p++) {
+        size_t len = strlen(prefixes[p]);
+        uint64_t expected = 0;
+        uint64_t expected_first = UINT64_MAX;
+        for (uint64_t rank = 0; rank < art_size(tree); rank++) {
+            if (strncmp((const char*) art_select(tree, rank)->key, prefixes[p], len) == 0) {
+                if (expected_first == UINT64_MAX) {
+                    expected_first = rank;
+                }
+                ++expected;
+            }
+        }
+        uint64_t first;
+        uint64_t n = art_prefix_range(tree, (const uint8_t *) prefixes[p], len, &first);
+        my_assert(n == expected, "prefix range has the wrong number of keys");
+        my_assert(n == 0 || first == expected_first, "prefix range starts in the wrong place");
+    }
+
+    // the rank of a key, in the tree or not, is the number of keys before it
+    const char *keys[] = {"", "a", "tenant:3:", "tenant:3:user:10", "tenant:6:user:1000:profile:v7",
+        "tenant:1:user:1002:profile", "tenant:1:user:1002:profilf", "tenant:9", "zzz"};
+    for (uint32_t k = 0; k < sizeof(keys) / sizeof(keys[0]); k++) {
+        uint64_t expected = 0;
+        while (expected < art_size(tree) &&
+                strcmp((const char*) art_select(tree, expected)->key, keys[k]) < 0) {
+            ++expected;
+        }
+        my_assert(art_rank(tree, (key_type) keys[k]) == expected, "art_rank counted the wrong keys");
+    }
+
+    uint32_t freed = 0;
+    art_foreach(tree, free_node_cb, &freed);
+    art_destroy(tree);
+}
+
+void art_tests()
+{
+    printf("***Running art tests***\n");
+    test_art_insert_find_remove();
+    test_art_node_sizes();
+    test_art_prefix_range();
+}
@@ -0,0 +1,219 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "bench.h"
+#include "cache.h"
+#include "mrc.h"
+#include "pages.h"
+#include "parallel.h"
+#include "trace.h"
+
+struct bench_case
+{
+    const char *name;
+    enum cache_engine engine;
+    enum cache_pages pages;
+    int numa_node; // -2 for the node we're running on
+    bool long_keys; // tenant:T:user:U:profile:v7 instead of bench:N
+    bool mrc; // with miss_ratio_curve
+};
+
+static const struct bench_case cases[] = {
+    {"chained", CACHE_ENGINE_CHAINED, CACHE_PAGES_DEFAULT, -1, false, false},
+    {"chained/2MB", CACHE_ENGINE_CHAINED, CACHE_PAGES_HUGE_2MB, -1, false, false},
+    {"chained/2MB/local", CACHE_ENGINE_CHAINED, CACHE_PAGES_HUGE_2MB, -2, false, false},
+    {"cuckoo", CACHE_ENGINE_CUCKOO, CACHE_PAGES_DEFAULT, -1, false, false},
+    {"cuckoo/2MB", CACHE_ENGINE_CUCKOO, CACHE_PAGES_HUGE_2MB, -1, false, false},
+    {"cuckoo/2MB/local", CACHE_ENGINE_CUCKOO, CACHE_PAGES_HUGE_2MB, -2, false, false},
+    {"art", CACHE_ENGINE_ART, CACHE_PAGES_DEFAULT, -1, false, false},
+    {"chained/long keys", CACHE_ENGINE_CHAINED, CACHE_PAGES_DEFAULT, -1, true, false},
+    {"cuckoo/long keys", CACHE_ENGINE_CUCKOO, CACHE_PAGES_DEFAULT, -1, true, false},
+    {"art/long keys", CACHE_ENGINE_ART, CACHE_PAGES_DEFAULT, -1, true, false},
+    {"chained/mrc", CACHE_ENGINE_CHAINED, CACHE_PAGES_DEFAULT, -1, false, true},
+    {"cuckoo/mrc", CACHE_ENGINE_CUCKOO, CACHE_PAGES_DEFAULT, -1, false, true},
+};
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void make_key(const struct bench_case *bc, char *key, size_t len, uint64_t i)
+{
+    if (bc->long_keys) {
+        snprintf(key, len, "tenant:%03" PRIu64 ":user:%" PRIu64 ":profile:v7", i % 100, i);
+    } else {
+        snprintf(key, len, "bench:%" PRIu64, i);
+    }
+}
+
+static void bench_case(const struct bench_case *bc, uint64_t num_items)
+{
+    struct cache_config config;
+    cache_config_init(&config, num_items * 8 * 2);
+    config.engine = bc->engine;
+    // the LRU queue's get is linear in the number of keys, which would
+    // drown out the table
+    config.eviction = CACHE_EVICT_SAMPLED;
+    config.expected_items = num_items;
+    config.pages = bc->pages;
+    config.numa_node = bc->numa_node == -2 ? pages_current_node() : bc->numa_node;
+    config.miss_ratio_curve = bc->mrc;
+    cache_t c = create_cache_with_config(&config);
+
+    char key[64];
+    double start = now_ns();
+    for (uint64_t i = 0; i < num_items; i++) {
+        make_key(bc, key, sizeof(key), i);
+        cache_set(c, (key_type) key, &i, sizeof(i));
+    }
+    double set_ns = (now_ns() - start) / num_items;
+
+    // random gets, so the table doesn't stay in cache
+    uint64_t rng = 88172645463325252ULL;
+    uint64_t hits = 0;
+    start = now_ns();
+    for (uint64_t i = 0; i < num_items; i++) {
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        make_key(bc, key, sizeof(key), rng % num_items);
+        uint32_t size;
+        val_type v = cache_get(c, (key_type) key, &size);
+        hits += v != NULL;
+        free((void *) v);
+    }
+    double get_ns = (now_ns() - start) / num_items;
+
+    printf("%-20s set %8.1f ns/op   get %8.1f ns/op   hits %" PRIu64 "\n",
+            bc->name, set_ns, get_ns, hits);
+    destroy_cache(c);
+#ifdef CACHE_TRACING
+    // where the time went, from the sampled latencies
+    trace_report(stdout);
+    trace_reset();
+#endif
+}
+
+static cache_t filled_cache(enum cache_engine engine, uint64_t num_items)
+{
+    struct cache_config config;
+    cache_config_init(&config, num_items * 8 * 2);
+    config.engine = engine;
+    config.eviction = CACHE_EVICT_SAMPLED;
+    config.expected_items = num_items;
+    cache_t c = create_cache_with_config(&config);
+    char key[64];
+    for (uint64_t i = 0; i < num_items; i++) {
+        snprintf(key, sizeof(key), "bench:%" PRIu64, i);
+        cache_set(c, (key_type) key, &i, sizeof(i));
+    }
+    return c;
+}
+
+static double random_gets(cache_t c, uint64_t num_items)
+{
+    uint64_t rng = 88172645463325252ULL;
+    char key[64];
+    double start = now_ns();
+    for (uint64_t i = 0; i < num_items; i++) {
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        snprintf(key, sizeof(key), "bench:%" PRIu64, rng % num_items);
+        uint32_t size;
+        free((void *) cache_get(c, (key_type) key, &size));
+    }
+    return (now_ns() - start) / num_items;
+}
+
+static void bench_mrc_overhead(enum cache_engine engine, const char *name, uint64_t num_items)
+{
+    // Two caches, one with the estimator and one without, differ by more
+    // than it costs in layout and timing noise, so time what a get pays
+    // for it, mrc_read with the cache's defaults, against a plain get
+    cache_t c = filled_cache(engine, num_items);
+    double get_ns = 1e18;
+    for (int round = 0; round < 3; round++) {
+        double ns = random_gets(c, num_items);
+        get_ns = ns < get_ns ? ns : get_ns;
+    }
+    destroy_cache(c);
+
+    struct cache_config config;
+    cache_config_init(&config, 0);
+    mrc_t mrc = mrc_create(config.mrc_sample_rate, config.mrc_max_keys);
+    double mrc_ns = 1e18;
+    for (int round = 0; round < 3; round++) {
+        uint64_t rng = 88172645463325252ULL;
+        double start = now_ns();
+        for (uint64_t i = 0; i < num_items; i++) {
+            rng ^= rng << 13;
+            rng ^= rng >> 7;
+            rng ^= rng << 17;
+            mrc_read(mrc, rng, sizeof(uint64_t)); // as good as a hash
+        }
+        double ns = (now_ns() - start) / num_items;
+        mrc_ns = ns < mrc_ns ? ns : mrc_ns;
+    }
+    mrc_destroy(mrc);
+    printf("%-20s get %8.1f ns/op   mrc_read %6.1f ns/op   overhead %.2f%%\n",
+            name, get_ns, mrc_ns, 100 * mrc_ns / get_ns);
+}
+
+static double warm_up(uint64_t num_items, const struct cache_entry *entries, uint32_t threads)
+{
+    // load a cold chained cache that wasn't told how big it would get,
+    // with cache_set if threads is 0
+    struct cache_config config;
+    cache_config_init(&config, num_items * 8 * 2);
+    config.eviction = CACHE_EVICT_SAMPLED;
+    cache_t c = create_cache_with_config(&config);
+    double start = now_ns();
+    if (threads == 0) {
+        for (uint64_t i = 0; i < num_items; i++) {
+            cache_set(c, entries[i].key, entries[i].val, entries[i].val_size);
+        }
+    } else {
+        cache_bulk_load(c, entries, num_items, threads);
+    }
+    double ns = (now_ns() - start) / num_items;
+    destroy_cache(c);
+    return ns;
+}
+
+static void bench_warm_up(uint64_t num_items)
+{
+    struct cache_entry *entries = calloc(num_items, sizeof(struct cache_entry));
+    char (*keys)[32] = calloc(num_items, 32);
+    uint64_t *vals = calloc(num_items, sizeof(uint64_t));
+    for (uint64_t i = 0; i < num_items; i++) {
+        snprintf(keys[i], 32, "bench:%" PRIu64, i);
+        vals[i] = i;
+        entries[i].key = (key_type) keys[i];
+        entries[i].val = &vals[i];
+        entries[i].val_size = sizeof(uint64_t);
+    }
+    printf("%-20s set %8.1f ns/op\n", "warm up/cache_set", warm_up(num_items, entries, 0));
+    printf("%-20s set %8.1f ns/op\n", "warm up/bulk x1", warm_up(num_items, entries, 1));
+    printf("%-20s set %8.1f ns/op\n", "warm up/bulk", warm_up(num_items, entries, parallel_cpus()));
+    free(entries);
+    free(keys);
+    free(vals);
+}
+
+void bench(uint64_t num_items)
+{
+    printf("***Running benchmarks with %" PRIu64 " items***\n", num_items);
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        bench_case(&cases[i], num_items);
+    }
+    bench_warm_up(num_items);
+    bench_mrc_overhead(CACHE_ENGINE_CHAINED, "mrc overhead/chained", num_items);
+    bench_mrc_overhead(CACHE_ENGINE_CUCKOO, "mrc overhead/cuckoo", num_items);
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <inttypes.h>
+
+// time sets and gets under a few cache configurations and print the
+// results, one line per configuration
+void bench(uint64_t num_items);
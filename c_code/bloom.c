@@ -0,0 +1,126 @@
+/*
+ * bloom.c: a counting bloom filter, see bloom.h
+ *
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "bloom.h"
+
+#define BLOOM_COUNTER_MAX 255
+
+struct bloom_obj
+{
+    uint64_t capacity;
+    uint64_t mask; // number of counters - 1
+    uint32_t num_hashes;
+    _Atomic uint8_t counters[];
+};
+
+static uint64_t bloom_mix(uint64_t hash, uint64_t seed)
+{
+    hash ^= seed;
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+// counter i of an item, by double hashing
+static uint64_t bloom_position(bloom_t filter, uint64_t h1, uint64_t h2, uint32_t i)
+{
+    return (h1 + i * h2) & filter->mask;
+}
+
+bloom_t bloom_create(uint64_t capacity, double target_fpr)
+{
+    assert(target_fpr > 0 && target_fpr < 1 && "false positive rate must be in (0, 1)");
+    if (capacity == 0) {
+        capacity = 1;
+    }
+    // the usual optimum: m = -n ln(p) / ln(2)^2 counters and
+    // k = (m / n) ln(2) hashes, with m rounded up to a power of two
+    double wanted = -(double) capacity * log(target_fpr) / (M_LN2 * M_LN2);
+    uint64_t num_counters = 64;
+    while (num_counters < wanted) {
+        num_counters *= 2;
+    }
+    uint32_t num_hashes = (uint32_t) round((double) num_counters / capacity * M_LN2);
+    if (num_hashes < 1) {
+        num_hashes = 1;
+    }
+    if (num_hashes > 16) {
+        num_hashes = 16;
+    }
+
+    bloom_t filter = calloc(1, sizeof(struct bloom_obj) + num_counters * sizeof(_Atomic uint8_t));
+    assert(filter && "memory");
+    filter->capacity = capacity;
+    filter->mask = num_counters - 1;
+    filter->num_hashes = num_hashes;
+    return filter;
+}
+
+void bloom_destroy(bloom_t filter)
+{
+    free(filter);
+}
+
+void bloom_add(bloom_t filter, uint64_t hash)
+{
+    uint64_t h1 = bloom_mix(hash, 0);
+    uint64_t h2 = bloom_mix(hash, 0x9e3779b97f4a7c15ULL) | 1;
+    for (uint32_t i = 0; i < filter->num_hashes; ++i) {
+        _Atomic uint8_t *c = &filter->counters[bloom_position(filter, h1, h2, i)];
+        uint8_t count = atomic_load_explicit(c, memory_order_relaxed);
+        if (count < BLOOM_COUNTER_MAX) {
+            atomic_store_explicit(c, count + 1, memory_order_release);
+        }
+    }
+}
+
+void bloom_remove(bloom_t filter, uint64_t hash)
+{
+    uint64_t h1 = bloom_mix(hash, 0);
+    uint64_t h2 = bloom_mix(hash, 0x9e3779b97f4a7c15ULL) | 1;
+    for (uint32_t i = 0; i < filter->num_hashes; ++i) {
+        _Atomic uint8_t *c = &filter->counters[bloom_position(filter, h1, h2, i)];
+        uint8_t count = atomic_load_explicit(c, memory_order_relaxed);
+        assert(count > 0 && "removing an item that was never added");
+        // a saturated counter has lost track of how many items it holds
+        if (count < BLOOM_COUNTER_MAX) {
+            atomic_store_explicit(c, count - 1, memory_order_release);
+        }
+    }
+}
+
+bool bloom_maybe_contains(bloom_t filter, uint64_t hash)
+{
+    uint64_t h1 = bloom_mix(hash, 0);
+    uint64_t h2 = bloom_mix(hash, 0x9e3779b97f4a7c15ULL) | 1;
+    for (uint32_t i = 0; i < filter->num_hashes; ++i) {
+        if (atomic_load_explicit(&filter->counters[bloom_position(filter, h1, h2, i)],
+                    memory_order_acquire) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint64_t bloom_capacity(bloom_t filter)
+{
+    return filter->capacity;
+}
+
+double bloom_estimated_fpr(bloom_t filter, uint64_t num_items)
+{
+    // (1 - e^(-kn/m))^k
+    double k = filter->num_hashes;
+    double m = (double) filter->mask + 1;
+    return pow(1 - exp(-k * num_items / m), k);
+}
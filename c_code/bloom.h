@@ -0,0 +1,36 @@
+/*
+ * bloom.h: header file for a counting bloom filter
+ *
+ */
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+// A counting bloom filter over 64 bit key hashes. Each item bumps
+// num_hashes one byte counters, so items can be removed again. A counter
+// that reaches 255 sticks there, which can only cause false positives.
+//
+// Adds and removes must be serialized by the caller, but
+// bloom_maybe_contains may run concurrently with them.
+typedef struct bloom_obj *bloom_t;
+
+// create a filter sized for capacity items at roughly target_fpr false
+// positive rate
+bloom_t bloom_create(uint64_t capacity, double target_fpr);
+
+void bloom_destroy(bloom_t filter);
+
+void bloom_add(bloom_t filter, uint64_t hash);
+
+// remove an item that was added before
+void bloom_remove(bloom_t filter, uint64_t hash);
+
+// false means the item is definitely not in the filter
+bool bloom_maybe_contains(bloom_t filter, uint64_t hash);
+
+// number of items the filter was sized for
+uint64_t bloom_capacity(bloom_t filter);
+
+// the expected false positive rate with num_items in the filter
+double bloom_estimated_fpr(bloom_t filter, uint64_t num_items);
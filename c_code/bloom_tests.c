@@ -0,0 +1,86 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bloom.h"
+#include "bloom_tests.h"
+
+#define my_assert(value, string) \
+{if (!(value)) { printf("!!!FAILURE!!! %s\n", string);}}
+
+static uint64_t item(uint64_t i)
+{
+    // some spread-out hashes to feed the filter
+    return i * 0x9e3779b97f4a7c15ULL + 12345;
+}
+
+static void test_bloom_no_false_negatives()
+{
+    printf("Running bloom no false negatives test\n");
+    bloom_t filter = bloom_create(1000, 0.01);
+    for (uint64_t i = 0; i < 1000; i++) {
+        bloom_add(filter, item(i));
+    }
+    for (uint64_t i = 0; i < 1000; i++) {
+        my_assert(bloom_maybe_contains(filter, item(i)), "bloom filter lost an item");
+    }
+    bloom_destroy(filter);
+}
+
+static void test_bloom_false_positive_rate()
+{
+    printf("Running bloom false positive rate test\n");
+    bloom_t filter = bloom_create(10000, 0.01);
+    for (uint64_t i = 0; i < 10000; i++) {
+        bloom_add(filter, item(i));
+    }
+    uint32_t false_positives = 0;
+    for (uint64_t i = 10000; i < 110000; i++) {
+        false_positives += bloom_maybe_contains(filter, item(i));
+    }
+    double rate = false_positives / 100000.0;
+    my_assert(rate < 0.02, "bloom false positive rate is well above target");
+    double estimate = bloom_estimated_fpr(filter, 10000);
+    my_assert(estimate > 0.001 && estimate < 0.02, "bloom estimated rate is off");
+    bloom_destroy(filter);
+}
+
+static void test_bloom_remove()
+{
+    printf("Running bloom remove test\n");
+    bloom_t filter = bloom_create(1000, 0.01);
+    for (uint64_t i = 0; i < 1000; i++) {
+        bloom_add(filter, item(i));
+    }
+    for (uint64_t i = 0; i < 1000; i += 2) {
+        bloom_remove(filter, item(i));
+    }
+    uint32_t still_there = 0;
+    for (uint64_t i = 0; i < 1000; i++) {
+        bool present = bloom_maybe_contains(filter, item(i));
+        if (i % 2 == 1) {
+            my_assert(present, "bloom remove took out another item");
+        } else {
+            still_there += present;
+        }
+    }
+    my_assert(still_there < 25, "bloom remove left most items behind");
+
+    // removing everything empties the filter completely
+    for (uint64_t i = 1; i < 1000; i += 2) {
+        bloom_remove(filter, item(i));
+    }
+    for (uint64_t i = 0; i < 1000; i++) {
+        my_assert(!bloom_maybe_contains(filter, item(i)), "bloom filter not empty");
+    }
+    bloom_destroy(filter);
+}
+
+void bloom_tests()
+{
+    printf("***Running bloom tests***\n");
+    test_bloom_no_false_negatives();
+    test_bloom_false_positive_rate();
+    test_bloom_remove();
+}
@@ -0,0 +1,3 @@
+#pragma once
+
+void bloom_tests();
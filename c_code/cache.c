@@ -1,26 +1,73 @@
 #include <assert.h>
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "evict.h"
+#include "gdsf.h"
+#include "trace.h"
 #include "dbLL.h"
+#include "bloom.h"
+#include "chunks.h"
+#include "cuckoo.h"
+#include "epoch.h"
+#include "art.h"
+#include "near.h"
+#include "pages.h"
+#include "parallel.h"
+#include "slab.h"
+#include "mrc.h"
+#include "tags.h"
 #include "cache.h"
 
 const bool debug = false;
 
 // What is this best practice for constants? Put them at top of file or in function?
-const float RESET_LOAD_FACTOR = 0.1;
-const float MAX_LOAD_FACTOR = 0.5;
+// bucket counts are always powers of two, so hashes can be masked
+const uint64_t DEFAULT_NUM_BUCKETS = 128;
+const uint64_t MIN_NUM_BUCKETS = 16;
+const float DEFAULT_MIN_LOAD_FACTOR = 0.125;
+const float DEFAULT_MAX_LOAD_FACTOR = 1.0;
+// with a maintenance thread, cache_set leaves resizing to the thread
+// unless the table gets this many times past max_load_factor
+const float HARD_LOAD_MULTIPLE = 4.0;
+// evictions (or frees) done per lock hold by the maintenance thread
+const uint32_t MAINTENANCE_BATCH = 64;
+// keys are spread over this many near cache invalidation stamps
+#define NEAR_STRIPES 1024
+// number of caches a thread keeps near caches for at once
+#define NEAR_CACHES_PER_THREAD 8
+// number of candidates sampled eviction keeps between rounds
+#define EVICTION_POOL_SIZE 16
+// cache_scan gives up on a batch after visiting count times this many
+// buckets, so a sparse table doesn't hold the lock for long
+const uint32_t SCAN_BUCKETS_PER_ENTRY = 10;
+// ART scans remember where this many walks left off
+#define SCAN_CURSORS 1024
+// fewer entries than this per thread aren't worth starting the thread
+const uint64_t BULK_ENTRIES_PER_THREAD = 4096;
+// nor are fewer buckets than this per rehash thread
+const uint64_t REHASH_BUCKETS_PER_THREAD = 1 << 15;
+// entries a defrag pass looks at per lock hold
+#define DEFRAG_BATCH 64
 
 uint64_t modified_jenkins(key_type key)
 {
     // https://en.wikipedia.org/wiki/Jenkins_hash_function
-    uint32_t hash = *key;
-    hash += (hash << 10);
-    hash ^= (hash >> 6);
+    // (one-at-a-time, over every byte of the key)
+    uint32_t hash = 0;
+    while (*key) {
+        hash += *key++;
+        hash += (hash << 10);
+        hash ^= (hash >> 6);
+    }
     hash += (hash << 3);
     hash ^= (hash >> 11);
     hash += (hash << 15);
@@ -29,6 +76,22 @@ uint64_t modified_jenkins(key_type key)
 
 typedef struct _dbLL_t hash_bucket;
 
+// the last key an ART scan handed out, see art_scan_locked
+struct scan_cursor
+{
+    uint64_t id; // the cursor that was returned for it
+    uint8_t *key; // NULL once the walk is done
+};
+
+// an entry kept in the sampled eviction pool
+struct evict_candidate
+{
+    uint8_t *key;
+    uint64_t hash;
+    uint32_t atime; // if the entry's atime changed, it has been used since
+    uint32_t idle;
+};
+
 static void print_key(key_type key)
 {
     uint32_t i = 0;
@@ -39,6 +102,39 @@ static void print_key(key_type key)
     printf("\n");
 }
 
+// A namespace, see cache_namespace_create. Only touched under the lock,
+// except for the atomics and the prefix, which is filled in before
+// num_namespaces counts the namespace and never changes after.
+struct cache_ns
+{
+    char *prefix; // NULL for the default namespace
+    size_t prefix_len;
+    uint64_t quota;
+    bool hard;
+    uint64_t memused;
+    uint64_t num_elements;
+    uint64_t flushed_elements; // entries from before the last flush
+    _Atomic uint32_t generation; // bumped by every flush
+
+    // the eviction order of the namespace's entries, by the cache's policy
+    evict_t evict; // NULL unless eviction is CACHE_EVICT_LRU
+    gdsf_t gdsf; // NULL unless eviction is CACHE_EVICT_GDSF
+    struct evict_candidate *pool; // sampled eviction, sorted by idle time, oldest last
+    uint32_t pool_size;
+    // sampled eviction draws from these, the namespace's entries in no
+    // order; node->heap_index is each one's place
+    node_t **members;
+    uint64_t num_members;
+    uint64_t members_capacity;
+    uint64_t sampled; // candidates drawn
+
+    _Atomic uint64_t hits;
+    _Atomic uint64_t misses;
+    uint64_t sets;
+    uint64_t evictions;
+    uint64_t flushes;
+};
+
 struct cache_obj 
 {
     // http://stackoverflow.com/questions/6316987/should-struct-definitions-go-in-h-or-c-file
@@ -46,170 +142,2495 @@ struct cache_obj
     uint64_t memused;
     uint64_t maxmem;
     uint64_t num_elements;
-    hash_bucket **buckets; // so buckets[i] = pointer to double linked list
-    hash_func hash; // should only be accessed via cache_hash
-    evict_t evict;
+    enum cache_engine engine;
+    hash_bucket *buckets; // so buckets[i] = double linked list, one allocation
+    cuckoo_t cuckoo; // the table instead of buckets for CACHE_ENGINE_CUCKOO
+    art_t art; // the index instead of buckets for CACHE_ENGINE_ART
+    struct page_policy pages; // how bucket arrays are allocated
+    hash_func hash; // full hash of a key; its bucket is hash & (num_buckets - 1)
+
+    // every namespace has its own eviction order, see struct cache_ns;
+    // namespaces[0] is the default one
+    struct cache_ns namespaces[CACHE_MAX_NAMESPACES];
+    _Atomic uint32_t num_namespaces;
+
+    // sampled eviction, see policy_select_victim
+    enum cache_eviction eviction;
+    uint32_t samples;
+    uint32_t lru_clock; // ticks on every set and locked get, read by lock-free gets
+    uint64_t next_version; // last version handed to a write, see cache_cas
+    uint64_t rng;
+    node_t *replacing; // an overwritten node still in the table, see cache_insert_node_locked
 
-    // buckets[i] = pointer to double linked list
+    // grow when the load factor goes above max_load_factor, shrink (after
+    // deletes) when it drops below min_load_factor
+    float min_load_factor;
+    float max_load_factor;
+    uint32_t rehash_threads;
+    uint64_t rehashes; // of the chained table, and the parts they were split into
+    uint64_t rehash_parts;
+
+    // every public function holds lock while touching the fields above,
+    // except for the lock-free cuckoo lookup in cache_get
+    pthread_mutex_t lock;
+
+    // lock-free readers in flight, counted by epoch. Unlinked nodes (and
+    // old cuckoo arrays and filters) retired during epoch e are freed once
+    // epoch e + 2 starts, see cache_collect.
+    epoch_t readers;
+
+    // background maintenance, see maintenance_loop
+    bool has_maintenance;
+    bool stopping; // set by destroy_cache to stop the thread
+    bool evicting; // memused crossed high_mark and hasn't reached low_mark yet
+    pthread_t maintenance;
+    pthread_cond_t wake;
+    uint64_t high_mark;
+    uint64_t low_mark;
+    float high_watermark; // the marks as fractions of maxmem, which can change
+    float low_watermark;
+    bool trim; // give freed memory back to the OS once eviction is done
+    uint32_t interval_ms;
+    // deleted nodes waiting to be freed, linked by next: retired in the
+    // current epoch, and in the one before
+    node_t *garbage;
+    node_t *garbage_before;
+    uint64_t garbage_pending; // nodes in both, and taken but not freed yet
+
+    // entries come from slab if it isn't NULL, see slab_allocator. A
+    // defrag pass walks the table from defrag_cursor (a bucket, or a key
+    // rank for the tree) moving entries off sparse pages; the maintenance
+    // thread starts one when fragmentation passes defrag_threshold.
+    slab_t slab;
+    float defrag_threshold;
+    bool defragging;
+    uint64_t defrag_cursor;
+    uint64_t defrag_passes;
+    uint64_t defrag_moved;
+
+    // reuse distances of sampled keys, if miss_ratio_curve is set
+    mrc_t mrc;
+
+    // tag -> nodes, see cache_set_tagged
+    tags_t tags;
+
+    // where walks in key order left off, see art_scan_locked
+    struct scan_cursor *scan_cursors; // SCAN_CURSORS of them, for CACHE_ENGINE_ART
+    uint32_t next_scan_cursor;
+
+    // per-thread near caches, see thread_near. A write to a key bumps its
+    // stripe's stamp after the table has changed, which invalidates every
+    // near cache copy of keys in that stripe.
+    uint64_t id; // unique over the life of the process, unlike the pointer
+    uint32_t near_entries;
+    uint32_t near_max_val_size;
+    _Atomic uint64_t *stamps; // NEAR_STRIPES of them, or NULL
+
+    // membership filter, NULL if there is none. Keys are added before they
+    // go into the table and removed after they leave it, so lock-free
+    // readers never get a false negative.
+    _Atomic bloom_t filter;
+    bloom_t retired_filter; // waiting for lock-free readers to finish
+    uint64_t retired_filter_epoch;
+    double filter_fpr;
+    _Atomic uint64_t filter_negatives;
+    _Atomic uint64_t filter_false_positives;
+
+    // buckets[i] = double linked list
     // each node in double linked list is a hash-bucket
 };
 
+static struct cache_ns *node_ns(cache_t cache, node_t *node)
+{
+    return &cache->namespaces[node->ns];
+}
+
+static bool node_flushed(cache_t cache, node_t *node)
+{
+    // safe without the lock: generations only go up
+    return node->generation != atomic_load_explicit(&node_ns(cache, node)->generation,
+            memory_order_acquire);
+}
+
+static uint32_t key_namespace(cache_t cache, key_type key)
+{
+    uint32_t n = atomic_load_explicit(&cache->num_namespaces, memory_order_acquire);
+    for (uint32_t i = 1; i < n; ++i) {
+        struct cache_ns *ns = &cache->namespaces[i];
+        if (strncmp((const char*) key, ns->prefix, ns->prefix_len) == 0) {
+            return i;
+        }
+    }
+    return CACHE_DEFAULT_NAMESPACE;
+}
+
+static void count_lookup(cache_t cache, key_type key, uint64_t hash, node_t *node)
+{
+    if (cache->mrc) {
+        mrc_read(cache->mrc, hash, node ? node->val_size : 0);
+    }
+    if (node) {
+        atomic_fetch_add_explicit(&node_ns(cache, node)->hits, 1, memory_order_relaxed);
+    } else {
+        atomic_fetch_add_explicit(&cache->namespaces[key_namespace(cache, key)].misses, 1,
+                memory_order_relaxed);
+    }
+}
+
 static uint64_t cache_hash(cache_t cache, key_type key) 
 {
-    return cache->hash(key) % cache->num_buckets;
+    return cache->hash(key) & (cache->num_buckets - 1);
+}
+
+static float cache_load_factor(cache_t cache)
+{
+    if (cache->engine != CACHE_ENGINE_CHAINED) {
+        return 0; // the other engines manage their own size
+    }
+    return (float)cache->num_elements / (float)cache->num_buckets;
+}
+
+static uint64_t buckets_for(cache_t cache, uint64_t num_elements)
+{
+    // smallest power of two that puts num_elements at half the max load
+    // factor, so a freshly resized table has room to grow both ways
+    uint64_t num_buckets = MIN_NUM_BUCKETS;
+    while ((float) num_elements > num_buckets * cache->max_load_factor / 2) {
+        num_buckets *= 2;
+    }
+    return num_buckets;
+}
+
+static hash_bucket *new_buckets(cache_t cache, uint64_t num_buckets)
+{
+    hash_bucket *buckets = pages_alloc(&cache->pages, num_buckets * sizeof(hash_bucket));
+    for (uint64_t i = 0; i < num_buckets; i++){
+        ll_init(&buckets[i]);
+    }
+    return buckets;
+}
+
+struct rehash
+{
+    hash_bucket *old_table;
+    uint64_t old_num_buckets;
+    hash_bucket *new_table;
+    uint64_t new_num_buckets;
+    _Atomic uint64_t parts_done;
+};
+
+static void rehash_part(uint32_t part, uint32_t parts, void *arg)
+{
+    // Both sizes are powers of two, so when growing, old bucket i only
+    // feeds new buckets i + k * old_num_buckets, and when shrinking, new
+    // bucket j only takes from old buckets j + k * new_num_buckets. A part
+    // takes a run of the smaller table's buckets along with everything
+    // they map to, which no other part touches.
+    struct rehash *r = arg;
+    bool growing = r->new_num_buckets >= r->old_num_buckets;
+    uint64_t small = growing ? r->old_num_buckets : r->new_num_buckets;
+    uint64_t big = growing ? r->new_num_buckets : r->old_num_buckets;
+    for (uint64_t i = small * part / parts; i < small * (part + 1) / parts; ++i) {
+        for (uint64_t j = i; j < r->new_num_buckets; j += small) {
+            ll_init(&r->new_table[j]);
+        }
+        for (uint64_t j = i; j < (growing ? i + 1 : big); j += small) {
+            node_t *node;
+            while ((node = ll_pop_node(&r->old_table[j])) != NULL) {
+                ll_push_node(&r->new_table[node->hash & (r->new_num_buckets - 1)], node);
+            }
+        }
+    }
+    atomic_fetch_add(&r->parts_done, 1);
+}
+
+static void cache_rehash(cache_t cache, uint64_t new_num_buckets)
+{
+    // move every node into a new bucket array. Nodes are relinked, not
+    // copied, since each node remembers its full hash.
+    struct rehash r = {cache->buckets, cache->num_buckets,
+        pages_alloc(&cache->pages, new_num_buckets * sizeof(hash_bucket)), new_num_buckets, 0};
+    uint64_t small = r.old_num_buckets < new_num_buckets ? r.old_num_buckets : new_num_buckets;
+    uint64_t parts = small / REHASH_BUCKETS_PER_THREAD;
+    if (parts > cache->rehash_threads) {
+        parts = cache->rehash_threads;
+    }
+    parallel_run(parts > 0 ? (uint32_t) parts : 1, rehash_part, &r);
+    ++cache->rehashes;
+    cache->rehash_parts += atomic_load(&r.parts_done);
+    hash_bucket *new_table = r.new_table;
+    pages_free(cache->buckets);
+    cache->buckets = new_table;
+    cache->num_buckets = new_num_buckets;
 }
 
-static void cache_dynamic_resize(cache_t cache)
+static void cache_dynamic_resize(cache_t cache, float max_load_factor)
 { 
     // dynamically resizes size of hash table, via changing num_buckets
-    // and copying key-value pairs IF the current load factor exceeds
-    
-    float load_factor = (float)cache->num_elements / (float)cache->num_buckets;
-    if (load_factor > MAX_LOAD_FACTOR) {
-        uint64_t new_num_buckets = (uint64_t) ((float) cache->num_elements / RESET_LOAD_FACTOR);
+    // and relinking key-value pairs IF the current load factor exceeds
+    if (cache_load_factor(cache) > max_load_factor) {
+        cache_rehash(cache, buckets_for(cache, cache->num_elements));
+    } 
+}
+
+static bool cache_should_shrink(cache_t cache)
+{
+    return cache->engine == CACHE_ENGINE_CHAINED && cache->num_buckets > MIN_NUM_BUCKETS &&
+        cache_load_factor(cache) < cache->min_load_factor;
+}
 
-        // new memory for new cache & initialize lists
-        hash_bucket **new_buckets = calloc(new_num_buckets, sizeof(hash_bucket*)); 
-        assert(new_buckets && "memory");
-        for (uint32_t i = 0; i < new_num_buckets; i++){
-            new_buckets[i] = new_list();
+static void cache_maybe_shrink(cache_t cache)
+{
+    // give bucket memory back after mass deletes
+    if (cache_should_shrink(cache)) {
+        uint64_t new_num_buckets = buckets_for(cache, cache->num_elements);
+        if (new_num_buckets < cache->num_buckets) {
+            cache_rehash(cache, new_num_buckets);
         }
+    }
+}
 
-        // loop over all possible hash values
-        for (uint64_t i = 0; i < cache->num_buckets; i++) {
-            hash_bucket *dbll = cache->buckets[i];
-            key_type *keys = ll_get_keys(dbll);
-            uint32_t num_keys = ll_size(dbll);
-            for (uint32_t j = 0; j < num_keys; j++) {
-                uint32_t val_size;
-                val_type val = ll_search(dbll, keys[j], &val_size);
-
-                // insert key, val, val_size into dbll in new memory
-                uint64_t new_hash = cache->hash(keys[j]) % new_num_buckets;
-                hash_bucket *e = new_buckets[new_hash];
-                ll_insert(e, keys[j], val, val_size);
-                free((void *)val);
-            }
-            free(keys);
-            destroy_list(cache->buckets[i]);
+// The near caches of the calling thread, one per cache it has read from
+// (up to NEAR_CACHES_PER_THREAD, after which the oldest is dropped).
+// Freed when the thread exits.
+struct near_slots
+{
+    uint64_t cache_ids[NEAR_CACHES_PER_THREAD];
+    near_t nears[NEAR_CACHES_PER_THREAD];
+    uint32_t victim;
+};
+
+static _Atomic uint64_t next_cache_id = 1;
+static __thread struct near_slots *thread_near_slots;
+static pthread_key_t near_slots_key;
+static pthread_once_t near_slots_once = PTHREAD_ONCE_INIT;
+
+static void free_near_slots(void *arg)
+{
+    struct near_slots *slots = arg;
+    for (uint32_t i = 0; i < NEAR_CACHES_PER_THREAD; ++i) {
+        if (slots->nears[i]) {
+            near_destroy(slots->nears[i]);
         }
-        cache->num_buckets = new_num_buckets;
-        free(cache->buckets);
-        cache->buckets = new_buckets;
-    } 
+    }
+    free(slots);
 }
 
-cache_t create_cache(uint64_t maxmem)
+static void make_near_slots_key(void)
 {
-    cache_t c = calloc(1, sizeof(struct cache_obj));
+    pthread_key_create(&near_slots_key, free_near_slots);
+}
 
-    c->memused = 0;
-    c->maxmem = maxmem;
-    c->num_buckets = 100;
+static near_t thread_near(cache_t cache, bool create)
+{
+    struct near_slots *slots = thread_near_slots;
+    if (slots == NULL) {
+        if (!create) {
+            return NULL;
+        }
+        pthread_once(&near_slots_once, make_near_slots_key);
+        slots = calloc(1, sizeof(struct near_slots));
+        assert(slots && "memory");
+        pthread_setspecific(near_slots_key, slots);
+        thread_near_slots = slots;
+    }
 
-    c->buckets = calloc(c->num_buckets, sizeof(hash_bucket*));
-    assert(c->buckets);
-    for (uint32_t i = 0; i < c->num_buckets; i++){
-        c->buckets[i] = new_list();
+    for (uint32_t i = 0; i < NEAR_CACHES_PER_THREAD; ++i) {
+        if (slots->cache_ids[i] == cache->id) {
+            return slots->nears[i];
+        }
+    }
+    if (!create) {
+        return NULL;
     }
 
-    c->hash = modified_jenkins;
-    c->evict = evict_create(c->num_buckets);
-    return c;
+    uint32_t i = slots->victim;
+    slots->victim = (slots->victim + 1) % NEAR_CACHES_PER_THREAD;
+    if (slots->nears[i]) {
+        near_destroy(slots->nears[i]);
+    }
+    slots->cache_ids[i] = cache->id;
+    slots->nears[i] = near_create(cache->near_entries, cache->near_max_val_size);
+    return slots->nears[i];
 }
 
-void cache_set(cache_t cache, key_type key, val_type val, uint32_t val_size)
+static void drop_thread_near(cache_t cache)
 {
+    struct near_slots *slots = thread_near_slots;
+    for (uint32_t i = 0; slots && i < NEAR_CACHES_PER_THREAD; ++i) {
+        if (slots->cache_ids[i] == cache->id) {
+            near_destroy(slots->nears[i]);
+            slots->nears[i] = NULL;
+            slots->cache_ids[i] = 0;
+        }
+    }
+}
 
-    key_type k;
+static _Atomic uint64_t *near_stamp(cache_t cache, uint64_t hash)
+{
+    return &cache->stamps[hash & (NEAR_STRIPES - 1)];
+}
 
-    if (debug) {
-        uint64_t hash = cache_hash(cache, key);
-        printf("setting key = %" PRIu8 "\n", *key);
-        printf("hash = %" PRIu64 "\n", hash);
-        printf("value = %" PRIu8 "\n\n", *(uint8_t *)val);
+static void cache_invalidate_near(cache_t cache, uint64_t hash)
+{
+    if (cache->stamps) {
+        atomic_fetch_add(near_stamp(cache, hash), 1);
     }
-    cache_dynamic_resize(cache); // will resize cache if load factor is exceeded
+}
 
-    // eviction, if necessary
-    cache->memused += val_size;
-    while (cache->memused > cache->maxmem) {
-        k = evict_select_for_removal(cache->evict);
-        assert(k && "if k is null, then our evict is empty and we shouldn't be removing anything");
-        cache_delete(cache, k);
-        free((uint8_t*) k);
+static node_t *table_find(cache_t cache, key_type key, uint64_t hash)
+{
+    if (cache->engine == CACHE_ENGINE_CUCKOO) {
+        return cuckoo_find(cache->cuckoo, key, hash);
     }
+    if (cache->engine == CACHE_ENGINE_ART) {
+        return art_find(cache->art, key);
+    }
+    return ll_find_node(&cache->buckets[hash & (cache->num_buckets - 1)], key);
+}
 
-    uint64_t hash = cache_hash(cache, key);
-    hash_bucket *e = cache->buckets[hash]; // bucket the key belongs to
+static node_t *live_find(cache_t cache, key_type key, uint64_t hash)
+{
+    // table_find, but entries of a flushed namespace generation are misses
+    node_t *node = table_find(cache, key, hash);
+    return node && node_flushed(cache, node) ? NULL : node;
+}
 
-    // check if the key exists in the cache already
-    uint32_t old_val_size = ll_remove_key(e, key);
-    if (old_val_size != 0){
-        cache_delete(cache, key);
+static void table_insert(cache_t cache, node_t *node)
+{
+    if (cache->engine == CACHE_ENGINE_CUCKOO) {
+        cuckoo_insert(cache->cuckoo, node);
+    } else if (cache->engine == CACHE_ENGINE_ART) {
+        art_insert(cache->art, node);
+    } else {
+        ll_push_node(&cache->buckets[node->hash & (cache->num_buckets - 1)], node);
     }
+}
 
-    // insert the key, value into cache
-    ll_insert(e, key, val, val_size); // insert into double linked list
-    evict_set(cache->evict, key); // notify evict object that key was inserted
-    ++cache->num_elements;
+static node_t *table_unlink(cache_t cache, key_type key, uint64_t hash)
+{
+    if (cache->engine == CACHE_ENGINE_CUCKOO) {
+        return cuckoo_remove(cache->cuckoo, key, hash);
+    }
+    if (cache->engine == CACHE_ENGINE_ART) {
+        return art_remove(cache->art, key);
+    }
+    return ll_unlink_key(&cache->buckets[hash & (cache->num_buckets - 1)], key);
 }
 
-val_type cache_get(cache_t cache, key_type key, uint32_t *val_size)
+static void table_replace(cache_t cache, node_t *old, node_t *node)
 {
-    uint64_t hash = cache_hash(cache, key);
+    // swap node in for old, which has the same key. Lock-free readers see
+    // one or the other, never neither.
+    node_t *replaced;
+    if (cache->engine == CACHE_ENGINE_CUCKOO) {
+        replaced = cuckoo_replace(cache->cuckoo, node);
+    } else if (cache->engine == CACHE_ENGINE_ART) {
+        replaced = art_replace(cache->art, node);
+    } else {
+        replaced = table_unlink(cache, old->key, old->hash);
+        table_insert(cache, node);
+    }
+    assert(replaced == old && "replaced node was not in the table");
+}
 
-    if (debug) {
-        printf("getting key = %" PRIu8 "\n", *key);
-        printf("hash = %" PRIu64 "\n\n", hash);
+static void table_foreach(cache_t cache, void (*fn)(node_t *node, void *arg), void *arg)
+{
+    if (cache->engine == CACHE_ENGINE_CUCKOO) {
+        cuckoo_foreach(cache->cuckoo, fn, arg);
+        return;
+    }
+    if (cache->engine == CACHE_ENGINE_ART) {
+        art_foreach(cache->art, fn, arg);
+        return;
+    }
+    for (uint64_t i = 0; i < cache->num_buckets; ++i) {
+        node_t *cur = cache->buckets[i].head;
+        while (cur) {
+            node_t *next = cur->next; // fn may free cur
+            fn(cur, arg);
+            cur = next;
+        }
     }
+}
 
-    hash_bucket *e = cache->buckets[hash];
-    void *res = (void *) ll_search(e, key, val_size);
-    evict_get(cache->evict, key);
+static void *copy_value(node_t *node, uint32_t *val_size)
+{
+    // values too big for a uint32_t size can only be read with cache_read
+    if (node->val_size > UINT32_MAX) {
+        return NULL;
+    }
+    void *res = calloc(1, node->val_size);
+    if (node->chunked) {
+        chunks_read((chunks_t) node->val, 0, res, node->val_size);
+    } else {
+        memcpy(res, node->val, node->val_size);
+    }
+    *val_size = (uint32_t) node->val_size;
     return res;
 }
 
-void cache_delete(cache_t cache, key_type key) 
+static uint64_t free_garbage(node_t *garbage)
 {
-    uint64_t hash = cache_hash(cache, key);
-    // uint32_t val_size;
-    hash_bucket *e = cache->buckets[hash];
-    uint32_t val_size = ll_remove_key(e, key);
-    //there was actually an item to delete
-    if (val_size != 0) {
-        --cache->num_elements;
-        cache->memused -= val_size;
-        evict_delete(cache->evict, key);
+    uint64_t freed = 0;
+    while (garbage) {
+        node_t *next = garbage->next;
+        free_node(garbage);
+        garbage = next;
+        ++freed;
     }
+    return freed;
 }
 
-uint64_t cache_space_used(cache_t cache)
+static bool cache_has_retired(cache_t cache)
 {
-    return cache->memused;
+    return cache->garbage || cache->garbage_before || cache->retired_filter ||
+        (cache->engine == CACHE_ENGINE_CUCKOO && cuckoo_has_retired(cache->cuckoo));
 }
 
-void destroy_cache(cache_t cache)
+static node_t *cache_collect(cache_t cache)
 {
-    for (uint32_t i = 0; i < cache->num_buckets; i++) {
-        destroy_list(cache->buckets[i]);
+    // start a new epoch if anything is waiting for one and the readers
+    // allow it, free the cuckoo arrays and filter retired two epochs ago,
+    // and return the nodes retired then for the caller to free
+    if (!cache_has_retired(cache) || !epoch_advance(cache->readers)) {
+        return NULL;
     }
+    node_t *garbage = cache->garbage_before;
+    cache->garbage_before = cache->garbage;
+    cache->garbage = NULL;
+    if (cache->engine == CACHE_ENGINE_CUCKOO) {
+        cuckoo_next_epoch(cache->cuckoo);
+    }
+    if (cache->retired_filter &&
+            epoch_current(cache->readers) >= cache->retired_filter_epoch + 2) {
+        bloom_destroy(cache->retired_filter);
+        cache->retired_filter = NULL;
+    }
+    return garbage;
+}
 
-    evict_destroy(cache->evict);
-    free(cache->evict);
-    free(cache->buckets);
-    cache->evict = NULL;
-    cache->buckets = NULL;
-    free(cache);
-    cache = NULL;
+static void cache_retire_node(cache_t cache, node_t *node)
+{
+    // with a maintenance thread, frees are batched up and done off the
+    // caller's thread (and outside the lock). With lock-free readers the
+    // node has to wait until no reader can be using it.
+    if (cache->has_maintenance || cache->engine == CACHE_ENGINE_CUCKOO) {
+        node->next = cache->garbage;
+        cache->garbage = node;
+        ++cache->garbage_pending;
+    } else {
+        free_node(node);
+    }
 }
 
-void print_cache(cache_t cache)
+static void cache_reclaim(cache_t cache)
+{
+    // free retired memory as soon as no reader can be using it, which
+    // takes two new epochs
+    for (uint32_t i = 0; i < 2; ++i) {
+        cache->garbage_pending -= free_garbage(cache_collect(cache));
+    }
+}
+
+static uint64_t filter_target_capacity(cache_t cache)
+{
+    // as many keys as the table can take before it next grows
+    if (cache->engine == CACHE_ENGINE_CUCKOO) {
+        return cuckoo_bucket_count(cache->cuckoo) * CUCKOO_SLOTS;
+    }
+    if (cache->engine == CACHE_ENGINE_ART) {
+        // the tree never fills up; resize the filter when the key count
+        // crosses a power of two
+        return (uint64_t) (buckets_for(cache, cache->num_elements) * cache->max_load_factor);
+    }
+    return (uint64_t) (cache->num_buckets * cache->max_load_factor);
+}
+
+static void filter_add_cb(node_t *node, void *arg)
+{
+    bloom_add(arg, node->hash);
+}
+
+static void cache_sync_filter(cache_t cache)
+{
+    // rebuild the filter whenever the table has been resized
+    bloom_t filter = atomic_load(&cache->filter);
+    if (filter == NULL || cache->retired_filter != NULL) {
+        return; // no filter, or still waiting to free the last one
+    }
+    uint64_t capacity = filter_target_capacity(cache);
+    if (bloom_capacity(filter) == capacity) {
+        return;
+    }
+
+    bloom_t new_filter = bloom_create(capacity, cache->filter_fpr);
+    table_foreach(cache, filter_add_cb, new_filter);
+    atomic_store(&cache->filter, new_filter);
+    cache->retired_filter = filter; // every engine reads the filter without the lock
+    cache->retired_filter_epoch = epoch_current(cache->readers);
+}
+
+static bool filter_says_absent(cache_t cache, uint64_t hash)
+{
+    bloom_t filter = atomic_load_explicit(&cache->filter, memory_order_acquire);
+    if (filter && !bloom_maybe_contains(filter, hash)) {
+        atomic_fetch_add_explicit(&cache->filter_negatives, 1, memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+static void filter_count_miss(cache_t cache)
+{
+    // the filter let a lookup through, but the key wasn't there
+    if (atomic_load_explicit(&cache->filter, memory_order_relaxed)) {
+        atomic_fetch_add_explicit(&cache->filter_false_positives, 1, memory_order_relaxed);
+    }
+}
+
+static uint64_t cache_random(cache_t cache)
+{
+    // xorshift64, callers hold the lock
+    cache->rng ^= cache->rng << 13;
+    cache->rng ^= cache->rng >> 7;
+    cache->rng ^= cache->rng << 17;
+    return cache->rng;
+}
+
+static uint64_t table_bucket_count(cache_t cache)
+{
+    if (cache->engine == CACHE_ENGINE_CUCKOO) {
+        return cuckoo_bucket_count(cache->cuckoo);
+    }
+    return cache->num_buckets;
+}
+
+static uint32_t bucket_nodes(cache_t cache, uint64_t bucket, node_t **nodes, uint32_t room)
+{
+    // up to room of the nodes in one bucket of the chained or cuckoo table
+    uint32_t n = 0;
+    if (cache->engine == CACHE_ENGINE_CUCKOO) {
+        node_t *slots[CUCKOO_SLOTS];
+        uint32_t found = cuckoo_bucket_nodes(cache->cuckoo, bucket, slots);
+        for (; n < found && n < room; ++n) {
+            nodes[n] = slots[n];
+        }
+        return n;
+    }
+    for (node_t *cur = cache->buckets[bucket].head; cur && n < room; cur = cur->next) {
+        nodes[n++] = cur;
+    }
+    return n;
+}
+
+static void ns_add_member(struct cache_ns *ns, node_t *node)
+{
+    if (ns->num_members == ns->members_capacity) {
+        ns->members_capacity = ns->members_capacity ? 2 * ns->members_capacity : 64;
+        ns->members = realloc(ns->members, ns->members_capacity * sizeof(node_t *));
+        assert(ns->members && "memory");
+    }
+    node->heap_index = (uint32_t) ns->num_members;
+    ns->members[ns->num_members++] = node;
+}
+
+static void ns_remove_member(struct cache_ns *ns, node_t *node)
+{
+    // the last member takes node's place
+    uint32_t i = node->heap_index;
+    assert(i < ns->num_members && ns->members[i] == node && "node is not a member");
+    node_t *last = ns->members[--ns->num_members];
+    ns->members[i] = last;
+    last->heap_index = i;
+}
+
+static void ns_move_member(struct cache_ns *ns, node_t *old, node_t *node)
+{
+    uint32_t i = old->heap_index;
+    assert(i < ns->num_members && ns->members[i] == old && "node is not a member");
+    ns->members[i] = node;
+    node->heap_index = i;
+}
+
+static uint32_t node_atime(node_t *node)
+{
+    // lock-free cuckoo readers store atime without the lock
+    return __atomic_load_n(&node->atime, __ATOMIC_RELAXED);
+}
+
+static void pool_offer(cache_t cache, struct cache_ns *ns, node_t *node)
+{
+    // flushed entries are as idle as it gets
+    uint32_t idle = node_flushed(cache, node) ? UINT32_MAX : cache->lru_clock - node_atime(node);
+    for (uint32_t i = 0; i < ns->pool_size; ++i) {
+        if (ns->pool[i].hash == node->hash &&
+                strcmp((const char*) ns->pool[i].key, (const char*) node->key) == 0) {
+            return; // already a candidate
+        }
+    }
+    if (ns->pool_size == EVICTION_POOL_SIZE) {
+        if (idle <= ns->pool[0].idle) {
+            return; // no better than anything in the pool
+        }
+        free(ns->pool[0].key);
+        memmove(&ns->pool[0], &ns->pool[1], (EVICTION_POOL_SIZE - 1) * sizeof(struct evict_candidate));
+        --ns->pool_size;
+    }
+
+    // insertion sort by idle time
+    uint32_t i = ns->pool_size;
+    while (i > 0 && ns->pool[i - 1].idle > idle) {
+        ns->pool[i] = ns->pool[i - 1];
+        --i;
+    }
+    struct evict_candidate *c = &ns->pool[i];
+    c->key = calloc(strlen((const char*) node->key) + 1, sizeof(uint8_t));
+    strcpy((char*) c->key, (const char*) node->key);
+    c->hash = node->hash;
+    c->atime = node_atime(node);
+    c->idle = idle;
+    ++ns->pool_size;
+}
+
+static void policy_set(cache_t cache, node_t *node)
+{
+    struct cache_ns *ns = node_ns(cache, node);
+    if (cache->eviction == CACHE_EVICT_SAMPLED) {
+        node->atime = __atomic_add_fetch(&cache->lru_clock, 1, __ATOMIC_RELAXED);
+        ns_add_member(ns, node);
+    } else if (cache->eviction == CACHE_EVICT_GDSF) {
+        gdsf_set(ns->gdsf, node);
+    } else {
+        evict_set(ns->evict, node->key); // notify evict object that key was inserted
+    }
+}
+
+static void policy_get(cache_t cache, node_t *node)
+{
+    // callers hold the lock
+    struct cache_ns *ns = node_ns(cache, node);
+    if (cache->eviction == CACHE_EVICT_SAMPLED) {
+        uint32_t now = __atomic_add_fetch(&cache->lru_clock, 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&node->atime, now, __ATOMIC_RELAXED);
+    } else if (cache->eviction == CACHE_EVICT_GDSF) {
+        gdsf_get(ns->gdsf, node);
+    } else {
+        evict_get(ns->evict, node->key);
+    }
+}
+
+static void policy_delete(cache_t cache, node_t *node)
+{
+    struct cache_ns *ns = node_ns(cache, node);
+    if (cache->eviction == CACHE_EVICT_LRU) {
+        evict_delete(ns->evict, node->key);
+    } else if (cache->eviction == CACHE_EVICT_GDSF) {
+        gdsf_delete(ns->gdsf, node);
+    } else {
+        ns_remove_member(ns, node); // its pool entries are checked when they come up
+    }
+}
+
+static key_type policy_select_victim(cache_t cache, struct cache_ns *ns)
+{
+    // returns a copy of the key in ns to evict, or NULL if ns is empty.
+    // Entries from before a flush come first: LRU has them at the old end
+    // already (they can't be read any more), GDSF orders by generation and
+    // sampling sees them as idle forever.
+    if (cache->eviction == CACHE_EVICT_LRU) {
+        return evict_select_for_removal(ns->evict);
+    }
+    if (cache->eviction == CACHE_EVICT_GDSF) {
+        node_t *node = gdsf_select_for_removal(ns->gdsf);
+        if (node == NULL) {
+            return NULL;
+        }
+        uint8_t *key = calloc(strlen((const char*) node->key) + 1, sizeof(uint8_t));
+        assert(key && "memory");
+        strcpy((char*) key, (const char*) node->key);
+        return key;
+    }
+
+    // samples come from the namespace's own members, so a round costs the
+    // same however small the namespace is next to the rest of the table
+    uint32_t index = (uint32_t) (ns - cache->namespaces);
+    while (ns->num_members > 0) {
+        for (uint32_t i = 0; i < cache->samples; ++i) {
+            pool_offer(cache, ns, ns->members[cache_random(cache) % ns->num_members]);
+        }
+        ns->sampled += cache->samples;
+
+        // the oldest candidate wins, unless it was deleted or used since
+        struct evict_candidate best = ns->pool[--ns->pool_size];
+        node_t *node = table_find(cache, best.key, best.hash);
+        if (node && node != cache->replacing && node->ns == index && node_atime(node) == best.atime) {
+            return best.key;
+        }
+        free(best.key);
+    }
+    return NULL;
+}
+
+static void cache_unaccount_node(cache_t cache, node_t *node)
+{
+    // what goes with node leaving the table, but for the eviction policy
+    // and freeing it
+    cache_invalidate_near(cache, node->hash);
+    bloom_t filter = atomic_load(&cache->filter);
+    if (filter) {
+        bloom_remove(filter, node->hash);
+    }
+    struct cache_ns *ns = node_ns(cache, node);
+    if (node_flushed(cache, node)) {
+        --ns->flushed_elements;
+    }
+    --ns->num_elements;
+    ns->memused -= node->val_size;
+    --cache->num_elements;
+    cache->memused -= node->val_size;
+    tags_remove(cache->tags, node);
+}
+
+static void cache_forget_node(cache_t cache, node_t *node)
+{
+    // everything that goes with node leaving the table, once it has
+    cache_unaccount_node(cache, node);
+    policy_delete(cache, node);
+    cache_retire_node(cache, node);
+}
+
+static void cache_delete_locked(cache_t cache, key_type key)
+{
+    node_t *node = table_unlink(cache, key, cache->hash(key));
+    //there was actually an item to delete
+    if (node != NULL) {
+        cache_forget_node(cache, node);
+    }
+}
+
+static void cache_evict_from(cache_t cache, struct cache_ns *ns)
+{
+    key_type k = policy_select_victim(cache, ns);
+    assert(k && "if k is null, then our evict is empty and we shouldn't be removing anything");
+    cache_delete_locked(cache, k);
+    free((uint8_t*) k);
+    ++ns->evictions;
+}
+
+static struct cache_ns *victim_namespace(cache_t cache)
+{
+    // flushed entries go before anything else; after that memory comes
+    // back from the namespace furthest over its quota. With no namespaces
+    // that is always the default one.
+    struct cache_ns *victim = NULL;
+    int64_t worst = 0;
+    uint32_t n = atomic_load(&cache->num_namespaces);
+    for (uint32_t i = 0; i < n; ++i) {
+        struct cache_ns *ns = &cache->namespaces[i];
+        if (ns->num_elements == 0) {
+            continue;
+        }
+        if (ns->flushed_elements > 0) {
+            return ns;
+        }
+        int64_t over = (int64_t) ns->memused - (int64_t) ns->quota;
+        if (victim == NULL || over > worst) {
+            victim = ns;
+            worst = over;
+        }
+    }
+    return victim;
+}
+
+static void cache_evict_one(cache_t cache)
 {
-    for (uint32_t i = 0; i < cache->num_buckets; ++i) {
-        if (ll_size(cache->buckets[i]) > 0){
-            printf("hash=%" PRIu32 " has dbll: \n", i);
-            rep_list(cache->buckets[i]);
+    struct cache_ns *ns = victim_namespace(cache);
+    assert(ns && "nothing left to evict");
+    cache_evict_from(cache, ns);
+}
+
+static void cache_evict_to_fit(cache_t cache, struct cache_ns *ns)
+{
+    // after ns grew: its hard quota first, then maxmem
+    while (ns->hard && ns->memused > ns->quota && ns->num_elements > 0) {
+        cache_evict_from(cache, ns);
+    }
+    while (cache->memused > cache->maxmem) {
+        cache_evict_one(cache);
+    }
+}
+
+struct defrag_walk
+{
+    node_t **nodes;
+    uint32_t n;
+};
+
+static bool defrag_walk_cb(node_t *node, void *arg)
+{
+    struct defrag_walk *walk = arg;
+    walk->nodes[walk->n++] = node;
+    return walk->n < DEFRAG_BATCH;
+}
+
+static void defrag_move(cache_t cache, node_t *node)
+{
+    // swap in a copy of node on a fuller page. Nothing else about the
+    // entry changes: not its version, its place in the eviction order or
+    // near cache copies of it. The LRU queue points at the node's key, and
+    // GDSF and sampled eviction at the node.
+    node_t *copy = move_slab_node(cache->slab, node);
+    assert(copy && "a slab node has to fit in the slab again");
+    table_replace(cache, node, copy);
+    tags_move(cache->tags, node, copy);
+    if (cache->eviction == CACHE_EVICT_LRU) {
+        evict_move(node_ns(cache, node)->evict, node->key, copy->key);
+    } else if (cache->eviction == CACHE_EVICT_GDSF) {
+        gdsf_move(node_ns(cache, node)->gdsf, node, copy);
+    } else {
+        ns_move_member(node_ns(cache, node), node, copy);
+    }
+    cache_retire_node(cache, node);
+    ++cache->defrag_moved;
+}
+
+static void defrag_nodes(cache_t cache, node_t **nodes, uint32_t n)
+{
+    for (uint32_t i = 0; i < n; ++i) {
+        if (nodes[i]->slab && slab_should_move(nodes[i])) {
+            defrag_move(cache, nodes[i]);
+        }
+    }
+}
+
+static bool cache_defrag_batch(cache_t cache, uint64_t *cursor)
+{
+    // one lock hold of a defrag pass: look at the next DEFRAG_BATCH or so
+    // entries from *cursor and move the ones on pages the slab picked to
+    // empty at the start of the pass. Returns true once the pass has been
+    // over the whole table. Like cache_scan, a resize or cuckoo insert
+    // between batches can make a pass miss some entries, as can a chained
+    // bucket longer than a batch; their pages are given back to the slab
+    // at the end and picked again next time.
+    if (*cursor == 0) {
+        slab_plan_defrag(cache->slab);
+    }
+    node_t *nodes[DEFRAG_BATCH];
+    bool done;
+    if (cache->engine == CACHE_ENGINE_ART) {
+        struct defrag_walk walk = {nodes, 0};
+        art_walk(cache->art, *cursor, defrag_walk_cb, &walk);
+        defrag_nodes(cache, nodes, walk.n);
+        *cursor += walk.n;
+        done = walk.n < DEFRAG_BATCH;
+    } else {
+        // a bucket at a time, since moving relinks nodes within it
+        uint64_t num_buckets = table_bucket_count(cache);
+        uint64_t max_visits = (uint64_t) DEFRAG_BATCH * SCAN_BUCKETS_PER_ENTRY;
+        uint32_t seen = 0;
+        for (uint64_t v = 0; v < max_visits && *cursor < num_buckets && seen < DEFRAG_BATCH; ++v) {
+            uint32_t n = bucket_nodes(cache, (*cursor)++, nodes, DEFRAG_BATCH);
+            defrag_nodes(cache, nodes, n);
+            seen += n;
+        }
+        done = *cursor >= num_buckets;
+    }
+
+    if (done) {
+        slab_end_defrag(cache->slab);
+        *cursor = 0;
+        ++cache->defrag_passes;
+    }
+    return done;
+}
+
+static bool maintenance_has_work(cache_t cache)
+{
+    return cache->evicting || cache->memused > cache->high_mark || cache->defragging ||
+        (cache_has_retired(cache) && epoch_ready(cache->readers)) ||
+        cache_load_factor(cache) > cache->max_load_factor ||
+        cache_should_shrink(cache);
+}
+
+static void *maintenance_loop(void *arg)
+{
+    cache_t cache = arg;
+    pthread_mutex_lock(&cache->lock);
+    while (!cache->stopping) {
+        if (cache->memused > cache->high_mark) {
+            cache->evicting = true;
+        }
+
+        if (!maintenance_has_work(cache)) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += cache->interval_ms / 1000;
+            deadline.tv_nsec += (long) (cache->interval_ms % 1000) * 1000000;
+            if (deadline.tv_nsec >= 1000000000) {
+                ++deadline.tv_sec;
+                deadline.tv_nsec -= 1000000000;
+            }
+            int rc = pthread_cond_timedwait(&cache->wake, &cache->lock, &deadline);
+            assert((rc == 0 || rc == ETIMEDOUT) && "cond wait");
+            // at most one defrag pass per idle interval, even if passes
+            // can't get fragmentation under the threshold
+            if (rc == ETIMEDOUT && cache->slab &&
+                    slab_fragmentation(cache->slab) > cache->defrag_threshold) {
+                cache->defragging = true;
+            }
+            continue;
+        }
+
+        cache_dynamic_resize(cache, cache->max_load_factor);
+        cache_maybe_shrink(cache);
+        cache_sync_filter(cache);
+
+        // evict one batch, then let waiting callers in before the next one
+        for (uint32_t i = 0; i < MAINTENANCE_BATCH && cache->evicting; ++i) {
+            if (cache->memused <= cache->low_mark || cache->num_elements == 0) {
+                cache->evicting = false;
+                break;
+            }
+            cache_evict_one(cache);
+        }
+
+        // then a batch of defrag moves; the nodes moved from are freed
+        // with the rest of the garbage, which releases emptied pages
+        if (cache->defragging && cache_defrag_batch(cache, &cache->defrag_cursor)) {
+            cache->defragging = false;
+        }
+
+        bool trim = cache->trim && !cache->evicting;
+        if (trim) {
+            cache->trim = false;
+        }
+        node_t *garbage = cache_collect(cache);
+        pthread_mutex_unlock(&cache->lock);
+        uint64_t freed = free_garbage(garbage);
+        if (trim) {
+            malloc_trim(0);
+        }
+        pthread_mutex_lock(&cache->lock);
+        cache->garbage_pending -= freed;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return NULL;
+}
+
+void cache_config_init(struct cache_config *config, uint64_t maxmem)
+{
+    config->maxmem = maxmem;
+    config->engine = CACHE_ENGINE_CHAINED;
+    config->eviction = CACHE_EVICT_LRU;
+    config->eviction_samples = 5;
+    config->maintenance_thread = false;
+    config->high_watermark = 0.9;
+    config->low_watermark = 0.75;
+    config->maintenance_interval_ms = 100;
+    config->expected_items = 0;
+    config->min_load_factor = DEFAULT_MIN_LOAD_FACTOR;
+    config->max_load_factor = DEFAULT_MAX_LOAD_FACTOR;
+    config->rehash_threads = 0;
+    config->near_cache_entries = 0;
+    config->near_cache_max_val_size = 256;
+    config->membership_filter = false;
+    config->filter_fpr = 0.01;
+    config->pages = CACHE_PAGES_DEFAULT;
+    config->numa_node = -1;
+    config->hash = NULL;
+    config->slab_allocator = false;
+    config->defrag_threshold = 0.2;
+    config->miss_ratio_curve = false;
+    config->mrc_sample_rate = 0.01;
+    config->mrc_max_keys = 8192;
+}
+
+static void ns_init(cache_t cache, struct cache_ns *ns, uint64_t expected_items)
+{
+    if (cache->eviction == CACHE_EVICT_LRU) {
+        ns->evict = evict_create_borrowed(cache->num_buckets); // keys live in the nodes
+    } else if (cache->eviction == CACHE_EVICT_GDSF) {
+        ns->gdsf = gdsf_create(expected_items);
+    } else {
+        ns->pool = calloc(EVICTION_POOL_SIZE, sizeof(struct evict_candidate));
+        assert(ns->pool && "memory");
+    }
+}
+
+static void ns_destroy(struct cache_ns *ns)
+{
+    if (ns->evict) {
+        evict_destroy(ns->evict);
+        free(ns->evict);
+    }
+    if (ns->gdsf) {
+        gdsf_destroy(ns->gdsf);
+    }
+    for (uint32_t i = 0; i < ns->pool_size; ++i) {
+        free(ns->pool[i].key);
+    }
+    free(ns->pool);
+    free(ns->members);
+    free(ns->prefix);
+}
+
+static enum page_size page_size_for(enum cache_pages pages)
+{
+    switch (pages) {
+    case CACHE_PAGES_HUGE_2MB:
+        return PAGES_HUGE_2MB;
+    case CACHE_PAGES_HUGE_1GB:
+        return PAGES_HUGE_1GB;
+    default:
+        return PAGES_DEFAULT;
+    }
+}
+
+cache_t create_cache_with_config(const struct cache_config *config)
+{
+    assert(config->low_watermark <= config->high_watermark && "watermarks");
+    assert(config->min_load_factor * 4 <= config->max_load_factor &&
+            "min_load_factor must be well below max_load_factor or the table will thrash");
+    cache_t c = calloc(1, sizeof(struct cache_obj));
+    assert(c && "memory");
+
+    c->memused = 0;
+    c->maxmem = config->maxmem;
+    c->min_load_factor = config->min_load_factor;
+    c->max_load_factor = config->max_load_factor;
+    c->rehash_threads = config->rehash_threads ? config->rehash_threads : parallel_cpus();
+
+    // size for the expected number of items up front, so warming the
+    // cache up doesn't go through a series of rehashes
+    c->engine = config->engine;
+    c->num_buckets = DEFAULT_NUM_BUCKETS;
+    if (config->expected_items > 0) {
+        c->num_buckets = buckets_for(c, config->expected_items);
+    }
+    c->pages.size = page_size_for(config->pages);
+    c->pages.numa_node = config->numa_node;
+    if (c->engine == CACHE_ENGINE_CUCKOO) {
+        c->cuckoo = cuckoo_create_with_pages(config->expected_items, &c->pages);
+    } else if (c->engine == CACHE_ENGINE_ART) {
+        c->art = art_create();
+        c->scan_cursors = calloc(SCAN_CURSORS, sizeof(struct scan_cursor));
+        assert(c->scan_cursors && "memory");
+    } else {
+        c->buckets = new_buckets(c, c->num_buckets);
+    }
+
+    c->hash = config->hash ? config->hash : modified_jenkins;
+    c->eviction = config->eviction;
+    if (c->eviction == CACHE_EVICT_SAMPLED) {
+        assert(config->eviction_samples > 0 && "sampled eviction needs samples");
+        c->samples = config->eviction_samples;
+        c->rng = 0x9e3779b97f4a7c15ULL ^ (uintptr_t) c;
+    }
+    ns_init(c, &c->namespaces[CACHE_DEFAULT_NAMESPACE], config->expected_items);
+    atomic_init(&c->num_namespaces, 1);
+    c->id = atomic_fetch_add(&next_cache_id, 1);
+    c->near_entries = config->near_cache_entries;
+    c->near_max_val_size = config->near_cache_max_val_size;
+    if (c->near_entries > 0) {
+        c->stamps = calloc(NEAR_STRIPES, sizeof(*c->stamps));
+        assert(c->stamps && "memory");
+    }
+    if (config->slab_allocator) {
+        c->slab = slab_create();
+        c->defrag_threshold = config->defrag_threshold;
+    }
+    if (config->miss_ratio_curve) {
+        c->mrc = mrc_create(config->mrc_sample_rate, config->mrc_max_keys);
+    }
+    c->tags = tags_create();
+    c->readers = epoch_create();
+    c->filter_fpr = config->filter_fpr;
+    if (config->membership_filter) {
+        atomic_init(&c->filter, bloom_create(filter_target_capacity(c), c->filter_fpr));
+    }
+    pthread_mutex_init(&c->lock, NULL);
+
+    c->has_maintenance = config->maintenance_thread;
+    c->high_watermark = config->high_watermark;
+    c->low_watermark = config->low_watermark;
+    if (c->has_maintenance) {
+        c->high_mark = (uint64_t) (c->high_watermark * c->maxmem);
+        c->low_mark = (uint64_t) (c->low_watermark * c->maxmem);
+        c->interval_ms = config->maintenance_interval_ms;
+        pthread_cond_init(&c->wake, NULL);
+        int rc = pthread_create(&c->maintenance, NULL, maintenance_loop, c);
+        assert(rc == 0 && "could not start maintenance thread");
+    }
+    return c;
+}
+
+cache_t create_cache(uint64_t maxmem)
+{
+    struct cache_config config;
+    cache_config_init(&config, maxmem);
+    return create_cache_with_config(&config);
+}
+
+void cache_set(cache_t cache, key_type key, val_type val, uint32_t val_size)
+{
+    cache_set_with_cost(cache, key, val, val_size, 1.0);
+}
+
+static void cache_write_done(cache_t cache)
+{
+    // housekeeping after a write, still under the lock
+    cache_sync_filter(cache);
+    if (!cache->has_maintenance) {
+        cache_reclaim(cache);
+    }
+
+    if (cache->has_maintenance && maintenance_has_work(cache)) {
+        pthread_cond_signal(&cache->wake);
+    }
+}
+
+static void policy_replace(cache_t cache, node_t *old, node_t *node)
+{
+    // node, an edited copy of old, took its place (see splice_locked); like
+    // an edit in place that counts as a read of the key
+    if (old->ns != node->ns) {
+        // old was set before its key's namespace was created
+        policy_delete(cache, old);
+        policy_set(cache, node);
+    } else if (cache->eviction == CACHE_EVICT_SAMPLED) {
+        node->atime = __atomic_add_fetch(&cache->lru_clock, 1, __ATOMIC_RELAXED);
+        ns_move_member(node_ns(cache, node), old, node);
+    } else if (cache->eviction == CACHE_EVICT_GDSF) {
+        gdsf_replace(node_ns(cache, node)->gdsf, old, node);
+    } else {
+        evict_get(node_ns(cache, node)->evict, node->key); // and now points at node's key
+    }
+}
+
+static void cache_insert_node_locked(cache_t cache, node_t *node)
+{
+    // put a new node in the cache, replacing the key's old value if any
+    key_type key = node->key;
+    node->version = ++cache->next_version;
+
+    // will resize cache if load factor is exceeded. The maintenance thread,
+    // if any, normally gets to it first.
+    TRACE_BEGIN(TRACE_RESIZE);
+    cache_dynamic_resize(cache, cache->has_maintenance ?
+            HARD_LOAD_MULTIPLE * cache->max_load_factor : cache->max_load_factor);
+    TRACE_END(TRACE_RESIZE);
+
+    TRACE_BEGIN(TRACE_HASH);
+    node->hash = cache->hash(key);
+    TRACE_END(TRACE_HASH);
+
+    node->ns = key_namespace(cache, key);
+    struct cache_ns *ns = node_ns(cache, node);
+    node->generation = ns->generation;
+    ++ns->sets;
+    if (cache->mrc) {
+        mrc_write(cache->mrc, node->hash, node->val_size);
+    }
+
+    // An overwrite is a fresh set on every engine: the old node leaves the
+    // accounting and the eviction order before anything is evicted, and
+    // the new one joins them after, as if the key were new (so GDSF's read
+    // count starts over). The old node stays in the table until the new
+    // one takes its place, so lock-free cuckoo readers find one or the
+    // other; sampled eviction, which checks its candidates through the
+    // table, is told to pass it over.
+    bloom_t filter = atomic_load(&cache->filter);
+    if (filter) {
+        bloom_add(filter, node->hash); // before lock-free readers can see the node
+    }
+    node_t *old = table_find(cache, key, node->hash);
+    if (old) {
+        cache_unaccount_node(cache, old);
+        policy_delete(cache, old);
+        cache->replacing = old;
+    }
+
+    // eviction, if necessary
+    cache->memused += node->val_size;
+    ns->memused += node->val_size;
+    TRACE_BEGIN(TRACE_EVICT);
+    cache_evict_to_fit(cache, ns);
+    TRACE_END(TRACE_EVICT);
+    cache->replacing = NULL;
+
+    // insert the key, value into cache
+    if (old) {
+        table_replace(cache, old, node);
+        cache_retire_node(cache, old);
+    } else {
+        table_insert(cache, node);
+    }
+    cache_invalidate_near(cache, node->hash);
+    TRACE_BEGIN(TRACE_POLICY);
+    policy_set(cache, node);
+    TRACE_END(TRACE_POLICY);
+    ++cache->num_elements;
+    ++ns->num_elements;
+
+    cache_write_done(cache);
+}
+
+static void cache_insert_node(cache_t cache, node_t *node)
+{
+    pthread_mutex_lock(&cache->lock);
+    cache_insert_node_locked(cache, node);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+static node_t *node_for_value(cache_t cache, key_type key, val_type val, uint32_t val_size)
+{
+    // copy the value into a new node; big ones go into chunks, and the
+    // slab, if any, takes everything that fits in a slot
+    if (val_size > CACHE_CHUNK_THRESHOLD) {
+        chunks_t chunks = chunks_create();
+        chunks_append(chunks, val, val_size);
+        return new_chunked_node(key, chunks);
+    }
+    node_t *node = cache->slab ? new_slab_node(cache->slab, key, val, val_size) : NULL;
+    return node ? node : new_node(key, val, val_size);
+}
+
+void cache_set_with_cost(cache_t cache, key_type key, val_type val, uint32_t val_size,
+        double cost)
+{
+    TRACE_OP();
+    TRACE_BEGIN(TRACE_SET);
+    if (debug) {
+        uint64_t hash = cache_hash(cache, key);
+        printf("setting key = %" PRIu8 "\n", *key);
+        printf("hash = %" PRIu64 "\n", hash);
+        printf("value = %" PRIu8 "\n\n", *(uint8_t *)val);
+    }
+
+    // copy the value before taking the lock
+    node_t *node = node_for_value(cache, key, val, val_size);
+    node->cost = cost;
+    cache_insert_node(cache, node);
+    TRACE_END(TRACE_SET);
+}
+
+void cache_set_tagged(cache_t cache, key_type key, val_type val, uint32_t val_size,
+        const char *const *tags, uint32_t num_tags)
+{
+    TRACE_OP();
+    TRACE_BEGIN(TRACE_SET);
+    node_t *node = node_for_value(cache, key, val, val_size);
+    node->cost = 1.0;
+    pthread_mutex_lock(&cache->lock);
+    // tagged before it is in the table, so that if the insert evicts the
+    // node itself, that untags it like any other
+    tags_add(cache->tags, node, tags, num_tags);
+    cache_insert_node_locked(cache, node);
+    pthread_mutex_unlock(&cache->lock);
+    TRACE_END(TRACE_SET);
+}
+
+struct bulk_load
+{
+    cache_t cache;
+    const struct cache_entry *entries;
+    uint64_t n;
+    node_t **nodes; // nodes[i] holds entries[i]
+    node_t **replaced; // the node with the same key nodes[i] unlinked, if any
+    uint64_t *order; // entry indexes grouped by part, in entry order within a part
+    uint64_t *starts; // part p is order[starts[p]] up to order[starts[p + 1]]
+};
+
+static void bulk_build(uint32_t part, uint32_t parts, void *arg)
+{
+    // make and hash the nodes for a slice of the entries
+    struct bulk_load *load = arg;
+    for (uint64_t i = load->n * part / parts; i < load->n * (part + 1) / parts; ++i) {
+        const struct cache_entry *e = &load->entries[i];
+        node_t *node = node_for_value(load->cache, e->key, e->val, e->val_size);
+        node->cost = 1.0;
+        node->hash = load->cache->hash(e->key);
+        load->nodes[i] = node;
+    }
+}
+
+static uint32_t bulk_part(cache_t cache, uint64_t hash, uint32_t parts)
+{
+    // parts own consecutive runs of buckets
+    return (uint32_t) ((hash & (cache->num_buckets - 1)) * parts / cache->num_buckets);
+}
+
+static void bulk_link(uint32_t part, uint32_t parts, void *arg)
+{
+    // link a part's nodes into its own buckets, which no other part
+    // touches, dropping any node with the same key already there
+    (void) parts;
+    struct bulk_load *load = arg;
+    cache_t cache = load->cache;
+    for (uint64_t k = load->starts[part]; k < load->starts[part + 1]; ++k) {
+        uint64_t i = load->order[k];
+        node_t *node = load->nodes[i];
+        hash_bucket *bucket = &cache->buckets[node->hash & (cache->num_buckets - 1)];
+        load->replaced[i] = ll_unlink_key(bucket, node->key);
+        ll_push_node(bucket, node);
+    }
+}
+
+static void bulk_link_chained(cache_t cache, struct bulk_load *load, uint32_t threads)
+{
+    // size the table once for everything, then link in parallel
+    uint64_t wanted = buckets_for(cache, cache->num_elements + load->n);
+    if (wanted > cache->num_buckets) {
+        cache_rehash(cache, wanted);
+    }
+    uint32_t parts = threads < cache->num_buckets ? threads : (uint32_t) cache->num_buckets;
+
+    // counting sort of the entries by part, keeping their order
+    load->starts = calloc(parts + 1, sizeof(uint64_t));
+    uint64_t *fill = calloc(parts, sizeof(uint64_t));
+    load->order = malloc(load->n * sizeof(uint64_t));
+    load->replaced = malloc(load->n * sizeof(node_t *));
+    assert(load->starts && fill && load->order && load->replaced && "memory");
+    for (uint64_t i = 0; i < load->n; ++i) {
+        ++load->starts[bulk_part(cache, load->nodes[i]->hash, parts) + 1];
+    }
+    for (uint32_t p = 0; p < parts; ++p) {
+        load->starts[p + 1] += load->starts[p];
+        fill[p] = load->starts[p];
+    }
+    for (uint64_t i = 0; i < load->n; ++i) {
+        load->order[fill[bulk_part(cache, load->nodes[i]->hash, parts)]++] = i;
+    }
+    free(fill);
+    parallel_run(parts, bulk_link, load);
+
+    // the bookkeeping is shared, so it goes in entry order on this thread.
+    // A node replaced by a later entry of the load has been accounted for
+    // by then, just like one that was in the cache before.
+    bloom_t filter = atomic_load(&cache->filter);
+    for (uint64_t i = 0; i < load->n; ++i) {
+        node_t *node = load->nodes[i];
+        if (load->replaced[i]) {
+            cache_forget_node(cache, load->replaced[i]);
+        }
+        node->version = ++cache->next_version;
+        node->ns = key_namespace(cache, node->key);
+        struct cache_ns *ns = node_ns(cache, node);
+        node->generation = ns->generation;
+        ++ns->sets;
+        if (cache->mrc) {
+            mrc_write(cache->mrc, node->hash, node->val_size);
+        }
+        ++ns->num_elements;
+        ns->memused += node->val_size;
+        ++cache->num_elements;
+        cache->memused += node->val_size;
+        if (filter) {
+            bloom_add(filter, node->hash);
+        }
+        cache_invalidate_near(cache, node->hash);
+        policy_set(cache, node);
+    }
+    free(load->starts);
+    free(load->order);
+    free(load->replaced);
+}
+
+void cache_bulk_load(cache_t cache, const struct cache_entry *entries, uint64_t n, uint32_t threads)
+{
+    if (n == 0) {
+        return;
+    }
+    if (threads == 0) {
+        threads = parallel_cpus();
+    }
+    if (threads > n / BULK_ENTRIES_PER_THREAD) {
+        threads = n / BULK_ENTRIES_PER_THREAD > 0 ? (uint32_t) (n / BULK_ENTRIES_PER_THREAD) : 1;
+    }
+    struct bulk_load load = {cache, entries, n, NULL, NULL, NULL, NULL};
+    load.nodes = malloc(n * sizeof(node_t *));
+    assert(load.nodes && "memory");
+    parallel_run(threads, bulk_build, &load);
+
+    pthread_mutex_lock(&cache->lock);
+    if (cache->engine == CACHE_ENGINE_CHAINED) {
+        bulk_link_chained(cache, &load, threads);
+        uint32_t num_namespaces = atomic_load(&cache->num_namespaces);
+        for (uint32_t i = 0; i < num_namespaces; ++i) {
+            cache_evict_to_fit(cache, &cache->namespaces[i]);
+        }
+        cache_write_done(cache);
+    } else {
+        // the cuckoo table and the tree take one node at a time
+        for (uint64_t i = 0; i < n; ++i) {
+            cache_insert_node_locked(cache, load.nodes[i]);
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+    free(load.nodes);
+}
+
+struct cache_writer_obj
+{
+    cache_t cache;
+    uint8_t *key;
+    chunks_t chunks;
+};
+
+cache_writer_t cache_write_begin(cache_t cache, key_type key)
+{
+    cache_writer_t writer = calloc(1, sizeof(struct cache_writer_obj));
+    assert(writer && "memory");
+    writer->cache = cache;
+    writer->key = calloc(strlen((const char*) key) + 1, sizeof(uint8_t));
+    assert(writer->key && "memory");
+    strcpy((char*) writer->key, (const char*) key);
+    writer->chunks = chunks_create();
+    return writer;
+}
+
+void cache_write_append(cache_writer_t writer, const void *buf, uint64_t len)
+{
+    chunks_append(writer->chunks, buf, len);
+}
+
+void cache_write_commit(cache_writer_t writer)
+{
+    node_t *node = new_chunked_node(writer->key, writer->chunks);
+    node->cost = 1.0;
+    cache_insert_node(writer->cache, node);
+    free(writer->key);
+    free(writer);
+}
+
+void cache_write_abort(cache_writer_t writer)
+{
+    chunks_destroy(writer->chunks);
+    free(writer->key);
+    free(writer);
+}
+
+static void lock_free_read_done(cache_t cache, epoch_reader_t reader, key_type key,
+        uint64_t hash, node_t *node)
+{
+    // end of a lock-free read of node (NULL on a miss): note the access
+    // and stop counting as a reader
+    if (node && cache->eviction == CACHE_EVICT_SAMPLED) {
+        // just a store into the node, no lock needed
+        __atomic_store_n(&node->atime, __atomic_load_n(&cache->lru_clock, __ATOMIC_RELAXED),
+                __ATOMIC_RELAXED);
+    }
+    epoch_exit(reader);
+
+    // LRU and GDSF bookkeeping needs the lock. Skip it when the lock is
+    // busy rather than wait: recency is approximate under contention. The
+    // node may be gone by now, so only touch the policy if it is still in
+    // the table.
+    if (node && cache->eviction != CACHE_EVICT_SAMPLED &&
+            pthread_mutex_trylock(&cache->lock) == 0) {
+        TRACE_BEGIN(TRACE_POLICY);
+        if (cuckoo_find(cache->cuckoo, key, hash) == node) {
+            policy_get(cache, node);
+        }
+        TRACE_END(TRACE_POLICY);
+        pthread_mutex_unlock(&cache->lock);
+    }
+}
+
+static uint64_t read_node(node_t *node, uint64_t offset, void *buf, uint64_t len)
+{
+    if (node->chunked) {
+        return chunks_read((chunks_t) node->val, offset, buf, len);
+    }
+    if (offset >= node->val_size) {
+        return 0;
+    }
+    if (len > node->val_size - offset) {
+        len = node->val_size - offset;
+    }
+    memcpy(buf, (const uint8_t *) node->val + offset, len);
+    return len;
+}
+
+bool cache_read(cache_t cache, key_type key, uint64_t offset, void *buf, uint64_t len,
+        uint64_t *copied, uint64_t *val_size)
+{
+    // like cache_get, but only copies the part asked for. Chunks are never
+    // changed once written, so the lock-free path can read them too.
+    uint64_t hash = cache->hash(key);
+    node_t *node;
+    if (cache->engine == CACHE_ENGINE_CUCKOO) {
+        epoch_reader_t reader = epoch_enter(cache->readers);
+        node = cuckoo_find(cache->cuckoo, key, hash);
+        if (node && node_flushed(cache, node)) {
+            node = NULL;
+        }
+        if (node) {
+            *copied = read_node(node, offset, buf, len);
+            *val_size = node->val_size;
+        }
+        count_lookup(cache, key, hash, node);
+        lock_free_read_done(cache, reader, key, hash, node);
+    } else {
+        pthread_mutex_lock(&cache->lock);
+        node = live_find(cache, key, hash);
+        if (node) {
+            *copied = read_node(node, offset, buf, len);
+            *val_size = node->val_size;
+            policy_get(cache, node);
+        }
+        count_lookup(cache, key, hash, node);
+        pthread_mutex_unlock(&cache->lock);
+    }
+    return node != NULL;
+}
+
+static void append_range(chunks_t chunks, node_t *node, uint64_t from, uint64_t to)
+{
+    // append bytes [from, to) of node's value to chunks
+    if (!node->chunked) {
+        chunks_append(chunks, (const uint8_t *) node->val + from, to - from);
+        return;
+    }
+    uint8_t *piece = malloc(CHUNK_SIZE);
+    assert(piece && "memory");
+    while (from < to) {
+        uint64_t n = read_node(node, from, piece, to - from < CHUNK_SIZE ? to - from : CHUNK_SIZE);
+        chunks_append(chunks, piece, n);
+        from += n;
+    }
+    free(piece);
+}
+
+static node_t *spliced_copy(cache_t cache, node_t *node, uint64_t offset, uint64_t cut,
+        const void *buf, uint64_t len)
+{
+    // a new node for the same key whose value is node's with bytes
+    // [offset, offset + cut) replaced by buf
+    uint64_t new_size = node->val_size - cut + len;
+    node_t *copy;
+    if (new_size > CACHE_CHUNK_THRESHOLD) {
+        chunks_t chunks = chunks_create();
+        append_range(chunks, node, 0, offset);
+        chunks_append(chunks, buf, len);
+        append_range(chunks, node, offset + cut, node->val_size);
+        copy = new_chunked_node(node->key, chunks);
+    } else {
+        uint8_t *val = malloc(new_size ? new_size : 1);
+        assert(val && "memory");
+        read_node(node, 0, val, offset);
+        memcpy(val + offset, buf, len);
+        read_node(node, offset + cut, val + offset + len, node->val_size - offset - cut);
+        copy = cache->slab ? new_slab_node(cache->slab, node->key, val, (uint32_t) new_size) : NULL;
+        if (copy) {
+            free(val);
+        } else {
+            copy = new_node_owning(node->key, val, new_size);
+        }
+    }
+    copy->hash = node->hash;
+    copy->cost = node->cost;
+    copy->ns = node->ns;
+    copy->generation = node->generation;
+    return copy;
+}
+
+static void splice_locked(cache_t cache, node_t *node, uint64_t offset, uint64_t cut,
+        const void *buf, uint64_t len)
+{
+    // replace bytes [offset, offset + cut) of node's value with len bytes
+    // of buf, then account for the change in size
+    uint64_t old_size = node->val_size;
+    uint64_t new_size = old_size - cut + len;
+    if (cache->engine != CACHE_ENGINE_CUCKOO && !node->chunked && !node->slab &&
+            new_size <= CACHE_CHUNK_THRESHOLD) {
+        // every reader holds the lock, so change the value where it is
+        uint8_t *val = (uint8_t *) node->val;
+        uint64_t tail = old_size - offset - cut;
+        if (new_size > old_size) {
+            val = realloc(val, new_size);
+            assert(val && "memory");
+        }
+        memmove(val + offset + len, val + offset + cut, tail);
+        memcpy(val + offset, buf, len);
+        if (new_size < old_size && new_size > 0) {
+            val = realloc(val, new_size);
+            assert(val && "memory");
+        }
+        node->val = val;
+        node->val_size = new_size;
+        node->version = ++cache->next_version;
+        policy_get(cache, node);
+    } else {
+        // lock-free readers may be copying the old value, it's chunked and
+        // chunks are never changed, or it shares a slab slot with its
+        // node: write a new node and swap it in
+        node_t *copy = spliced_copy(cache, node, offset, cut, buf, len);
+        copy->version = ++cache->next_version;
+        table_replace(cache, node, copy);
+        policy_replace(cache, node, copy);
+        tags_move(cache->tags, node, copy);
+        cache_retire_node(cache, node);
+        node = copy;
+    }
+    cache_invalidate_near(cache, node->hash);
+    if (cache->mrc) {
+        mrc_write(cache->mrc, node->hash, new_size);
+    }
+
+    struct cache_ns *ns = node_ns(cache, node);
+    ns->memused = ns->memused - old_size + new_size;
+    cache->memused = cache->memused - old_size + new_size;
+    cache_evict_to_fit(cache, ns); // may evict this very node
+    cache_write_done(cache);
+}
+
+bool cache_append(cache_t cache, key_type key, const void *buf, uint64_t len)
+{
+    pthread_mutex_lock(&cache->lock);
+    node_t *node = live_find(cache, key, cache->hash(key));
+    if (node) {
+        splice_locked(cache, node, node->val_size, 0, buf, len);
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return node != NULL;
+}
+
+bool cache_prepend(cache_t cache, key_type key, const void *buf, uint64_t len)
+{
+    pthread_mutex_lock(&cache->lock);
+    node_t *node = live_find(cache, key, cache->hash(key));
+    if (node) {
+        splice_locked(cache, node, 0, 0, buf, len);
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return node != NULL;
+}
+
+bool cache_overwrite(cache_t cache, key_type key, uint64_t offset, const void *buf, uint64_t len)
+{
+    pthread_mutex_lock(&cache->lock);
+    node_t *node = live_find(cache, key, cache->hash(key));
+    bool ok = node && offset <= node->val_size;
+    if (ok) {
+        uint64_t cut = node->val_size - offset < len ? node->val_size - offset : len;
+        splice_locked(cache, node, offset, cut, buf, len);
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return ok;
+}
+
+static bool parse_number(node_t *node, uint64_t *number)
+{
+    // an unsigned decimal number with no sign, spaces or terminator
+    char digits[20];
+    if (node->val_size == 0 || node->val_size > sizeof(digits)) {
+        return false;
+    }
+    read_node(node, 0, digits, node->val_size);
+    uint64_t n = 0;
+    for (uint64_t i = 0; i < node->val_size; ++i) {
+        if (digits[i] < '0' || digits[i] > '9') {
+            return false;
+        }
+        uint64_t d = digits[i] - '0';
+        if (n > (UINT64_MAX - d) / 10) {
+            return false;
+        }
+        n = n * 10 + d;
+    }
+    *number = n;
+    return true;
+}
+
+static bool cache_add(cache_t cache, key_type key, uint64_t delta, bool subtract, uint64_t *result)
+{
+    pthread_mutex_lock(&cache->lock);
+    node_t *node = live_find(cache, key, cache->hash(key));
+    uint64_t n;
+    bool ok = node && parse_number(node, &n);
+    if (ok) {
+        if (subtract) {
+            n = n > delta ? n - delta : 0;
+        } else {
+            n += delta;
+        }
+        char digits[21];
+        int len = snprintf(digits, sizeof(digits), "%" PRIu64, n);
+        splice_locked(cache, node, 0, node->val_size, digits, len);
+        *result = n;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return ok;
+}
+
+bool cache_incr(cache_t cache, key_type key, uint64_t delta, uint64_t *result)
+{
+    return cache_add(cache, key, delta, false, result);
+}
+
+bool cache_decr(cache_t cache, key_type key, uint64_t delta, uint64_t *result)
+{
+    return cache_add(cache, key, delta, true, result);
+}
+
+static val_type cache_get_lock_free(cache_t cache, key_type key, uint32_t *val_size,
+        uint64_t *version)
+{
+    // the node can't be freed while we are counted as a reader
+    TRACE_BEGIN(TRACE_HASH);
+    uint64_t hash = cache->hash(key);
+    TRACE_END(TRACE_HASH);
+    epoch_reader_t reader = epoch_enter(cache->readers);
+    node_t *node = NULL;
+    TRACE_BEGIN(TRACE_LOOKUP);
+    if (!filter_says_absent(cache, hash)) {
+        node = cuckoo_find(cache->cuckoo, key, hash);
+        if (node == NULL) {
+            filter_count_miss(cache);
+        } else if (node_flushed(cache, node)) {
+            node = NULL;
+        }
+    }
+    TRACE_END(TRACE_LOOKUP);
+    count_lookup(cache, key, hash, node);
+    void *res = NULL;
+    if (node) {
+        res = copy_value(node, val_size);
+        if (version) {
+            *version = node->version; // cuckoo nodes never change once published
+        }
+    }
+    lock_free_read_done(cache, reader, key, hash, node);
+    return res;
+}
+
+static val_type cache_get_main(cache_t cache, key_type key, uint32_t *val_size,
+        uint64_t *version)
+{
+    if (cache->engine == CACHE_ENGINE_CUCKOO) {
+        return cache_get_lock_free(cache, key, val_size, version);
+    }
+
+    TRACE_BEGIN(TRACE_HASH);
+    uint64_t hash = cache->hash(key);
+    TRACE_END(TRACE_HASH);
+
+    // a miss the filter rules out never takes the lock. Counting as a
+    // reader keeps a filter replaced meanwhile from being freed under us.
+    if (atomic_load_explicit(&cache->filter, memory_order_relaxed)) {
+        epoch_reader_t reader = epoch_enter(cache->readers);
+        bool absent = filter_says_absent(cache, hash);
+        epoch_exit(reader);
+        if (absent) {
+            count_lookup(cache, key, hash, NULL);
+            return NULL;
+        }
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    TRACE_BEGIN(TRACE_LOOKUP);
+    node_t *node = table_find(cache, key, hash);
+    if (node == NULL) {
+        filter_count_miss(cache);
+    } else if (node_flushed(cache, node)) {
+        node = NULL;
+    }
+    TRACE_END(TRACE_LOOKUP);
+    count_lookup(cache, key, hash, node);
+    void *res = NULL;
+    if (node != NULL) {
+        res = copy_value(node, val_size);
+        if (version) {
+            *version = node->version;
+        }
+        TRACE_BEGIN(TRACE_POLICY);
+        policy_get(cache, node);
+        TRACE_END(TRACE_POLICY);
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return res;
+}
+
+static val_type cache_get_near(cache_t cache, key_type key, uint32_t *val_size)
+{
+    if (debug) {
+        printf("getting key = %" PRIu8 "\n", *key);
+        printf("hash = %" PRIu64 "\n\n", cache->hash(key));
+    }
+
+    if (cache->near_entries == 0) {
+        return cache_get_main(cache, key, val_size, NULL);
+    }
+
+    // the stamp has to be read before the main cache is, so that a write
+    // racing with this lookup leaves the near cache copy stale
+    uint64_t hash = cache->hash(key);
+    near_t near = thread_near(cache, true);
+    uint64_t stamp = atomic_load(near_stamp(cache, hash));
+    bool refresh;
+    void *res = near_get(near, key, hash, stamp, val_size, &refresh);
+    if (res && !refresh) {
+        if (cache->mrc) {
+            mrc_read(cache->mrc, hash, *val_size);
+        }
+        return res;
+    }
+    free(res);
+
+    res = (void *) cache_get_main(cache, key, val_size, NULL);
+    if (res) {
+        near_offer(near, key, hash, stamp, res, *val_size);
+    }
+    return res;
+}
+
+val_type cache_get(cache_t cache, key_type key, uint32_t *val_size)
+{
+    TRACE_OP();
+    TRACE_BEGIN(TRACE_GET);
+    val_type res = cache_get_near(cache, key, val_size);
+    TRACE_END(TRACE_GET);
+    return res;
+}
+
+val_type cache_get_versioned(cache_t cache, key_type key, uint32_t *val_size, uint64_t *version)
+{
+    // skips the near cache, which doesn't keep versions
+    return cache_get_main(cache, key, val_size, version);
+}
+
+bool cache_version(cache_t cache, key_type key, uint64_t *version)
+{
+    uint64_t hash = cache->hash(key);
+    node_t *node;
+    if (cache->engine == CACHE_ENGINE_CUCKOO) {
+        epoch_reader_t reader = epoch_enter(cache->readers);
+        node = cuckoo_find(cache->cuckoo, key, hash);
+        if (node && node_flushed(cache, node)) {
+            node = NULL;
+        }
+        if (node) {
+            *version = node->version;
+        }
+        epoch_exit(reader);
+    } else {
+        pthread_mutex_lock(&cache->lock);
+        node = live_find(cache, key, hash);
+        if (node) {
+            *version = node->version;
+        }
+        pthread_mutex_unlock(&cache->lock);
+    }
+    return node != NULL;
+}
+
+enum cache_cas_result cache_cas(cache_t cache, key_type key, val_type val, uint32_t val_size,
+        uint64_t expected_version)
+{
+    node_t *node = node_for_value(cache, key, val, val_size);
+    node->cost = 1.0;
+
+    pthread_mutex_lock(&cache->lock);
+    node_t *cur = live_find(cache, key, cache->hash(key));
+    enum cache_cas_result result = CACHE_CAS_OK;
+    if (cur == NULL && expected_version != 0) {
+        result = CACHE_CAS_MISSING;
+    } else if (cur != NULL && cur->version != expected_version) {
+        result = CACHE_CAS_CHANGED;
+    } else {
+        cache_insert_node_locked(cache, node);
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    if (result != CACHE_CAS_OK) {
+        free_node(node);
+    }
+    return result;
+}
+
+static void cache_delete_done(cache_t cache)
+{
+    // housekeeping after deletes, still under the lock
+    if (!cache->has_maintenance) {
+        cache_maybe_shrink(cache);
+        cache_sync_filter(cache);
+        cache_reclaim(cache);
+    } else if (cache_should_shrink(cache)) {
+        pthread_cond_signal(&cache->wake);
+    }
+}
+
+void cache_delete(cache_t cache, key_type key) 
+{
+    TRACE_OP();
+    TRACE_BEGIN(TRACE_DELETE);
+    pthread_mutex_lock(&cache->lock);
+    cache_delete_locked(cache, key);
+    if (cache->mrc) {
+        mrc_delete(cache->mrc, cache->hash(key)); // unlike an eviction, a bigger cache loses it too
+    }
+    cache_delete_done(cache);
+    pthread_mutex_unlock(&cache->lock);
+    TRACE_END(TRACE_DELETE);
+}
+
+static bool key_gone(key_type key, void *arg)
+{
+    cache_t cache = arg;
+    return table_find(cache, key, cache->hash(key)) == NULL;
+}
+
+uint64_t cache_invalidate_tag(cache_t cache, const char *tag)
+{
+    // Every node with the tag is unlinked first, so that each LRU queue
+    // it touches is then cleaned in one pass, instead of one pass per key
+    // as cache_delete would take. The other policies drop a node in
+    // O(log n) or less anyway.
+    TRACE_OP();
+    TRACE_BEGIN(TRACE_DELETE);
+    pthread_mutex_lock(&cache->lock);
+    node_t **nodes;
+    uint64_t n = tags_nodes(cache->tags, tag, &nodes);
+    uint64_t lru_namespaces = 0; // a bit each
+    for (uint64_t i = 0; i < n; ++i) {
+        node_t *node = nodes[i];
+        node_t *unlinked = table_unlink(cache, node->key, node->hash);
+        assert(unlinked == node && "tagged node was not in the table");
+        if (cache->mrc) {
+            mrc_delete(cache->mrc, node->hash);
+        }
+        cache_unaccount_node(cache, node);
+        if (cache->eviction == CACHE_EVICT_LRU) {
+            lru_namespaces |= 1ull << node->ns;
+        } else {
+            policy_delete(cache, node);
+        }
+    }
+    for (uint32_t i = 0; lru_namespaces; ++i, lru_namespaces >>= 1) {
+        if (lru_namespaces & 1) {
+            evict_delete_if(cache->namespaces[i].evict, key_gone, cache);
+        }
+    }
+    for (uint64_t i = 0; i < n; ++i) {
+        cache_retire_node(cache, nodes[i]);
+    }
+    free(nodes);
+    cache_delete_done(cache);
+    pthread_mutex_unlock(&cache->lock);
+    TRACE_END(TRACE_DELETE);
+    return n;
+}
+
+uint64_t cache_tag_count(cache_t cache, const char *tag)
+{
+    pthread_mutex_lock(&cache->lock);
+    uint64_t n = tags_count(cache->tags, tag);
+    pthread_mutex_unlock(&cache->lock);
+    return n;
+}
+
+struct scan_item
+{
+    key_type key;
+    void *val;
+    uint32_t val_size;
+};
+
+struct scan_batch
+{
+    struct scan_item *items;
+    uint32_t size;
+    uint32_t capacity;
+};
+
+static void scan_batch_add(cache_t cache, struct scan_batch *batch, node_t *node)
+{
+    if (node_flushed(cache, node)) {
+        return;
+    }
+    if (batch->size == batch->capacity) {
+        batch->capacity = batch->capacity ? 2 * batch->capacity : 16;
+        batch->items = realloc(batch->items, batch->capacity * sizeof(struct scan_item));
+        assert(batch->items && "memory");
+    }
+    struct scan_item *item = &batch->items[batch->size++];
+    item->key = calloc(strlen((const char*) node->key) + 1, sizeof(uint8_t));
+    strcpy((char*) item->key, (const char*) node->key);
+    item->val = copy_value(node, &item->val_size);
+}
+
+static void scan_batch_run(struct scan_batch *batch, cache_scan_fn fn, void *arg)
+{
+    // hand the copied entries to fn, without the lock
+    for (uint32_t i = 0; i < batch->size; ++i) {
+        fn(batch->items[i].key, batch->items[i].val, batch->items[i].val_size, arg);
+        free((void *) batch->items[i].key);
+        free(batch->items[i].val);
+    }
+    free(batch->items);
+}
+
+struct scan_add
+{
+    cache_t cache;
+    struct scan_batch *batch;
+};
+
+static void scan_add_cb(node_t *node, void *arg)
+{
+    struct scan_add *add = arg;
+    scan_batch_add(add->cache, add->batch, node);
+}
+
+struct rank_scan
+{
+    cache_t cache;
+    struct scan_batch *batch;
+    uint64_t left;
+    node_t *last;
+};
+
+static bool rank_scan_cb(node_t *node, void *arg)
+{
+    struct rank_scan *scan = arg;
+    scan_batch_add(scan->cache, scan->batch, node);
+    scan->last = node; // flushed entries count, but aren't handed out
+    return --scan->left > 0;
+}
+
+static uint64_t art_scan_locked(cache_t cache, uint64_t first, uint64_t n, uint64_t cursor,
+        uint32_t count, struct scan_batch *batch)
+{
+    // Walk the n keys from rank first in key order. A cursor names the
+    // slot holding a copy of the last key it walked, and the walk goes on
+    // from the first key after that one, however many keys have come or
+    // gone before it since. A walk keeps its slot from call to call; new
+    // walks take the slots in turn, so a walk left idle while SCAN_CURSORS
+    // others start finds its slot gone and starts over, seeing keys again
+    // but missing none.
+    struct scan_cursor *slot = &cache->scan_cursors[cursor % SCAN_CURSORS];
+    uint64_t start = first;
+    if (cursor != 0 && slot->id == cursor && slot->key) {
+        start = art_rank(cache->art, slot->key) + (art_find(cache->art, slot->key) != NULL);
+        start = start > first ? start : first;
+    } else {
+        slot = &cache->scan_cursors[cache->next_scan_cursor++ % SCAN_CURSORS];
+    }
+
+    struct rank_scan scan = {cache, batch, count ? count : 1, NULL};
+    if (start < first + n) {
+        if (scan.left > first + n - start) {
+            scan.left = first + n - start;
+        }
+        uint64_t wanted = scan.left;
+        art_walk(cache->art, start, rank_scan_cb, &scan);
+        start += wanted - scan.left;
+    }
+    free(slot->key);
+    slot->key = NULL;
+    if (start >= first + n || scan.last == NULL) {
+        return 0;
+    }
+    slot->key = calloc(strlen((const char*) scan.last->key) + 1, sizeof(uint8_t));
+    assert(slot->key && "memory");
+    strcpy((char*) slot->key, (const char*) scan.last->key);
+    // ids of a slot go up by SCAN_CURSORS, so an old cursor for it is stale
+    slot->id = (slot->id ? slot->id : (uint64_t) (slot - cache->scan_cursors)) + SCAN_CURSORS;
+    return slot->id;
+}
+
+static uint64_t reverse_bits(uint64_t v)
+{
+    v = ((v >> 1) & 0x5555555555555555ULL) | ((v & 0x5555555555555555ULL) << 1);
+    v = ((v >> 2) & 0x3333333333333333ULL) | ((v & 0x3333333333333333ULL) << 2);
+    v = ((v >> 4) & 0x0f0f0f0f0f0f0f0fULL) | ((v & 0x0f0f0f0f0f0f0f0fULL) << 4);
+    v = ((v >> 8) & 0x00ff00ff00ff00ffULL) | ((v & 0x00ff00ff00ff00ffULL) << 8);
+    v = ((v >> 16) & 0x0000ffff0000ffffULL) | ((v & 0x0000ffff0000ffffULL) << 16);
+    return (v >> 32) | (v << 32);
+}
+
+uint64_t cache_scan(cache_t cache, uint64_t cursor, uint32_t count,
+        cache_scan_fn fn, void *arg)
+{
+    // The cursor counts through bucket indexes with its bits reversed, i.e.
+    // it increments from the high bit of the mask down. When the table
+    // doubles, bucket i splits into i and i + num_buckets, which both come
+    // after the already visited cursors; when it halves, the buckets merge
+    // into ones we'd visit anyway. So no bucket of a table of any size is
+    // skipped (http://redis.io/commands/scan).
+    // The cuckoo engine moves nodes between their two buckets on inserts,
+    // but never out of their block, and its blocks split the same way. So
+    // there the cursor counts through blocks, and a block is always
+    // visited in one go.
+    struct scan_batch batch = {NULL, 0, 0};
+    pthread_mutex_lock(&cache->lock);
+    if (cache->engine == CACHE_ENGINE_ART) {
+        cursor = art_scan_locked(cache, 0, cache->num_elements, cursor, count, &batch);
+        pthread_mutex_unlock(&cache->lock);
+        scan_batch_run(&batch, fn, arg);
+        return cursor;
+    }
+    uint64_t num_buckets = cache->num_buckets;
+    uint64_t step = 1; // buckets per cursor position
+    if (cache->engine == CACHE_ENGINE_CUCKOO) {
+        num_buckets = cuckoo_block_count(cache->cuckoo);
+        step = cuckoo_bucket_count(cache->cuckoo) / num_buckets;
+    }
+    uint64_t mask = num_buckets - 1;
+    uint64_t max_visits = (uint64_t) count * SCAN_BUCKETS_PER_ENTRY;
+    if (max_visits == 0) {
+        max_visits = 1;
+    }
+
+    for (uint64_t visits = 0; visits < max_visits; visits += step) {
+        uint64_t bucket = cursor & mask;
+        if (cache->engine == CACHE_ENGINE_CUCKOO) {
+            struct scan_add add = {cache, &batch};
+            cuckoo_block_foreach(cache->cuckoo, bucket, scan_add_cb, &add);
+        } else {
+            for (node_t *cur = cache->buckets[bucket].head; cur; cur = cur->next) {
+                scan_batch_add(cache, &batch, cur);
+            }
+        }
+
+        // increment the reversed cursor
+        cursor |= ~mask;
+        cursor = reverse_bits(cursor);
+        ++cursor;
+        cursor = reverse_bits(cursor);
+
+        if (cursor == 0 || batch.size >= count) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+    scan_batch_run(&batch, fn, arg);
+    return cursor;
+}
+
+uint64_t cache_scan_prefix(cache_t cache, key_type prefix, uint64_t cursor, uint32_t count,
+        cache_scan_fn fn, void *arg)
+{
+    assert(cache->engine == CACHE_ENGINE_ART && "prefix scans need CACHE_ENGINE_ART");
+    struct scan_batch batch = {NULL, 0, 0};
+    pthread_mutex_lock(&cache->lock);
+    uint64_t first;
+    uint64_t n = art_prefix_range(cache->art, prefix, strlen((const char*) prefix), &first);
+    cursor = art_scan_locked(cache, first, n, cursor, count, &batch);
+    pthread_mutex_unlock(&cache->lock);
+    scan_batch_run(&batch, fn, arg);
+    return cursor;
+}
+
+uint64_t cache_near_hits(cache_t cache)
+{
+    near_t near = thread_near(cache, false);
+    return near ? near_hits(near) : 0;
+}
+
+void cache_filter_stats(cache_t cache, struct cache_filter_stats *stats)
+{
+    pthread_mutex_lock(&cache->lock);
+    memset(stats, 0, sizeof(*stats));
+    bloom_t filter = atomic_load(&cache->filter);
+    if (filter) {
+        stats->negatives = atomic_load(&cache->filter_negatives);
+        stats->false_positives = atomic_load(&cache->filter_false_positives);
+        stats->estimated_fpr = bloom_estimated_fpr(filter, cache->num_elements);
+        uint64_t absent = stats->negatives + stats->false_positives;
+        stats->observed_fpr = absent ? (double) stats->false_positives / absent : 0;
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void cache_rehash_stats(cache_t cache, uint64_t *rehashes, uint64_t *parts)
+{
+    pthread_mutex_lock(&cache->lock);
+    *rehashes = cache->rehashes;
+    *parts = cache->rehash_parts;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+uint64_t cache_garbage_count(cache_t cache)
+{
+    pthread_mutex_lock(&cache->lock);
+    uint64_t count = cache->garbage_pending;
+    pthread_mutex_unlock(&cache->lock);
+    return count;
+}
+
+uint64_t cache_bucket_count(cache_t cache)
+{
+    pthread_mutex_lock(&cache->lock);
+    uint64_t num_buckets = cache->num_buckets;
+    if (cache->engine == CACHE_ENGINE_CUCKOO) {
+        num_buckets = cuckoo_bucket_count(cache->cuckoo);
+    } else if (cache->engine == CACHE_ENGINE_ART) {
+        num_buckets = 0;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return num_buckets;
+}
+
+int cache_numa_node(cache_t cache)
+{
+    return cache->pages.numa_node;
+}
+
+void cache_set_maxmem(cache_t cache, uint64_t maxmem)
+{
+    pthread_mutex_lock(&cache->lock);
+    cache->maxmem = maxmem;
+    cache->high_mark = (uint64_t) (cache->high_watermark * maxmem);
+    cache->low_mark = (uint64_t) (cache->low_watermark * maxmem);
+    uint64_t limit = cache->has_maintenance ? cache->high_mark : maxmem;
+    if (cache->memused <= limit) {
+        pthread_mutex_unlock(&cache->lock);
+        return;
+    }
+
+    if (cache->has_maintenance) {
+        // the thread evicts down to the new low mark, then trims
+        cache->evicting = true;
+        cache->trim = true;
+        pthread_cond_signal(&cache->wake);
+        pthread_mutex_unlock(&cache->lock);
+        return;
+    }
+
+    // evict a batch at a time, letting waiting callers in between
+    while (cache->memused > cache->maxmem && cache->num_elements > 0) {
+        for (uint32_t i = 0; i < MAINTENANCE_BATCH && cache->memused > cache->maxmem; ++i) {
+            cache_evict_one(cache);
+        }
+        pthread_mutex_unlock(&cache->lock);
+        pthread_mutex_lock(&cache->lock);
+    }
+    cache_write_done(cache);
+    pthread_mutex_unlock(&cache->lock);
+    malloc_trim(0);
+}
+
+uint64_t cache_maxmem(cache_t cache)
+{
+    pthread_mutex_lock(&cache->lock);
+    uint64_t maxmem = cache->maxmem;
+    pthread_mutex_unlock(&cache->lock);
+    return maxmem;
+}
+
+uint32_t cache_namespace_create(cache_t cache, const char *prefix, uint64_t quota, bool hard)
+{
+    size_t len = strlen(prefix);
+    assert(len > 0 && "a namespace needs a prefix");
+    pthread_mutex_lock(&cache->lock);
+    uint32_t n = atomic_load(&cache->num_namespaces);
+    assert(n < CACHE_MAX_NAMESPACES && "too many namespaces");
+    for (uint32_t i = 1; i < n; ++i) {
+        struct cache_ns *other = &cache->namespaces[i];
+        assert(strncmp(prefix, other->prefix, len < other->prefix_len ? len : other->prefix_len) != 0 &&
+                "namespace prefixes overlap");
+    }
+
+    struct cache_ns *ns = &cache->namespaces[n];
+    ns->prefix = calloc(len + 1, sizeof(char));
+    assert(ns->prefix && "memory");
+    strcpy(ns->prefix, prefix);
+    ns->prefix_len = len;
+    ns->quota = quota;
+    ns->hard = hard;
+    ns_init(cache, ns, 0);
+    atomic_store_explicit(&cache->num_namespaces, n + 1, memory_order_release);
+    pthread_mutex_unlock(&cache->lock);
+    return n;
+}
+
+void cache_namespace_flush(cache_t cache, uint32_t ns_id)
+{
+    pthread_mutex_lock(&cache->lock);
+    assert(ns_id < atomic_load(&cache->num_namespaces) && "no such namespace");
+    struct cache_ns *ns = &cache->namespaces[ns_id];
+    atomic_fetch_add_explicit(&ns->generation, 1, memory_order_release);
+    ns->flushed_elements = ns->num_elements;
+    ++ns->flushes;
+    if (cache->stamps) {
+        // near caches may hold copies of any of the keys
+        for (uint32_t i = 0; i < NEAR_STRIPES; ++i) {
+            atomic_fetch_add(&cache->stamps[i], 1);
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void cache_namespace_stats(cache_t cache, uint32_t ns_id, struct cache_namespace_stats *stats)
+{
+    pthread_mutex_lock(&cache->lock);
+    assert(ns_id < atomic_load(&cache->num_namespaces) && "no such namespace");
+    struct cache_ns *ns = &cache->namespaces[ns_id];
+    stats->quota = ns->quota;
+    stats->memused = ns->memused;
+    stats->items = ns->num_elements;
+    stats->flushed_items = ns->flushed_elements;
+    stats->hits = atomic_load_explicit(&ns->hits, memory_order_relaxed);
+    stats->misses = atomic_load_explicit(&ns->misses, memory_order_relaxed);
+    stats->sets = ns->sets;
+    stats->evictions = ns->evictions;
+    stats->flushes = ns->flushes;
+    stats->sampled = ns->sampled;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+uint64_t cache_defrag(cache_t cache)
+{
+    if (cache->slab == NULL) {
+        return 0;
+    }
+    pthread_mutex_lock(&cache->lock);
+    uint64_t moved = cache->defrag_moved;
+    // drive the same pass as the maintenance thread, so a pass it has
+    // under way is finished rather than planned again over the top of it,
+    // a batch at a time, letting waiting callers (and the thread) in
+    // between; whichever of us gets to the end of the table ends the pass
+    uint64_t passes = cache->defrag_passes;
+    cache->defragging = true;
+    while (cache->defrag_passes == passes) {
+        if (cache_defrag_batch(cache, &cache->defrag_cursor)) {
+            cache->defragging = false;
+        } else {
+            pthread_mutex_unlock(&cache->lock);
+            pthread_mutex_lock(&cache->lock);
+        }
+    }
+    moved = cache->defrag_moved - moved;
+    cache_write_done(cache);
+    pthread_mutex_unlock(&cache->lock);
+    return moved;
+}
+
+void cache_defrag_stats(cache_t cache, struct cache_defrag_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (cache->slab == NULL) {
+        return;
+    }
+    struct slab_stats slab;
+    slab_get_stats(cache->slab, &slab);
+    stats->pages = slab.pages;
+    stats->free_pages = slab.free_pages;
+    stats->used_bytes = slab.used_bytes;
+    stats->slack_bytes = slab.slack_bytes;
+    uint64_t in_use = slab.pages - slab.free_pages;
+    stats->fragmentation = in_use ? (double) slab.slack_bytes / ((double) in_use * SLAB_PAGE_SIZE) : 0;
+    pthread_mutex_lock(&cache->lock);
+    stats->passes = cache->defrag_passes;
+    stats->moved = cache->defrag_moved;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+uint64_t cache_miss_ratio_curve(cache_t cache, const uint64_t *sizes, double *miss_ratios,
+        uint32_t n)
+{
+    if (cache->mrc == NULL) {
+        for (uint32_t i = 0; i < n; ++i) {
+            miss_ratios[i] = 1;
+        }
+        return 0;
+    }
+    return mrc_curve(cache->mrc, sizes, miss_ratios, n);
+}
+
+uint64_t cache_space_used(cache_t cache)
+{
+    pthread_mutex_lock(&cache->lock);
+    uint64_t memused = cache->memused;
+    pthread_mutex_unlock(&cache->lock);
+    return memused;
+}
+
+static void free_node_cb(node_t *node, void *arg)
+{
+    (void) arg;
+    free_node(node);
+}
+
+static void rep_node_cb(node_t *node, void *arg)
+{
+    (void) arg;
+    rep_node(node);
+}
+
+void destroy_cache(cache_t cache)
+{
+    if (cache->has_maintenance) {
+        pthread_mutex_lock(&cache->lock);
+        cache->stopping = true;
+        pthread_cond_signal(&cache->wake);
+        pthread_mutex_unlock(&cache->lock);
+        pthread_join(cache->maintenance, NULL);
+        pthread_cond_destroy(&cache->wake);
+    }
+    pthread_mutex_destroy(&cache->lock);
+    drop_thread_near(cache);
+    free(cache->stamps);
+    if (atomic_load(&cache->filter)) {
+        bloom_destroy(atomic_load(&cache->filter));
+    }
+    if (cache->retired_filter) {
+        bloom_destroy(cache->retired_filter);
+    }
+    free_garbage(cache->garbage);
+    free_garbage(cache->garbage_before);
+    cache->garbage = NULL;
+    cache->garbage_before = NULL;
+    epoch_destroy(cache->readers);
+
+    if (cache->engine == CACHE_ENGINE_CUCKOO) {
+        cuckoo_foreach(cache->cuckoo, free_node_cb, NULL);
+        cuckoo_destroy(cache->cuckoo);
+        cache->cuckoo = NULL;
+    } else if (cache->engine == CACHE_ENGINE_ART) {
+        art_foreach(cache->art, free_node_cb, NULL);
+        art_destroy(cache->art);
+        cache->art = NULL;
+        for (uint32_t i = 0; i < SCAN_CURSORS; ++i) {
+            free(cache->scan_cursors[i].key);
+        }
+        free(cache->scan_cursors);
+    } else {
+        for (uint64_t i = 0; i < cache->num_buckets; i++) {
+            ll_clear(&cache->buckets[i]);
+        }
+    }
+
+    uint32_t num_namespaces = atomic_load(&cache->num_namespaces);
+    for (uint32_t i = 0; i < num_namespaces; ++i) {
+        ns_destroy(&cache->namespaces[i]);
+    }
+    pages_free(cache->buckets);
+    cache->buckets = NULL;
+    if (cache->slab) {
+        slab_destroy(cache->slab); // after the nodes in it are gone
+    }
+    if (cache->mrc) {
+        mrc_destroy(cache->mrc);
+    }
+    tags_destroy(cache->tags);
+    free(cache);
+    cache = NULL;
+}
+
+void print_cache(cache_t cache)
+{
+    if (cache->engine != CACHE_ENGINE_CHAINED) {
+        table_foreach(cache, rep_node_cb, NULL);
+        return;
+    }
+    for (uint64_t i = 0; i < cache->num_buckets; ++i) {
+        if (ll_size(&cache->buckets[i]) > 0){
+            printf("hash=%" PRIu64 " has dbll: \n", i);
+            rep_list(&cache->buckets[i]);
         }
     }
 }
@@ -1,6 +1,11 @@
 #pragma once 
 
 #include <inttypes.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 struct cache_obj;
 typedef struct cache_obj *cache_t;
@@ -11,25 +16,418 @@ typedef const void *val_type;
 // For a given key string, return a pseudo-random integer:
 typedef uint64_t (*hash_func)(key_type key);
 
+// How the hash table is laid out
+enum cache_engine
+{
+    // buckets of doubly linked lists (the default)
+    CACHE_ENGINE_CHAINED,
+    // bucketized cuckoo hashing, see cuckoo.h: every lookup reads at most
+    // two buckets, and cache_get does not take the cache lock
+    CACHE_ENGINE_CUCKOO,
+    // an adaptive radix tree, see art.h: prefixes shared by many keys are
+    // stored once in the index, there is no hash table to size or resize,
+    // and keys are kept in order, so cache_scan_prefix works. Reads take
+    // the lock like the chained engine.
+    CACHE_ENGINE_ART,
+};
+
+// How the cache picks what to evict
+enum cache_eviction
+{
+    // exact LRU through the evict.h queue (the default)
+    CACHE_EVICT_LRU,
+    // approximate LRU without a queue to keep in order: every entry keeps
+    // a coarse access clock, and eviction samples eviction_samples random
+    // entries of the namespace it evicts from (each namespace has an
+    // array of its entries) and evicts the least recently used, keeping a
+    // few of the best candidates around between rounds
+    CACHE_EVICT_SAMPLED,
+    // GreedyDual-Size-Frequency: evicts the entry with the least
+    // cost * reads / val_size first, aging entries that are not read
+    // again (see gdsf.h). Costs come from cache_set_with_cost.
+    CACHE_EVICT_GDSF,
+};
+
+// What backs the bucket arrays of the hash engines, see pages.h
+enum cache_pages
+{
+    CACHE_PAGES_DEFAULT, // normal pages (the default)
+    CACHE_PAGES_HUGE_2MB,
+    CACHE_PAGES_HUGE_1GB,
+};
+
+// Optional settings for create_cache_with_config.
+// Always fill in with cache_config_init first, then override fields.
+struct cache_config
+{
+    uint64_t maxmem;
+    enum cache_engine engine;
+    enum cache_eviction eviction;
+    uint32_t eviction_samples; // entries looked at per eviction, for CACHE_EVICT_SAMPLED
+
+    // Run eviction, resizing and frees on a background maintenance thread.
+    // Once memused crosses high_watermark * maxmem the thread evicts down to
+    // low_watermark * maxmem, so cache_set only evicts inline when a single
+    // insert would exceed maxmem before the thread catches up.
+    bool maintenance_thread;
+    float high_watermark;
+    float low_watermark;
+    uint32_t maintenance_interval_ms; // how often the thread wakes up on its own
+
+    // Number of items the cache is expected to hold (0 if unknown). The
+    // bucket array is sized for it up front instead of growing during warmup.
+    uint64_t expected_items;
+
+    // The table grows when num_elements / num_buckets exceeds
+    // max_load_factor and shrinks after deletes once it drops below
+    // min_load_factor. Either way it is resized to half of max_load_factor.
+    // (CACHE_ENGINE_CHAINED only; the cuckoo engine grows on its own.)
+    float min_load_factor;
+    float max_load_factor;
+
+    // Threads that share the rehash when a big chained table resizes (0 for
+    // one per CPU, 1 to always rehash on the calling thread). Each takes a
+    // run of buckets and relinks the nodes in it; small tables are always
+    // rehashed on the calling thread.
+    uint32_t rehash_threads;
+
+    // Give each thread that reads from the cache a near cache (see near.h)
+    // of this many entries holding copies of hot values up to
+    // near_cache_max_val_size bytes. Writes from any thread invalidate
+    // them. 0 turns near caches off. Near cache copies don't count
+    // towards maxmem.
+    uint32_t near_cache_entries;
+    uint32_t near_cache_max_val_size;
+
+    // Keep a counting bloom filter of the keys in the cache and check it
+    // before the table (and the lock), so most misses never look at a
+    // bucket or wait for a writer. It is
+    // resized along with the table, aiming for filter_fpr false positives.
+    bool membership_filter;
+    double filter_fpr;
+
+    // Back the bucket arrays of the hash engines with huge pages, and/or
+    // prefer a NUMA node for them (-1 for anywhere), see pages.h. Both
+    // fall back to normal pages when the host can't do it. Entries, on
+    // the heap or on slab pages, get neither.
+    enum cache_pages pages;
+    int numa_node;
+
+    // Hash for keys, NULL for the built-in one (a modified Jenkins
+    // one-at-a-time hash of the key's bytes). The chained and cuckoo
+    // engines use the low bits for the bucket.
+    hash_func hash;
+    // Allocate each entry that fits (node, key and value together, up to
+    // SLAB_MAX_SIZE bytes, see slab.h) from a slab allocator rather than
+    // malloc, so the cache can defragment its memory: entries on sparsely
+    // used pages are moved to fuller ones, and emptied pages go back to
+    // the kernel. The maintenance thread, if any, makes a pass on its own
+    // after an idle interval in which free slots were more than
+    // defrag_threshold of the slab memory in use; otherwise see
+    // cache_defrag.
+    bool slab_allocator;
+    float defrag_threshold;
+    // Estimate the miss ratio cache_get would have with an LRU cache of
+    // any size, from the traffic the cache sees (see mrc.h and
+    // cache_miss_ratio_curve). Keys are sampled by hash at
+    // mrc_sample_rate, and at most mrc_max_keys of them are tracked; past
+    // that the rate comes down on its own.
+    bool miss_ratio_curve;
+    double mrc_sample_rate;
+    uint32_t mrc_max_keys;
+};
+
+// How the membership filter has been doing, see cache_filter_stats
+struct cache_filter_stats
+{
+    uint64_t negatives; // lookups the filter answered on its own
+    uint64_t false_positives; // lookups the filter let through that missed
+    double estimated_fpr; // expected rate for the current number of keys
+    double observed_fpr; // false_positives / (false_positives + negatives)
+};
+
+// How the slab allocator is doing, see cache_defrag_stats
+struct cache_defrag_stats
+{
+    uint64_t pages; // slab pages mapped
+    uint64_t free_pages; // of those, emptied and given back to the kernel
+    uint64_t used_bytes; // slots holding entries
+    uint64_t slack_bytes; // free slots on the pages in use, past a page's worth per size class
+    double fragmentation; // slack_bytes over the size of the pages in use
+    uint64_t passes; // defrag passes over the whole table
+    uint64_t moved; // entries moved to fuller pages
+};
+
+// Namespaces split one cache between tenants by key prefix, see
+// cache_namespace_create. Namespace 0 holds every key outside the others.
+#define CACHE_MAX_NAMESPACES 64
+#define CACHE_DEFAULT_NAMESPACE 0
+
+// What a namespace holds and how it has been used, see cache_namespace_stats
+struct cache_namespace_stats
+{
+    uint64_t quota;
+    uint64_t memused; // value bytes, including flushed entries not yet evicted
+    uint64_t items; // including flushed entries not yet evicted
+    uint64_t flushed_items; // flushed but still taking up memory
+    uint64_t hits; // cache_get and cache_read lookups, not near cache hits
+    uint64_t misses;
+    uint64_t sets;
+    uint64_t evictions;
+    uint64_t flushes;
+    uint64_t sampled; // candidates drawn by CACHE_EVICT_SAMPLED evictions
+};
+
+// One key and value for cache_bulk_load
+struct cache_entry
+{
+    key_type key;
+    val_type val;
+    uint32_t val_size;
+};
+
+// Fill config with the defaults used by create_cache(maxmem).
+void cache_config_init(struct cache_config *config, uint64_t maxmem);
+
 // Create a new cache object with a given maximum memory capacity.
 cache_t create_cache(uint64_t maxmem);
 
+// Create a new cache object from a config (see struct cache_config).
+cache_t create_cache_with_config(const struct cache_config *config);
+
 // Add a <key, value> pair to the cache.
-// If key already exists, it will overwrite the old value.
+// If key already exists, it will overwrite the old value. On every engine
+// and eviction policy an overwrite counts as a new entry, not a read of the
+// old one (GDSF's frequency starts over, for one).
 // If maxmem capacity is exceeded, sufficient values will be removed
 // from the cache to accomodate the new value.
 void cache_set(cache_t cache, key_type key, val_type val, uint32_t val_size);
 
+// Same as cache_set, with a hint of what the value costs to recompute (in
+// any unit, e.g. milliseconds). Only CACHE_EVICT_GDSF looks at the cost;
+// cache_set uses a cost of 1.
+void cache_set_with_cost(cache_t cache, key_type key, val_type val, uint32_t val_size,
+        double cost);
+
+// Set like cache_set, and tag the entry with each of tags[0..num_tags)
+// (strings, e.g. the upstream objects the value was derived from) so
+// cache_invalidate_tag can drop it. Tags go with the value: overwriting
+// the key replaces them (a plain cache_set leaves it untagged), while
+// appends, increments and other updates of the value in place keep them.
+void cache_set_tagged(cache_t cache, key_type key, val_type val, uint32_t val_size,
+        const char *const *tags, uint32_t num_tags);
+
 // Retrieve the value associated with key in the cache, or NULL if not found.
 // The size of the returned buffer will be assigned to *val_size.
+// Values of 4GB or more are only readable with cache_read.
 val_type cache_get(cache_t cache, key_type key, uint32_t *val_size);
 
+// Every write to a key (set, in-place update, cas) gives it a new 64 bit
+// version, never 0 and never reused within a cache. Reading the version
+// along with a value and passing it back to cache_cas makes an optimistic
+// read-modify-write: the write only goes through if nobody else wrote the
+// key in between.
+
+// cache_get that also fills in *version. It doesn't use the near cache.
+val_type cache_get_versioned(cache_t cache, key_type key, uint32_t *val_size, uint64_t *version);
+
+// Set *version to key's current version without copying the value, or
+// return false if key isn't in the cache. Doesn't count as a use.
+bool cache_version(cache_t cache, key_type key, uint64_t *version);
+
+enum cache_cas_result
+{
+    CACHE_CAS_OK, // stored
+    CACHE_CAS_CHANGED, // key was written since expected_version
+    CACHE_CAS_MISSING, // key isn't in the cache (any more)
+};
+
+// cache_set, but only if key is still at expected_version. An
+// expected_version of 0 means only if key isn't in the cache.
+enum cache_cas_result cache_cas(cache_t cache, key_type key, val_type val, uint32_t val_size,
+        uint64_t expected_version);
+
+// Values bigger than this are stored in CHUNK_SIZE chunks (see chunks.h)
+// rather than one contiguous buffer.
+#define CACHE_CHUNK_THRESHOLD (256 * 1024)
+
+// Streams a value into the cache a piece at a time, without ever holding
+// all of it in one buffer. Nothing is visible until cache_write_commit,
+// which replaces the key's old value like cache_set. Values written this
+// way are always chunked and may be larger than 4GB.
+typedef struct cache_writer_obj *cache_writer_t;
+
+cache_writer_t cache_write_begin(cache_t cache, key_type key);
+
+// add len bytes to the end of the value
+void cache_write_append(cache_writer_t writer, const void *buf, uint64_t len);
+
+// store the value and free the writer
+void cache_write_commit(cache_writer_t writer);
+
+// drop the value and free the writer
+void cache_write_abort(cache_writer_t writer);
+
+// Copy up to len bytes of key's value starting at offset into buf.
+// Returns false if key isn't in the cache; otherwise sets *copied to the
+// number of bytes copied and *val_size to the size of the whole value.
+// Only the bytes asked for are copied.
+bool cache_read(cache_t cache, key_type key, uint64_t offset, void *buf, uint64_t len,
+        uint64_t *copied, uint64_t *val_size);
+
+// Change a value inside the cache instead of getting, changing and setting
+// it. The value is edited where it is when possible and otherwise
+// replaced with one new copy; either way it counts as a use of the key
+// for eviction, memused follows the new size, and the cache evicts if the
+// value grew past maxmem. Each returns false if key isn't in the cache.
+
+// add len bytes to the end of key's value
+bool cache_append(cache_t cache, key_type key, const void *buf, uint64_t len);
+
+// add len bytes to the start of key's value
+bool cache_prepend(cache_t cache, key_type key, const void *buf, uint64_t len);
+
+// write len bytes over key's value starting at offset, growing it if they
+// run past the end. Also returns false if offset is past the end.
+bool cache_overwrite(cache_t cache, key_type key, uint64_t offset, const void *buf, uint64_t len);
+
+// Treat key's value as an unsigned decimal number in ASCII, like
+// memcached does, add or subtract delta and store the result back as
+// digits. incr wraps around at 2^64 and decr stops at 0. The new number
+// goes in *result. Also returns false if the value isn't such a number.
+bool cache_incr(cache_t cache, key_type key, uint64_t delta, uint64_t *result);
+bool cache_decr(cache_t cache, key_type key, uint64_t delta, uint64_t *result);
+
+// cache_set every entry, in order (so of two entries with the same key the
+// later one wins), for warming a cache up from a dump. The nodes are built
+// and hashed on threads threads (0 for one per CPU) without the lock. Only
+// CACHE_ENGINE_CHAINED links them in parallel: the table is sized once for
+// all of them, the buckets are split between the threads, which link the
+// nodes in side by side, and eviction runs once at the end. The cuckoo and
+// ART engines insert the built nodes one at a time, as cache_set would.
+// Either way a load bigger than maxmem keeps its last entries, as a series
+// of sets would.
+// The cache lock is held from the first node linked in to the end, so
+// other callers see none of the load or all of it, except lock-free
+// cuckoo readers, which may see it partway.
+void cache_bulk_load(cache_t cache, const struct cache_entry *entries, uint64_t n, uint32_t threads);
+
 // Delete an object from the cache, if it's still there
 void cache_delete(cache_t cache, key_type key);
 
+// Called by cache_scan for each entry. key and val are only valid during
+// the call. The cache is not locked, so fn may call back into the cache.
+typedef void (*cache_scan_fn)(key_type key, val_type val, uint32_t val_size, void *arg);
+
+// Walk the cache a few buckets at a time, Redis SCAN style. Start with
+// cursor 0 and pass each returned cursor back in; a return of 0 means the
+// walk is done. Each call visits buckets until it has found at least
+// count entries, holding the lock only for that batch.
+// Every key that is in the cache for the whole walk is seen at least once,
+// even if the table grows or shrinks in between calls (though some keys
+// may be seen more than once). The cuckoo engine walks a block of
+// CUCKOO_BLOCK_BUCKETS buckets at a time (see cuckoo.h), so a call there
+// may hand out more than count entries.
+uint64_t cache_scan(cache_t cache, uint64_t cursor, uint32_t count,
+        cache_scan_fn fn, void *arg);
+
+// Change maxmem (and with it the maintenance watermarks) at runtime. If
+// the cache is now over budget it evicts down to it, a batch at a time
+// (or leaves that to the maintenance thread), then hands the freed memory
+// back to the OS with malloc_trim. See memctl.h for a controller that
+// calls this as the host runs low on memory.
+void cache_set_maxmem(cache_t cache, uint64_t maxmem);
+
+uint64_t cache_maxmem(cache_t cache);
+
+// cache_scan over just the keys that start with prefix, in byte order of
+// the keys; needs CACHE_ENGINE_ART. The cursor stands for the last key
+// the walk got to, so each call finds its place after that key in one walk
+// down the tree, and keys inserted or deleted in between don't move it.
+// On CACHE_ENGINE_ART, cache_scan goes in key order the same way. The
+// cache remembers where the last 1024 walks got to; a walk left idle while
+// that many others start begins again, seeing keys twice but missing none.
+uint64_t cache_scan_prefix(cache_t cache, key_type prefix, uint64_t cursor, uint32_t count,
+        cache_scan_fn fn, void *arg);
+
+// Make every key starting with prefix (which must not overlap another
+// namespace's) a namespace with its own eviction order, memory quota and
+// stats, and return its number. Keys set before stay where they were.
+// Lookups don't change: all namespaces share the one table.
+// With hard, the namespace never holds more than quota bytes and evicts
+// its own entries to stay under. Otherwise it may borrow memory the rest
+// of the cache isn't using, and when the cache is full the namespace
+// furthest over its quota is evicted from first. The default namespace
+// has a quota of 0, so it gives up memory before any namespace under its
+// quota does.
+uint32_t cache_namespace_create(cache_t cache, const char *prefix, uint64_t quota, bool hard);
+
+// Drop every key in the namespace, in O(1): its generation goes up, and
+// entries of an older one are misses from then on. They still count
+// towards memused until they are overwritten, deleted or evicted, and
+// they are evicted before anything else.
+void cache_namespace_flush(cache_t cache, uint32_t ns);
+
+void cache_namespace_stats(cache_t cache, uint32_t ns, struct cache_namespace_stats *stats);
+
+// Make one defrag pass over the table (see slab_allocator), a batch of
+// entries per lock hold, and return the number of entries moved. Moving
+// one copies it to a fuller slab page and swaps the copy in; it keeps its
+// version and its place in the eviction order. If the maintenance thread
+// has a pass under way, this finishes that pass (the two share it) rather
+// than starting another. Does nothing without slab_allocator.
+uint64_t cache_defrag(cache_t cache);
+
+// Fill in stats for the slab allocator (all zero if there is none)
+void cache_defrag_stats(cache_t cache, struct cache_defrag_stats *stats);
+
+// Fill in miss_ratios[i] with the estimated miss ratio of cache_get for
+// an LRU cache of sizes[i] bytes of values, and return the number of
+// sampled gets the estimate rests on. Recent traffic weighs the most.
+// Returns 0 and fills in 1s without miss_ratio_curve.
+uint64_t cache_miss_ratio_curve(cache_t cache, const uint64_t *sizes, double *miss_ratios,
+        uint32_t n);
+
+// Delete every entry tagged with tag by cache_set_tagged, under one hold
+// of the lock, and return how many there were. A secondary index finds
+// them in O(entries dropped), not a scan of the cache. Taking them out of
+// the eviction order is O(1) each for sampled eviction and O(log n) for
+// GDSF, but under LRU it takes one pass over the queue of each namespace
+// they were in, since the queue can't unlink a key in place.
+uint64_t cache_invalidate_tag(cache_t cache, const char *tag);
+
+// Number of entries in the cache tagged with tag
+uint64_t cache_tag_count(cache_t cache, const char *tag);
+
 // Compute the total amount of memory used up by all cache values (not keys)
 uint64_t cache_space_used(cache_t cache);
 
-// Destroy all resource connected to a cache object
+// Number of cache_get calls from the calling thread that were answered by
+// its near cache
+uint64_t cache_near_hits(cache_t cache);
+
+// Fill in stats for the membership filter (all zero if there is none)
+void cache_filter_stats(cache_t cache, struct cache_filter_stats *stats);
+
+// Number of buckets currently in the hash table (0 for CACHE_ENGINE_ART)
+uint64_t cache_bucket_count(cache_t cache);
+
+// Number of times the chained table has been rehashed, and the number of
+// parts (one per thread) those rehashes were split into, all told
+void cache_rehash_stats(cache_t cache, uint64_t *rehashes, uint64_t *parts);
+
+// Number of deleted or replaced entries not freed yet, because lock-free
+// readers may still be using them or the maintenance thread hasn't got to
+// them
+uint64_t cache_garbage_count(cache_t cache);
+
+// NUMA node the cache's table was placed on (see numa_node), or -1
+int cache_numa_node(cache_t cache);
+
+// Destroy all resource connected to a cache object.
+// Stops the maintenance thread, if there is one.
 void destroy_cache(cache_t cache);
 
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,209 @@
+/*
+ * cache_cpp_tests.cpp: tests for hash_it_out.hpp, built by make cpp_tests
+ *
+ */
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <string_view>
+
+#include "hash_it_out.hpp"
+
+#define my_assert(value, string) \
+{if (!(value)) { printf("!!!FAILURE!!! %s\n", string);}}
+
+// every operator new in the program, to check what allocates
+static uint64_t allocations = 0;
+
+void *operator new(size_t size)
+{
+    ++allocations;
+    void *p = malloc(size ? size : 1);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+namespace
+{
+
+struct point
+{
+    int32_t x, y;
+};
+
+enum class color : int8_t { red = -1, green, blue };
+
+// a deliberately weak hash, to check a custom Hash is what gets called
+struct mod_hash
+{
+    static inline uint64_t calls = 0;
+
+    uint64_t operator()(const uint32_t &key) const
+    {
+        ++calls;
+        return key % 1024;
+    }
+};
+
+// custom string hashes, one on the string and one on a view of it
+struct string_hash
+{
+    uint64_t operator()(const std::string &key) const
+    {
+        return std::hash<std::string>{}(key);
+    }
+};
+
+struct view_hash
+{
+    uint64_t operator()(std::string_view key) const
+    {
+        return std::hash<std::string_view>{}(key);
+    }
+};
+
+void test_key_codec()
+{
+    printf("Running key codec test\n");
+    using hash_it_out::detail::key_codec;
+    const int64_t signed_keys[] = {INT64_MIN, -1000, -1, 0, 1, 255, 256, 1000, INT64_MAX};
+    key_codec<int64_t>::buffer last, buf;
+    for (size_t i = 0; i < sizeof(signed_keys) / sizeof(signed_keys[0]); i++) {
+        key_type key = key_codec<int64_t>::encode(signed_keys[i], buf);
+        my_assert(strlen((const char *) key) == key_codec<int64_t>::bytes, "encoded key has a zero byte");
+        my_assert(key_codec<int64_t>::decode(key) == signed_keys[i], "int64 key did not round trip");
+        my_assert(i == 0 || strcmp((const char *) last.data(), (const char *) key) < 0,
+                "encoded keys are not in numeric order");
+        last = buf;
+    }
+
+    key_codec<color>::buffer cbuf;
+    my_assert(key_codec<color>::decode(key_codec<color>::encode(color::red, cbuf)) == color::red,
+            "enum key did not round trip");
+    key_codec<point>::buffer pbuf;
+    point p = key_codec<point>::decode(key_codec<point>::encode(point{-3, 7}, pbuf));
+    my_assert(p.x == -3 && p.y == 7, "struct key did not round trip");
+}
+
+template <class Policy>
+void check_integer_cache(struct cache_config config)
+{
+    hash_it_out::cache<uint64_t, point, hash_it_out::default_hash<uint64_t>, Policy> c(config);
+    for (uint64_t i = 0; i < 1000; i++) {
+        c.set(i, point{int32_t(i), -int32_t(i)});
+    }
+    for (uint64_t i = 0; i < 1000; i++) {
+        auto p = c.get(i);
+        my_assert(p && p->x == int32_t(i) && p->y == -int32_t(i), "integer key lost its value");
+    }
+    my_assert(!c.get(1000) && !c.contains(1000), "found a key never set");
+
+    point out;
+    my_assert(c.get(7, out) && out.x == 7, "borrowing get missed");
+    c.erase(7);
+    my_assert(!c.get(7, out) && !c.contains(7) && c.contains(8), "erase removed the wrong key");
+
+    // a stored value of another size is a miss, not a partial copy
+    uint8_t byte = 1;
+    hash_it_out::detail::key_codec<uint64_t>::buffer buf;
+    cache_set(c.handle(), hash_it_out::detail::key_codec<uint64_t>::encode(9, buf), &byte, 1);
+    my_assert(!c.get(9), "a value of the wrong size was read");
+}
+
+void test_policies_and_engines()
+{
+    printf("Running typed cache test\n");
+    const cache_engine engines[] = {CACHE_ENGINE_CHAINED, CACHE_ENGINE_CUCKOO, CACHE_ENGINE_ART};
+    for (cache_engine engine : engines) {
+        struct cache_config config;
+        cache_config_init(&config, 1 << 20);
+        config.engine = engine;
+        check_integer_cache<hash_it_out::lru>(config);
+        check_integer_cache<hash_it_out::sampled>(config);
+        check_integer_cache<hash_it_out::gdsf>(config);
+    }
+}
+
+void test_string_values()
+{
+    printf("Running typed string test\n");
+    hash_it_out::cache<std::string, std::string> c(1 << 20);
+    std::string val(1000, 'v');
+    c.set("short", "abc");
+    c.set("long", std::move(val));
+
+    std::string out;
+    out.reserve(8);
+    my_assert(c.get("short", out) && out == "abc", "short string value misread");
+    my_assert(c.get("long", out) && out == std::string(1000, 'v'), "string value bigger than the buffer misread");
+    my_assert(c.get("short", out) && out == "abc", "reused buffer kept old bytes");
+    my_assert(!c.get("missing", out), "found a missing string key");
+    my_assert(*c.get("long") == std::string(1000, 'v'), "optional get of a string misread");
+}
+
+void test_custom_hash_and_eviction()
+{
+    printf("Running typed custom hash test\n");
+    hash_it_out::cache<uint32_t, uint64_t, mod_hash> c(20000);
+    for (uint32_t i = 0; i < 5000; i++) {
+        c.set(i, uint64_t(i) * 3);
+    }
+    my_assert(mod_hash::calls >= 5000, "custom hash was not used");
+    my_assert(c.space_used() <= 20000, "typed cache went over maxmem");
+    auto newest = c.get(4999);
+    my_assert(newest && *newest == 4999 * 3, "newest key was evicted");
+
+    hash_it_out::cache<uint32_t, uint64_t, mod_hash> moved(std::move(c));
+    my_assert(moved.get(4999) && !c.handle(), "move did not hand the cache over");
+}
+
+template <class Hash>
+uint64_t allocations_per_get()
+{
+    // operator news done by 1000 gets of a key too long for the small
+    // string buffer, after a first get to warm things up
+    hash_it_out::cache<std::string, std::string, Hash> c(1 << 20);
+    std::string key(100, 'k');
+    c.set(key, "v");
+    std::string out;
+    my_assert(c.get(key, out) && out == "v", "custom string hash lost the key");
+    uint64_t before = allocations;
+    for (int i = 0; i < 1000; i++) {
+        c.get(key, out);
+    }
+    return allocations - before;
+}
+
+void test_string_hash_allocations()
+{
+    printf("Running typed string hash test\n");
+    my_assert(allocations_per_get<string_hash>() == 0, "a custom string hash allocated per lookup");
+    my_assert(allocations_per_get<view_hash>() == 0, "a string_view hash allocated per lookup");
+}
+
+} // namespace
+
+int main()
+{
+    printf("***Running C++ front-end tests***\n");
+    test_key_codec();
+    test_policies_and_engines();
+    test_string_values();
+    test_custom_hash_and_eviction();
+    test_string_hash_allocations();
+    return 0;
+}
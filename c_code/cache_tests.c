@@ -5,6 +5,9 @@
 #include <stdbool.h>
 #include <getopt.h>
 #include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 #include "dbLL_tests.h"
 #include "cache.h"
@@ -147,6 +150,1522 @@ static void test_space()
     destroy_cache(c);
 }
 
+static void test_maintenance_thread()
+{
+    // the maintenance thread should pull memory down below the high
+    // watermark without cache_set ever going over maxmem
+    printf("Running cache maintenance thread test\n");
+    struct cache_config config;
+    cache_config_init(&config, 1000);
+    config.maintenance_thread = true;
+    config.high_watermark = 0.8;
+    config.low_watermark = 0.5;
+    config.maintenance_interval_ms = 10;
+    cache_t c = create_cache_with_config(&config);
+
+    uint8_t val[10] = {0,1,2,3,4,5,6,7,8,9};
+    char key[16];
+    for (uint32_t i = 0; i < 500; i++) {
+        snprintf(key, sizeof(key), "key%" PRIu32, i);
+        cache_set(c, (key_type) key, val, 10);
+        my_assert(cache_space_used(c) <= 1000, "maxmem exceeded with maintenance thread");
+    }
+
+    // give the thread a chance to catch up
+    for (uint32_t tries = 0; tries < 100 && cache_space_used(c) > 800; tries++) {
+        usleep(10000);
+    }
+    my_assert(cache_space_used(c) <= 800, "maintenance thread did not evict to watermark");
+
+    // the most recent key survives
+    uint32_t size;
+    snprintf(key, sizeof(key), "key%" PRIu32, 499);
+    val_type v = cache_get(c, (key_type) key, &size);
+    my_assert(v && size == 10, "most recent key was evicted");
+    free((void *) v);
+
+    destroy_cache(c);
+}
+
+static void test_presize_and_shrink()
+{
+    // a sized cache should not rehash during warmup, and should give the
+    // buckets back once it is emptied
+    printf("Running cache presize/shrink test\n");
+    struct cache_config config;
+    cache_config_init(&config, 100000);
+    config.expected_items = 1000;
+    cache_t c = create_cache_with_config(&config);
+
+    uint64_t initial_buckets = cache_bucket_count(c);
+    my_assert(initial_buckets >= 1000, "expected_items hint ignored");
+
+    uint8_t val[4] = {1,2,3,4};
+    char key[16];
+    for (uint32_t i = 0; i < 1000; i++) {
+        snprintf(key, sizeof(key), "key%" PRIu32, i);
+        cache_set(c, (key_type) key, val, 4);
+    }
+    my_assert(cache_bucket_count(c) == initial_buckets, "presized cache rehashed during warmup");
+
+    for (uint32_t i = 0; i < 1000; i++) {
+        snprintf(key, sizeof(key), "key%" PRIu32, i);
+        cache_delete(c, (key_type) key);
+    }
+    my_assert(cache_bucket_count(c) < initial_buckets, "cache did not shrink after deletes");
+    my_assert(0 == cache_space_used(c), "not everything was deleted");
+
+    // the shrunk table still works
+    cache_set(c, (key_type) "again", val, 4);
+    uint32_t size;
+    val_type v = cache_get(c, (key_type) "again", &size);
+    my_assert(v && size == 4, "lookup after shrink failed");
+    free((void *) v);
+
+    destroy_cache(c);
+
+    // a cuckoo table has no buckets to shrink: emptying a presized one
+    // must leave it alone
+    config.engine = CACHE_ENGINE_CUCKOO;
+    c = create_cache_with_config(&config);
+    initial_buckets = cache_bucket_count(c);
+    for (uint32_t i = 0; i < 1000; i++) {
+        snprintf(key, sizeof(key), "key%" PRIu32, i);
+        cache_set(c, (key_type) key, val, 4);
+    }
+    for (uint32_t i = 0; i < 1000; i++) {
+        snprintf(key, sizeof(key), "key%" PRIu32, i);
+        cache_delete(c, (key_type) key);
+    }
+    my_assert(cache_bucket_count(c) == initial_buckets, "cuckoo table changed size after deletes");
+    my_assert(0 == cache_space_used(c), "not everything was deleted from the cuckoo table");
+    cache_set(c, (key_type) "again", val, 4);
+    v = cache_get(c, (key_type) "again", &size);
+    my_assert(v && size == 4, "cuckoo lookup after deletes failed");
+    free((void *) v);
+    destroy_cache(c);
+}
+
+static void test_parallel_rehash()
+{
+    // grow and shrink a table big enough to be split across threads
+    printf("Running parallel rehash test\n");
+    struct cache_config config;
+    cache_config_init(&config, 1 << 26);
+    config.rehash_threads = 4;
+    config.eviction = CACHE_EVICT_SAMPLED; // the LRU queue would make this quadratic
+    cache_t c = create_cache_with_config(&config);
+
+    const uint32_t n = 200000;
+    char key[16];
+    for (uint32_t i = 0; i < n; i++) {
+        snprintf(key, sizeof(key), "key%" PRIu32, i);
+        cache_set(c, (key_type) key, &i, sizeof(i));
+    }
+    uint64_t grown = cache_bucket_count(c);
+    my_assert(grown >= 4 * (1 << 15), "table never got big enough to split");
+    uint64_t rehashes, parts;
+    cache_rehash_stats(c, &rehashes, &parts);
+    my_assert(rehashes > 0 && parts > rehashes, "no rehash was split across threads");
+
+    for (uint32_t i = 0; i < n; i++) {
+        snprintf(key, sizeof(key), "key%" PRIu32, i);
+        if (i % 100 != 0) {
+            cache_delete(c, (key_type) key);
+        }
+    }
+    my_assert(cache_bucket_count(c) < grown, "cache did not shrink after deletes");
+    uint64_t grown_rehashes = rehashes, grown_parts = parts;
+    cache_rehash_stats(c, &rehashes, &parts);
+    my_assert(parts - grown_parts > rehashes - grown_rehashes, "no shrink was split across threads");
+
+    bool all_found = true;
+    for (uint32_t i = 0; i < n; i++) {
+        snprintf(key, sizeof(key), "key%" PRIu32, i);
+        uint32_t size;
+        val_type v = cache_get(c, (key_type) key, &size);
+        if ((v != NULL) != (i % 100 == 0) || (v && (size != sizeof(i) || memcmp(v, &i, sizeof(i))))) {
+            all_found = false;
+        }
+        free((void *) v);
+    }
+    my_assert(all_found, "a key was lost or resurrected by a rehash");
+
+    destroy_cache(c);
+}
+
+static void test_cuckoo_engine()
+{
+    // the cache API should behave the same on the cuckoo engine
+    printf("Running cache cuckoo engine test\n");
+    struct cache_config config;
+    cache_config_init(&config, 3000);
+    config.engine = CACHE_ENGINE_CUCKOO;
+    cache_t c = create_cache_with_config(&config);
+
+    uint8_t val[10] = {0,1,2,3,4,5,6,7,8,9};
+    char key[16];
+    for (uint32_t i = 0; i < 1000; i++) {
+        snprintf(key, sizeof(key), "key%" PRIu32, i);
+        val[0] = i % 256;
+        cache_set(c, (key_type) key, val, 10);
+    }
+    // only the last 300 fit
+    my_assert(cache_space_used(c) == 3000, "cuckoo cache memory accounting is off");
+
+    uint32_t size;
+    for (uint32_t i = 0; i < 1000; i++) {
+        snprintf(key, sizeof(key), "key%" PRIu32, i);
+        uint8_t *v = (uint8_t *) cache_get(c, (key_type) key, &size);
+        if (i < 700) {
+            my_assert(v == NULL, "cuckoo cache kept an evicted key");
+        } else {
+            my_assert(v && size == 10 && v[0] == i % 256, "cuckoo cache lost a key");
+        }
+        free(v);
+    }
+
+    cache_set(c, (key_type) "key999", val, 4);
+    my_assert(cache_space_used(c) == 2994, "cuckoo overwrite accounting is off");
+    cache_delete(c, (key_type) "key999");
+    my_assert(cache_get(c, (key_type) "key999", &size) == NULL, "cuckoo delete failed");
+
+    destroy_cache(c);
+}
+
+struct steady_reader
+{
+    cache_t cache;
+    atomic_bool done;
+};
+
+static void *steady_reader(void *arg)
+{
+    // never stop reading, so there is always a lock-free reader in flight
+    struct steady_reader *r = arg;
+    char key[16];
+    for (uint32_t i = 0; !r->done; i++) {
+        snprintf(key, sizeof(key), "key%" PRIu32, i % 100);
+        uint32_t size;
+        free((void *) cache_get(r->cache, (key_type) key, &size));
+    }
+    return NULL;
+}
+
+static void test_reclaim_under_load()
+{
+    // overwritten cuckoo nodes get freed while readers keep coming
+    printf("Running cache reclaim under load test\n");
+    struct cache_config config;
+    cache_config_init(&config, 1 << 20);
+    config.engine = CACHE_ENGINE_CUCKOO;
+    cache_t c = create_cache_with_config(&config);
+
+    char key[16];
+    for (uint32_t i = 0; i < 100; i++) {
+        snprintf(key, sizeof(key), "key%" PRIu32, i);
+        cache_set(c, (key_type) key, "value", 5);
+    }
+    struct steady_reader reader = {c, false};
+    pthread_t threads[4];
+    for (uint32_t i = 0; i < 4; i++) {
+        pthread_create(&threads[i], NULL, steady_reader, &reader);
+    }
+    for (uint32_t i = 0; i < 2000; i++) {
+        snprintf(key, sizeof(key), "key%" PRIu32, i % 100);
+        cache_set(c, (key_type) key, "value", 5);
+    }
+    // a reader that was preempted mid-get can hold up a few more writes
+    uint64_t garbage = cache_garbage_count(c);
+    for (uint32_t i = 0; i < 100 && garbage >= 100; i++) {
+        usleep(1000);
+        cache_set(c, (key_type) "key0", "value", 5);
+        garbage = cache_garbage_count(c);
+    }
+    reader.done = true;
+    for (uint32_t i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    my_assert(garbage < 100, "overwritten nodes piled up under a steady read load");
+    cache_set(c, (key_type) "key0", "value", 5);
+    my_assert(cache_garbage_count(c) == 0, "overwritten nodes weren't freed once readers stopped");
+    destroy_cache(c);
+}
+
+struct prefix_state
+{
+    char last[64];
+    uint32_t calls;
+    bool sorted;
+    bool matched;
+};
+
+static void prefix_cb(key_type key, val_type val, uint32_t val_size, void *arg)
+{
+    (void) val;
+    (void) val_size;
+    struct prefix_state *state = arg;
+    if (strcmp(state->last, (const char*) key) >= 0) {
+        state->sorted = false;
+    }
+    if (strncmp((const char*) key, "tenant:3:", 9) != 0) {
+        state->matched = false;
+    }
+    snprintf(state->last, sizeof(state->last), "%s", (const char*) key);
+    ++state->calls;
+}
+
+static void test_art_engine()
+{
+    // the cache API should behave the same on the art engine, which also
+    // walks keys in order
+    printf("Running cache art engine test\n");
+    struct cache_config config;
+    cache_config_init(&config, 3000);
+    config.engine = CACHE_ENGINE_ART;
+    cache_t c = create_cache_with_config(&config);
+
+    uint8_t val[10] = {0,1,2,3,4,5,6,7,8,9};
+    char key[64];
+    for (uint32_t i = 0; i < 1000; i++) {
+        snprintf(key, sizeof(key), "tenant:%" PRIu32 ":user:%" PRIu32 ":profile:v7", i % 10, i);
+        val[0] = i % 256;
+        cache_set(c, (key_type) key, val, 10);
+    }
+    // only the last 300 fit
+    my_assert(cache_space_used(c) == 3000, "art cache memory accounting is off");
+    my_assert(cache_bucket_count(c) == 0, "art cache has buckets");
+
+    uint32_t size;
+    for (uint32_t i = 0; i < 1000; i++) {
+        snprintf(key, sizeof(key), "tenant:%" PRIu32 ":user:%" PRIu32 ":profile:v7", i % 10, i);
+        uint8_t *v = (uint8_t *) cache_get(c, (key_type) key, &size);
+        if (i < 700) {
+            my_assert(v == NULL, "art cache kept an evicted key");
+        } else {
+            my_assert(v && size == 10 && v[0] == i % 256, "art cache lost a key");
+        }
+        free(v);
+    }
+
+    // a prefix scan sees exactly the 30 tenant:3 keys left, in order,
+    // however small the batches
+    struct prefix_state state = {"", 0, true, true};
+    uint64_t cursor = 0;
+    do {
+        cursor = cache_scan_prefix(c, (key_type) "tenant:3:", cursor, 7, prefix_cb, &state);
+    } while (cursor != 0);
+    my_assert(state.calls == 30 && state.sorted && state.matched, "prefix scan saw the wrong keys");
+    state.calls = 0;
+    cache_scan_prefix(c, (key_type) "tenant:3:user:5", 0, 100, prefix_cb, &state);
+    my_assert(state.calls == 0, "prefix scan of a missing prefix saw keys");
+
+    // and a full scan goes in key order too
+    struct prefix_state all = {"", 0, true, true};
+    cursor = 0;
+    do {
+        cursor = cache_scan(c, cursor, 50, prefix_cb, &all);
+    } while (cursor != 0);
+    my_assert(all.calls == 300 && all.sorted, "art scan is not a sorted walk of every key");
+
+    cache_set(c, (key_type) "tenant:9:user:999:profile:v7", val, 4);
+    my_assert(cache_space_used(c) == 2994, "art overwrite accounting is off");
+    cache_delete(c, (key_type) "tenant:9:user:999:profile:v7");
+    my_assert(cache_get(c, (key_type) "tenant:9:user:999:profile:v7", &size) == NULL, "art delete failed");
+
+    destroy_cache(c);
+}
+
+static uint8_t get_byte(cache_t c, const char *key)
+{
+    // first byte of the value for key, or 0 if it's missing
+    uint32_t size;
+    uint8_t *v = (uint8_t *) cache_get(c, (key_type) key, &size);
+    uint8_t res = v ? v[0] : 0;
+    free(v);
+    return res;
+}
+
+static void *near_reader(void *arg)
+{
+    // warm this thread's near cache, then report what it sees
+    cache_t c = arg;
+    for (uint32_t i = 0; i < 10; i++) {
+        get_byte(c, "hot");
+    }
+    return (void *) (uintptr_t) get_byte(c, "hot");
+}
+
+static void test_near_cache()
+{
+    printf("Running cache near cache test\n");
+    struct cache_config config;
+    cache_config_init(&config, 1000);
+    config.near_cache_entries = 64;
+    cache_t c = create_cache_with_config(&config);
+
+    uint8_t val[4] = {1,2,3,4};
+    cache_set(c, (key_type) "hot", val, 4);
+    for (uint32_t i = 0; i < 10; i++) {
+        my_assert(get_byte(c, "hot") == 1, "wrong value from near cache");
+    }
+    my_assert(cache_near_hits(c) > 0, "hot key never hit the near cache");
+
+    // overwrites and deletes must not be hidden by the near cache
+    val[0] = 2;
+    cache_set(c, (key_type) "hot", val, 4);
+    my_assert(get_byte(c, "hot") == 2, "near cache returned a stale value after overwrite");
+    get_byte(c, "hot");
+    cache_delete(c, (key_type) "hot");
+    my_assert(get_byte(c, "hot") == 0, "near cache returned a deleted key");
+
+    // a write from this thread invalidates another thread's near cache
+    val[0] = 3;
+    cache_set(c, (key_type) "hot", val, 4);
+    pthread_t thread;
+    pthread_create(&thread, NULL, near_reader, c);
+    void *seen;
+    pthread_join(thread, &seen);
+    my_assert((uintptr_t) seen == 3, "other thread read the wrong value");
+    val[0] = 4;
+    cache_set(c, (key_type) "hot", val, 4);
+    pthread_create(&thread, NULL, near_reader, c);
+    pthread_join(thread, &seen);
+    my_assert((uintptr_t) seen == 4, "other thread's near cache went stale");
+
+    // evictions invalidate too
+    for (uint32_t i = 0; i < 10; i++) {
+        get_byte(c, "hot");
+    }
+    char key[16];
+    for (uint32_t i = 0; i < 300; i++) {
+        snprintf(key, sizeof(key), "key%" PRIu32, i);
+        cache_set(c, (key_type) key, val, 4);
+    }
+    my_assert(get_byte(c, "hot") == 0, "near cache returned an evicted key");
+
+    destroy_cache(c);
+}
+
+static void check_filter(enum cache_engine engine)
+{
+    struct cache_config config;
+    cache_config_init(&config, 1000000);
+    config.engine = engine;
+    config.membership_filter = true;
+    cache_t c = create_cache_with_config(&config);
+
+    // enough keys to resize the table (and so the filter) a few times
+    uint8_t val[4] = {1,2,3,4};
+    char key[16];
+    for (uint32_t i = 0; i < 5000; i++) {
+        snprintf(key, sizeof(key), "key%" PRIu32, i);
+        cache_set(c, (key_type) key, val, 4);
+    }
+    for (uint32_t i = 0; i < 5000; i += 2) {
+        snprintf(key, sizeof(key), "key%" PRIu32, i);
+        cache_delete(c, (key_type) key);
+    }
+
+    uint32_t size;
+    for (uint32_t i = 0; i < 5000; i++) {
+        snprintf(key, sizeof(key), "key%" PRIu32, i);
+        uint8_t *v = (uint8_t *) cache_get(c, (key_type) key, &size);
+        my_assert((i % 2 == 1) == (v != NULL), "filtered cache returned the wrong answer");
+        free(v);
+    }
+    for (uint32_t i = 0; i < 10000; i++) {
+        snprintf(key, sizeof(key), "missing%" PRIu32, i);
+        my_assert(cache_get(c, (key_type) key, &size) == NULL, "filtered cache found a missing key");
+    }
+
+    struct cache_filter_stats stats;
+    cache_filter_stats(c, &stats);
+    my_assert(stats.negatives > 10000, "filter did not short-circuit misses");
+    my_assert(stats.observed_fpr < 0.05, "filter false positive rate is too high");
+    my_assert(stats.estimated_fpr > 0 && stats.estimated_fpr < 0.05, "filter estimate is off");
+    destroy_cache(c);
+}
+
+static void test_membership_filter()
+{
+    printf("Running cache membership filter test\n");
+    check_filter(CACHE_ENGINE_CHAINED);
+    check_filter(CACHE_ENGINE_CUCKOO);
+    check_filter(CACHE_ENGINE_ART);
+}
+
+struct scan_state
+{
+    cache_t cache;
+    uint32_t seen[1000]; // times each stable key was seen
+    uint32_t calls;
+};
+
+static void scan_cb(key_type key, val_type val, uint32_t val_size, void *arg)
+{
+    struct scan_state *state = arg;
+    uint32_t i;
+    if (sscanf((const char*) key, "stable%" SCNu32, &i) == 1 && i < 1000) {
+        my_assert(val_size == 4 && ((uint8_t*) val)[0] == i % 256, "scan returned a wrong value");
+        ++state->seen[i];
+    }
+    ++state->calls;
+}
+
+static void check_scan(enum cache_engine engine, uint32_t churn)
+{
+    struct cache_config config;
+    cache_config_init(&config, 1000000);
+    config.engine = engine;
+    if (engine == CACHE_ENGINE_CUCKOO) {
+        config.expected_items = 4000; // several blocks from the start
+    }
+    cache_t c = create_cache_with_config(&config);
+
+    uint8_t val[4] = {0,0,0,0};
+    char key[24];
+    for (uint32_t i = 0; i < 1000; i++) {
+        snprintf(key, sizeof(key), "stable%" PRIu32, i);
+        val[0] = i % 256;
+        cache_set(c, (key_type) key, val, 4);
+    }
+
+    // grow the table while the scan is running, then shrink it again
+    struct scan_state *state = calloc(1, sizeof(struct scan_state));
+    uint64_t cursor = 0;
+    uint32_t round = 0;
+    uint64_t buckets = cache_bucket_count(c);
+    bool grew = false;
+    do {
+        cursor = cache_scan(c, cursor, 20, scan_cb, state);
+        grew = grew || (cursor != 0 && cache_bucket_count(c) > buckets);
+        if (round < 40) {
+            for (uint32_t i = 0; i < churn; i++) {
+                snprintf(key, sizeof(key), "churn%" PRIu32, round * churn + i);
+                cache_set(c, (key_type) key, val, 4);
+            }
+        } else if (round < 80) {
+            for (uint32_t i = 0; i < churn; i++) {
+                snprintf(key, sizeof(key), "churn%" PRIu32, (round - 40) * churn + i);
+                cache_delete(c, (key_type) key);
+            }
+        }
+        ++round;
+    } while (cursor != 0);
+
+    my_assert(grew || engine == CACHE_ENGINE_ART, "the table never grew under the scan");
+    for (uint32_t i = 0; i < 1000; i++) {
+        my_assert(state->seen[i] > 0, "scan missed a key present for the whole scan");
+    }
+    free(state);
+    destroy_cache(c);
+}
+
+static void test_scan()
+{
+    printf("Running cache scan test\n");
+    check_scan(CACHE_ENGINE_CHAINED, 200);
+    // the cuckoo engine walks a block per call, so grow it faster to
+    // split blocks under the cursor
+    check_scan(CACHE_ENGINE_CUCKOO, 2000);
+    // the tree has no buckets, but the churn keys all sort before the
+    // stable ones, so they move every stable key's rank under the cursor
+    check_scan(CACHE_ENGINE_ART, 200);
+
+    // on a cache that isn't changing, one full walk sees every key once
+    cache_t c = create_cache(100000);
+    uint8_t val[4] = {0,0,0,0};
+    char key[24];
+    for (uint32_t i = 0; i < 1000; i++) {
+        snprintf(key, sizeof(key), "stable%" PRIu32, i);
+        val[0] = i % 256;
+        cache_set(c, (key_type) key, val, 4);
+    }
+    struct scan_state *state = calloc(1, sizeof(struct scan_state));
+    uint64_t cursor = 0;
+    do {
+        cursor = cache_scan(c, cursor, 7, scan_cb, state);
+    } while (cursor != 0);
+    my_assert(state->calls == 1000, "scan of an unchanging cache saw the wrong number of keys");
+    free(state);
+    destroy_cache(c);
+}
+
+static void check_sampled_eviction(enum cache_engine engine)
+{
+    // room for 1000 values; 100 hot keys are read between every insert
+    // of 5000 cold ones, so sampling should almost never pick them
+    struct cache_config config;
+    cache_config_init(&config, 4000);
+    config.engine = engine;
+    config.eviction = CACHE_EVICT_SAMPLED;
+    cache_t c = create_cache_with_config(&config);
+
+    uint8_t val[4] = {0,0,0,0};
+    char key[24];
+    for (uint32_t i = 0; i < 100; i++) {
+        snprintf(key, sizeof(key), "hot%" PRIu32, i);
+        cache_set(c, (key_type) key, val, 4);
+    }
+    uint32_t size;
+    for (uint32_t i = 0; i < 5000; i++) {
+        snprintf(key, sizeof(key), "cold%" PRIu32, i);
+        cache_set(c, (key_type) key, val, 4);
+        snprintf(key, sizeof(key), "hot%" PRIu32, i % 100);
+        free((void *) cache_get(c, (key_type) key, &size));
+        my_assert(cache_space_used(c) <= 4000, "sampled eviction let the cache overflow");
+    }
+
+    uint32_t hot = 0;
+    for (uint32_t i = 0; i < 100; i++) {
+        snprintf(key, sizeof(key), "hot%" PRIu32, i);
+        val_type v = cache_get(c, (key_type) key, &size);
+        hot += v != NULL;
+        free((void *) v);
+    }
+    my_assert(hot >= 90, "sampled eviction evicted too many hot keys");
+
+    // of the cold keys, the recent ones should have survived
+    uint32_t old = 0, recent = 0;
+    for (uint32_t i = 0; i < 1000; i++) {
+        snprintf(key, sizeof(key), "cold%" PRIu32, i);
+        val_type v = cache_get(c, (key_type) key, &size);
+        old += v != NULL;
+        free((void *) v);
+        snprintf(key, sizeof(key), "cold%" PRIu32, 4000 + i);
+        v = cache_get(c, (key_type) key, &size);
+        recent += v != NULL;
+        free((void *) v);
+    }
+    my_assert(recent > 4 * old, "sampled eviction did not favour recent keys");
+    destroy_cache(c);
+}
+
+static void test_sampled_eviction()
+{
+    printf("Running cache sampled eviction test\n");
+    check_sampled_eviction(CACHE_ENGINE_CHAINED);
+    check_sampled_eviction(CACHE_ENGINE_CUCKOO);
+    check_sampled_eviction(CACHE_ENGINE_ART);
+}
+
+static double replay_costly_workload(enum cache_engine engine, enum cache_eviction eviction)
+{
+    // 20 expensive keys read every 200 requests, between a stream of
+    // cheap ones spread over far more keys than fit. Returns the cost
+    // saved by hits.
+    struct cache_config config;
+    cache_config_init(&config, 100 * 100);
+    config.engine = engine;
+    config.eviction = eviction;
+    cache_t c = create_cache_with_config(&config);
+
+    uint8_t val[100] = {0};
+    char key[24];
+    uint32_t rng = 12345;
+    double saved = 0;
+    for (uint32_t i = 0; i < 20000; i++) {
+        double cost = 1;
+        if (i % 10 == 0) {
+            snprintf(key, sizeof(key), "costly%" PRIu32, (i / 10) % 20);
+            cost = 1000;
+        } else {
+            rng = rng * 1103515245 + 12345;
+            snprintf(key, sizeof(key), "cheap%" PRIu32, (rng >> 16) % 500);
+        }
+        uint32_t size;
+        val_type v = cache_get(c, (key_type) key, &size);
+        if (v) {
+            saved += cost;
+        } else {
+            cache_set_with_cost(c, (key_type) key, val, sizeof(val), cost);
+        }
+        free((void *) v);
+    }
+    destroy_cache(c);
+    return saved;
+}
+
+static void check_gdsf(enum cache_engine engine)
+{
+    // room for 4 values: the cheapest per byte goes first
+    struct cache_config config;
+    cache_config_init(&config, 400);
+    config.engine = engine;
+    config.eviction = CACHE_EVICT_GDSF;
+    cache_t c = create_cache_with_config(&config);
+    uint8_t val[200] = {0};
+    uint32_t size;
+    cache_set_with_cost(c, (key_type) "big", val, 200, 100); // 0.5 per byte
+    cache_set_with_cost(c, (key_type) "slow", val, 100, 500); // 5 per byte
+    cache_set_with_cost(c, (key_type) "fast", val, 100, 10); // 0.1 per byte
+    cache_set_with_cost(c, (key_type) "new", val, 100, 50); // evicts fast
+    val_type v = cache_get(c, (key_type) "fast", &size);
+    my_assert(v == NULL, "gdsf kept the cheapest entry");
+    v = cache_get(c, (key_type) "slow", &size);
+    my_assert(v != NULL, "gdsf evicted the most expensive entry");
+    free((void *) v);
+    cache_set_with_cost(c, (key_type) "new2", val, 100, 50); // evicts big
+    v = cache_get(c, (key_type) "big", &size);
+    my_assert(v == NULL, "gdsf did not rank by cost per byte");
+    free((void *) v);
+    my_assert(cache_space_used(c) <= 400, "gdsf let the cache overflow");
+    destroy_cache(c);
+
+    double gdsf = replay_costly_workload(engine, CACHE_EVICT_GDSF);
+    double lru = replay_costly_workload(engine, CACHE_EVICT_LRU);
+    my_assert(gdsf > 2 * lru, "gdsf did not save more recompute cost than lru");
+}
+
+static void test_gdsf_eviction()
+{
+    printf("Running cache gdsf eviction test\n");
+    check_gdsf(CACHE_ENGINE_CHAINED);
+    check_gdsf(CACHE_ENGINE_CUCKOO);
+    check_gdsf(CACHE_ENGINE_ART);
+}
+
+static uint8_t pattern(uint64_t i)
+{
+    return (uint8_t) (i * 7 % 251);
+}
+
+static bool matches_pattern(const uint8_t *buf, uint64_t offset, uint64_t len)
+{
+    for (uint64_t i = 0; i < len; i++) {
+        if (buf[i] != pattern(offset + i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void check_chunked(enum cache_engine engine)
+{
+    struct cache_config config;
+    cache_config_init(&config, 16 << 20);
+    config.engine = engine;
+    cache_t c = create_cache_with_config(&config);
+
+    // a big cache_set is chunked behind the scenes
+    uint32_t big = 1 << 20;
+    uint8_t *val = malloc(big);
+    for (uint32_t i = 0; i < big; i++) {
+        val[i] = pattern(i);
+    }
+    cache_set(c, (key_type) "big", val, big);
+    uint32_t size;
+    uint8_t *got = (uint8_t *) cache_get(c, (key_type) "big", &size);
+    my_assert(got && size == big && matches_pattern(got, 0, big), "chunked cache_get is wrong");
+    free(got);
+
+    uint8_t window[5000];
+    uint64_t copied, total;
+    bool found = cache_read(c, (key_type) "big", 100000, window, sizeof(window), &copied, &total);
+    my_assert(found && copied == sizeof(window) && total == big, "cache_read sizes are wrong");
+    my_assert(matches_pattern(window, 100000, copied), "cache_read across chunks is wrong");
+    cache_read(c, (key_type) "big", big - 10, window, sizeof(window), &copied, &total);
+    my_assert(copied == 10 && matches_pattern(window, big - 10, 10), "cache_read at the end is wrong");
+    cache_read(c, (key_type) "big", big + 10, window, sizeof(window), &copied, &total);
+    my_assert(copied == 0, "cache_read past the end copied something");
+    my_assert(!cache_read(c, (key_type) "nope", 0, window, 1, &copied, &total), "cache_read found a missing key");
+
+    // small values can be read in pieces too
+    cache_set(c, (key_type) "small", val, 100);
+    cache_read(c, (key_type) "small", 90, window, 20, &copied, &total);
+    my_assert(copied == 10 && total == 100 && matches_pattern(window, 90, 10), "cache_read of a small value is wrong");
+
+    // stream in 3MB in odd-sized pieces
+    cache_writer_t w = cache_write_begin(c, (key_type) "stream");
+    uint8_t piece[9973];
+    uint64_t written = 0;
+    while (written < 3 * big) {
+        for (uint64_t i = 0; i < sizeof(piece); i++) {
+            piece[i] = pattern(written + i);
+        }
+        cache_write_append(w, piece, sizeof(piece));
+        written += sizeof(piece);
+    }
+    my_assert(!cache_read(c, (key_type) "stream", 0, window, 1, &copied, &total),
+            "streamed value visible before commit");
+    cache_write_commit(w);
+    cache_read(c, (key_type) "stream", 0, window, 1, &copied, &total);
+    my_assert(total == written, "streamed value has the wrong size");
+    for (uint64_t off = 0; off < written; off += 123457) {
+        cache_read(c, (key_type) "stream", off, window, sizeof(window), &copied, &total);
+        my_assert(matches_pattern(window, off, copied), "streamed value is wrong");
+    }
+    my_assert(cache_space_used(c) == big + 100 + written, "chunked values are not accounted for");
+
+    // overwrite it, and abort another
+    cache_set(c, (key_type) "stream", val, 10);
+    got = (uint8_t *) cache_get(c, (key_type) "stream", &size);
+    my_assert(got && size == 10, "overwriting a streamed value failed");
+    free(got);
+    w = cache_write_begin(c, (key_type) "aborted");
+    cache_write_append(w, val, big);
+    cache_write_abort(w);
+    my_assert(!cache_read(c, (key_type) "aborted", 0, window, 1, &copied, &total), "aborted write was stored");
+
+    free(val);
+    destroy_cache(c);
+}
+
+static void test_chunked_values()
+{
+    printf("Running cache chunked values test\n");
+    check_chunked(CACHE_ENGINE_CHAINED);
+    check_chunked(CACHE_ENGINE_CUCKOO);
+    check_chunked(CACHE_ENGINE_ART);
+}
+
+static bool value_is(cache_t c, const char *key, const char *want)
+{
+    uint32_t size;
+    val_type v = cache_get(c, (key_type) key, &size);
+    bool same = v && size == strlen(want) && memcmp(v, want, size) == 0;
+    free((void *) v);
+    return same;
+}
+
+struct counter_reader
+{
+    cache_t cache;
+    atomic_bool done;
+    bool bad;
+};
+
+static void *counter_reader(void *arg)
+{
+    // a counter being incremented must always read as a number
+    struct counter_reader *r = arg;
+    while (!r->done) {
+        uint32_t size;
+        const char *v = (const char *) cache_get(r->cache, (key_type) "n", &size);
+        for (uint32_t i = 0; v && i < size; i++) {
+            r->bad |= v[i] < '0' || v[i] > '9';
+        }
+        free((void *) v);
+    }
+    return NULL;
+}
+
+static void check_in_place(enum cache_engine engine)
+{
+    struct cache_config config;
+    cache_config_init(&config, 1 << 20);
+    config.engine = engine;
+    cache_t c = create_cache_with_config(&config);
+
+    cache_set(c, (key_type) "list", "abc", 3);
+    my_assert(cache_append(c, (key_type) "list", "def", 3) && value_is(c, "list", "abcdef"), "append failed");
+    my_assert(cache_prepend(c, (key_type) "list", "xy", 2) && value_is(c, "list", "xyabcdef"), "prepend failed");
+    my_assert(cache_overwrite(c, (key_type) "list", 2, "ZZ", 2) && value_is(c, "list", "xyZZcdef"), "overwrite failed");
+    my_assert(cache_overwrite(c, (key_type) "list", 7, "123", 3) && value_is(c, "list", "xyZZcde123"),
+            "overwrite past the end failed");
+    my_assert(!cache_overwrite(c, (key_type) "list", 11, "!", 1), "overwrite after the end succeeded");
+    my_assert(!cache_append(c, (key_type) "nope", "a", 1), "append to a missing key succeeded");
+    my_assert(cache_space_used(c) == 10, "in-place edits got memused wrong");
+
+    uint64_t n;
+    cache_set(c, (key_type) "n", "7", 1);
+    my_assert(cache_incr(c, (key_type) "n", 5, &n) && n == 12 && value_is(c, "n", "12"), "incr failed");
+    my_assert(cache_decr(c, (key_type) "n", 20, &n) && n == 0 && value_is(c, "n", "0"), "decr did not stop at 0");
+    my_assert(!cache_incr(c, (key_type) "list", 1, &n), "incr of a non-number succeeded");
+    cache_set(c, (key_type) "n", "18446744073709551615", 20);
+    my_assert(cache_incr(c, (key_type) "n", 1, &n) && n == 0, "incr did not wrap");
+    my_assert(cache_space_used(c) == 11, "incr got memused wrong");
+
+    // chunked values are copied, not edited
+    uint32_t big = CACHE_CHUNK_THRESHOLD + 1000;
+    uint8_t *val = calloc(1, big);
+    cache_set(c, (key_type) "big", val, big);
+    my_assert(cache_append(c, (key_type) "big", "end", 3), "append to a chunked value failed");
+    my_assert(cache_prepend(c, (key_type) "big", "start", 5), "prepend to a chunked value failed");
+    char window[8];
+    uint64_t copied, total;
+    cache_read(c, (key_type) "big", big + 5, window, sizeof(window), &copied, &total);
+    my_assert(copied == 3 && total == big + 8 && memcmp(window, "end", 3) == 0, "chunked append is wrong");
+    cache_read(c, (key_type) "big", 0, window, 6, &copied, &total);
+    my_assert(memcmp(window, "start", 5) == 0 && window[5] == 0, "chunked prepend is wrong");
+    free(val);
+
+    // concurrent readers never see a half-written counter
+    cache_set(c, (key_type) "n", "0", 1);
+    struct counter_reader reader = {c, false, false};
+    pthread_t thread;
+    pthread_create(&thread, NULL, counter_reader, &reader);
+    for (uint32_t i = 0; i < 20000; i++) {
+        cache_incr(c, (key_type) "n", 1, &n);
+    }
+    reader.done = true;
+    pthread_join(thread, NULL);
+    my_assert(!reader.bad && n == 20000 && value_is(c, "n", "20000"), "concurrent incr went wrong");
+    destroy_cache(c);
+
+    // edits count as a use, and growing past maxmem evicts
+    cache_config_init(&config, 30);
+    config.engine = engine;
+    c = create_cache_with_config(&config);
+    cache_set(c, (key_type) "a", "aaaaaaaaaa", 10);
+    cache_set(c, (key_type) "b", "bbbbbbbbbb", 10);
+    cache_set(c, (key_type) "c", "cccccccccc", 10);
+    cache_overwrite(c, (key_type) "a", 0, "A", 1);
+    cache_set(c, (key_type) "d", "dddddddddd", 10);
+    my_assert(value_is(c, "a", "Aaaaaaaaaa"), "edited key was evicted");
+    my_assert(!value_is(c, "b", "bbbbbbbbbb"), "untouched key was not evicted");
+    cache_append(c, (key_type) "d", "0123456789", 10);
+    my_assert(cache_space_used(c) <= 30, "growing a value overflowed maxmem");
+    destroy_cache(c);
+}
+
+static void test_in_place_updates()
+{
+    printf("Running cache in-place update test\n");
+    check_in_place(CACHE_ENGINE_CHAINED);
+    check_in_place(CACHE_ENGINE_CUCKOO);
+    check_in_place(CACHE_ENGINE_ART);
+}
+
+struct cas_worker
+{
+    cache_t cache;
+    uint32_t retries;
+};
+
+static void *cas_incrementer(void *arg)
+{
+    // 500 optimistic increments of a binary counter
+    struct cas_worker *w = arg;
+    for (uint32_t i = 0; i < 500; i++) {
+        for (;;) {
+            uint32_t size;
+            uint64_t version;
+            uint64_t *v = (uint64_t *) cache_get_versioned(w->cache, (key_type) "count", &size, &version);
+            uint64_t next = *v + 1;
+            free(v);
+            if (cache_cas(w->cache, (key_type) "count", &next, sizeof(next), version) == CACHE_CAS_OK) {
+                break;
+            }
+            ++w->retries;
+        }
+    }
+    return NULL;
+}
+
+static void check_cas(enum cache_engine engine)
+{
+    struct cache_config config;
+    cache_config_init(&config, 1 << 20);
+    config.engine = engine;
+    cache_t c = create_cache_with_config(&config);
+
+    uint32_t size;
+    uint64_t v1, v2, v3;
+    cache_set(c, (key_type) "k", "one", 3);
+    val_type v = cache_get_versioned(c, (key_type) "k", &size, &v1);
+    my_assert(v && v1 != 0, "cache_get_versioned returned no version");
+    free((void *) v);
+    my_assert(cache_version(c, (key_type) "k", &v2) && v2 == v1, "cache_version disagrees with get");
+
+    my_assert(cache_cas(c, (key_type) "k", "two", 3, v1) == CACHE_CAS_OK && value_is(c, "k", "two"),
+            "cas with the current version failed");
+    my_assert(cache_cas(c, (key_type) "k", "three", 5, v1) == CACHE_CAS_CHANGED && value_is(c, "k", "two"),
+            "cas with a stale version went through");
+    cache_version(c, (key_type) "k", &v2);
+    my_assert(v2 > v1, "cas did not bump the version");
+    cache_append(c, (key_type) "k", "!", 1);
+    cache_version(c, (key_type) "k", &v3);
+    my_assert(v3 > v2, "append did not bump the version");
+
+    my_assert(cache_cas(c, (key_type) "new", "x", 1, 5) == CACHE_CAS_MISSING, "cas of a missing key went through");
+    my_assert(cache_cas(c, (key_type) "new", "x", 1, 0) == CACHE_CAS_OK && value_is(c, "new", "x"),
+            "cas with version 0 did not add the key");
+    my_assert(cache_cas(c, (key_type) "new", "y", 1, 0) == CACHE_CAS_CHANGED, "cas with version 0 overwrote a key");
+    cache_delete(c, (key_type) "k");
+    my_assert(cache_cas(c, (key_type) "k", "four", 4, v3) == CACHE_CAS_MISSING, "cas of a deleted key went through");
+    my_assert(!cache_version(c, (key_type) "k", &v3), "deleted key has a version");
+
+    // no lost updates between racing read-modify-writes
+    uint64_t zero = 0;
+    cache_set(c, (key_type) "count", &zero, sizeof(zero));
+    struct cas_worker workers[4];
+    pthread_t threads[4];
+    for (uint32_t i = 0; i < 4; i++) {
+        workers[i].cache = c;
+        workers[i].retries = 0;
+        pthread_create(&threads[i], NULL, cas_incrementer, &workers[i]);
+    }
+    for (uint32_t i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    uint64_t *count = (uint64_t *) cache_get(c, (key_type) "count", &size);
+    my_assert(count && *count == 2000, "cas lost an update");
+    free(count);
+    destroy_cache(c);
+}
+
+static uint32_t overwrite_survivors(enum cache_engine engine, enum cache_eviction eviction)
+{
+    // a bit per key of which keys are left after reading key 0 a lot,
+    // overwriting it and then setting enough new keys to evict
+    struct cache_config config;
+    cache_config_init(&config, 40);
+    config.engine = engine;
+    config.eviction = eviction;
+    cache_t c = create_cache_with_config(&config);
+    uint8_t val[4] = {1,2,3,4};
+    char key[16];
+    uint32_t size;
+    for (uint32_t i = 0; i < 10; i++) {
+        snprintf(key, sizeof(key), "key%" PRIu32, i);
+        cache_set(c, (key_type) key, val, 4);
+    }
+    for (uint32_t i = 0; i < 20; i++) {
+        free((void *) cache_get(c, (key_type) "key0", &size));
+    }
+    cache_set(c, (key_type) "key0", val, 4);
+    for (uint32_t i = 10; i < 25; i++) {
+        snprintf(key, sizeof(key), "key%" PRIu32, i);
+        cache_set(c, (key_type) key, val, 4);
+    }
+    uint32_t survivors = 0;
+    for (uint32_t i = 0; i < 25; i++) {
+        snprintf(key, sizeof(key), "key%" PRIu32, i);
+        val_type v = cache_get(c, (key_type) key, &size);
+        if (v) {
+            survivors |= 1u << i;
+        }
+        free((void *) v);
+    }
+    destroy_cache(c);
+    return survivors;
+}
+
+static void test_cas()
+{
+    printf("Running cache cas test\n");
+    check_cas(CACHE_ENGINE_CHAINED);
+    check_cas(CACHE_ENGINE_CUCKOO);
+    check_cas(CACHE_ENGINE_ART);
+
+    // an overwrite is a new entry for eviction, whatever the engine
+    uint32_t lru = overwrite_survivors(CACHE_ENGINE_CHAINED, CACHE_EVICT_LRU);
+    my_assert(lru == overwrite_survivors(CACHE_ENGINE_CUCKOO, CACHE_EVICT_LRU) &&
+            lru == overwrite_survivors(CACHE_ENGINE_ART, CACHE_EVICT_LRU),
+            "engines evicted differently after an overwrite under LRU");
+    uint32_t gdsf = overwrite_survivors(CACHE_ENGINE_CHAINED, CACHE_EVICT_GDSF);
+    my_assert(gdsf == overwrite_survivors(CACHE_ENGINE_CUCKOO, CACHE_EVICT_GDSF) &&
+            gdsf == overwrite_survivors(CACHE_ENGINE_ART, CACHE_EVICT_GDSF),
+            "engines evicted differently after an overwrite under GDSF");
+    my_assert(!(gdsf & 1), "an overwrite kept the old value's reads under GDSF");
+}
+
+static void set_keys(cache_t c, const char *prefix, uint32_t from, uint32_t to)
+{
+    char key[32];
+    uint8_t val[100] = {0};
+    for (uint32_t i = from; i < to; i++) {
+        snprintf(key, sizeof(key), "%s%" PRIu32, prefix, i);
+        cache_set(c, (key_type) key, val, sizeof(val));
+    }
+}
+
+static bool has_key(cache_t c, const char *prefix, uint32_t i)
+{
+    char key[32];
+    snprintf(key, sizeof(key), "%s%" PRIu32, prefix, i);
+    uint32_t size;
+    val_type v = cache_get(c, (key_type) key, &size);
+    free((void *) v);
+    return v != NULL;
+}
+
+static void count_scan_cb(key_type key, val_type val, uint32_t val_size, void *arg)
+{
+    (void) key;
+    (void) val;
+    (void) val_size;
+    ++*(uint32_t *) arg;
+}
+
+static void check_namespaces(enum cache_engine engine, enum cache_eviction eviction)
+{
+    struct cache_config config;
+    cache_config_init(&config, 10000);
+    config.engine = engine;
+    config.eviction = eviction;
+    cache_t c = create_cache_with_config(&config);
+    uint32_t a = cache_namespace_create(c, "a:", 5000, false);
+    uint32_t b = cache_namespace_create(c, "b:", 3000, true);
+    struct cache_namespace_stats stats;
+    // sampled eviction only picks roughly the right key within a namespace
+    bool exact = eviction != CACHE_EVICT_SAMPLED;
+
+    // a hard quota holds even while the cache has room
+    set_keys(c, "b:", 0, 50);
+    cache_namespace_stats(c, b, &stats);
+    my_assert(stats.memused == 3000 && stats.items == 30 && stats.evictions == 20,
+            "hard quota was not kept");
+    my_assert(has_key(c, "b:", 49) && (!exact || !has_key(c, "b:", 0)), "hard quota evicted the wrong keys");
+
+    // a burst from one namespace borrows what is free, then only takes
+    // memory back from namespaces over their quota
+    set_keys(c, "x", 0, 20);
+    set_keys(c, "a:", 0, 150);
+    my_assert(cache_space_used(c) <= 10000, "namespaces let the cache overflow");
+    cache_namespace_stats(c, b, &stats);
+    my_assert(stats.memused == 3000 && stats.evictions == 20, "a burst in another namespace evicted b");
+    cache_namespace_stats(c, a, &stats);
+    my_assert(stats.memused > 5000 && stats.memused <= 6100, "a did not borrow from the default namespace");
+    my_assert(stats.sets == 150 && stats.evictions == 150 - stats.items, "a's stats are off");
+    my_assert(has_key(c, "a:", 149), "a's newest key was evicted");
+    cache_namespace_stats(c, CACHE_DEFAULT_NAMESPACE, &stats);
+    my_assert(stats.quota == 0 && stats.memused >= 900 && stats.memused < 2000,
+            "the default namespace did not give memory back");
+
+    cache_namespace_stats(c, a, &stats);
+    uint64_t hits = stats.hits;
+    uint64_t misses = stats.misses;
+    has_key(c, "a:", 149);
+    has_key(c, "a:", 1000);
+    cache_namespace_stats(c, a, &stats);
+    my_assert(stats.hits == hits + 1 && stats.misses == misses + 1, "a's hits and misses are off");
+
+    // a flush is immediate; flushed entries are evicted before anything else
+    uint64_t items = stats.items;
+    cache_namespace_flush(c, a);
+    cache_namespace_stats(c, a, &stats);
+    my_assert(stats.flushes == 1 && stats.flushed_items == items && stats.items == items,
+            "flush did not mark a's entries");
+    my_assert(!has_key(c, "a:", 149), "flushed key was found");
+    uint64_t version;
+    my_assert(!cache_version(c, (key_type) "a:149", &version), "flushed key has a version");
+    my_assert(!cache_append(c, (key_type) "a:149", "x", 1), "appended to a flushed key");
+    uint32_t scanned = 0;
+    uint64_t cursor = 0;
+    do {
+        cursor = cache_scan(c, cursor, 16, count_scan_cb, &scanned);
+    } while (cursor != 0);
+    cache_namespace_stats(c, CACHE_DEFAULT_NAMESPACE, &stats);
+    my_assert(scanned == 30 + stats.items, "scan handed out flushed entries");
+
+    set_keys(c, "a:", 0, 10);
+    my_assert(has_key(c, "a:", 5), "key set after a flush was not found");
+    set_keys(c, "x", 100, 130);
+    cache_namespace_stats(c, b, &stats);
+    my_assert(stats.memused == 3000 && stats.evictions == 20, "b lost keys while flushed ones were left");
+    cache_namespace_stats(c, a, &stats);
+    my_assert(stats.flushed_items < items && (!exact || stats.items - stats.flushed_items == 10),
+            "flushed entries were not evicted first");
+    for (uint32_t i = 0; exact && i < 10; i++) {
+        my_assert(has_key(c, "a:", i), "a live key went before the flushed ones");
+    }
+    destroy_cache(c);
+}
+
+static void test_namespaces()
+{
+    printf("Running cache namespace test\n");
+    enum cache_engine engines[] = {CACHE_ENGINE_CHAINED, CACHE_ENGINE_CUCKOO, CACHE_ENGINE_ART};
+    enum cache_eviction evictions[] = {CACHE_EVICT_LRU, CACHE_EVICT_SAMPLED, CACHE_EVICT_GDSF};
+    for (uint32_t e = 0; e < 3; e++) {
+        for (uint32_t p = 0; p < 3; p++) {
+            check_namespaces(engines[e], evictions[p]);
+        }
+    }
+}
+
+static uint64_t small_namespace_samples(uint32_t others)
+{
+    // candidates drawn for a namespace with room for 4 entries to evict
+    // its way through 5000 sets, next to others entries in the default
+    // namespace
+    struct cache_config config;
+    cache_config_init(&config, 1 << 26);
+    config.eviction = CACHE_EVICT_SAMPLED;
+    config.eviction_samples = 5;
+    cache_t c = create_cache_with_config(&config);
+    uint32_t small = cache_namespace_create(c, "small:", 400, true);
+    set_keys(c, "x", 0, others);
+    set_keys(c, "small:", 0, 5000);
+    struct cache_namespace_stats stats;
+    cache_namespace_stats(c, small, &stats);
+    my_assert(stats.items == 4 && stats.evictions == 4996, "small namespace kept the wrong entries");
+    destroy_cache(c);
+    return stats.sampled;
+}
+
+static void test_namespace_sampling_cost()
+{
+    printf("Running cache namespace sampling cost test\n");
+    // sampled eviction in a namespace draws from the namespace alone, so
+    // a big table around it doesn't change how many candidates an
+    // eviction takes; sampling the whole table would take thousands of
+    // rounds per eviction here
+    uint64_t alone = small_namespace_samples(0);
+    uint64_t crowded = small_namespace_samples(100000);
+    my_assert(alone >= 4996 * 5 && alone <= 4996 * 5 * 4, "sampling in a small namespace took too many rounds");
+    my_assert(crowded < 2 * alone, "sampling in a small namespace grew with the table");
+}
+
+static bool value_is_u32(cache_t c, const char *key, uint32_t want)
+{
+    uint32_t size;
+    uint32_t *v = (uint32_t *) cache_get(c, (key_type) key, &size);
+    bool same = v && size == sizeof(uint32_t) && *v == want;
+    free(v);
+    return same;
+}
+
+static void check_bulk_load(enum cache_engine engine)
+{
+    struct cache_config config;
+    cache_config_init(&config, 1 << 24);
+    config.engine = engine;
+    config.membership_filter = true;
+    cache_t c = create_cache_with_config(&config);
+    cache_set(c, (key_type) "key7", "old", 3);
+    cache_set(c, (key_type) "untouched", "here", 4);
+
+    // the last of each duplicate key wins, and so does the load over what
+    // was there
+    uint32_t n = 50000;
+    struct cache_entry *entries = calloc(n, sizeof(struct cache_entry));
+    char (*keys)[16] = calloc(n, 16);
+    uint32_t *vals = calloc(n, sizeof(uint32_t));
+    for (uint32_t i = 0; i < n; i++) {
+        snprintf(keys[i], 16, "key%" PRIu32, i % (n - 100));
+        vals[i] = i;
+        entries[i].key = (key_type) keys[i];
+        entries[i].val = &vals[i];
+        entries[i].val_size = sizeof(uint32_t);
+    }
+    cache_bulk_load(c, entries, n, 4);
+    my_assert(cache_space_used(c) == (n - 100) * sizeof(uint32_t) + 4, "bulk load miscounted memory");
+    my_assert(value_is(c, "untouched", "here"), "bulk load lost a key it didn't set");
+    bool all_found = true;
+    for (uint32_t i = 0; i < n - 100; i++) {
+        uint32_t size;
+        uint32_t *v = (uint32_t *) cache_get(c, (key_type) keys[i], &size);
+        uint32_t expected = i < 100 ? i + n - 100 : i;
+        all_found = all_found && v && *v == expected;
+        free(v);
+    }
+    my_assert(all_found, "bulk loaded keys are missing or not the last value");
+    if (engine == CACHE_ENGINE_CHAINED) {
+        my_assert(cache_bucket_count(c) >= n / 2, "bulk load did not size the table");
+    }
+    uint32_t size;
+    my_assert(cache_get(c, (key_type) "nope", &size) == NULL, "found a key never loaded");
+    destroy_cache(c);
+
+    // a load bigger than maxmem keeps the last entries
+    cache_config_init(&config, 1000 * sizeof(uint32_t));
+    config.engine = engine;
+    c = create_cache_with_config(&config);
+    for (uint32_t i = 0; i < n; i++) {
+        snprintf(keys[i], 16, "key%" PRIu32, i);
+    }
+    cache_bulk_load(c, entries, n, 0);
+    my_assert(cache_space_used(c) <= 1000 * sizeof(uint32_t), "bulk load went over maxmem");
+    my_assert(value_is_u32(c, keys[n - 1], n - 1) && !value_is_u32(c, keys[0], 0),
+            "bulk load kept the wrong entries");
+    destroy_cache(c);
+    free(entries);
+    free(keys);
+    free(vals);
+}
+
+static void test_bulk_load()
+{
+    printf("Running cache bulk load test\n");
+    check_bulk_load(CACHE_ENGINE_CHAINED);
+    check_bulk_load(CACHE_ENGINE_CUCKOO);
+    check_bulk_load(CACHE_ENGINE_ART);
+}
+
+static void check_defrag(enum cache_engine engine, enum cache_eviction eviction)
+{
+    struct cache_config config;
+    cache_config_init(&config, 1 << 26);
+    config.engine = engine;
+    config.eviction = eviction;
+    config.slab_allocator = true;
+    cache_t c = create_cache_with_config(&config);
+
+    // fill some pages, then delete four entries in five all over them
+    const uint32_t n = 40000;
+    char key[16];
+    uint8_t val[100];
+    for (uint32_t i = 0; i < n; i++) {
+        snprintf(key, sizeof(key), "key%" PRIu32, i);
+        memset(val, (int) (i & 0xff), sizeof(val));
+        cache_set(c, (key_type) key, val, sizeof(val));
+    }
+    uint64_t version_before;
+    cache_version(c, (key_type) "key5", &version_before);
+    for (uint32_t i = 0; i < n; i++) {
+        if (i % 5 != 0) {
+            snprintf(key, sizeof(key), "key%" PRIu32, i);
+            cache_delete(c, (key_type) key);
+        }
+    }
+    struct cache_defrag_stats before, after;
+    cache_defrag_stats(c, &before);
+    my_assert(before.fragmentation > 0.5, "deletes all over didn't fragment the slab");
+
+    my_assert(cache_defrag(c) > 0, "defrag moved nothing");
+    cache_defrag_stats(c, &after);
+    my_assert(after.free_pages > before.free_pages, "defrag emptied no page");
+    my_assert(after.fragmentation < before.fragmentation / 2, "defrag left the slab fragmented");
+    my_assert(after.used_bytes == before.used_bytes && after.passes == 1, "defrag stats are off");
+
+    // the moved entries are the same entries
+    bool all_found = true;
+    for (uint32_t i = 0; i < n; i += 5) {
+        snprintf(key, sizeof(key), "key%" PRIu32, i);
+        uint32_t size;
+        uint8_t *v = (uint8_t *) cache_get(c, (key_type) key, &size);
+        memset(val, (int) (i & 0xff), sizeof(val));
+        all_found = all_found && v && size == sizeof(val) && memcmp(v, val, size) == 0;
+        free(v);
+    }
+    my_assert(all_found, "defrag lost or mangled an entry");
+    uint64_t version_after;
+    my_assert(cache_version(c, (key_type) "key5", &version_after) && version_after == version_before,
+            "defrag changed a version");
+    my_assert(cache_space_used(c) == (n / 5) * sizeof(val), "defrag changed memused");
+
+    // the eviction order still knows every entry
+    cache_set_maxmem(c, 100 * sizeof(val));
+    my_assert(cache_space_used(c) <= 100 * sizeof(val), "could not evict after defrag");
+    destroy_cache(c);
+}
+
+static void test_defrag()
+{
+    printf("Running cache defrag test\n");
+    check_defrag(CACHE_ENGINE_CHAINED, CACHE_EVICT_LRU);
+    check_defrag(CACHE_ENGINE_CUCKOO, CACHE_EVICT_SAMPLED);
+    check_defrag(CACHE_ENGINE_ART, CACHE_EVICT_GDSF);
+    check_defrag(CACHE_ENGINE_CHAINED, CACHE_EVICT_GDSF);
+
+    // the maintenance thread gets to it on its own
+    struct cache_config config;
+    cache_config_init(&config, 1 << 26);
+    config.slab_allocator = true;
+    config.maintenance_thread = true;
+    config.maintenance_interval_ms = 10;
+    cache_t c = create_cache_with_config(&config);
+    char key[16];
+    uint8_t val[100] = {0};
+    for (uint32_t i = 0; i < 20000; i++) {
+        snprintf(key, sizeof(key), "key%" PRIu32, i);
+        cache_set(c, (key_type) key, val, sizeof(val));
+    }
+    for (uint32_t i = 0; i < 20000; i++) {
+        if (i % 5 != 0) {
+            snprintf(key, sizeof(key), "key%" PRIu32, i);
+            cache_delete(c, (key_type) key);
+        }
+    }
+    struct cache_defrag_stats stats;
+    cache_defrag_stats(c, &stats);
+    for (uint32_t tries = 0; tries < 200 && stats.fragmentation > config.defrag_threshold; tries++) {
+        usleep(10000);
+        cache_defrag_stats(c, &stats);
+    }
+    my_assert(stats.passes > 0 && stats.moved > 0, "maintenance thread never defragmented");
+    my_assert(stats.fragmentation <= config.defrag_threshold, "maintenance thread left the slab fragmented");
+
+    // cache_defrag works on the thread's pass rather than beside it: it
+    // ends the pass in progress, if any, and nothing is lost either way
+    for (uint32_t round = 0; round < 20; round++) {
+        for (uint32_t i = 0; i < 20000; i += 5) {
+            if (i % 10 != 0 && (i / 5) % 20 == round) {
+                snprintf(key, sizeof(key), "key%" PRIu32, i);
+                cache_delete(c, (key_type) key);
+            }
+        }
+        uint64_t passes = stats.passes;
+        cache_defrag(c);
+        cache_defrag_stats(c, &stats);
+        my_assert(stats.passes > passes, "cache_defrag didn't end a pass");
+    }
+    bool all_found = true;
+    for (uint32_t i = 0; i < 20000; i += 10) {
+        snprintf(key, sizeof(key), "key%" PRIu32, i);
+        uint32_t size;
+        void *v = (void *) cache_get(c, (key_type) key, &size);
+        all_found = all_found && v;
+        free(v);
+    }
+    my_assert(all_found, "defrag passes side by side lost an entry");
+    destroy_cache(c);
+}
+
+static void check_mrc(enum cache_engine engine)
+{
+    // Loop look-aside over twice as many values as fit: the cache misses
+    // every get, and the curve has to say so at its size and show that
+    // one big enough for the loop would hit
+    struct cache_config config;
+    const uint64_t maxmem = 1 << 20;
+    cache_config_init(&config, maxmem);
+    config.engine = engine;
+    config.miss_ratio_curve = true;
+    config.mrc_sample_rate = 0.1;
+    cache_t c = create_cache_with_config(&config);
+    char key[16];
+    uint8_t val[100] = {0};
+    const uint32_t n = 2 * maxmem / sizeof(val);
+    for (uint32_t pass = 0; pass < 10; pass++) {
+        for (uint32_t i = 0; i < n; i++) {
+            snprintf(key, sizeof(key), "key%" PRIu32, i);
+            uint32_t size;
+            val_type v = cache_get(c, (key_type) key, &size);
+            if (v == NULL) {
+                cache_set(c, (key_type) key, val, sizeof(val));
+            }
+            free((void *) v);
+        }
+    }
+    struct cache_namespace_stats ns;
+    cache_namespace_stats(c, CACHE_DEFAULT_NAMESPACE, &ns);
+    my_assert(ns.hits == 0, "an LRU cache hit a loop bigger than itself");
+
+    uint64_t sizes[] = {maxmem, 3 * maxmem};
+    double ratios[2];
+    uint64_t reads = cache_miss_ratio_curve(c, sizes, ratios, 2);
+    my_assert(reads > 0, "cache sampled no gets");
+    my_assert(ratios[0] > 0.9, "miss ratio curve disagrees with the cache at its size");
+    my_assert(ratios[1] < 0.2, "miss ratio curve says a cache the loop fits in misses");
+    destroy_cache(c);
+}
+
+static void test_miss_ratio_curve()
+{
+    printf("Running cache miss ratio curve test\n");
+    check_mrc(CACHE_ENGINE_CHAINED);
+    check_mrc(CACHE_ENGINE_CUCKOO);
+    check_mrc(CACHE_ENGINE_ART);
+
+    // off by default
+    cache_t c = create_cache(1 << 20);
+    uint64_t sizes[] = {1 << 20};
+    double ratios[1];
+    my_assert(cache_miss_ratio_curve(c, sizes, ratios, 1) == 0 && ratios[0] == 1,
+            "cache estimated a miss ratio curve it wasn't asked for");
+    destroy_cache(c);
+}
+
+static bool cache_has(cache_t c, const char *key)
+{
+    uint32_t size;
+    val_type v = cache_get(c, (key_type) key, &size);
+    free((void *) v);
+    return v != NULL;
+}
+
+static void check_tags(enum cache_engine engine, enum cache_eviction eviction, bool slab)
+{
+    struct cache_config config;
+    cache_config_init(&config, 1 << 20);
+    config.engine = engine;
+    config.eviction = eviction;
+    config.slab_allocator = slab;
+    cache_t c = create_cache_with_config(&config);
+    char key[16];
+    uint8_t val[100] = {0};
+    for (uint32_t i = 0; i < 100; i++) {
+        snprintf(key, sizeof(key), "key%" PRIu32, i);
+        const char *tags[] = {"all", i % 2 ? "odd" : "even", "all"};
+        cache_set_tagged(c, (key_type) key, val, sizeof(val), tags, 3);
+    }
+    for (uint32_t i = 0; i < 10; i++) {
+        snprintf(key, sizeof(key), "plain%" PRIu32, i);
+        cache_set(c, (key_type) key, val, sizeof(val));
+    }
+    my_assert(cache_tag_count(c, "all") == 100 && cache_tag_count(c, "even") == 50,
+            "tag counts are off");
+
+    // an overwrite brings its own tags, an append keeps them
+    cache_set(c, (key_type) "key0", val, sizeof(val));
+    const char *fresh[] = {"fresh"};
+    cache_set_tagged(c, (key_type) "key1", val, sizeof(val), fresh, 1);
+    cache_append(c, (key_type) "key2", val, sizeof(val));
+    cache_delete(c, (key_type) "key4");
+    my_assert(cache_tag_count(c, "all") == 97 && cache_tag_count(c, "even") == 48 &&
+            cache_tag_count(c, "odd") == 49 && cache_tag_count(c, "fresh") == 1,
+            "overwrites, appends or deletes left the tags wrong");
+    if (slab) {
+        // defrag moves nodes, which have to keep their tags
+        const char *filler[] = {"filler"};
+        for (uint32_t i = 0; i < 8000; i++) {
+            snprintf(key, sizeof(key), "filler%" PRIu32, i);
+            cache_set_tagged(c, (key_type) key, val, sizeof(val), filler, 1);
+        }
+        for (uint32_t i = 0; i < 8000; i++) {
+            if (i % 8 != 0) {
+                snprintf(key, sizeof(key), "filler%" PRIu32, i);
+                cache_delete(c, (key_type) key);
+            }
+        }
+        my_assert(cache_defrag(c) > 0, "defrag moved no tagged entries");
+        my_assert(cache_invalidate_tag(c, "filler") == 1000 && !cache_has(c, "filler8"),
+                "moved entries lost their tags");
+    }
+
+    uint64_t evens = cache_tag_count(c, "even");
+    my_assert(cache_invalidate_tag(c, "even") == evens, "invalidate missed entries");
+    my_assert(cache_invalidate_tag(c, "nothing") == 0, "invalidated an unknown tag");
+    bool ok = cache_tag_count(c, "even") == 0 && cache_tag_count(c, "all") == 49;
+    for (uint32_t i = 0; i < 100; i++) {
+        snprintf(key, sizeof(key), "key%" PRIu32, i);
+        bool expected = i % 2 == 1 || i == 0;
+        ok = ok && cache_has(c, key) == expected;
+    }
+    ok = ok && cache_has(c, "plain0");
+    my_assert(ok, "invalidating a tag dropped the wrong entries");
+
+    // Evict most of it: evicted entries leave their tags, and the eviction
+    // order can't hold invalidated keys (it would pick them forever)
+    for (uint32_t i = 0; i < 20000; i++) {
+        snprintf(key, sizeof(key), "new%" PRIu32, i);
+        const char *tags[] = {"new"};
+        cache_set_tagged(c, (key_type) key, val, sizeof(val), tags, 1);
+    }
+    uint64_t odd_left = 0;
+    for (uint32_t i = 3; i < 100; i += 2) {
+        snprintf(key, sizeof(key), "key%" PRIu32, i);
+        odd_left += cache_has(c, key);
+    }
+    my_assert(cache_tag_count(c, "odd") == odd_left && cache_tag_count(c, "new") < 20000,
+            "evicted entries kept their tags");
+    cache_invalidate_tag(c, "new");
+    cache_invalidate_tag(c, "odd");
+    cache_invalidate_tag(c, "fresh");
+    cache_delete(c, (key_type) "key0");
+    for (uint32_t i = 0; i < 10; i++) {
+        snprintf(key, sizeof(key), "plain%" PRIu32, i);
+        cache_delete(c, (key_type) key);
+    }
+    my_assert(cache_space_used(c) == 0 && cache_tag_count(c, "all") == 0,
+            "invalidating every entry left some behind");
+    destroy_cache(c);
+}
+
+static void test_tags()
+{
+    printf("Running cache tags test\n");
+    check_tags(CACHE_ENGINE_CHAINED, CACHE_EVICT_LRU, false);
+    check_tags(CACHE_ENGINE_CUCKOO, CACHE_EVICT_SAMPLED, false);
+    check_tags(CACHE_ENGINE_ART, CACHE_EVICT_GDSF, false);
+    check_tags(CACHE_ENGINE_CHAINED, CACHE_EVICT_GDSF, true);
+}
+
 void cache_tests()
 {
     printf("***Running cache tests***\n");
@@ -155,6 +1674,26 @@ void cache_tests()
     test_duplicate_key();
     test_space();
     test_delete();
+    test_maintenance_thread();
+    test_presize_and_shrink();
+    test_parallel_rehash();
+    test_cuckoo_engine();
+    test_reclaim_under_load();
+    test_art_engine();
+    test_near_cache();
+    test_membership_filter();
+    test_scan();
+    test_sampled_eviction();
+    test_gdsf_eviction();
+    test_chunked_values();
+    test_in_place_updates();
+    test_cas();
+    test_namespaces();
+    test_namespace_sampling_cost();
+    test_bulk_load();
+    test_defrag();
+    test_miss_ratio_curve();
+    test_tags();
 }
 
 
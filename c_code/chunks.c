@@ -0,0 +1,84 @@
+/*
+ * chunks.c: values stored in fixed-size chunks, see chunks.h
+ *
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chunks.h"
+
+struct chunks_obj
+{
+    uint64_t size;
+    uint64_t num_chunks;
+    uint64_t capacity; // room in chunks for this many pointers
+    uint8_t **chunks; // all full except maybe the last
+};
+
+chunks_t chunks_create(void)
+{
+    chunks_t chunks = calloc(1, sizeof(struct chunks_obj));
+    assert(chunks && "memory");
+    return chunks;
+}
+
+void chunks_destroy(chunks_t chunks)
+{
+    for (uint64_t i = 0; i < chunks->num_chunks; ++i) {
+        free(chunks->chunks[i]);
+    }
+    free(chunks->chunks);
+    free(chunks);
+}
+
+void chunks_append(chunks_t chunks, const void *buf, uint64_t len)
+{
+    const uint8_t *src = buf;
+    while (len > 0) {
+        uint64_t used = chunks->size % CHUNK_SIZE;
+        if (used == 0 && chunks->size == chunks->num_chunks * CHUNK_SIZE) {
+            // last chunk is full (or there is none yet)
+            if (chunks->num_chunks == chunks->capacity) {
+                chunks->capacity = chunks->capacity ? 2 * chunks->capacity : 4;
+                chunks->chunks = realloc(chunks->chunks, chunks->capacity * sizeof(uint8_t *));
+                assert(chunks->chunks && "memory");
+            }
+            chunks->chunks[chunks->num_chunks] = malloc(CHUNK_SIZE);
+            assert(chunks->chunks[chunks->num_chunks] && "memory");
+            ++chunks->num_chunks;
+        }
+        uint64_t n = CHUNK_SIZE - used < len ? CHUNK_SIZE - used : len;
+        memcpy(chunks->chunks[chunks->num_chunks - 1] + used, src, n);
+        chunks->size += n;
+        src += n;
+        len -= n;
+    }
+}
+
+uint64_t chunks_read(chunks_t chunks, uint64_t offset, void *buf, uint64_t len)
+{
+    if (offset >= chunks->size) {
+        return 0;
+    }
+    if (len > chunks->size - offset) {
+        len = chunks->size - offset;
+    }
+    uint8_t *dst = buf;
+    uint64_t left = len;
+    while (left > 0) {
+        uint64_t in_chunk = offset % CHUNK_SIZE;
+        uint64_t n = CHUNK_SIZE - in_chunk < left ? CHUNK_SIZE - in_chunk : left;
+        memcpy(dst, chunks->chunks[offset / CHUNK_SIZE] + in_chunk, n);
+        dst += n;
+        offset += n;
+        left -= n;
+    }
+    return len;
+}
+
+uint64_t chunks_size(chunks_t chunks)
+{
+    return chunks->size;
+}
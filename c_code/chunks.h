@@ -0,0 +1,31 @@
+/*
+ * chunks.h: header file for values stored in fixed-size chunks
+ *
+ */
+#pragma once
+
+#include <inttypes.h>
+
+// A large value kept as a list of CHUNK_SIZE pieces instead of one
+// contiguous buffer, so storing it never needs one huge allocation and
+// reading part of it only copies that part. It is built by appending and
+// is never changed after that, so any number of readers can read it at
+// once.
+#define CHUNK_SIZE (64 * 1024)
+
+typedef struct chunks_obj *chunks_t;
+
+// create an empty value
+chunks_t chunks_create(void);
+
+void chunks_destroy(chunks_t chunks);
+
+// add len bytes at the end
+void chunks_append(chunks_t chunks, const void *buf, uint64_t len);
+
+// copy up to len bytes starting at offset into buf and return how many
+// were copied (0 if offset is at or past the end)
+uint64_t chunks_read(chunks_t chunks, uint64_t offset, void *buf, uint64_t len);
+
+// total size of the value
+uint64_t chunks_size(chunks_t chunks);
@@ -0,0 +1,333 @@
+/*
+ * cluster.c: a consistent hashing cluster of caches, see cluster.h
+ *
+ */
+
+#define _GNU_SOURCE // pthread_attr_setaffinity_np
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cluster.h"
+#include "pages.h"
+
+struct ring_point
+{
+    uint64_t point;
+    uint32_t node_id;
+};
+
+struct cluster_obj
+{
+    pthread_rwlock_t lock; // write locked while the ring changes
+    uint32_t vnodes;
+
+    struct cluster_backend *nodes; // indexed by node id
+    bool *live; // whether nodes[i] is still on the ring
+    int *numa; // NUMA node each node's memory is on, or -1
+    uint32_t num_nodes;
+
+    struct ring_point *ring; // sorted by point
+    uint32_t ring_size;
+};
+
+// one node's share of a multi-key request
+struct fanout
+{
+    struct cluster_backend backend;
+    int numa_node;
+    uint32_t *indexes; // which of the caller's keys belong to this node
+    uint32_t n;
+    const key_type *keys;
+    const val_type *set_vals;
+    const uint32_t *set_sizes;
+    val_type *get_vals;
+    uint32_t *get_sizes;
+    pthread_t thread;
+};
+
+static uint64_t ring_hash(const uint8_t *bytes, size_t len)
+{
+    // FNV-1a, then a finalizer so nearby inputs land far apart on the ring
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+static uint64_t key_point(key_type key)
+{
+    return ring_hash(key, strlen((const char*) key));
+}
+
+static int compare_points(const void *a, const void *b)
+{
+    uint64_t pa = ((const struct ring_point *) a)->point;
+    uint64_t pb = ((const struct ring_point *) b)->point;
+    return (pa > pb) - (pa < pb);
+}
+
+static void rebuild_ring(cluster_t cluster)
+{
+    uint32_t live = 0;
+    for (uint32_t i = 0; i < cluster->num_nodes; ++i) {
+        live += cluster->live[i];
+    }
+    free(cluster->ring);
+    cluster->ring_size = live * cluster->vnodes;
+    cluster->ring = calloc(cluster->ring_size ? cluster->ring_size : 1, sizeof(struct ring_point));
+    assert(cluster->ring && "memory");
+
+    uint32_t r = 0;
+    for (uint32_t i = 0; i < cluster->num_nodes; ++i) {
+        if (!cluster->live[i]) {
+            continue;
+        }
+        for (uint32_t v = 0; v < cluster->vnodes; ++v) {
+            uint32_t id_and_vnode[2] = {i, v};
+            cluster->ring[r].point = ring_hash((const uint8_t *) id_and_vnode, sizeof(id_and_vnode));
+            cluster->ring[r].node_id = i;
+            ++r;
+        }
+    }
+    qsort(cluster->ring, cluster->ring_size, sizeof(struct ring_point), compare_points);
+}
+
+static uint32_t lookup_node(cluster_t cluster, key_type key)
+{
+    // first point at or after the key's point, wrapping around the ring
+    assert(cluster->ring_size > 0 && "cluster has no nodes");
+    uint64_t point = key_point(key);
+    uint32_t lo = 0;
+    uint32_t hi = cluster->ring_size;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (cluster->ring[mid].point < point) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return cluster->ring[lo == cluster->ring_size ? 0 : lo].node_id;
+}
+
+cluster_t cluster_create(uint32_t vnodes)
+{
+    assert(vnodes > 0 && "every node needs at least one point on the ring");
+    cluster_t cluster = calloc(1, sizeof(struct cluster_obj));
+    assert(cluster && "memory");
+    pthread_rwlock_init(&cluster->lock, NULL);
+    cluster->vnodes = vnodes;
+    return cluster;
+}
+
+void cluster_destroy(cluster_t cluster)
+{
+    pthread_rwlock_destroy(&cluster->lock);
+    free(cluster->nodes);
+    free(cluster->live);
+    free(cluster->numa);
+    free(cluster->ring);
+    free(cluster);
+}
+
+static uint32_t add_node(cluster_t cluster, struct cluster_backend backend, int numa_node)
+{
+    pthread_rwlock_wrlock(&cluster->lock);
+    uint32_t id = cluster->num_nodes++;
+    cluster->nodes = realloc(cluster->nodes, cluster->num_nodes * sizeof(struct cluster_backend));
+    cluster->live = realloc(cluster->live, cluster->num_nodes * sizeof(bool));
+    cluster->numa = realloc(cluster->numa, cluster->num_nodes * sizeof(int));
+    assert(cluster->nodes && cluster->live && cluster->numa && "memory");
+    cluster->nodes[id] = backend;
+    cluster->live[id] = true;
+    cluster->numa[id] = numa_node;
+    rebuild_ring(cluster);
+    pthread_rwlock_unlock(&cluster->lock);
+    return id;
+}
+
+uint32_t cluster_add_node(cluster_t cluster, struct cluster_backend backend)
+{
+    return add_node(cluster, backend, -1);
+}
+
+static void cache_backend_set(void *ctx, key_type key, val_type val, uint32_t val_size)
+{
+    cache_set(ctx, key, val, val_size);
+}
+
+static val_type cache_backend_get(void *ctx, key_type key, uint32_t *val_size)
+{
+    return cache_get(ctx, key, val_size);
+}
+
+static void cache_backend_delete(void *ctx, key_type key)
+{
+    cache_delete(ctx, key);
+}
+
+uint32_t cluster_add_cache(cluster_t cluster, cache_t cache)
+{
+    struct cluster_backend backend = {cache, cache_backend_set, cache_backend_get,
+        cache_backend_delete};
+    return add_node(cluster, backend, cache_numa_node(cache));
+}
+
+void cluster_remove_node(cluster_t cluster, uint32_t node_id)
+{
+    pthread_rwlock_wrlock(&cluster->lock);
+    assert(node_id < cluster->num_nodes && cluster->live[node_id] && "no such node");
+    cluster->live[node_id] = false;
+    rebuild_ring(cluster);
+    pthread_rwlock_unlock(&cluster->lock);
+}
+
+uint32_t cluster_node_for(cluster_t cluster, key_type key)
+{
+    pthread_rwlock_rdlock(&cluster->lock);
+    uint32_t id = lookup_node(cluster, key);
+    pthread_rwlock_unlock(&cluster->lock);
+    return id;
+}
+
+static struct cluster_backend backend_for(cluster_t cluster, key_type key)
+{
+    pthread_rwlock_rdlock(&cluster->lock);
+    struct cluster_backend backend = cluster->nodes[lookup_node(cluster, key)];
+    pthread_rwlock_unlock(&cluster->lock);
+    return backend;
+}
+
+void cluster_set(cluster_t cluster, key_type key, val_type val, uint32_t val_size)
+{
+    struct cluster_backend backend = backend_for(cluster, key);
+    backend.set(backend.ctx, key, val, val_size);
+}
+
+val_type cluster_get(cluster_t cluster, key_type key, uint32_t *val_size)
+{
+    struct cluster_backend backend = backend_for(cluster, key);
+    return backend.get(backend.ctx, key, val_size);
+}
+
+void cluster_delete(cluster_t cluster, key_type key)
+{
+    struct cluster_backend backend = backend_for(cluster, key);
+    backend.del(backend.ctx, key);
+}
+
+static void *run_fanout(void *arg)
+{
+    struct fanout *f = arg;
+    for (uint32_t j = 0; j < f->n; ++j) {
+        uint32_t i = f->indexes[j];
+        if (f->get_vals) {
+            f->get_vals[i] = f->backend.get(f->backend.ctx, f->keys[i], &f->get_sizes[i]);
+        } else {
+            f->backend.set(f->backend.ctx, f->keys[i], f->set_vals[i], f->set_sizes[i]);
+        }
+    }
+    return NULL;
+}
+
+static void start_fanout(struct fanout *f)
+{
+    // run next to the node's memory if we know where that is
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    cpu_set_t cpus;
+    if (f->numa_node >= 0 && pages_node_cpus(f->numa_node, &cpus)) {
+        pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+    }
+    int rc = pthread_create(&f->thread, &attr, run_fanout, f);
+    assert(rc == 0 && "could not start fan-out thread");
+    pthread_attr_destroy(&attr);
+}
+
+static void fan_out(cluster_t cluster, const key_type *keys, uint32_t n,
+        const val_type *set_vals, const uint32_t *set_sizes,
+        val_type *get_vals, uint32_t *get_sizes)
+{
+    // group the keys by node under the read lock, then run every group
+    // on its own thread, pinned to the group's NUMA node. The caller's
+    // thread takes a group on its own NUMA node if there is one, else the
+    // first group.
+    pthread_rwlock_rdlock(&cluster->lock);
+    uint32_t num_nodes = cluster->num_nodes;
+    struct fanout *groups = calloc(num_nodes ? num_nodes : 1, sizeof(struct fanout));
+    uint32_t *owners = calloc(n ? n : 1, sizeof(uint32_t));
+    assert(groups && owners && "memory");
+    for (uint32_t i = 0; i < n; ++i) {
+        owners[i] = lookup_node(cluster, keys[i]);
+        ++groups[owners[i]].n;
+    }
+    for (uint32_t id = 0; id < num_nodes; ++id) {
+        struct fanout *f = &groups[id];
+        f->backend = cluster->nodes[id];
+        f->numa_node = cluster->numa[id];
+        f->indexes = calloc(f->n ? f->n : 1, sizeof(uint32_t));
+        assert(f->indexes && "memory");
+        f->keys = keys;
+        f->set_vals = set_vals;
+        f->set_sizes = set_sizes;
+        f->get_vals = get_vals;
+        f->get_sizes = get_sizes;
+        f->n = 0;
+    }
+    for (uint32_t i = 0; i < n; ++i) {
+        struct fanout *f = &groups[owners[i]];
+        f->indexes[f->n++] = i;
+    }
+    pthread_rwlock_unlock(&cluster->lock);
+
+    int here = pages_current_node();
+    int32_t mine = -1;
+    for (uint32_t id = 0; id < num_nodes; ++id) {
+        if (groups[id].n == 0) {
+            continue;
+        }
+        if (mine < 0 || (groups[id].numa_node == here && groups[mine].numa_node != here)) {
+            mine = (int32_t) id;
+        }
+    }
+    for (uint32_t id = 0; id < num_nodes; ++id) {
+        if (groups[id].n > 0 && (int32_t) id != mine) {
+            start_fanout(&groups[id]);
+        }
+    }
+    if (mine >= 0) {
+        run_fanout(&groups[mine]);
+    }
+    for (uint32_t id = 0; id < num_nodes; ++id) {
+        if (groups[id].n > 0 && (int32_t) id != mine) {
+            pthread_join(groups[id].thread, NULL);
+        }
+    }
+
+    for (uint32_t id = 0; id < num_nodes; ++id) {
+        free(groups[id].indexes);
+    }
+    free(groups);
+    free(owners);
+}
+
+void cluster_multi_get(cluster_t cluster, const key_type *keys, uint32_t n,
+        val_type *vals, uint32_t *val_sizes)
+{
+    fan_out(cluster, keys, n, NULL, NULL, vals, val_sizes);
+}
+
+void cluster_multi_set(cluster_t cluster, const key_type *keys, const val_type *vals,
+        const uint32_t *val_sizes, uint32_t n)
+{
+    fan_out(cluster, keys, n, vals, val_sizes, NULL, NULL);
+}
@@ -0,0 +1,68 @@
+/*
+ * cluster.h: header file for a client-side cluster of caches
+ *
+ */
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include "cache.h"
+
+// A cluster spreads keys over several nodes with a consistent hash ring:
+// each node owns vnodes points on the ring, and a key goes to the node
+// owning the first point at or after the key's hash. Adding or removing a
+// node only moves the keys between it and its neighbours on the ring,
+// about 1/N of them.
+//
+// A node is anything that implements struct cluster_backend. Only local,
+// in-process caches are supported so far, added with cluster_add_cache:
+// this tree has no cache server and no network backend, so caches on
+// other (e.g. localhost) ports can't be clustered yet. Such a backend
+// would implement the same three calls.
+typedef struct cluster_obj *cluster_t;
+
+struct cluster_backend
+{
+    void *ctx;
+    void (*set)(void *ctx, key_type key, val_type val, uint32_t val_size);
+    // returns a buffer the caller frees, or NULL
+    val_type (*get)(void *ctx, key_type key, uint32_t *val_size);
+    void (*del)(void *ctx, key_type key);
+};
+
+// create an empty cluster where each node gets vnodes points on the ring
+cluster_t cluster_create(uint32_t vnodes);
+
+// frees the cluster, but not the caches or backends in it
+void cluster_destroy(cluster_t cluster);
+
+// add a node and return its id
+uint32_t cluster_add_node(cluster_t cluster, struct cluster_backend backend);
+
+// add a local cache as a node and return its id. If the cache was
+// created for a NUMA node (see cache_config.numa_node), multi-key requests
+// run its share on that node's cpus.
+uint32_t cluster_add_cache(cluster_t cluster, cache_t cache);
+
+// take a node off the ring. Its keys are not moved anywhere, they will
+// just miss on the nodes that inherit them.
+void cluster_remove_node(cluster_t cluster, uint32_t node_id);
+
+// id of the node that owns key. The cluster must not be empty.
+uint32_t cluster_node_for(cluster_t cluster, key_type key);
+
+// same as cache_set, cache_get and cache_delete, on the node owning key
+void cluster_set(cluster_t cluster, key_type key, val_type val, uint32_t val_size);
+val_type cluster_get(cluster_t cluster, key_type key, uint32_t *val_size);
+void cluster_delete(cluster_t cluster, key_type key);
+
+// Get n keys at once. The keys are grouped by node and every node's
+// group is fetched on its own thread. vals[i] and val_sizes[i] are filled
+// in like cluster_get would for keys[i].
+void cluster_multi_get(cluster_t cluster, const key_type *keys, uint32_t n,
+        val_type *vals, uint32_t *val_sizes);
+
+// Set n keys at once, grouped and fanned out like cluster_multi_get
+void cluster_multi_set(cluster_t cluster, const key_type *keys, const val_type *vals,
+        const uint32_t *val_sizes, uint32_t n);
@@ -0,0 +1,211 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cache.h"
+#include "cluster.h"
+#include "cluster_tests.h"
+#include "pages.h"
+
+#define my_assert(value, string) \
+{if (!(value)) { printf("!!!FAILURE!!! %s\n", string);}}
+
+#define NUM_KEYS 10000
+
+static void make_key(char *key, size_t len, uint32_t i)
+{
+    snprintf(key, len, "user:%" PRIu32 ":profile", i);
+}
+
+static void test_cluster_set_get()
+{
+    printf("Running cluster set/get test\n");
+    cache_t caches[3];
+    cluster_t cluster = cluster_create(100);
+    for (uint32_t i = 0; i < 3; i++) {
+        caches[i] = create_cache(1000000);
+        cluster_add_cache(cluster, caches[i]);
+    }
+
+    char key[32];
+    for (uint32_t i = 0; i < 1000; i++) {
+        make_key(key, sizeof(key), i);
+        cluster_set(cluster, (key_type) key, &i, sizeof(i));
+    }
+    for (uint32_t i = 0; i < 1000; i++) {
+        make_key(key, sizeof(key), i);
+        uint32_t size;
+        uint32_t *v = (uint32_t *) cluster_get(cluster, (key_type) key, &size);
+        my_assert(v && *v == i, "cluster lost a key");
+        free(v);
+    }
+
+    // every node should hold a fair share of the keys
+    for (uint32_t i = 0; i < 3; i++) {
+        uint64_t used = cache_space_used(caches[i]);
+        my_assert(used > 1000 * sizeof(uint32_t) / 6, "cluster is badly unbalanced");
+    }
+
+    make_key(key, sizeof(key), 7);
+    cluster_delete(cluster, (key_type) key);
+    uint32_t size;
+    my_assert(cluster_get(cluster, (key_type) key, &size) == NULL, "cluster delete failed");
+
+    cluster_destroy(cluster);
+    for (uint32_t i = 0; i < 3; i++) {
+        destroy_cache(caches[i]);
+    }
+}
+
+static void test_cluster_remapping()
+{
+    // adding a fifth node should only move about a fifth of the keys, and
+    // removing it again should put them all back
+    printf("Running cluster remapping test\n");
+    cache_t caches[5];
+    cluster_t cluster = cluster_create(160);
+    for (uint32_t i = 0; i < 4; i++) {
+        caches[i] = create_cache(1000);
+        cluster_add_cache(cluster, caches[i]);
+    }
+
+    uint32_t *before = calloc(NUM_KEYS, sizeof(uint32_t));
+    char key[32];
+    for (uint32_t i = 0; i < NUM_KEYS; i++) {
+        make_key(key, sizeof(key), i);
+        before[i] = cluster_node_for(cluster, (key_type) key);
+    }
+
+    caches[4] = create_cache(1000);
+    uint32_t added = cluster_add_cache(cluster, caches[4]);
+    uint32_t moved = 0;
+    for (uint32_t i = 0; i < NUM_KEYS; i++) {
+        make_key(key, sizeof(key), i);
+        uint32_t now = cluster_node_for(cluster, (key_type) key);
+        if (now != before[i]) {
+            ++moved;
+            my_assert(now == added, "a key moved between two old nodes");
+        }
+    }
+    my_assert(moved > NUM_KEYS / 10 && moved < NUM_KEYS * 3 / 10,
+            "adding a node did not move about 1/N of the keys");
+
+    cluster_remove_node(cluster, added);
+    for (uint32_t i = 0; i < NUM_KEYS; i++) {
+        make_key(key, sizeof(key), i);
+        my_assert(cluster_node_for(cluster, (key_type) key) == before[i],
+                "removing a node moved keys it didn't own");
+    }
+
+    free(before);
+    cluster_destroy(cluster);
+    for (uint32_t i = 0; i < 5; i++) {
+        destroy_cache(caches[i]);
+    }
+}
+
+static void test_cluster_multi()
+{
+    printf("Running cluster multi get/set test\n");
+    cache_t caches[4];
+    cluster_t cluster = cluster_create(100);
+    for (uint32_t i = 0; i < 4; i++) {
+        caches[i] = create_cache(1000000);
+        cluster_add_cache(cluster, caches[i]);
+    }
+
+    enum { N = 500 };
+    char keybufs[N][32];
+    key_type keys[N];
+    uint32_t nums[N];
+    val_type vals[N];
+    uint32_t sizes[N];
+    for (uint32_t i = 0; i < N; i++) {
+        make_key(keybufs[i], sizeof(keybufs[i]), i);
+        keys[i] = (key_type) keybufs[i];
+        nums[i] = i * 3;
+        vals[i] = &nums[i];
+        sizes[i] = sizeof(uint32_t);
+    }
+    // only set the even keys, so the odd ones miss
+    key_type even_keys[N / 2];
+    val_type even_vals[N / 2];
+    for (uint32_t i = 0; i < N / 2; i++) {
+        even_keys[i] = keys[2 * i];
+        even_vals[i] = vals[2 * i];
+    }
+    cluster_multi_set(cluster, even_keys, even_vals, sizes, N / 2);
+
+    val_type got[N];
+    uint32_t got_sizes[N];
+    cluster_multi_get(cluster, keys, N, got, got_sizes);
+    for (uint32_t i = 0; i < N; i++) {
+        if (i % 2 == 0) {
+            my_assert(got[i] && got_sizes[i] == sizeof(uint32_t) &&
+                    *(const uint32_t *) got[i] == i * 3, "multi get returned a wrong value");
+        } else {
+            my_assert(got[i] == NULL, "multi get found a key that was never set");
+        }
+        free((void *) got[i]);
+    }
+
+    cluster_destroy(cluster);
+    for (uint32_t i = 0; i < 4; i++) {
+        destroy_cache(caches[i]);
+    }
+}
+
+static void test_cluster_numa()
+{
+    // caches placed on NUMA nodes, with huge page tables; the multi-key
+    // calls pin their threads to those nodes
+    printf("Running cluster numa test\n");
+    cache_t caches[2];
+    cluster_t cluster = cluster_create(100);
+    for (uint32_t i = 0; i < 2; i++) {
+        struct cache_config config;
+        cache_config_init(&config, 1000000);
+        config.pages = CACHE_PAGES_HUGE_2MB;
+        config.numa_node = pages_current_node();
+        config.engine = i == 0 ? CACHE_ENGINE_CHAINED : CACHE_ENGINE_CUCKOO;
+        caches[i] = create_cache_with_config(&config);
+        my_assert(cache_numa_node(caches[i]) == config.numa_node, "cache forgot its numa node");
+        cluster_add_cache(cluster, caches[i]);
+    }
+
+    enum { N = 1000 };
+    char key_bufs[N][32];
+    key_type keys[N];
+    val_type vals[N];
+    uint32_t sizes[N];
+    uint32_t ids[N];
+    for (uint32_t i = 0; i < N; i++) {
+        make_key(key_bufs[i], sizeof(key_bufs[i]), i);
+        keys[i] = (key_type) key_bufs[i];
+        ids[i] = i;
+        vals[i] = &ids[i];
+        sizes[i] = sizeof(uint32_t);
+    }
+    cluster_multi_set(cluster, keys, vals, sizes, N);
+    val_type got[N];
+    cluster_multi_get(cluster, keys, N, got, sizes);
+    for (uint32_t i = 0; i < N; i++) {
+        my_assert(got[i] && *(const uint32_t *) got[i] == i, "numa cluster lost a key");
+        free((void *) got[i]);
+    }
+
+    cluster_destroy(cluster);
+    for (uint32_t i = 0; i < 2; i++) {
+        destroy_cache(caches[i]);
+    }
+}
+
+void cluster_tests()
+{
+    printf("***Running cluster tests***\n");
+    test_cluster_set_get();
+    test_cluster_remapping();
+    test_cluster_multi();
+    test_cluster_numa();
+}
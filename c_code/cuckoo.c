@@ -0,0 +1,460 @@
+/*
+ * cuckoo.c: a bucketized cuckoo hash table of nodes, see cuckoo.h
+ *
+ */
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cuckoo.h"
+
+// load factor the table is sized for at creation
+const float CUCKOO_INITIAL_LOAD = 0.5;
+const uint64_t CUCKOO_MIN_BUCKETS = 16;
+// number of (bucket, slot) entries the displacement search may look at
+// before giving up and growing the table
+#define CUCKOO_MAX_SEARCH 1024
+
+struct cuckoo_bucket
+{
+    _Atomic uint32_t version; // odd while a writer is changing the bucket
+    _Atomic uint8_t tags[CUCKOO_SLOTS];
+    node_t *_Atomic slots[CUCKOO_SLOTS];
+};
+
+struct cuckoo_array
+{
+    uint64_t num_buckets; // always a power of two
+    struct cuckoo_array *retired_next;
+    struct cuckoo_bucket buckets[];
+};
+
+struct cuckoo_obj
+{
+    struct cuckoo_array *_Atomic array;
+    uint64_t size;
+    // old arrays readers may still be using: retired since the last
+    // cuckoo_next_epoch, and in the epoch before that
+    struct cuckoo_array *retired;
+    struct cuckoo_array *retired_before;
+    struct page_policy pages;
+};
+
+// one step of the displacement search: the node in (bucket, slot), reached
+// from the entry at index parent
+struct cuckoo_step
+{
+    uint64_t bucket;
+    uint32_t slot;
+    int32_t parent;
+};
+
+static uint64_t cuckoo_mix(uint64_t hash)
+{
+    // the alternate bucket and tag come from a remix of the key's hash
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+static uint8_t cuckoo_tag(uint64_t hash)
+{
+    return (uint8_t) (cuckoo_mix(hash) >> 56) | 1;
+}
+
+static uint64_t block_mask(struct cuckoo_array *a)
+{
+    // blocks are numbered by the low bits of bucket indexes
+    uint64_t num_blocks = a->num_buckets / CUCKOO_BLOCK_BUCKETS;
+    return num_blocks > 0 ? num_blocks - 1 : 0;
+}
+
+static uint64_t cuckoo_primary(struct cuckoo_array *a, uint64_t hash)
+{
+    return hash & (a->num_buckets - 1);
+}
+
+static uint64_t cuckoo_secondary(struct cuckoo_array *a, uint64_t hash)
+{
+    // in the primary's block: same low bits, the rest from the remix
+    uint64_t mask = block_mask(a);
+    return (hash & mask) | (cuckoo_mix(hash) & (a->num_buckets - 1) & ~mask);
+}
+
+static uint64_t cuckoo_alternate(struct cuckoo_array *a, node_t *node, uint64_t bucket)
+{
+    uint64_t primary = cuckoo_primary(a, node->hash);
+    return bucket == primary ? cuckoo_secondary(a, node->hash) : primary;
+}
+
+static struct cuckoo_array *new_array(cuckoo_t table, uint64_t num_buckets)
+{
+    struct cuckoo_array *a = pages_alloc(&table->pages, sizeof(struct cuckoo_array) +
+            num_buckets * sizeof(struct cuckoo_bucket));
+    a->num_buckets = num_buckets;
+    return a;
+}
+
+static void begin_write(struct cuckoo_bucket *b)
+{
+    atomic_fetch_add(&b->version, 1);
+}
+
+static void end_write(struct cuckoo_bucket *b)
+{
+    atomic_fetch_add(&b->version, 1);
+}
+
+static void set_slot(struct cuckoo_bucket *b, uint32_t slot, node_t *node, uint8_t tag)
+{
+    // release: a reader that sees the pointer also sees the node's key
+    atomic_store_explicit(&b->slots[slot], node, memory_order_release);
+    atomic_store_explicit(&b->tags[slot], tag, memory_order_relaxed);
+}
+
+static int32_t empty_slot(struct cuckoo_bucket *b)
+{
+    for (uint32_t s = 0; s < CUCKOO_SLOTS; ++s) {
+        if (atomic_load_explicit(&b->slots[s], memory_order_relaxed) == NULL) {
+            return (int32_t) s;
+        }
+    }
+    return -1;
+}
+
+static int32_t find_slot(struct cuckoo_bucket *b, uint8_t tag, key_type key)
+{
+    for (uint32_t s = 0; s < CUCKOO_SLOTS; ++s) {
+        if (atomic_load_explicit(&b->tags[s], memory_order_relaxed) != tag) {
+            continue;
+        }
+        node_t *node = atomic_load_explicit(&b->slots[s], memory_order_acquire);
+        if (node && strcmp((const char*) node->key, (const char*) key) == 0) {
+            return (int32_t) s;
+        }
+    }
+    return -1;
+}
+
+cuckoo_t cuckoo_create(uint64_t num_items)
+{
+    return cuckoo_create_with_pages(num_items, NULL);
+}
+
+cuckoo_t cuckoo_create_with_pages(uint64_t num_items, const struct page_policy *policy)
+{
+    cuckoo_t table = calloc(1, sizeof(struct cuckoo_obj));
+    assert(table && "memory");
+    table->pages.size = PAGES_DEFAULT;
+    table->pages.numa_node = -1;
+    if (policy) {
+        table->pages = *policy;
+    }
+    uint64_t num_buckets = CUCKOO_MIN_BUCKETS;
+    while ((float) num_items > num_buckets * CUCKOO_SLOTS * CUCKOO_INITIAL_LOAD) {
+        num_buckets *= 2;
+    }
+    atomic_init(&table->array, new_array(table, num_buckets));
+    return table;
+}
+
+void cuckoo_destroy(cuckoo_t table)
+{
+    cuckoo_reclaim(table);
+    pages_free(atomic_load(&table->array));
+    free(table);
+}
+
+node_t *cuckoo_find(cuckoo_t table, key_type key, uint64_t hash)
+{
+    uint8_t tag = cuckoo_tag(hash);
+    for (;;) {
+        struct cuckoo_array *a = atomic_load_explicit(&table->array, memory_order_acquire);
+        struct cuckoo_bucket *b1 = &a->buckets[cuckoo_primary(a, hash)];
+        struct cuckoo_bucket *b2 = &a->buckets[cuckoo_secondary(a, hash)];
+
+        uint32_t v1 = atomic_load_explicit(&b1->version, memory_order_acquire);
+        uint32_t v2 = atomic_load_explicit(&b2->version, memory_order_acquire);
+        if ((v1 | v2) & 1) {
+            continue; // a writer is in the middle of changing a bucket
+        }
+
+        node_t *found = NULL;
+        int32_t s = find_slot(b1, tag, key);
+        if (s >= 0) {
+            found = atomic_load_explicit(&b1->slots[s], memory_order_relaxed);
+        } else if ((s = find_slot(b2, tag, key)) >= 0) {
+            found = atomic_load_explicit(&b2->slots[s], memory_order_relaxed);
+        }
+
+        // the answer only counts if neither bucket (nor the array) changed
+        atomic_thread_fence(memory_order_acquire);
+        if (v1 == atomic_load_explicit(&b1->version, memory_order_relaxed) &&
+                v2 == atomic_load_explicit(&b2->version, memory_order_relaxed) &&
+                a == atomic_load_explicit(&table->array, memory_order_relaxed)) {
+            return found;
+        }
+    }
+}
+
+static bool on_path(struct cuckoo_step *queue, int32_t i, uint64_t bucket)
+{
+    // a chain must not pass through the same bucket twice, or executing it
+    // would move the wrong nodes
+    for (; i >= 0; i = queue[i].parent) {
+        if (queue[i].bucket == bucket) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool try_insert(struct cuckoo_array *a, node_t *node)
+{
+    uint64_t i1 = cuckoo_primary(a, node->hash);
+    uint64_t i2 = cuckoo_secondary(a, node->hash);
+    uint8_t tag = cuckoo_tag(node->hash);
+
+    // easy case: one of the two buckets has a free slot
+    uint64_t candidates[2] = {i1, i2};
+    for (uint32_t c = 0; c < 2; ++c) {
+        struct cuckoo_bucket *b = &a->buckets[candidates[c]];
+        int32_t s = empty_slot(b);
+        if (s >= 0) {
+            begin_write(b);
+            set_slot(b, s, node, tag);
+            end_write(b);
+            return true;
+        }
+    }
+
+    // breadth first search for a chain of nodes that can each move to
+    // their alternate bucket, ending in a bucket with a free slot
+    static __thread struct cuckoo_step queue[CUCKOO_MAX_SEARCH];
+    int32_t head = 0;
+    int32_t tail = 0;
+    for (uint32_t c = 0; c < 2; ++c) {
+        for (uint32_t s = 0; s < CUCKOO_SLOTS; ++s) {
+            queue[tail++] = (struct cuckoo_step) {candidates[c], s, -1};
+        }
+    }
+
+    int32_t last = -1;
+    uint64_t free_bucket = 0;
+    uint32_t free_slot = 0;
+    while (head < tail && last < 0) {
+        struct cuckoo_step *step = &queue[head];
+        node_t *n = atomic_load_explicit(&a->buckets[step->bucket].slots[step->slot],
+                memory_order_relaxed);
+        uint64_t alt = cuckoo_alternate(a, n, step->bucket);
+        if (!on_path(queue, head, alt)) {
+            int32_t s = empty_slot(&a->buckets[alt]);
+            if (s >= 0) {
+                last = head;
+                free_bucket = alt;
+                free_slot = (uint32_t) s;
+            } else {
+                for (uint32_t k = 0; k < CUCKOO_SLOTS && tail < CUCKOO_MAX_SEARCH; ++k) {
+                    queue[tail++] = (struct cuckoo_step) {alt, k, head};
+                }
+            }
+        }
+        ++head;
+    }
+    if (last < 0) {
+        return false;
+    }
+
+    // walk the chain back from the free slot. Each node is copied into its
+    // new slot before its old slot is cleared, so readers always find it
+    // in at least one bucket (and the version bumps make them retry).
+    for (int32_t i = last; i >= 0; i = queue[i].parent) {
+        struct cuckoo_bucket *from = &a->buckets[queue[i].bucket];
+        struct cuckoo_bucket *to = &a->buckets[free_bucket];
+        uint32_t s = queue[i].slot;
+        node_t *n = atomic_load_explicit(&from->slots[s], memory_order_relaxed);
+
+        begin_write(to);
+        begin_write(from);
+        set_slot(to, free_slot, n, atomic_load_explicit(&from->tags[s], memory_order_relaxed));
+        set_slot(from, s, NULL, 0);
+        end_write(from);
+        end_write(to);
+
+        free_bucket = queue[i].bucket;
+        free_slot = s;
+    }
+
+    struct cuckoo_bucket *b = &a->buckets[free_bucket];
+    begin_write(b);
+    set_slot(b, free_slot, node, tag);
+    end_write(b);
+    return true;
+}
+
+static void cuckoo_grow(cuckoo_t table)
+{
+    // build a bigger array off to the side, then publish it in one store.
+    // Readers still on the old array notice the swap and retry.
+    struct cuckoo_array *old = atomic_load(&table->array);
+    uint64_t num_buckets = old->num_buckets * 2;
+    for (;;) {
+        struct cuckoo_array *a = new_array(table, num_buckets);
+        bool ok = true;
+        for (uint64_t i = 0; i < old->num_buckets && ok; ++i) {
+            for (uint32_t s = 0; s < CUCKOO_SLOTS && ok; ++s) {
+                node_t *n = atomic_load_explicit(&old->buckets[i].slots[s], memory_order_relaxed);
+                if (n) {
+                    ok = try_insert(a, n);
+                }
+            }
+        }
+        if (ok) {
+            atomic_store_explicit(&table->array, a, memory_order_release);
+            old->retired_next = table->retired;
+            table->retired = old;
+            return;
+        }
+        pages_free(a);
+        num_buckets *= 2;
+    }
+}
+
+void cuckoo_insert(cuckoo_t table, node_t *node)
+{
+    while (!try_insert(atomic_load(&table->array), node)) {
+        cuckoo_grow(table);
+    }
+    ++table->size;
+}
+
+node_t *cuckoo_remove(cuckoo_t table, key_type key, uint64_t hash)
+{
+    struct cuckoo_array *a = atomic_load(&table->array);
+    uint8_t tag = cuckoo_tag(hash);
+    uint64_t candidates[2] = {cuckoo_primary(a, hash), cuckoo_secondary(a, hash)};
+    for (uint32_t c = 0; c < 2; ++c) {
+        struct cuckoo_bucket *b = &a->buckets[candidates[c]];
+        int32_t s = find_slot(b, tag, key);
+        if (s >= 0) {
+            node_t *node = atomic_load_explicit(&b->slots[s], memory_order_relaxed);
+            begin_write(b);
+            set_slot(b, s, NULL, 0);
+            end_write(b);
+            --table->size;
+            return node;
+        }
+    }
+    return NULL;
+}
+
+node_t *cuckoo_replace(cuckoo_t table, node_t *node)
+{
+    struct cuckoo_array *a = atomic_load(&table->array);
+    uint8_t tag = cuckoo_tag(node->hash);
+    uint64_t candidates[2] = {cuckoo_primary(a, node->hash), cuckoo_secondary(a, node->hash)};
+    for (uint32_t c = 0; c < 2; ++c) {
+        struct cuckoo_bucket *b = &a->buckets[candidates[c]];
+        int32_t s = find_slot(b, tag, node->key);
+        if (s >= 0) {
+            node_t *old = atomic_load_explicit(&b->slots[s], memory_order_relaxed);
+            begin_write(b);
+            set_slot(b, s, node, tag);
+            end_write(b);
+            return old;
+        }
+    }
+    return NULL;
+}
+
+uint64_t cuckoo_size(cuckoo_t table)
+{
+    return table->size;
+}
+
+uint64_t cuckoo_bucket_count(cuckoo_t table)
+{
+    return atomic_load(&table->array)->num_buckets;
+}
+
+uint32_t cuckoo_bucket_nodes(cuckoo_t table, uint64_t bucket, node_t **nodes)
+{
+    struct cuckoo_array *a = atomic_load(&table->array);
+    uint32_t n = 0;
+    for (uint32_t s = 0; s < CUCKOO_SLOTS; ++s) {
+        node_t *node = atomic_load_explicit(&a->buckets[bucket].slots[s], memory_order_relaxed);
+        if (node) {
+            nodes[n++] = node;
+        }
+    }
+    return n;
+}
+
+uint64_t cuckoo_block_count(cuckoo_t table)
+{
+    return block_mask(atomic_load(&table->array)) + 1;
+}
+
+void cuckoo_block_foreach(cuckoo_t table, uint64_t block,
+        void (*fn)(node_t *node, void *arg), void *arg)
+{
+    struct cuckoo_array *a = atomic_load(&table->array);
+    uint64_t num_blocks = block_mask(a) + 1;
+    for (uint64_t i = block; i < a->num_buckets; i += num_blocks) {
+        for (uint32_t s = 0; s < CUCKOO_SLOTS; ++s) {
+            node_t *n = atomic_load_explicit(&a->buckets[i].slots[s], memory_order_relaxed);
+            if (n) {
+                fn(n, arg);
+            }
+        }
+    }
+}
+
+void cuckoo_foreach(cuckoo_t table, void (*fn)(node_t *node, void *arg), void *arg)
+{
+    struct cuckoo_array *a = atomic_load(&table->array);
+    for (uint64_t i = 0; i < a->num_buckets; ++i) {
+        for (uint32_t s = 0; s < CUCKOO_SLOTS; ++s) {
+            node_t *n = atomic_load_explicit(&a->buckets[i].slots[s], memory_order_relaxed);
+            if (n) {
+                fn(n, arg);
+            }
+        }
+    }
+}
+
+static void free_retired(struct cuckoo_array *a)
+{
+    while (a) {
+        struct cuckoo_array *next = a->retired_next;
+        pages_free(a);
+        a = next;
+    }
+}
+
+void cuckoo_reclaim(cuckoo_t table)
+{
+    free_retired(table->retired);
+    free_retired(table->retired_before);
+    table->retired = NULL;
+    table->retired_before = NULL;
+}
+
+void cuckoo_next_epoch(cuckoo_t table)
+{
+    free_retired(table->retired_before);
+    table->retired_before = table->retired;
+    table->retired = NULL;
+}
+
+bool cuckoo_has_retired(cuckoo_t table)
+{
+    return table->retired || table->retired_before;
+}
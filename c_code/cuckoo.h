@@ -0,0 +1,92 @@
+/*
+ * cuckoo.h: header file for a bucketized cuckoo hash table of nodes
+ *
+ */
+#pragma once
+
+#include <stdbool.h>
+
+#include "node.h"
+#include "pages.h"
+
+// Every key has two candidate buckets of CUCKOO_SLOTS slots each, so a
+// lookup looks at no more than 2 * CUCKOO_SLOTS entries however full the
+// table is. Slots hold a one byte tag and a pointer to the node, so there
+// are no chain pointers to follow.
+//
+// Writes (insert, remove) must be serialized by the caller. cuckoo_find
+// takes no locks and may run concurrently with a writer: each bucket has a
+// version counter which is odd while the bucket is being changed, and a
+// reader retries if either of its buckets changed under it.
+// Nodes removed from the table, and bucket arrays retired by growth, may
+// still be in use by concurrent readers; the caller decides when readers
+// are done with them (see cuckoo_reclaim and cuckoo_next_epoch).
+#define CUCKOO_SLOTS 4
+
+// Both buckets of a key are in the same block of CUCKOO_BLOCK_BUCKETS
+// buckets (the whole table while it is smaller than two blocks), so inserts
+// only ever move nodes within a block. Blocks are numbered by the low bits
+// of the hash: when the table doubles, block i splits into blocks i and
+// i + the old block count, like the buckets of a chained table, which is
+// what lets cache_scan walk a block at a time across growth.
+#define CUCKOO_BLOCK_BUCKETS 256
+
+typedef struct cuckoo_obj *cuckoo_t;
+
+// create a table with room for roughly num_items nodes
+cuckoo_t cuckoo_create(uint64_t num_items);
+
+// same, with the bucket arrays allocated following policy (see pages.h)
+cuckoo_t cuckoo_create_with_pages(uint64_t num_items, const struct page_policy *policy);
+
+// frees the table, but not the nodes in it
+void cuckoo_destroy(cuckoo_t table);
+
+// returns the node with key, or NULL. hash is the full hash of key.
+node_t *cuckoo_find(cuckoo_t table, key_type key, uint64_t hash);
+
+// insert a node whose key is not in the table yet. node->hash must be set.
+// The table grows if there is no room for the node.
+void cuckoo_insert(cuckoo_t table, node_t *node);
+
+// unlink and return the node with key, or NULL if it isn't in the table
+node_t *cuckoo_remove(cuckoo_t table, key_type key, uint64_t hash);
+
+// put node in the slot of the node with the same key, and return that
+// node, or NULL if the key isn't in the table. Concurrent readers find
+// either the old node or the new one, never neither.
+node_t *cuckoo_replace(cuckoo_t table, node_t *node);
+
+// number of nodes in the table
+uint64_t cuckoo_size(cuckoo_t table);
+
+// number of buckets in the table (each with CUCKOO_SLOTS slots)
+uint64_t cuckoo_bucket_count(cuckoo_t table);
+
+// copy the nodes in one bucket into nodes (which has room for
+// CUCKOO_SLOTS) and return how many there were. Not safe against a
+// concurrent writer.
+uint32_t cuckoo_bucket_nodes(cuckoo_t table, uint64_t bucket, node_t **nodes);
+
+// number of blocks in the table, a power of two
+uint64_t cuckoo_block_count(cuckoo_t table);
+
+// call fn on every node in one block. Not safe against a concurrent writer.
+void cuckoo_block_foreach(cuckoo_t table, uint64_t block,
+        void (*fn)(node_t *node, void *arg), void *arg);
+
+// call fn on every node in the table. Not safe against a concurrent writer.
+void cuckoo_foreach(cuckoo_t table, void (*fn)(node_t *node, void *arg), void *arg);
+
+// free bucket arrays retired by growth. Only call this when no
+// cuckoo_find can still be running against an old array.
+void cuckoo_reclaim(cuckoo_t table);
+
+// free bucket arrays retired before the previous call, and keep the ones
+// retired since for the next. For callers that track readers in epochs:
+// call it when a new epoch starts, once every cuckoo_find that began
+// before the previous call has returned.
+void cuckoo_next_epoch(cuckoo_t table);
+
+// true if bucket arrays retired by growth are waiting to be freed
+bool cuckoo_has_retired(cuckoo_t table);
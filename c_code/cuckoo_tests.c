@@ -0,0 +1,209 @@
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cuckoo.h"
+#include "cuckoo_tests.h"
+
+#define my_assert(value, string) \
+{if (!(value)) { printf("!!!FAILURE!!! %s\n", string);}}
+
+#define NUM_TEST_NODES 5000
+
+// the tests hash keys themselves, cuckoo.h leaves that to the cache
+static uint64_t test_hash(key_type key)
+{
+    uint64_t hash = 14695981039346656037ULL; // FNV-1a
+    while (*key) {
+        hash ^= *key++;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static node_t *make_node(uint32_t i)
+{
+    char key[16];
+    snprintf(key, sizeof(key), "node%" PRIu32, i);
+    node_t *node = new_node((key_type) key, &i, sizeof(i));
+    node->hash = test_hash(node->key);
+    return node;
+}
+
+static void free_node_cb(node_t *node, void *arg)
+{
+    ++*(uint32_t *) arg;
+    free_node(node);
+}
+
+static void test_cuckoo_insert_find_remove()
+{
+    printf("Running cuckoo insert/find/remove test\n");
+    cuckoo_t table = cuckoo_create(10);
+    node_t *nodes[NUM_TEST_NODES];
+    for (uint32_t i = 0; i < NUM_TEST_NODES; i++) {
+        nodes[i] = make_node(i);
+        cuckoo_insert(table, nodes[i]);
+    }
+    my_assert(cuckoo_size(table) == NUM_TEST_NODES, "wrong size after inserts");
+
+    for (uint32_t i = 0; i < NUM_TEST_NODES; i++) {
+        node_t *found = cuckoo_find(table, nodes[i]->key, nodes[i]->hash);
+        my_assert(found == nodes[i], "inserted node not found");
+    }
+    my_assert(cuckoo_find(table, (key_type) "missing", test_hash((key_type) "missing")) == NULL,
+            "found a key that was never inserted");
+
+    // remove the even nodes
+    for (uint32_t i = 0; i < NUM_TEST_NODES; i += 2) {
+        node_t *removed = cuckoo_remove(table, nodes[i]->key, nodes[i]->hash);
+        my_assert(removed == nodes[i], "remove returned the wrong node");
+        free_node(removed);
+    }
+    for (uint32_t i = 0; i < NUM_TEST_NODES; i++) {
+        char key[16];
+        snprintf(key, sizeof(key), "node%" PRIu32, i);
+        node_t *found = cuckoo_find(table, (key_type) key, test_hash((key_type) key));
+        my_assert((i % 2 == 0) == (found == NULL), "find after remove is wrong");
+    }
+
+    uint32_t count = 0;
+    cuckoo_foreach(table, free_node_cb, &count);
+    my_assert(count == NUM_TEST_NODES / 2, "foreach missed nodes");
+    cuckoo_destroy(table);
+}
+
+static void test_cuckoo_load_factor()
+{
+    // the table should fill well past 90% of its slots before it has to grow
+    printf("Running cuckoo load factor test\n");
+    cuckoo_t table = cuckoo_create(0);
+    uint64_t initial_buckets = cuckoo_bucket_count(table);
+    uint64_t best_load = 0;
+    uint32_t i = 0;
+    while (cuckoo_bucket_count(table) == initial_buckets) {
+        best_load = cuckoo_size(table);
+        cuckoo_insert(table, make_node(i++));
+    }
+    float load = (float) best_load / (initial_buckets * CUCKOO_SLOTS);
+    my_assert(load > 0.9, "cuckoo table grew before reaching 90% load");
+
+    uint32_t count = 0;
+    cuckoo_foreach(table, free_node_cb, &count);
+    cuckoo_destroy(table);
+}
+
+struct block_check
+{
+    uint64_t block;
+    uint64_t mask;
+    uint32_t count;
+    uint32_t misplaced;
+};
+
+static void block_check_cb(node_t *node, void *arg)
+{
+    struct block_check *check = arg;
+    ++check->count;
+    if ((node->hash & check->mask) != check->block) {
+        ++check->misplaced;
+    }
+}
+
+static void test_cuckoo_blocks()
+{
+    // after any number of doublings, every node is in the block its hash
+    // says, and walking the blocks finds each node once
+    printf("Running cuckoo blocks test\n");
+    cuckoo_t table = cuckoo_create(0);
+    for (uint32_t i = 0; i < NUM_TEST_NODES * 4; i++) {
+        cuckoo_insert(table, make_node(i));
+    }
+    uint64_t blocks = cuckoo_block_count(table);
+    my_assert(blocks > 1, "table never got past one block");
+    struct block_check check = {0, blocks - 1, 0, 0};
+    for (check.block = 0; check.block < blocks; ++check.block) {
+        cuckoo_block_foreach(table, check.block, block_check_cb, &check);
+    }
+    my_assert(check.count == NUM_TEST_NODES * 4, "block walk missed nodes");
+    my_assert(check.misplaced == 0, "a node left its block");
+
+    uint32_t count = 0;
+    cuckoo_foreach(table, free_node_cb, &count);
+    cuckoo_destroy(table);
+}
+
+struct reader_args
+{
+    cuckoo_t table;
+    node_t **stable; // nodes that stay in the table the whole time
+    atomic_bool done;
+    uint32_t bad;
+};
+
+static void *reader(void *arg)
+{
+    struct reader_args *args = arg;
+    while (!atomic_load(&args->done)) {
+        for (uint32_t i = 0; i < 100; i++) {
+            node_t *n = args->stable[i];
+            if (cuckoo_find(args->table, n->key, n->hash) != n) {
+                ++args->bad;
+            }
+        }
+    }
+    return NULL;
+}
+
+static void test_cuckoo_concurrent_reads()
+{
+    // a reader must never miss a key that stays in the table, even while
+    // a writer is displacing nodes around it and growing the table.
+    // Nothing is freed until the reader is done.
+    printf("Running cuckoo concurrent read test\n");
+    cuckoo_t table = cuckoo_create(0);
+    node_t *stable[100];
+    for (uint32_t i = 0; i < 100; i++) {
+        stable[i] = make_node(i);
+        cuckoo_insert(table, stable[i]);
+    }
+
+    struct reader_args args = {table, stable, false, 0};
+    pthread_t thread;
+    pthread_create(&thread, NULL, reader, &args);
+
+    node_t *churn[NUM_TEST_NODES];
+    for (uint32_t i = 0; i < NUM_TEST_NODES; i++) {
+        churn[i] = make_node(100 + i);
+        cuckoo_insert(table, churn[i]);
+        if (i % 3 == 0) {
+            cuckoo_remove(table, churn[i]->key, churn[i]->hash);
+        }
+    }
+
+    atomic_store(&args.done, true);
+    pthread_join(thread, NULL);
+    my_assert(args.bad == 0, "concurrent reader missed a stable key");
+
+    for (uint32_t i = 0; i < NUM_TEST_NODES; i++) {
+        if (i % 3 == 0) {
+            free_node(churn[i]);
+        }
+    }
+    uint32_t count = 0;
+    cuckoo_foreach(table, free_node_cb, &count);
+    cuckoo_destroy(table);
+}
+
+void cuckoo_tests()
+{
+    printf("***Running cuckoo tests***\n");
+    test_cuckoo_insert_find_remove();
+    test_cuckoo_load_factor();
+    test_cuckoo_blocks();
+    test_cuckoo_concurrent_reads();
+}
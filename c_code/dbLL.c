@@ -14,15 +14,25 @@
 dbLL_t *new_list(){
     dbLL_t *list = (dbLL_t *) calloc(1, sizeof(dbLL_t));
     assert(list);
+    ll_init(list);
+    return list;
+}
+
+void ll_init(dbLL_t *list){
     list->head = NULL;
     list->tail = NULL;
     list->size = 0;
-    return list;
 }
 
-void ll_insert(dbLL_t *list, key_type key, val_type val, uint32_t val_size){
+node_t *ll_insert(dbLL_t *list, key_type key, val_type val, uint32_t val_size){
     node_t *node = new_node(key, val, val_size);
+    ll_push_node(list, node);
+    return node;
+}
 
+void ll_push_node(dbLL_t *list, node_t *node){
+    node->prev = NULL;
+    node->next = NULL;
     if ((list->size) == 0){
         //printf("EMPTY LIST: Inserting a new node with key: %d, val: %d\n", *node->key, *(uint8_t *)node->val);
         list->head = node;
@@ -37,6 +47,31 @@ void ll_insert(dbLL_t *list, key_type key, val_type val, uint32_t val_size){
     list->size += 1;
 }
 
+node_t *ll_pop_node(dbLL_t *list){
+    node_t *node = list->head;
+    if (node == NULL) {
+        return NULL;
+    }
+    list->head = node->next;
+    if (list->head == NULL) {
+        list->tail = NULL;
+    } else {
+        list->head->prev = NULL;
+    }
+    node->next = NULL;
+    list->size -= 1;
+    return node;
+}
+
+node_t *ll_find_node(dbLL_t *list, key_type key)
+{
+    node_t *cur = list->head;
+    while (cur != NULL && strcmp((const char*) cur->key, (const char*) key) != 0) {
+        cur = cur->next;
+    }
+    return cur;
+}
+
 val_type ll_search(dbLL_t *list, key_type key, uint32_t *val_size)
 {
     void *ret_val = NULL;
@@ -55,24 +90,19 @@ val_type ll_search(dbLL_t *list, key_type key, uint32_t *val_size)
     return ret_val;
 }
 
-uint32_t ll_remove_key(dbLL_t *list, key_type key){
+node_t *ll_unlink_key(dbLL_t *list, key_type key){
     node_t *cur = list->head;
-    uint32_t val_size = 0;
-    while((cur != NULL) &&(val_size == 0)){
-        if (*cur->key == *key){
-            val_size = cur->val_size;
+    while(cur != NULL){
+        if (strcmp((const char*) cur->key, (const char*) key) == 0){
             if((cur == list->head) && (cur == list->tail)){
-                // printf("cur head & tail ");
                 list->head = NULL;
                 list->tail = NULL;
             }
             else if(cur == list->tail){
-                // printf("cur tail ");
                 list->tail = list->tail->prev;
                 list->tail->next = NULL;
             }
             else if(cur == list->head){
-                // printf("cur head ");
                 list->head = list->head->next;
                 list->head->prev = NULL;
             }
@@ -80,30 +110,41 @@ uint32_t ll_remove_key(dbLL_t *list, key_type key){
                 cur->prev->next = cur->next;
                 cur->next->prev = cur->prev;
             }
-            // printf("a node with key: %d and value: %d and value size: %d was found and removed.\n", *cur->key, *(uint8_t *)cur->val, val_size);
-            free((void *)cur->key);
-            free((void *)cur->val);
-            free(cur);
+            cur->next = NULL;
+            cur->prev = NULL;
             list->size -= 1;
-            return val_size;
+            return cur;
         }
         else{
             cur = cur->next;
         }
     }
+    return NULL;
+}
+
+uint32_t ll_remove_key(dbLL_t *list, key_type key){
+    node_t *node = ll_unlink_key(list, key);
+    if (node == NULL) {
+        return 0;
+    }
+    uint32_t val_size = node->val_size;
+    free_node(node);
     return val_size;
 }
 
 void destroy_list(dbLL_t *list){
+    ll_clear(list);
+    free(list);
+}
+
+void ll_clear(dbLL_t *list){
     node_t *cur = list->head;
     while (cur != NULL){
-        free((void *)cur->key);
-        free((void *)cur->val);
         node_t *temp = cur;
         cur = cur->next;
-        free(temp);
+        free_node(temp);
     }
-    free(list);
+    ll_init(list);
 }
 
 void rep_list(dbLL_t *list){
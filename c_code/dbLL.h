@@ -17,12 +17,28 @@ struct _dbLL_t{
 
 dbLL_t *new_list();
 
-// insert a new node into the list with (key, val, val_size)
-void ll_insert(dbLL_t *list, key_type key, val_type val, uint32_t val_size);
+// initialize a list embedded in some other structure (e.g. a bucket array)
+void ll_init(dbLL_t *list);
+
+// insert a new node into the list with (key, val, val_size), returns the node
+node_t *ll_insert(dbLL_t *list, key_type key, val_type val, uint32_t val_size);
+
+// push an existing (unlinked) node onto the front of the list
+void ll_push_node(dbLL_t *list, node_t *node);
+
+// detach and return the head of the list, or NULL if the list is empty
+node_t *ll_pop_node(dbLL_t *list);
 
 // removes the node with key specified in function call
 uint32_t ll_remove_key(dbLL_t *list, key_type key);
 
+// detaches the node with key from the list without freeing it, or returns NULL
+// if the key is not in the list. The caller owns the node (see free_node).
+node_t *ll_unlink_key(dbLL_t *list, key_type key);
+
+// returns the node with key, or NULL if the key is not in the list
+node_t *ll_find_node(dbLL_t *list, key_type key);
+
 // search list for key. If the key is found, return the value. 
 // If the key is not found, NULL is returned
 val_type ll_search(dbLL_t *list, key_type key, uint32_t *val_size);
@@ -32,6 +48,9 @@ void rep_list(dbLL_t *list);
 
 void destroy_list(dbLL_t *list);
 
+// free every node in the list, leaving it empty (the list itself is not freed)
+void ll_clear(dbLL_t *list);
+
 // returns an array of all keys
 // can access size of array via list->size
 key_type *ll_get_keys(dbLL_t *list);
@@ -0,0 +1,103 @@
+/*
+ * epoch.c: epoch-based reclamation behind lock-free readers, see epoch.h
+ *
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "epoch.h"
+
+// readers are counted in this many places, one per thread until there are
+// more threads than this
+#define EPOCH_STRIPES 64
+#define CACHE_LINE 64
+
+// A stripe fills a cache line, and the epoch only shares its line with
+// padding, so readers only ever write to their own stripe's line.
+struct epoch_stripe
+{
+    _Atomic uint64_t count[2]; // readers counted under even and odd epochs
+    char pad[CACHE_LINE - 2 * sizeof(uint64_t)];
+};
+
+struct epoch_obj
+{
+    _Atomic uint64_t epoch;
+    char pad[CACHE_LINE - sizeof(uint64_t)];
+    struct epoch_stripe stripes[EPOCH_STRIPES];
+};
+
+static _Atomic uint32_t next_stripe;
+static __thread uint32_t thread_stripe = EPOCH_STRIPES;
+
+epoch_t epoch_create(void)
+{
+    epoch_t epochs = aligned_alloc(CACHE_LINE, sizeof(struct epoch_obj));
+    assert(epochs && "memory");
+    memset(epochs, 0, sizeof(struct epoch_obj));
+    return epochs;
+}
+
+void epoch_destroy(epoch_t epochs)
+{
+    free(epochs);
+}
+
+epoch_reader_t epoch_enter(epoch_t epochs)
+{
+    // the count goes under the epoch the reader still sees after making
+    // it. If a new epoch started in between, epoch_advance may already
+    // have looked at this stripe, so count again under the new one.
+    if (thread_stripe == EPOCH_STRIPES) {
+        thread_stripe = atomic_fetch_add(&next_stripe, 1) % EPOCH_STRIPES;
+    }
+    struct epoch_stripe *stripe = &epochs->stripes[thread_stripe];
+    for (;;) {
+        uint64_t epoch = atomic_load(&epochs->epoch);
+        epoch_reader_t reader = &stripe->count[epoch & 1];
+        atomic_fetch_add(reader, 1);
+        if (atomic_load(&epochs->epoch) == epoch) {
+            return reader;
+        }
+        atomic_fetch_sub(reader, 1);
+    }
+}
+
+void epoch_exit(epoch_reader_t reader)
+{
+    atomic_fetch_sub_explicit(reader, 1, memory_order_release);
+}
+
+uint64_t epoch_current(epoch_t epochs)
+{
+    return atomic_load(&epochs->epoch);
+}
+
+bool epoch_ready(epoch_t epochs)
+{
+    // readers counted under e - 1 share a parity with e + 1, which nobody
+    // counts under yet. The fence orders the caller's unlinks before the
+    // counts are read.
+    atomic_thread_fence(memory_order_seq_cst);
+    uint32_t before = (atomic_load(&epochs->epoch) + 1) & 1;
+    for (uint32_t i = 0; i < EPOCH_STRIPES; ++i) {
+        if (atomic_load(&epochs->stripes[i].count[before]) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool epoch_advance(epoch_t epochs)
+{
+    // Only readers counted under e - 1 or earlier can have found what was
+    // retired during e - 1, and the start of e waited for the ones before
+    // e - 1.
+    if (!epoch_ready(epochs)) {
+        return false;
+    }
+    atomic_fetch_add(&epochs->epoch, 1);
+    return true;
+}
@@ -0,0 +1,46 @@
+/*
+ * epoch.h: header file for epoch-based reclamation behind lock-free readers
+ *
+ */
+#pragma once
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// Lock-free readers count themselves in a stripe picked per thread, under
+// the parity of the current epoch, so readers on different threads don't
+// touch a shared cache line. The writer retires memory during some epoch
+// and frees it once two more epochs have started: a new epoch only starts
+// once every reader counted under the one before the current has left.
+// New readers count under the current epoch, so a steady stream of them
+// never holds reclamation off; only a reader that stays in for a whole
+// epoch does.
+//
+// epoch_enter and epoch_exit may run on any thread. epoch_advance must be
+// serialized by the caller, like the retiring of memory it pairs with.
+typedef struct epoch_obj *epoch_t;
+
+// where a reader is counted, handed from epoch_enter to epoch_exit
+typedef _Atomic uint64_t *epoch_reader_t;
+
+epoch_t epoch_create(void);
+
+void epoch_destroy(epoch_t epochs);
+
+// count the calling thread as a reader until epoch_exit. It may then see
+// anything that was not yet retired when this returned.
+epoch_reader_t epoch_enter(epoch_t epochs);
+
+void epoch_exit(epoch_reader_t reader);
+
+// the current epoch, which memory retired now belongs to
+uint64_t epoch_current(epoch_t epochs);
+
+// true if epoch_advance would start a new epoch
+bool epoch_ready(epoch_t epochs);
+
+// start epoch e + 1 if every reader counted under e - 1 has left, and
+// return whether it did. Memory retired during e - 1 or before can be
+// freed once this returns true.
+bool epoch_advance(epoch_t epochs);
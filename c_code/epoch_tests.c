@@ -0,0 +1,155 @@
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "epoch.h"
+#include "epoch_tests.h"
+
+#define my_assert(value, string) \
+{if (!(value)) { printf("!!!FAILURE!!! %s\n", string);}}
+
+static void test_epoch_steady_readers()
+{
+    // there is always a reader in, but each one leaves eventually, so
+    // epochs keep starting
+    printf("Running epoch steady readers test\n");
+    epoch_t epochs = epoch_create();
+    my_assert(epoch_advance(epochs) && epoch_advance(epochs), "epochs didn't start without readers");
+
+    epoch_reader_t reader = epoch_enter(epochs);
+    bool ok = true;
+    for (uint32_t i = 0; i < 1000; i++) {
+        ok &= epoch_advance(epochs); // the reader is counted under the current epoch
+        ok &= !epoch_advance(epochs); // and it hasn't left
+        epoch_reader_t next = epoch_enter(epochs);
+        epoch_exit(reader);
+        reader = next;
+    }
+    epoch_exit(reader);
+    my_assert(ok, "a stream of readers held off new epochs");
+    my_assert(epoch_current(epochs) == 1002, "epochs started when they shouldn't have");
+    epoch_destroy(epochs);
+}
+
+static void test_epoch_stuck_reader()
+{
+    // a reader that stays in holds reclamation off, no matter how many
+    // others come and go
+    printf("Running epoch stuck reader test\n");
+    epoch_t epochs = epoch_create();
+    epoch_reader_t stuck = epoch_enter(epochs);
+    my_assert(epoch_advance(epochs), "the first epoch didn't start");
+    uint64_t retired = epoch_current(epochs);
+    for (uint32_t i = 0; i < 100; i++) {
+        epoch_exit(epoch_enter(epochs));
+        my_assert(!epoch_advance(epochs) && !epoch_ready(epochs),
+                "an epoch started under a reader of the one before");
+    }
+    epoch_exit(stuck);
+    my_assert(epoch_advance(epochs) && epoch_advance(epochs), "epochs didn't start once the reader left");
+    my_assert(epoch_current(epochs) >= retired + 2, "memory retired under the reader can't be freed");
+    epoch_destroy(epochs);
+}
+
+#define POISON 0xdeadULL
+#define ALIVE 0x1234ULL
+
+struct block
+{
+    _Atomic uint64_t magic;
+    struct block *retired_next;
+    uint64_t retired_epoch;
+};
+
+struct epoch_state
+{
+    epoch_t epochs;
+    struct block *_Atomic current;
+    atomic_bool done;
+    atomic_bool bad;
+};
+
+static void *block_reader(void *arg)
+{
+    // never stop reading the current block
+    struct epoch_state *state = arg;
+    while (!state->done) {
+        epoch_reader_t reader = epoch_enter(state->epochs);
+        struct block *b = atomic_load(&state->current);
+        if (atomic_load(&b->magic) != ALIVE) {
+            state->bad = true;
+        }
+        epoch_exit(reader);
+    }
+    return NULL;
+}
+
+static struct block *new_block()
+{
+    struct block *b = calloc(1, sizeof(struct block));
+    atomic_init(&b->magic, ALIVE);
+    return b;
+}
+
+static void test_epoch_concurrent_reclaim()
+{
+    // a writer swaps blocks and frees old ones two epochs on, poisoning
+    // them first, while readers keep reading whichever is current
+    printf("Running epoch concurrent reclaim test\n");
+    struct epoch_state state;
+    state.epochs = epoch_create();
+    atomic_init(&state.current, new_block());
+    atomic_init(&state.done, false);
+    atomic_init(&state.bad, false);
+    pthread_t threads[4];
+    for (uint32_t i = 0; i < 4; i++) {
+        pthread_create(&threads[i], NULL, block_reader, &state);
+    }
+
+    struct block *retired = NULL; // newest first
+    uint64_t freed = 0;
+    for (uint32_t i = 0; i < 20000; i++) {
+        struct block *old = atomic_exchange(&state.current, new_block());
+        old->retired_epoch = epoch_current(state.epochs);
+        old->retired_next = retired;
+        retired = old;
+        epoch_advance(state.epochs);
+
+        struct block **b = &retired;
+        while (*b && (*b)->retired_epoch + 2 > epoch_current(state.epochs)) {
+            b = &(*b)->retired_next;
+        }
+        while (*b) {
+            struct block *next = (*b)->retired_next;
+            atomic_store(&(*b)->magic, POISON);
+            free(*b);
+            *b = next;
+            ++freed;
+        }
+    }
+
+    state.done = true;
+    for (uint32_t i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    my_assert(!state.bad, "a reader saw a block after it was freed");
+    my_assert(freed > 10000, "retired blocks piled up under steady readers");
+    while (retired) {
+        struct block *next = retired->retired_next;
+        free(retired);
+        retired = next;
+    }
+    free(atomic_load(&state.current));
+    epoch_destroy(state.epochs);
+}
+
+void epoch_tests()
+{
+    printf("***Running epoch tests***\n");
+    test_epoch_steady_readers();
+    test_epoch_stuck_reader();
+    test_epoch_concurrent_reclaim();
+}
@@ -12,6 +12,7 @@ struct evict_obj
     uint32_t max_queue_size; // sizeof(queue)
     uint32_t front; // index of top of queue
     uint32_t rear; // index of back of queue
+    bool borrowed; // the queue points at the caller's keys, see evict_create_borrowed
 };
 
 evict_t evict_create(uint32_t max_size)
@@ -28,14 +29,52 @@ evict_t evict_create(uint32_t max_size)
     return e;
 }
 
+evict_t evict_create_borrowed(uint32_t max_size)
+{
+    evict_t e = evict_create(max_size);
+    e->borrowed = true;
+    return e;
+}
+
+static void free_key(evict_t evict, key_type key)
+{
+    if (!evict->borrowed) {
+        free((uint8_t*) key);
+    }
+}
+
+static void evict_make_room(evict_t evict)
+{
+    // called when rear is about to run off the end of the queue
+    if (evict->rear + 1 < evict->max_queue_size) {
+        return;
+    }
+
+    // slide the queue back to index 0 if at least half of it is already
+    // consumed, otherwise double the size of the queue
+    if (evict->front >= evict->max_queue_size / 2) {
+        uint32_t n = evict->rear - evict->front;
+        memmove(evict->queue, evict->queue + evict->front, n * sizeof(key_type));
+        for (uint32_t j = n; j < evict->max_queue_size; ++j) {
+            evict->queue[j] = NULL;
+        }
+        evict->front = 0;
+        evict->rear = n;
+        return;
+    }
+
+    evict->queue = realloc(evict->queue, 2 * evict->max_queue_size * sizeof(key_type));
+    assert(evict->queue && "memory");
+    for (uint32_t j = evict->max_queue_size; j < 2 * evict->max_queue_size; ++j) {
+        evict->queue[j] = NULL;
+    }
+    evict->max_queue_size *= 2;
+}
+
 void evict_set(evict_t evict, key_type key) 
 {
     // check for resizing queue
-    if (evict->rear + 1 == evict->max_queue_size) {
-        evict->max_queue_size *= 2;
-        evict->queue = realloc(evict->queue, evict->max_queue_size * sizeof(key_type));
-        assert(evict->queue && "memory");
-    }
+    evict_make_room(evict);
 
     // This is commented out because because it requires linear time and our current 
     // cache API does not rely on it. This section of the code checks if a key is already
@@ -52,9 +91,12 @@ void evict_set(evict_t evict, key_type key)
     //}
 
     // put key on back of queue
-    key_type key_copy = calloc(strlen((const char*) key) + 1, sizeof(uint8_t));
-    strcpy((char*) key_copy, (char*) key);
-    evict->queue[evict->rear] = key_copy;
+    if (!evict->borrowed) {
+        key_type key_copy = calloc(strlen((const char*) key) + 1, sizeof(uint8_t));
+        strcpy((char*) key_copy, (char*) key);
+        key = key_copy;
+    }
+    evict->queue[evict->rear] = key;
     ++evict->rear;
 }
 
@@ -65,19 +107,14 @@ void evict_get(evict_t evict, key_type key)
     for (uint32_t i = evict->front; i < evict->rear; ++i) {
         if (evict->queue[i] &&
                 strcmp((char*) evict->queue[i], (char*) key) == 0) {
-            // check for resizing queue
-            if (evict->rear + 1 == evict->max_queue_size) {
-                // double the size of the queue!
-                evict->queue = realloc(evict->queue, 2 * evict->max_queue_size * sizeof(key_type));
-                for (uint32_t j = evict->max_queue_size; j < 2 * evict->max_queue_size; ++j) {
-                    evict->queue[j] = NULL;
-                }
-                evict->max_queue_size *= 2;
-                assert(evict->queue && "memory");
-            }
-
-            // place key on rear of queue
-            evict->queue[evict->rear] = evict->queue[i];
+            // check for resizing queue; this may slide the queue, so
+            // recompute the position of the key afterwards
+            uint32_t offset = i - evict->front;
+            evict_make_room(evict);
+            i = evict->front + offset;
+
+            // place key on rear of queue; a borrowed key may have moved
+            evict->queue[evict->rear] = evict->borrowed ? key : evict->queue[i];
             ++evict->rear;
             evict->queue[i] = NULL;
             failed = false;
@@ -97,8 +134,7 @@ void evict_delete(evict_t evict, key_type key)
     for (uint32_t i = evict->front; i < evict->rear; ++i) {
         if (evict->queue[i] &&
                 strcmp((char*) evict->queue[i], (char*) key) == 0) {
-            // place key on rear of queue
-            free((uint8_t*) evict->queue[i]);
+            free_key(evict, evict->queue[i]);
             evict->queue[i] = NULL;
             failed = false;
         }
@@ -109,17 +145,41 @@ void evict_delete(evict_t evict, key_type key)
     }
 }
 
+void evict_delete_if(evict_t evict, bool (*dead)(key_type key, void *arg), void *arg)
+{
+    for (uint32_t i = evict->front; i < evict->rear; ++i) {
+        if (evict->queue[i] && dead(evict->queue[i], arg)) {
+            free_key(evict, evict->queue[i]);
+            evict->queue[i] = NULL;
+        }
+    }
+}
+
 void evict_destroy(evict_t evict)
 {
     for (uint32_t i = 0; i < evict->max_queue_size; ++i) {
         if (evict->queue[i]) {
-            free((uint8_t*) evict->queue[i]);
+            free_key(evict, evict->queue[i]);
             evict->queue[i] = NULL;
         }
     }
     free(evict->queue);
 }
 
+void evict_move(evict_t evict, key_type old, key_type key)
+{
+    if (!evict->borrowed) {
+        return; // the copy is still good
+    }
+    for (uint32_t i = evict->front; i < evict->rear; ++i) {
+        if (evict->queue[i] == old) {
+            evict->queue[i] = key;
+            return;
+        }
+    }
+    assert(false && "key not found in eviction queue");
+}
+
 key_type evict_select_for_removal(evict_t evict)
 {
     while (evict->front < evict->rear) {
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <inttypes.h>
+#include <stdbool.h>
 
 typedef const uint8_t *key_type; //TODO - ask eitan what the best way to do types here is 
 struct evict_obj;
@@ -12,18 +13,33 @@ typedef uint64_t (*hash_func)(key_type key);
 // eviction object is dynamically adjusted as needed
 evict_t evict_create(uint32_t arr_size);
 
+// like evict_create, but the queue keeps the key pointers it is given
+// instead of copies of the keys, so a cache can share one allocation per
+// key with it. A key passed in must stay valid until it is deleted, or
+// until evict_get or evict_move hands over a new pointer to it.
+evict_t evict_create_borrowed(uint32_t arr_size);
+
 // notifies evict obj that key has been set to cache
 // assumes that key type is not already in queue, as 
 // checking for the key would require non-constant time.
 void evict_set(evict_t evict, key_type key);
 
 // notifies evict obj that key has been "gotten" from cache
-// i.e., it's been accessed
+// i.e., it's been accessed. A borrowed queue keeps this pointer to it.
 void evict_get(evict_t evict, key_type key);
 
+// for a borrowed queue: the key at old (the same pointer evict was given)
+// now lives at key, and keeps its place in the queue. Does nothing for a
+// queue of copies.
+void evict_move(evict_t evict, key_type old, key_type key);
+
 // notifies evict obj that key has been delete from cache
 void evict_delete(evict_t evict, key_type key);
 
+// deletes every key that dead says is no longer in the cache, in one
+// pass over the queue, for deleting many keys at once
+void evict_delete_if(evict_t evict, bool (*dead)(key_type key, void *arg), void *arg);
+
 // delete and free all memory of evict_t
 void evict_destroy(evict_t evict);
 
@@ -78,11 +78,79 @@ static void test_evict_duplicate_set()
     free(evict);
 }
 
+static bool starts_with_x(key_type key, void *arg)
+{
+    (void) arg;
+    return key[0] == 'x';
+}
+
+static void test_evict_delete_if()
+{
+    printf("Running evict delete_if test\n");
+    evict_t evict = evict_create(10);
+
+    uint8_t a[2] = {'a', '\0'};
+    uint8_t x1[3] = {'x', '1', '\0'};
+    uint8_t b[2] = {'b', '\0'};
+    uint8_t x2[3] = {'x', '2', '\0'};
+
+    evict_set(evict, x1);
+    evict_set(evict, a);
+    evict_set(evict, x2);
+    evict_set(evict, b);
+    evict_delete_if(evict, starts_with_x, NULL);
+
+    key_type k = evict_select_for_removal(evict);
+    my_assert(k && strcmp((const char*) k, (const char*) a) == 0, "delete_if kept a dead key");
+    free((uint8_t*) k);
+    evict_delete(evict, a);
+
+    k = evict_select_for_removal(evict);
+    my_assert(k && strcmp((const char*) k, (const char*) b) == 0, "delete_if dropped a live key");
+    free((uint8_t*) k);
+
+    evict_destroy(evict);
+    free(evict);
+}
+
+static void test_evict_borrowed()
+{
+    printf("Running evict borrowed test\n");
+    evict_t evict = evict_create_borrowed(10);
+
+    uint8_t a[2] = {'a', '\0'};
+    uint8_t b[2] = {'b', '\0'};
+    uint8_t a2[2] = {'a', '\0'}; // a, moved
+    uint8_t b2[2] = {'b', '\0'};
+
+    evict_set(evict, a);
+    evict_set(evict, b);
+    evict_move(evict, a, a2);
+    a[0] = 'x'; // the old copy is gone
+    evict_get(evict, b2);
+    b[0] = 'x';
+
+    key_type k = evict_select_for_removal(evict);
+    my_assert(k && strcmp((const char*) k, "a") == 0, "borrowed queue lost a moved key");
+    free((uint8_t*) k);
+    evict_delete(evict, a2);
+
+    k = evict_select_for_removal(evict);
+    my_assert(k && strcmp((const char*) k, "b") == 0, "borrowed queue kept the old pointer on a get");
+    free((uint8_t*) k);
+    evict_delete(evict, b2);
+
+    evict_destroy(evict); // frees none of the keys
+    free(evict);
+}
+
 void evict_tests() 
 {
     printf("***Running evict tests***\n");
     test_evict_object();
     test_evict_duplicate_set();
+    test_evict_delete_if();
+    test_evict_borrowed();
 }
 
 
@@ -0,0 +1,184 @@
+/*
+ * gdsf.c: GreedyDual-Size-Frequency eviction, see gdsf.h
+ *
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "gdsf.h"
+
+struct heap_entry
+{
+    uint32_t generation; // node->generation
+    double priority;
+    node_t *node;
+};
+
+struct gdsf_obj
+{
+    double clock; // priority of the last victim
+    uint32_t generation; // newest node->generation seen
+    struct heap_entry *heap;
+    uint64_t size;
+    uint64_t capacity;
+};
+
+static double gdsf_priority(gdsf_t gdsf, node_t *node)
+{
+    uint64_t size = node->val_size ? node->val_size : 1;
+    return gdsf->clock + (double) node->freq * node->cost / size;
+}
+
+static struct heap_entry make_entry(gdsf_t gdsf, node_t *node)
+{
+    struct heap_entry entry = {node->generation, gdsf_priority(gdsf, node), node};
+    return entry;
+}
+
+static bool entry_before(struct heap_entry a, struct heap_entry b)
+{
+    // flushed generations go first, whatever their priority
+    if (a.generation != b.generation) {
+        return a.generation < b.generation;
+    }
+    return a.priority < b.priority;
+}
+
+static void heap_place(gdsf_t gdsf, uint64_t i, struct heap_entry entry)
+{
+    gdsf->heap[i] = entry;
+    entry.node->heap_index = i;
+}
+
+static void sift_up(gdsf_t gdsf, uint64_t i)
+{
+    struct heap_entry entry = gdsf->heap[i];
+    while (i > 0) {
+        uint64_t parent = (i - 1) / 2;
+        if (!entry_before(entry, gdsf->heap[parent])) {
+            break;
+        }
+        heap_place(gdsf, i, gdsf->heap[parent]);
+        i = parent;
+    }
+    heap_place(gdsf, i, entry);
+}
+
+static void sift_down(gdsf_t gdsf, uint64_t i)
+{
+    struct heap_entry entry = gdsf->heap[i];
+    for (;;) {
+        uint64_t child = 2 * i + 1;
+        if (child >= gdsf->size) {
+            break;
+        }
+        if (child + 1 < gdsf->size && entry_before(gdsf->heap[child + 1], gdsf->heap[child])) {
+            ++child;
+        }
+        if (!entry_before(gdsf->heap[child], entry)) {
+            break;
+        }
+        heap_place(gdsf, i, gdsf->heap[child]);
+        i = child;
+    }
+    heap_place(gdsf, i, entry);
+}
+
+static void heap_update(gdsf_t gdsf, uint64_t i, struct heap_entry entry)
+{
+    // put entry at i, in place of whatever was there
+    struct heap_entry old = gdsf->heap[i];
+    heap_place(gdsf, i, entry);
+    if (entry_before(entry, old)) {
+        sift_up(gdsf, i);
+    } else {
+        sift_down(gdsf, i);
+    }
+}
+
+gdsf_t gdsf_create(uint64_t num_items)
+{
+    gdsf_t gdsf = calloc(1, sizeof(struct gdsf_obj));
+    assert(gdsf && "memory");
+    gdsf->capacity = num_items ? num_items : 16;
+    gdsf->heap = calloc(gdsf->capacity, sizeof(struct heap_entry));
+    assert(gdsf->heap && "memory");
+    return gdsf;
+}
+
+void gdsf_destroy(gdsf_t gdsf)
+{
+    free(gdsf->heap);
+    free(gdsf);
+}
+
+void gdsf_set(gdsf_t gdsf, node_t *node)
+{
+    if (gdsf->size == gdsf->capacity) {
+        gdsf->capacity *= 2;
+        gdsf->heap = realloc(gdsf->heap, gdsf->capacity * sizeof(struct heap_entry));
+        assert(gdsf->heap && "memory");
+    }
+    node->freq = 1;
+    if (node->generation > gdsf->generation) {
+        gdsf->generation = node->generation;
+    }
+    heap_place(gdsf, gdsf->size++, make_entry(gdsf, node));
+    sift_up(gdsf, node->heap_index);
+}
+
+void gdsf_get(gdsf_t gdsf, node_t *node)
+{
+    assert(gdsf->heap[node->heap_index].node == node && "node is not in gdsf");
+    ++node->freq;
+    heap_update(gdsf, node->heap_index, make_entry(gdsf, node));
+}
+
+void gdsf_delete(gdsf_t gdsf, node_t *node)
+{
+    uint64_t i = node->heap_index;
+    assert(i < gdsf->size && gdsf->heap[i].node == node && "node is not in gdsf");
+    struct heap_entry last = gdsf->heap[--gdsf->size];
+    if (i == gdsf->size) {
+        return;
+    }
+    heap_update(gdsf, i, last);
+}
+
+void gdsf_replace(gdsf_t gdsf, node_t *old, node_t *node)
+{
+    uint64_t i = old->heap_index;
+    assert(i < gdsf->size && gdsf->heap[i].node == old && "node is not in gdsf");
+    node->freq = old->freq + 1;
+    if (node->generation > gdsf->generation) {
+        gdsf->generation = node->generation;
+    }
+    heap_update(gdsf, i, make_entry(gdsf, node));
+}
+
+void gdsf_move(gdsf_t gdsf, node_t *old, node_t *node)
+{
+    uint64_t i = old->heap_index;
+    assert(i < gdsf->size && gdsf->heap[i].node == old && "node is not in gdsf");
+    gdsf->heap[i].node = node;
+    node->heap_index = i;
+}
+
+node_t *gdsf_select_for_removal(gdsf_t gdsf)
+{
+    if (gdsf->size == 0) {
+        return NULL;
+    }
+    // flushed entries are dead, not unpopular; they don't age the rest
+    if (gdsf->heap[0].generation == gdsf->generation) {
+        gdsf->clock = gdsf->heap[0].priority;
+    }
+    return gdsf->heap[0].node;
+}
+
+uint64_t gdsf_size(gdsf_t gdsf)
+{
+    return gdsf->size;
+}
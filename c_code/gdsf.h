@@ -0,0 +1,58 @@
+/*
+ * gdsf.h: header file for GreedyDual-Size-Frequency eviction
+ *
+ */
+#pragma once
+
+#include <inttypes.h>
+
+#include "node.h"
+
+// GreedyDual-Size-Frequency ranks every entry by
+//
+//     priority = clock + freq * cost / size
+//
+// where cost is what it takes to recompute the value (node->cost), freq is
+// how often it has been read since it was set, and size is its val_size.
+// The entry with the lowest priority is evicted first, and the clock is
+// raised to the priority of each victim, so entries that are not read
+// again slowly lose out to newer ones however expensive they were.
+//
+// Nodes of an older node->generation (flushed, see cache_namespace_flush)
+// come before all newer ones whatever their priority, and evicting them
+// doesn't move the clock.
+//
+// Nodes sit in a binary min-heap; node->heap_index is their place in it,
+// so every operation is O(log n). Callers serialize all calls.
+typedef struct gdsf_obj *gdsf_t;
+
+// create an empty policy with room for roughly num_items before growing
+gdsf_t gdsf_create(uint64_t num_items);
+
+// frees the policy, but not the nodes in it
+void gdsf_destroy(gdsf_t gdsf);
+
+// notifies gdsf that node was set; node->cost and node->val_size must be
+// filled in
+void gdsf_set(gdsf_t gdsf, node_t *node);
+
+// notifies gdsf that node was read
+void gdsf_get(gdsf_t gdsf, node_t *node);
+
+// notifies gdsf that node is leaving the cache
+void gdsf_delete(gdsf_t gdsf, node_t *node);
+
+// notifies gdsf that node took old's place in the cache (same key, new
+// value), counting as a read
+void gdsf_replace(gdsf_t gdsf, node_t *old, node_t *node);
+
+// notifies gdsf that node is now where old was, as a copy of it at
+// another address (see move_slab_node); its place in the order stays
+void gdsf_move(gdsf_t gdsf, node_t *old, node_t *node);
+
+// returns the node to evict next, or NULL if there are none, and raises
+// the clock to its priority. The node stays in gdsf until gdsf_delete.
+node_t *gdsf_select_for_removal(gdsf_t gdsf);
+
+// number of nodes tracked
+uint64_t gdsf_size(gdsf_t gdsf);
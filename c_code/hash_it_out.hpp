@@ -0,0 +1,381 @@
+/*
+ * hash_it_out.hpp: a typed, header-only C++ front end to cache.h
+ *
+ */
+#pragma once
+
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include "cache.h"
+
+// hash_it_out::cache<K, V, Hash, Policy> stores typed keys and values in
+// a C cache, with everything about the layout picked at compile time:
+//
+//  - Fixed-size keys (integers, enums, and trivially copyable types whose
+//    bytes are all value, so no padding and no floating point) are packed
+//    into a short key on the stack, seven bits to a byte with the high bit
+//    set so no byte is zero, which the C core can take as a string. Other
+//    key types need a specialization of detail::key_codec. No strlen of
+//    user data, no allocation per call. Integers are packed most
+//    significant bits first (signed ones with the sign bit flipped), so
+//    CACHE_ENGINE_ART walks them in numeric order.
+//    std::string keys are passed through as they are and must not hold
+//    zero bytes.
+//  - Trivially copyable values are stored as their sizeof(V) bytes and read
+//    straight back into a V with cache_read, so a get doesn't allocate.
+//    std::string values are stored as their bytes.
+//  - Hash is a function object taking const K&. The default for integers
+//    is a 64 bit finalizer of the value itself; for strings it is the C
+//    core's own hash. A custom Hash becomes the cache's hash_func through a
+//    per-type trampoline. A custom string Hash that takes std::string_view
+//    gets the core's key as it is; one that takes const std::string& gets
+//    it copied into a per-thread string whose buffer is reused, so neither
+//    allocates per lookup once warm.
+//  - Policy is one of lru, sampled or gdsf and picks the eviction.
+//
+// What this does not do is store keys inline in the core. However a key
+// is packed here, the core takes it as a C string: it strlen's it,
+// strcmp's it against the keys in its table and mallocs a copy per item.
+// Keeping fixed-size keys inline would take length-carrying binary keys
+// in node_t, compared with memcmp, in every engine, and the core has no
+// such path. Nor is there a moving set: the core copies every value into
+// memory it owns and frees, so a moved-from V has no buffer to hand it.
+// See cache.h for what each call does underneath.
+namespace hash_it_out
+{
+
+struct lru
+{
+    static constexpr cache_eviction eviction = CACHE_EVICT_LRU;
+};
+
+struct sampled
+{
+    static constexpr cache_eviction eviction = CACHE_EVICT_SAMPLED;
+};
+
+struct gdsf
+{
+    static constexpr cache_eviction eviction = CACHE_EVICT_GDSF;
+};
+
+namespace detail
+{
+
+// the integer type behind K, if K is an enum
+template <class K, bool = std::is_enum_v<K>>
+struct integer_of
+{
+    using type = K;
+};
+
+template <class K>
+struct integer_of<K, true>
+{
+    using type = std::underlying_type_t<K>;
+};
+
+// how a key type becomes a zero-free byte string for the C core
+template <class K, class Enable = void>
+struct key_codec
+{
+    static_assert(std::is_trivially_copyable_v<K>, "keys must be trivially copyable or std::string");
+    static constexpr size_t bytes = (sizeof(K) * 8 + 6) / 7;
+    using buffer = std::array<uint8_t, bytes + 1>;
+    static constexpr bool ordered = (std::is_integral_v<K> && !std::is_same_v<K, bool>) ||
+        std::is_enum_v<K>;
+
+    static void to_big_endian(const K &key, uint8_t *out)
+    {
+        // integers go most significant byte first so byte order is numeric
+        // order; anything else is taken as it is laid out in memory
+        if constexpr (ordered) {
+            using T = typename integer_of<K>::type;
+            using U = std::make_unsigned_t<T>;
+            U v = static_cast<U>(key);
+            if constexpr (std::is_signed_v<T>) {
+                v ^= U(1) << (sizeof(U) * 8 - 1);
+            }
+            for (size_t i = 0; i < sizeof(U); ++i) {
+                out[i] = static_cast<uint8_t>(v >> (8 * (sizeof(U) - 1 - i)));
+            }
+        } else {
+            // padding would make equal keys different byte strings
+            static_assert(std::has_unique_object_representations_v<K>,
+                          "keys with padding or floating point need their own key_codec");
+            std::memcpy(out, &key, sizeof(K));
+        }
+    }
+
+    static K from_big_endian(const uint8_t *in)
+    {
+        if constexpr (ordered) {
+            using T = typename integer_of<K>::type;
+            using U = std::make_unsigned_t<T>;
+            U v = 0;
+            for (size_t i = 0; i < sizeof(U); ++i) {
+                v = static_cast<U>((v << 8) | in[i]);
+            }
+            if constexpr (std::is_signed_v<T>) {
+                v ^= U(1) << (sizeof(U) * 8 - 1);
+            }
+            return static_cast<K>(v);
+        } else {
+            K key;
+            std::memcpy(&key, in, sizeof(K));
+            return key;
+        }
+    }
+
+    static key_type encode(const K &key, buffer &buf)
+    {
+        uint8_t raw[sizeof(K)];
+        to_big_endian(key, raw);
+        // seven bits at a time, from the top
+        size_t bit = 0;
+        for (size_t i = 0; i < bytes; ++i, bit += 7) {
+            uint32_t group = 0;
+            for (size_t b = bit; b < bit + 7; ++b) {
+                uint32_t set = b < sizeof(K) * 8 ? (raw[b / 8] >> (7 - b % 8)) & 1 : 0;
+                group = (group << 1) | set;
+            }
+            buf[i] = static_cast<uint8_t>(0x80 | group);
+        }
+        buf[bytes] = 0;
+        return buf.data();
+    }
+
+    static K decode(key_type key)
+    {
+        uint8_t raw[sizeof(K)] = {};
+        size_t bit = 0;
+        for (size_t i = 0; i < bytes; ++i) {
+            for (int b = 6; b >= 0; --b, ++bit) {
+                if (bit < sizeof(K) * 8 && ((key[i] >> b) & 1)) {
+                    raw[bit / 8] |= static_cast<uint8_t>(1 << (7 - bit % 8));
+                }
+            }
+        }
+        return from_big_endian(raw);
+    }
+};
+
+template <>
+struct key_codec<std::string>
+{
+    struct buffer {};
+
+    static key_type encode(const std::string &key, buffer &)
+    {
+        assert(key.find('\0') == std::string::npos && "string keys can't hold zero bytes");
+        return reinterpret_cast<key_type>(key.c_str());
+    }
+
+    static std::string decode(key_type key)
+    {
+        return std::string(reinterpret_cast<const char *>(key));
+    }
+};
+
+// how a value type is stored
+template <class V, class Enable = void>
+struct value_codec
+{
+    static_assert(std::is_trivially_copyable_v<V>, "values must be trivially copyable or std::string");
+
+    static void set(cache_t c, key_type key, const V &val, double cost)
+    {
+        cache_set_with_cost(c, key, &val, sizeof(V), cost);
+    }
+
+    static bool get(cache_t c, key_type key, V &out)
+    {
+        uint64_t copied, size;
+        return cache_read(c, key, 0, &out, sizeof(V), &copied, &size) && size == sizeof(V);
+    }
+};
+
+template <>
+struct value_codec<std::string>
+{
+    static void set(cache_t c, key_type key, const std::string &val, double cost)
+    {
+        assert(val.size() <= UINT32_MAX && "use cache_write_begin for values of 4GB or more");
+        cache_set_with_cost(c, key, val.data(), static_cast<uint32_t>(val.size()), cost);
+    }
+
+    static bool get(cache_t c, key_type key, std::string &out)
+    {
+        // read into out's existing storage, and again if it was too small
+        out.resize(out.capacity());
+        uint64_t copied, size;
+        if (!cache_read(c, key, 0, out.data(), out.size(), &copied, &size)) {
+            return false;
+        }
+        if (size > copied) {
+            out.resize(size);
+            if (!cache_read(c, key, 0, out.data(), out.size(), &copied, &size)) {
+                return false;
+            }
+        }
+        out.resize(copied);
+        return true;
+    }
+};
+
+} // namespace detail
+
+// The default Hash: integers and other fixed-size keys are mixed with the
+// splitmix64 finalizer, strings use the C core's hash.
+template <class K, class Enable = void>
+struct default_hash
+{
+    static constexpr bool use_core = false;
+
+    uint64_t operator()(const K &key) const
+    {
+        uint8_t raw[sizeof(K)];
+        detail::key_codec<K>::to_big_endian(key, raw);
+        uint64_t h = 0;
+        for (size_t i = 0; i < sizeof(K); ++i) {
+            h = (h << 8 | h >> 56) ^ raw[i];
+        }
+        h ^= h >> 30;
+        h *= 0xbf58476d1ce4e5b9ULL;
+        h ^= h >> 27;
+        h *= 0x94d049bb133111ebULL;
+        h ^= h >> 31;
+        return h;
+    }
+};
+
+template <>
+struct default_hash<std::string>
+{
+    static constexpr bool use_core = true;
+};
+
+template <class K, class V, class Hash = default_hash<K>, class Policy = lru>
+class cache
+{
+public:
+    explicit cache(uint64_t maxmem)
+    {
+        struct cache_config config;
+        cache_config_init(&config, maxmem);
+        create(config);
+    }
+
+    // Start from a config (engine, maintenance thread, ...). Its eviction
+    // and hash are replaced by the ones Policy and Hash pick.
+    explicit cache(struct cache_config config)
+    {
+        create(config);
+    }
+
+    ~cache()
+    {
+        if (c_) {
+            destroy_cache(c_);
+        }
+    }
+
+    cache(const cache &) = delete;
+    cache &operator=(const cache &) = delete;
+
+    cache(cache &&other) noexcept : c_(std::exchange(other.c_, nullptr)) {}
+
+    cache &operator=(cache &&other) noexcept
+    {
+        std::swap(c_, other.c_);
+        return *this;
+    }
+
+    // cost is only looked at by the gdsf policy, see cache_set_with_cost
+    void set(const K &key, const V &val, double cost = 1.0)
+    {
+        typename detail::key_codec<K>::buffer buf;
+        detail::value_codec<V>::set(c_, detail::key_codec<K>::encode(key, buf), val, cost);
+    }
+
+    std::optional<V> get(const K &key) const
+    {
+        std::optional<V> res(std::in_place);
+        if (!get(key, *res)) {
+            res.reset();
+        }
+        return res;
+    }
+
+    // Borrowing get: read the value into out, reusing its storage, and
+    // return whether key was there. out is unspecified on a miss.
+    bool get(const K &key, V &out) const
+    {
+        typename detail::key_codec<K>::buffer buf;
+        return detail::value_codec<V>::get(c_, detail::key_codec<K>::encode(key, buf), out);
+    }
+
+    bool contains(const K &key) const
+    {
+        typename detail::key_codec<K>::buffer buf;
+        uint64_t version;
+        return cache_version(c_, detail::key_codec<K>::encode(key, buf), &version);
+    }
+
+    void erase(const K &key)
+    {
+        typename detail::key_codec<K>::buffer buf;
+        cache_delete(c_, detail::key_codec<K>::encode(key, buf));
+    }
+
+    uint64_t space_used() const
+    {
+        return cache_space_used(c_);
+    }
+
+    // the underlying C cache, for the calls not wrapped here
+    cache_t handle() const
+    {
+        return c_;
+    }
+
+private:
+    static uint64_t hash_trampoline(key_type key)
+    {
+        if constexpr (std::is_same_v<K, std::string>) {
+            std::string_view view(reinterpret_cast<const char *>(key));
+            if constexpr (std::is_invocable_v<const Hash &, std::string_view>) {
+                return Hash{}(view);
+            } else {
+                thread_local std::string scratch;
+                scratch.assign(view);
+                return Hash{}(scratch);
+            }
+        } else {
+            return Hash{}(detail::key_codec<K>::decode(key));
+        }
+    }
+
+    void create(struct cache_config &config)
+    {
+        config.eviction = Policy::eviction;
+        if constexpr (std::is_same_v<Hash, default_hash<K>> && default_hash<K>::use_core) {
+            config.hash = nullptr;
+        } else {
+            config.hash = hash_trampoline;
+        }
+        c_ = create_cache_with_config(&config);
+    }
+
+    cache_t c_ = nullptr;
+};
+
+} // namespace hash_it_out
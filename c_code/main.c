@@ -5,25 +5,40 @@
 #include <getopt.h>
 #include <time.h>
 
+#include "bench.h"
 #include "dbLL_tests.h"
 #include "cache_tests.h"
 #include "evict_tests.h"
+#include "cuckoo_tests.h"
+#include "art_tests.h"
+#include "bloom_tests.h"
+#include "cluster_tests.h"
+#include "pages_tests.h"
+#include "trace_tests.h"
+#include "memctl_tests.h"
+#include "slab_tests.h"
+#include "mrc_tests.h"
+#include "epoch_tests.h"
 
 struct args {
     bool cache_tests;
     bool dbll_tests;
+    uint64_t bench_items; // 0 to skip the benchmarks
 };
 
 static struct option opts[] =
 {
     {"cache-tests", no_argument, 0, 'c'},
     {"dbll-tests", no_argument, 0, 'd'},
+    {"bench", optional_argument, 0, 'b'},
+    {0, 0, 0, 0},
 };
 
 static void args_init(struct args * args)
 {
     args->cache_tests = false;
     args->dbll_tests = false;
+    args->bench_items = 0;
 }
 
 static int go(struct args *args)
@@ -31,12 +46,26 @@ static int go(struct args *args)
     if (args->cache_tests) {
         cache_tests();
         evict_tests();
+        cuckoo_tests();
+        art_tests();
+        bloom_tests();
+        cluster_tests();
+        pages_tests();
+        trace_tests();
+        memctl_tests();
+        slab_tests();
+        mrc_tests();
+        epoch_tests();
     }
 
     if (args->dbll_tests) {
         printf("Running dbll tests\n");
         dbll_tests();
     }
+
+    if (args->bench_items) {
+        bench(args->bench_items);
+    }
     return 0;
 }
 
@@ -54,6 +83,9 @@ int main(int argc, char *argv[])
             case 'd':
                 args.dbll_tests = true;
                 break;
+            case 'b':
+                args.bench_items = optarg ? strtoull(optarg, NULL, 10) : 1000000;
+                break;
             default:
                 break;
         }
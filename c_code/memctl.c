@@ -0,0 +1,228 @@
+/*
+ * memctl.c: a memory pressure controller for a cache, see memctl.h
+ *
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "memctl.h"
+
+#define CGROUP_ROOT "/sys/fs/cgroup"
+
+struct memctl_obj
+{
+    cache_t cache;
+    struct memctl_config config;
+    char *psi_path; // NULL to ignore PSI
+    char *cgroup_dir; // NULL to ignore cgroups
+
+    bool running;
+    bool stopping;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+};
+
+void memctl_config_init(struct memctl_config *config, uint64_t min_maxmem, uint64_t max_maxmem)
+{
+    assert(min_maxmem <= max_maxmem && "min_maxmem is above max_maxmem");
+    config->min_maxmem = min_maxmem;
+    config->max_maxmem = max_maxmem;
+    config->psi_path = "/proc/pressure/memory";
+    config->cgroup_dir = NULL;
+    config->psi_high = 10.0;
+    config->psi_low = 1.0;
+    config->cgroup_high = 0.9;
+    config->cgroup_low = 0.8;
+    config->shrink_step = 0.1;
+    config->grow_step = 0.05;
+    config->interval_ms = 1000;
+}
+
+static char *own_cgroup_dir()
+{
+    // the "0::/path" line of /proc/self/cgroup is our cgroup v2
+    FILE *f = fopen("/proc/self/cgroup", "r");
+    if (f == NULL) {
+        return NULL;
+    }
+    char line[4096];
+    char *dir = NULL;
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, "0::", 3) == 0) {
+            line[strcspn(line, "\n")] = '\0';
+            dir = malloc(strlen(CGROUP_ROOT) + strlen(line + 3) + 1);
+            assert(dir && "memory");
+            sprintf(dir, "%s%s", CGROUP_ROOT, line + 3);
+            break;
+        }
+    }
+    fclose(f);
+    return dir;
+}
+
+static char *copy_string(const char *s)
+{
+    char *copy = malloc(strlen(s) + 1);
+    assert(copy && "memory");
+    strcpy(copy, s);
+    return copy;
+}
+
+memctl_t memctl_create(cache_t cache, const struct memctl_config *config)
+{
+    assert(config->min_maxmem <= config->max_maxmem && "min_maxmem is above max_maxmem");
+    assert(config->psi_low <= config->psi_high && config->cgroup_low <= config->cgroup_high &&
+            "low thresholds must not be above high ones");
+    memctl_t ctl = calloc(1, sizeof(struct memctl_obj));
+    assert(ctl && "memory");
+    ctl->cache = cache;
+    ctl->config = *config;
+    if (config->psi_path) {
+        ctl->psi_path = copy_string(config->psi_path);
+    }
+    if (config->cgroup_dir == NULL) {
+        ctl->cgroup_dir = own_cgroup_dir();
+    } else if (config->cgroup_dir[0] != '\0') {
+        ctl->cgroup_dir = copy_string(config->cgroup_dir);
+    }
+    ctl->config.psi_path = ctl->psi_path;
+    ctl->config.cgroup_dir = ctl->cgroup_dir;
+    pthread_mutex_init(&ctl->lock, NULL);
+    pthread_cond_init(&ctl->wake, NULL);
+    return ctl;
+}
+
+bool memctl_read_psi(const char *path, double *avg10)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return false;
+    }
+    char line[256];
+    bool found = false;
+    while (!found && fgets(line, sizeof(line), f)) {
+        found = sscanf(line, "some avg10=%lf", avg10) == 1;
+    }
+    fclose(f);
+    return found;
+}
+
+static bool read_number_file(const char *dir, const char *name, uint64_t *value)
+{
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return false;
+    }
+    // "max" (no limit) doesn't parse, on purpose
+    bool ok = fscanf(f, "%" SCNu64, value) == 1;
+    fclose(f);
+    return ok;
+}
+
+bool memctl_read_cgroup(const char *dir, uint64_t *current, uint64_t *max)
+{
+    return read_number_file(dir, "memory.current", current) &&
+        read_number_file(dir, "memory.max", max) && *max > 0;
+}
+
+void memctl_step(memctl_t ctl, struct memctl_reading *reading)
+{
+    const struct memctl_config *config = &ctl->config;
+    struct memctl_reading r;
+    memset(&r, 0, sizeof(r));
+    r.has_psi = ctl->psi_path && memctl_read_psi(ctl->psi_path, &r.psi_avg10);
+    r.has_cgroup = ctl->cgroup_dir &&
+        memctl_read_cgroup(ctl->cgroup_dir, &r.cgroup_current, &r.cgroup_max);
+    double used = r.has_cgroup ? (double) r.cgroup_current / r.cgroup_max : 0;
+
+    bool pressure = (r.has_psi && r.psi_avg10 > config->psi_high) ||
+        (r.has_cgroup && used > config->cgroup_high);
+    bool calm = (!r.has_psi || r.psi_avg10 < config->psi_low) &&
+        (!r.has_cgroup || used < config->cgroup_low);
+
+    uint64_t maxmem = cache_maxmem(ctl->cache);
+    uint64_t target = maxmem;
+    if (pressure) {
+        target = maxmem - (uint64_t) (maxmem * config->shrink_step);
+    } else if (calm) {
+        uint64_t step = (uint64_t) (maxmem * config->grow_step);
+        target = maxmem + (step > 0 ? step : 1);
+    }
+    if (target < config->min_maxmem) {
+        target = config->min_maxmem;
+    }
+    if (target > config->max_maxmem) {
+        target = config->max_maxmem;
+    }
+    if (target != maxmem) {
+        cache_set_maxmem(ctl->cache, target);
+    }
+
+    if (reading) {
+        r.maxmem = target;
+        *reading = r;
+    }
+}
+
+static void *memctl_loop(void *arg)
+{
+    memctl_t ctl = arg;
+    pthread_mutex_lock(&ctl->lock);
+    while (!ctl->stopping) {
+        pthread_mutex_unlock(&ctl->lock);
+        memctl_step(ctl, NULL);
+        pthread_mutex_lock(&ctl->lock);
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += ctl->config.interval_ms / 1000;
+        deadline.tv_nsec += (long) (ctl->config.interval_ms % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            ++deadline.tv_sec;
+            deadline.tv_nsec -= 1000000000;
+        }
+        while (!ctl->stopping) {
+            int rc = pthread_cond_timedwait(&ctl->wake, &ctl->lock, &deadline);
+            assert((rc == 0 || rc == ETIMEDOUT) && "cond wait");
+            if (rc == ETIMEDOUT) {
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&ctl->lock);
+    return NULL;
+}
+
+void memctl_start(memctl_t ctl)
+{
+    assert(!ctl->running && "controller already started");
+    assert(ctl->config.interval_ms > 0 && "interval_ms must be positive");
+    ctl->running = true;
+    int rc = pthread_create(&ctl->thread, NULL, memctl_loop, ctl);
+    assert(rc == 0 && "could not start memctl thread");
+}
+
+void memctl_destroy(memctl_t ctl)
+{
+    if (ctl->running) {
+        pthread_mutex_lock(&ctl->lock);
+        ctl->stopping = true;
+        pthread_cond_signal(&ctl->wake);
+        pthread_mutex_unlock(&ctl->lock);
+        pthread_join(ctl->thread, NULL);
+    }
+    pthread_cond_destroy(&ctl->wake);
+    pthread_mutex_destroy(&ctl->lock);
+    free(ctl->psi_path);
+    free(ctl->cgroup_dir);
+    free(ctl);
+}
@@ -0,0 +1,81 @@
+/*
+ * memctl.h: header file for a memory pressure controller for a cache
+ *
+ */
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include "cache.h"
+
+// Moves a cache's maxmem (see cache_set_maxmem) between min_maxmem and
+// max_maxmem as the host's memory gets tight or frees up, so the cache
+// gives memory back before the kernel has to reclaim or OOM-kill.
+//
+// Each step reads two signals, either of which may be missing:
+//  - Linux PSI: the "some avg10" line of psi_path, the share of the last
+//    10 seconds some task spent stalled on memory.
+//  - cgroup v2: memory.current and memory.max in cgroup_dir, how close the
+//    cgroup is to its limit.
+// If either says we are under pressure, maxmem shrinks by shrink_step of
+// itself. If both are calm (or absent), it grows back by grow_step. In
+// between it holds still, so it doesn't flap.
+typedef struct memctl_obj *memctl_t;
+
+struct memctl_config
+{
+    uint64_t min_maxmem;
+    uint64_t max_maxmem;
+
+    // "/proc/pressure/memory" by default, NULL to ignore PSI
+    const char *psi_path;
+    // the cgroup v2 directory to watch. NULL (the default) finds our own
+    // through /proc/self/cgroup; "" ignores cgroups.
+    const char *cgroup_dir;
+
+    double psi_high; // shrink above this avg10 (a percentage)
+    double psi_low; // may grow below it
+    double cgroup_high; // shrink above this memory.current / memory.max
+    double cgroup_low; // may grow below it
+
+    double shrink_step; // fraction of maxmem to give up per step
+    double grow_step; // fraction of maxmem to take back per step
+
+    uint32_t interval_ms; // how often memctl_start's thread steps
+};
+
+// What one step read, and what it did
+struct memctl_reading
+{
+    bool has_psi;
+    double psi_avg10;
+    bool has_cgroup; // false if there is no cgroup or it has no limit
+    uint64_t cgroup_current;
+    uint64_t cgroup_max;
+    uint64_t maxmem; // the cache's maxmem after the step
+};
+
+// Fill config with defaults for a cache that may use between min_maxmem
+// and max_maxmem bytes.
+void memctl_config_init(struct memctl_config *config, uint64_t min_maxmem, uint64_t max_maxmem);
+
+// Create a controller for cache. Nothing runs until memctl_step or
+// memctl_start. The config's strings are copied.
+memctl_t memctl_create(cache_t cache, const struct memctl_config *config);
+
+// Read the signals once and move maxmem. reading may be NULL.
+void memctl_step(memctl_t ctl, struct memctl_reading *reading);
+
+// Step every interval_ms on a background thread until memctl_destroy.
+void memctl_start(memctl_t ctl);
+
+// Stops the thread if there is one. Leaves the cache's maxmem where it is.
+void memctl_destroy(memctl_t ctl);
+
+// Parse the "some avg10" value out of a PSI file. False if it can't.
+bool memctl_read_psi(const char *path, double *avg10);
+
+// Read memory.current and memory.max in a cgroup v2 directory. False if
+// either is missing or memory.max is "max".
+bool memctl_read_cgroup(const char *dir, uint64_t *current, uint64_t *max);
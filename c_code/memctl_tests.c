@@ -0,0 +1,200 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "memctl.h"
+#include "memctl_tests.h"
+
+#define my_assert(value, string) \
+{if (!(value)) { printf("!!!FAILURE!!! %s\n", string);}}
+
+// a directory of fake /proc/pressure/memory and cgroup files
+struct fake_host
+{
+    char dir[64];
+    char psi[96];
+};
+
+static void write_file(const char *dir, const char *name, const char *contents)
+{
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *f = fopen(path, "w");
+    my_assert(f, "could not write fake file");
+    if (f) {
+        fputs(contents, f);
+        fclose(f);
+    }
+}
+
+static void set_psi(struct fake_host *host, double avg10)
+{
+    char contents[160];
+    snprintf(contents, sizeof(contents),
+            "some avg10=%.2f avg60=0.00 avg300=0.00 total=0\n"
+            "full avg10=0.00 avg60=0.00 avg300=0.00 total=0\n", avg10);
+    write_file(host->dir, "pressure", contents);
+}
+
+static void set_cgroup(struct fake_host *host, uint64_t current, const char *max)
+{
+    char contents[32];
+    snprintf(contents, sizeof(contents), "%" PRIu64 "\n", current);
+    write_file(host->dir, "memory.current", contents);
+    write_file(host->dir, "memory.max", max);
+}
+
+static void fake_host_init(struct fake_host *host)
+{
+    strcpy(host->dir, "/tmp/memctl_testXXXXXX");
+    my_assert(mkdtemp(host->dir), "could not make a temp dir");
+    snprintf(host->psi, sizeof(host->psi), "%s/pressure", host->dir);
+    set_psi(host, 0);
+    set_cgroup(host, 0, "max\n");
+}
+
+static void fake_host_remove(struct fake_host *host)
+{
+    const char *names[] = {"pressure", "memory.current", "memory.max"};
+    char path[128];
+    for (uint32_t i = 0; i < 3; i++) {
+        snprintf(path, sizeof(path), "%s/%s", host->dir, names[i]);
+        unlink(path);
+    }
+    rmdir(host->dir);
+}
+
+static void test_memctl_parsing()
+{
+    printf("Running memctl parsing test\n");
+    struct fake_host host;
+    fake_host_init(&host);
+
+    double avg10;
+    set_psi(&host, 12.5);
+    my_assert(memctl_read_psi(host.psi, &avg10) && avg10 == 12.5, "psi avg10 misread");
+    write_file(host.dir, "pressure", "full avg10=3.00 avg60=0.00 avg300=0.00 total=0\n");
+    my_assert(!memctl_read_psi(host.psi, &avg10), "psi without a some line was read");
+    my_assert(!memctl_read_psi("/nonexistent/pressure", &avg10), "missing psi file was read");
+
+    uint64_t current, max;
+    my_assert(!memctl_read_cgroup(host.dir, &current, &max), "cgroup without a limit was read");
+    set_cgroup(&host, 300, "1000\n");
+    my_assert(memctl_read_cgroup(host.dir, &current, &max) && current == 300 && max == 1000,
+            "cgroup files misread");
+
+    fake_host_remove(&host);
+}
+
+static void test_memctl_steps()
+{
+    printf("Running memctl step test\n");
+    struct fake_host host;
+    fake_host_init(&host);
+
+    cache_t cache = create_cache(100000);
+    char key[32];
+    uint8_t val[100] = {0};
+    for (uint32_t i = 0; i < 1000; i++) {
+        snprintf(key, sizeof(key), "key%" PRIu32, i);
+        cache_set(cache, (key_type) key, val, sizeof(val));
+    }
+
+    struct memctl_config config;
+    memctl_config_init(&config, 50000, 200000);
+    config.psi_path = host.psi;
+    config.cgroup_dir = host.dir;
+    memctl_t ctl = memctl_create(cache, &config);
+    struct memctl_reading r;
+
+    // memory pressure shrinks the budget, and the cache evicts down to it
+    set_psi(&host, 25);
+    memctl_step(ctl, &r);
+    my_assert(r.has_psi && !r.has_cgroup, "step read the wrong signals");
+    my_assert(cache_maxmem(cache) == 90000 && r.maxmem == 90000, "psi pressure did not shrink maxmem");
+    my_assert(cache_space_used(cache) <= 90000, "cache did not evict down to the new maxmem");
+
+    // but not below min_maxmem
+    for (uint32_t i = 0; i < 20; i++) {
+        memctl_step(ctl, NULL);
+    }
+    my_assert(cache_maxmem(cache) == 50000, "maxmem went below min_maxmem");
+    my_assert(cache_space_used(cache) <= 50000, "cache is over min_maxmem");
+
+    // moderate pressure holds still, no pressure grows back to max_maxmem
+    set_psi(&host, 5);
+    memctl_step(ctl, NULL);
+    my_assert(cache_maxmem(cache) == 50000, "moderate pressure moved maxmem");
+    set_psi(&host, 0);
+    memctl_step(ctl, NULL);
+    my_assert(cache_maxmem(cache) == 52500, "no pressure did not grow maxmem");
+    for (uint32_t i = 0; i < 100; i++) {
+        memctl_step(ctl, NULL);
+    }
+    my_assert(cache_maxmem(cache) == 200000, "maxmem did not grow back to max_maxmem");
+
+    // a cgroup close to its limit shrinks it too, even without psi
+    set_cgroup(&host, 950, "1000\n");
+    memctl_step(ctl, &r);
+    my_assert(r.has_cgroup && r.cgroup_current == 950 && r.cgroup_max == 1000, "cgroup misread");
+    my_assert(cache_maxmem(cache) == 180000, "cgroup pressure did not shrink maxmem");
+    set_cgroup(&host, 850, "1000\n");
+    memctl_step(ctl, NULL);
+    my_assert(cache_maxmem(cache) == 180000, "cgroup between the thresholds moved maxmem");
+
+    memctl_destroy(ctl);
+    destroy_cache(cache);
+    fake_host_remove(&host);
+}
+
+static void test_memctl_thread()
+{
+    printf("Running memctl thread test\n");
+    struct fake_host host;
+    fake_host_init(&host);
+
+    struct cache_config cache_config;
+    cache_config_init(&cache_config, 100000);
+    cache_config.maintenance_thread = true;
+    cache_config.maintenance_interval_ms = 5;
+    cache_t cache = create_cache_with_config(&cache_config);
+    char key[32];
+    uint8_t val[100] = {0};
+    for (uint32_t i = 0; i < 1000; i++) {
+        snprintf(key, sizeof(key), "key%" PRIu32, i);
+        cache_set(cache, (key_type) key, val, sizeof(val));
+    }
+
+    struct memctl_config config;
+    memctl_config_init(&config, 20000, 100000);
+    config.psi_path = host.psi;
+    config.cgroup_dir = "";
+    config.interval_ms = 5;
+    set_psi(&host, 80);
+    memctl_t ctl = memctl_create(cache, &config);
+    memctl_start(ctl);
+
+    // the maintenance thread evicts in the background as maxmem drops
+    for (uint32_t i = 0; i < 400 && (cache_maxmem(cache) > 20000 ||
+                cache_space_used(cache) > 20000); i++) {
+        usleep(5000);
+    }
+    memctl_destroy(ctl);
+    my_assert(cache_maxmem(cache) == 20000, "controller thread did not shrink maxmem");
+    my_assert(cache_space_used(cache) <= 20000, "maintenance thread did not evict to the new maxmem");
+
+    destroy_cache(cache);
+    fake_host_remove(&host);
+}
+
+void memctl_tests()
+{
+    printf("***Running memctl tests***\n");
+    test_memctl_parsing();
+    test_memctl_steps();
+    test_memctl_thread();
+}
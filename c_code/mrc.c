@@ -0,0 +1,448 @@
+/*
+ * mrc.c: miss ratio curve estimation with SHARDS, see mrc.h
+ *
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mrc.h"
+
+// histogram bins: bin 0 holds distances under 1, bin b > 0 the ones in
+// [2^((b - 1) / MRC_BINS_PER_DOUBLING), 2^(b / MRC_BINS_PER_DOUBLING))
+#define MRC_BINS_PER_DOUBLING 8
+#define MRC_BINS (64 * MRC_BINS_PER_DOUBLING + 1)
+#define MRC_NONE UINT32_MAX
+// each thread adds its reads to the count this many at a time, whichever
+// estimator the last of them went to
+#define MRC_COUNT_EVERY 64
+
+struct mrc_key
+{
+    uint64_t hash;
+    uint64_t size;
+    uint32_t sample; // spread hash, under the threshold
+    uint32_t time; // of its last access
+    uint32_t next; // in its bucket, or the free list
+    uint32_t heap_index;
+};
+
+struct mrc_obj
+{
+    _Atomic uint32_t threshold; // keys whose spread hash is under it are tracked
+    pthread_mutex_t lock;
+    uint32_t max_keys;
+    struct mrc_key *keys; // max_keys + 1 slots
+    uint32_t num_keys;
+    uint32_t free_slot;
+    uint32_t *buckets;
+    uint32_t bucket_mask;
+    uint32_t *heap; // slots, the highest spread hash on top
+    // Access times run from 0 to window; the tree sums the sizes of the
+    // keys whose last access was at each, and owner says whose it was.
+    // When time runs out the live ones are packed down to the start.
+    uint64_t *tree;
+    uint32_t *owner;
+    uint32_t window;
+    uint32_t clock;
+    // in reads, each weighted by 1 / rate
+    double bins[MRC_BINS];
+    double cold;
+    double reads;
+    uint32_t since_decay;
+    uint64_t sampled_reads;
+    // all reads, sampled or not, for SHARDS_adj: the ones counted by the
+    // last decay, halved like the bins, and the count then
+    _Atomic uint64_t all_reads;
+    double all_reads_decayed;
+    uint64_t all_reads_at_decay;
+};
+
+// reads by this thread not yet added to any count
+static _Thread_local uint32_t thread_reads;
+
+static uint32_t spread(uint64_t hash)
+{
+    // the top bits of a multiply depend on every bit of the hash, so this
+    // samples well even if the cache's hash is weak in some bits
+    return (uint32_t) ((hash * 0x9e3779b97f4a7c15ull) >> 40);
+}
+
+mrc_t mrc_create(double sample_rate, uint32_t max_keys)
+{
+    assert(sample_rate > 0 && sample_rate <= 1 && "sample rate");
+    assert(max_keys > 0 && "max keys");
+    mrc_t mrc = calloc(1, sizeof(struct mrc_obj));
+    assert(mrc && "memory");
+    pthread_mutex_init(&mrc->lock, NULL);
+    atomic_init(&mrc->threshold, (uint32_t) (sample_rate * MRC_MOD));
+    if (atomic_load(&mrc->threshold) == 0) {
+        atomic_store(&mrc->threshold, 1);
+    }
+    mrc->max_keys = max_keys;
+    mrc->keys = calloc((size_t) max_keys + 1, sizeof(struct mrc_key));
+    mrc->heap = calloc((size_t) max_keys + 1, sizeof(uint32_t));
+    uint32_t num_buckets = 1;
+    while (num_buckets < 2 * max_keys) {
+        num_buckets <<= 1;
+    }
+    mrc->buckets = malloc(num_buckets * sizeof(uint32_t));
+    mrc->bucket_mask = num_buckets - 1;
+    // twice the keys at least, so packing is paid for by as many accesses
+    // as it moves keys
+    mrc->window = 2 * (max_keys + 1);
+    mrc->tree = calloc((size_t) mrc->window + 1, sizeof(uint64_t));
+    mrc->owner = malloc(mrc->window * sizeof(uint32_t));
+    assert(mrc->keys && mrc->heap && mrc->buckets && mrc->tree && mrc->owner && "memory");
+    memset(mrc->buckets, 0xff, num_buckets * sizeof(uint32_t));
+    memset(mrc->owner, 0xff, mrc->window * sizeof(uint32_t));
+    for (uint32_t i = 0; i <= max_keys; ++i) {
+        mrc->keys[i].next = i < max_keys ? i + 1 : MRC_NONE;
+    }
+    return mrc;
+}
+
+void mrc_destroy(mrc_t mrc)
+{
+    pthread_mutex_destroy(&mrc->lock);
+    free(mrc->keys);
+    free(mrc->heap);
+    free(mrc->buckets);
+    free(mrc->tree);
+    free(mrc->owner);
+    free(mrc);
+}
+
+// Fenwick tree over access times, 1-based inside
+
+static void tree_add(mrc_t mrc, uint32_t time, uint64_t delta)
+{
+    // delta may be a negative one, wrapped: sums come out right mod 2^64
+    for (uint32_t i = time + 1; i <= mrc->window; i += i & -i) {
+        mrc->tree[i] += delta;
+    }
+}
+
+static uint64_t tree_sum(mrc_t mrc, uint32_t time)
+{
+    // sizes at times before time
+    uint64_t sum = 0;
+    for (uint32_t i = time; i > 0; i -= i & -i) {
+        sum += mrc->tree[i];
+    }
+    return sum;
+}
+
+static void pack_times(mrc_t mrc)
+{
+    uint32_t clock = 0;
+    for (uint32_t t = 0; t < mrc->clock; ++t) {
+        uint32_t slot = mrc->owner[t];
+        if (slot != MRC_NONE) {
+            mrc->owner[clock] = slot;
+            mrc->keys[slot].time = clock++;
+        }
+    }
+    memset(mrc->owner + clock, 0xff, (mrc->window - clock) * sizeof(uint32_t));
+    memset(mrc->tree, 0, ((size_t) mrc->window + 1) * sizeof(uint64_t));
+    mrc->clock = clock;
+    for (uint32_t t = 0; t < clock; ++t) {
+        tree_add(mrc, t, mrc->keys[mrc->owner[t]].size);
+    }
+}
+
+static void touch(mrc_t mrc, uint32_t slot, uint64_t size)
+{
+    // move the key to the top of the stack
+    struct mrc_key *key = &mrc->keys[slot];
+    if (key->time != MRC_NONE) {
+        tree_add(mrc, key->time, -key->size);
+        mrc->owner[key->time] = MRC_NONE;
+    }
+    if (mrc->clock == mrc->window) {
+        pack_times(mrc);
+    }
+    key->size = size;
+    key->time = mrc->clock++;
+    mrc->owner[key->time] = slot;
+    tree_add(mrc, key->time, size);
+}
+
+// max-heap of slots on their spread hash
+
+static bool heap_above(mrc_t mrc, uint32_t i, uint32_t j)
+{
+    return mrc->keys[mrc->heap[i]].sample > mrc->keys[mrc->heap[j]].sample;
+}
+
+static void heap_swap(mrc_t mrc, uint32_t i, uint32_t j)
+{
+    uint32_t slot = mrc->heap[i];
+    mrc->heap[i] = mrc->heap[j];
+    mrc->heap[j] = slot;
+    mrc->keys[mrc->heap[i]].heap_index = i;
+    mrc->keys[mrc->heap[j]].heap_index = j;
+}
+
+static void heap_up(mrc_t mrc, uint32_t i)
+{
+    while (i > 0 && heap_above(mrc, i, (i - 1) / 2)) {
+        heap_swap(mrc, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void heap_down(mrc_t mrc, uint32_t i)
+{
+    for (;;) {
+        uint32_t top = i;
+        uint32_t left = 2 * i + 1;
+        if (left < mrc->num_keys && heap_above(mrc, left, top)) {
+            top = left;
+        }
+        if (left + 1 < mrc->num_keys && heap_above(mrc, left + 1, top)) {
+            top = left + 1;
+        }
+        if (top == i) {
+            return;
+        }
+        heap_swap(mrc, i, top);
+        i = top;
+    }
+}
+
+static uint32_t find_key(mrc_t mrc, uint64_t hash)
+{
+    uint32_t slot = mrc->buckets[hash & mrc->bucket_mask];
+    while (slot != MRC_NONE && mrc->keys[slot].hash != hash) {
+        slot = mrc->keys[slot].next;
+    }
+    return slot;
+}
+
+static uint32_t add_key(mrc_t mrc, uint64_t hash, uint32_t sample)
+{
+    uint32_t slot = mrc->free_slot;
+    assert(slot != MRC_NONE && "mrc keys");
+    struct mrc_key *key = &mrc->keys[slot];
+    mrc->free_slot = key->next;
+    key->hash = hash;
+    key->size = 0;
+    key->sample = sample;
+    key->time = MRC_NONE;
+    uint32_t *bucket = &mrc->buckets[hash & mrc->bucket_mask];
+    key->next = *bucket;
+    *bucket = slot;
+    key->heap_index = mrc->num_keys;
+    mrc->heap[mrc->num_keys++] = slot;
+    heap_up(mrc, key->heap_index);
+    return slot;
+}
+
+static void remove_key(mrc_t mrc, uint32_t slot)
+{
+    struct mrc_key *key = &mrc->keys[slot];
+    if (key->time != MRC_NONE) {
+        tree_add(mrc, key->time, -key->size);
+        mrc->owner[key->time] = MRC_NONE;
+    }
+    uint32_t *link = &mrc->buckets[key->hash & mrc->bucket_mask];
+    while (*link != slot) {
+        link = &mrc->keys[*link].next;
+    }
+    *link = key->next;
+    uint32_t i = key->heap_index;
+    if (i != --mrc->num_keys) {
+        heap_swap(mrc, i, mrc->num_keys);
+        heap_down(mrc, i);
+        heap_up(mrc, i);
+    }
+    key->next = mrc->free_slot;
+    mrc->free_slot = slot;
+}
+
+static void shrink(mrc_t mrc)
+{
+    // over max_keys: lower the threshold to the highest spread hash, and
+    // drop every key at or above it
+    if (mrc->num_keys <= mrc->max_keys) {
+        return;
+    }
+    uint32_t threshold = mrc->keys[mrc->heap[0]].sample;
+    while (mrc->num_keys > 0 && mrc->keys[mrc->heap[0]].sample >= threshold) {
+        remove_key(mrc, mrc->heap[0]);
+    }
+    atomic_store_explicit(&mrc->threshold, threshold, memory_order_relaxed);
+}
+
+static uint32_t bin_of(double distance)
+{
+    if (distance < 1) {
+        return 0;
+    }
+    double b = floor(log2(distance) * MRC_BINS_PER_DOUBLING) + 1;
+    return b < MRC_BINS - 1 ? (uint32_t) b : MRC_BINS - 1;
+}
+
+static double bin_low(uint32_t b)
+{
+    return b == 0 ? 0 : exp2((double) (b - 1) / MRC_BINS_PER_DOUBLING);
+}
+
+static double bin_high(uint32_t b)
+{
+    return exp2((double) b / MRC_BINS_PER_DOUBLING);
+}
+
+static uint64_t count_all_reads(mrc_t mrc)
+{
+    return atomic_load_explicit(&mrc->all_reads, memory_order_relaxed);
+}
+
+static double all_reads_since_decay(mrc_t mrc)
+{
+    // all reads, weighted like the bins
+    return mrc->all_reads_decayed + (double) (count_all_reads(mrc) - mrc->all_reads_at_decay);
+}
+
+static void decay(mrc_t mrc)
+{
+    for (uint32_t b = 0; b < MRC_BINS; ++b) {
+        mrc->bins[b] /= 2;
+    }
+    mrc->cold /= 2;
+    mrc->reads /= 2;
+    mrc->since_decay = 0;
+    mrc->all_reads_decayed = all_reads_since_decay(mrc) / 2;
+    mrc->all_reads_at_decay = count_all_reads(mrc);
+}
+
+static bool sampled(mrc_t mrc, uint32_t sample)
+{
+    return sample < atomic_load_explicit(&mrc->threshold, memory_order_relaxed);
+}
+
+void mrc_read(mrc_t mrc, uint64_t hash, uint64_t size)
+{
+    uint32_t sample = spread(hash);
+    if (++thread_reads == MRC_COUNT_EVERY) {
+        thread_reads = 0;
+        atomic_fetch_add_explicit(&mrc->all_reads, MRC_COUNT_EVERY, memory_order_relaxed);
+    }
+    if (!sampled(mrc, sample)) {
+        return;
+    }
+    pthread_mutex_lock(&mrc->lock);
+    if (sampled(mrc, sample)) { // the threshold may have come down meanwhile
+        double weight = (double) MRC_MOD / atomic_load_explicit(&mrc->threshold, memory_order_relaxed);
+        uint32_t slot = find_key(mrc, hash);
+        if (slot == MRC_NONE) {
+            mrc->cold += weight;
+            slot = add_key(mrc, hash, sample);
+        } else {
+            struct mrc_key *key = &mrc->keys[slot];
+            if (size == 0) {
+                size = key->size; // a miss here, maybe not in a bigger cache
+            }
+            // the keys accessed since, and this one
+            uint64_t distance = tree_sum(mrc, mrc->clock) - tree_sum(mrc, key->time + 1) + size;
+            mrc->bins[bin_of(distance * weight)] += weight;
+        }
+        touch(mrc, slot, size);
+        mrc->reads += weight;
+        ++mrc->sampled_reads;
+        if (++mrc->since_decay == MRC_HALF_LIFE) {
+            decay(mrc);
+        }
+        shrink(mrc);
+    }
+    pthread_mutex_unlock(&mrc->lock);
+}
+
+void mrc_write(mrc_t mrc, uint64_t hash, uint64_t size)
+{
+    uint32_t sample = spread(hash);
+    if (!sampled(mrc, sample)) {
+        return;
+    }
+    pthread_mutex_lock(&mrc->lock);
+    if (sampled(mrc, sample)) {
+        uint32_t slot = find_key(mrc, hash);
+        if (slot == MRC_NONE) {
+            slot = add_key(mrc, hash, sample);
+        }
+        touch(mrc, slot, size);
+        shrink(mrc);
+    }
+    pthread_mutex_unlock(&mrc->lock);
+}
+
+void mrc_delete(mrc_t mrc, uint64_t hash)
+{
+    if (!sampled(mrc, spread(hash))) {
+        return;
+    }
+    pthread_mutex_lock(&mrc->lock);
+    uint32_t slot = find_key(mrc, hash);
+    if (slot != MRC_NONE) {
+        remove_key(mrc, slot);
+    }
+    pthread_mutex_unlock(&mrc->lock);
+}
+
+uint64_t mrc_curve(mrc_t mrc, const uint64_t *sizes, double *miss_ratios, uint32_t n)
+{
+    pthread_mutex_lock(&mrc->lock);
+    // SHARDS_adj: the sampled reads, scaled up, should come to all the
+    // reads. Whatever they are off by is put down to the sample having
+    // too few or too many of the hottest keys, whose reads are the ones
+    // with the shortest distances: the difference goes into the bottom
+    // of the histogram, or comes off it from the bottom up. Not until the
+    // reads threads haven't added to the count yet are a small part of it
+    double bins[MRC_BINS];
+    memcpy(bins, mrc->bins, sizeof(bins));
+    double reads = mrc->reads;
+    if (reads > 0 && count_all_reads(mrc) >= 64 * MRC_COUNT_EVERY) {
+        double adjust = all_reads_since_decay(mrc) - reads;
+        reads += adjust;
+        for (uint32_t b = 0; b < MRC_BINS && adjust < 0; ++b) {
+            double taken = bins[b] < -adjust ? bins[b] : -adjust;
+            bins[b] -= taken;
+            adjust += taken;
+        }
+        bins[0] += adjust > 0 ? adjust : 0;
+    }
+    for (uint32_t i = 0; i < n; ++i) {
+        if (reads <= 0) {
+            miss_ratios[i] = 1;
+            continue;
+        }
+        // reads with a distance of at most the size hit, taking distances
+        // as spread evenly over a bin
+        double size = (double) sizes[i];
+        double hits = 0;
+        for (uint32_t b = 0; b < MRC_BINS && bin_low(b) <= size; ++b) {
+            double high = bin_high(b);
+            if (high <= size) {
+                hits += bins[b];
+            } else {
+                hits += bins[b] * (size - bin_low(b)) / (high - bin_low(b));
+            }
+        }
+        double ratio = 1 - hits / reads;
+        miss_ratios[i] = ratio < 0 ? 0 : ratio;
+    }
+    uint64_t sampled_reads = mrc->sampled_reads;
+    pthread_mutex_unlock(&mrc->lock);
+    return sampled_reads;
+}
+
+double mrc_rate(mrc_t mrc)
+{
+    return (double) atomic_load_explicit(&mrc->threshold, memory_order_relaxed) / MRC_MOD;
+}
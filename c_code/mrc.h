@@ -0,0 +1,65 @@
+/*
+ * mrc.h: header file for miss ratio curve estimation with SHARDS
+ *
+ */
+#pragma once
+
+#include <inttypes.h>
+
+// Estimates the miss ratio an LRU cache would have at every size at once,
+// from the reads and writes seen by a real cache (Waldspurger et al.,
+// "Efficient MRC Construction with SHARDS", FAST 2015).
+//
+// Only keys whose hash, spread over [0, MRC_MOD), falls under a threshold
+// are tracked. That is a fixed fraction of the key space, the sample
+// rate, and a tracked key is seen on every access (spatial sampling). A
+// read of a tracked key has a reuse distance: the bytes of the distinct
+// tracked keys accessed since its last access, its own included. An LRU
+// cache of c bytes hits that read exactly when the distance, scaled up by
+// 1 / rate, is at most c. A Fenwick tree over access times gives the
+// distance in O(log n), and a histogram of distances gives the whole curve.
+//
+// At most max_keys keys are tracked. Past that the key with the highest
+// spread hash is dropped and the threshold comes down to it (fixed-size
+// SHARDS), so memory stays bounded however big the key space is and the
+// rate adapts to it. All counts are halved every MRC_HALF_LIFE sampled
+// reads, so the curve follows the workload as it changes.
+//
+// Writes put a key at the top of the LRU stack and set its size but are
+// not requests: the curve is of read misses, as cache_get sees them.
+//
+// Every read is also counted, for SHARDS_adj (from the same paper): if
+// the sampled reads, scaled up, come to more or fewer than all of them,
+// the sample holds too many or too few of the hottest keys, and the
+// difference is taken off or added to the shortest distances.
+//
+// A read of a key that isn't sampled costs a multiply, a compare and a
+// thread-local count, without the lock. Thread safe.
+#define MRC_MOD (1u << 24)
+#define MRC_HALF_LIFE (1u << 16)
+
+typedef struct mrc_obj *mrc_t;
+
+// track keys at sample_rate (0 to 1], and at most max_keys of them
+mrc_t mrc_create(double sample_rate, uint32_t max_keys);
+
+void mrc_destroy(mrc_t mrc);
+
+// a read of the key with this hash; size is its value size if it was
+// found, 0 if it wasn't
+void mrc_read(mrc_t mrc, uint64_t hash, uint64_t size);
+
+// a write of size bytes to the key with this hash
+void mrc_write(mrc_t mrc, uint64_t hash, uint64_t size);
+
+// the key with this hash was deleted (not evicted: it would still be in
+// a bigger cache)
+void mrc_delete(mrc_t mrc, uint64_t hash);
+
+// Fill in miss_ratios[i] with the estimated miss ratio of an LRU cache of
+// sizes[i] bytes, and return the number of sampled reads seen so far (0
+// means no estimate yet; all ratios are 1 then).
+uint64_t mrc_curve(mrc_t mrc, const uint64_t *sizes, double *miss_ratios, uint32_t n);
+
+// the sample rate now, lower than asked for once max_keys is reached
+double mrc_rate(mrc_t mrc);
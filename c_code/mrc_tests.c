@@ -0,0 +1,186 @@
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "mrc.h"
+#include "mrc_tests.h"
+
+#define my_assert(value, string) \
+{if (!(value)) { printf("!!!FAILURE!!! %s\n", string);}}
+
+static uint64_t next_random(uint64_t *state)
+{
+    // xorshift64*
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545f4914f6cdd1dull;
+}
+
+static void loop_over_keys(mrc_t mrc, uint64_t keys, uint64_t size, uint32_t passes)
+{
+    // read each key in turn, setting it on a miss, like a look-aside cache
+    for (uint32_t pass = 0; pass < passes; ++pass) {
+        for (uint64_t k = 1; k <= keys; ++k) {
+            mrc_read(mrc, k, pass ? size : 0);
+            if (pass == 0) {
+                mrc_write(mrc, k, size);
+            }
+        }
+    }
+}
+
+static void test_mrc_loop()
+{
+    printf("Running mrc loop test\n");
+    // An LRU cache misses every read of a loop bigger than itself and
+    // none of one that fits (but the first pass)
+    const uint64_t keys = 20000;
+    const uint64_t size = 100;
+    mrc_t mrc = mrc_create(0.1, 10000);
+    uint64_t sizes[] = {0, keys * size / 2, keys * size * 3 / 2, keys * size * 10};
+    double ratios[4];
+    my_assert(mrc_curve(mrc, sizes, ratios, 4) == 0 && ratios[2] == 1, "mrc had a curve without reads");
+
+    loop_over_keys(mrc, keys, size, 20);
+    uint64_t reads = mrc_curve(mrc, sizes, ratios, 4);
+    my_assert(reads > 20 * keys / 20 && reads < 20 * keys / 5, "mrc sampled the wrong number of reads");
+    my_assert(ratios[0] == 1, "mrc said an empty cache hits");
+    my_assert(ratios[1] > 0.95, "mrc said a cache too small for the loop hits");
+    my_assert(ratios[2] < 0.1 && ratios[3] < 0.1, "mrc said a cache the loop fits in misses");
+    my_assert(ratios[2] > 0.02, "mrc lost the cold misses");
+    mrc_destroy(mrc);
+}
+
+static void test_mrc_fixed_size()
+{
+    printf("Running mrc fixed size test\n");
+    // tracking every key to begin with, but only room for a few hundred:
+    // the rate has to come down to about 1% and the curve stay right
+    const uint64_t keys = 20000;
+    const uint64_t size = 100;
+    mrc_t mrc = mrc_create(1.0, 200);
+    loop_over_keys(mrc, keys, size, 20);
+    my_assert(mrc_rate(mrc) < 0.02 && mrc_rate(mrc) > 0.005, "mrc rate didn't adapt to max keys");
+
+    uint64_t sizes[] = {keys * size / 2, keys * size * 3 / 2};
+    double ratios[2];
+    mrc_curve(mrc, sizes, ratios, 2);
+    my_assert(ratios[0] > 0.9, "fixed size mrc said a cache too small for the loop hits");
+    my_assert(ratios[1] < 0.15, "fixed size mrc said a cache the loop fits in misses");
+    mrc_destroy(mrc);
+}
+
+static void test_mrc_uniform()
+{
+    printf("Running mrc uniform test\n");
+    // With every key as likely as the next, LRU holding a fraction f of
+    // them hits a fraction f of the reads
+    const uint64_t keys = 20000;
+    const uint64_t size = 50;
+    mrc_t mrc = mrc_create(0.1, 10000);
+    uint64_t state = 88172645463325252ull;
+    for (uint64_t i = 0; i < 40 * keys; ++i) {
+        uint64_t k = 1 + next_random(&state) % keys;
+        mrc_write(mrc, k, size); // sets only place keys; the curve is of reads
+        k = 1 + next_random(&state) % keys;
+        mrc_read(mrc, k, size);
+    }
+    uint64_t sizes[] = {keys * size / 4, keys * size / 2, keys * size * 3 / 4};
+    double ratios[3];
+    mrc_curve(mrc, sizes, ratios, 3);
+    bool ok = true;
+    for (int i = 0; i < 3; ++i) {
+        ok = ok && fabs(ratios[i] - (1 - (i + 1) / 4.0)) < 0.08;
+    }
+    my_assert(ok, "mrc curve is off for uniform reads");
+    my_assert(ratios[0] > ratios[1] && ratios[1] > ratios[2], "mrc curve went up with size");
+    mrc_destroy(mrc);
+}
+
+static void test_mrc_delete()
+{
+    printf("Running mrc delete test\n");
+    // a deleted key misses at every size, unlike an evicted one
+    const uint64_t keys = 1000;
+    mrc_t mrc = mrc_create(1.0, 2000);
+    for (uint64_t k = 1; k <= keys; ++k) {
+        mrc_write(mrc, k, 10);
+    }
+    for (uint64_t k = 1; k <= keys; ++k) {
+        mrc_delete(mrc, k);
+    }
+    for (uint64_t k = 1; k <= keys; ++k) {
+        mrc_read(mrc, k, 0);
+    }
+    uint64_t sizes[] = {1ull << 40};
+    double ratios[1];
+    mrc_curve(mrc, sizes, ratios, 1);
+    my_assert(ratios[0] == 1, "mrc hit a deleted key");
+
+    // and the reads put them back
+    for (uint64_t k = 1; k <= keys; ++k) {
+        mrc_read(mrc, k, 0);
+    }
+    mrc_curve(mrc, sizes, ratios, 1);
+    my_assert(fabs(ratios[0] - 0.5) < 0.01, "mrc missed keys it had seen");
+    mrc_destroy(mrc);
+}
+
+static uint64_t hot_key(bool sampled)
+{
+    // a key that is (or isn't) sampled at a rate of 0.1
+    for (uint64_t k = 1000000;; ++k) {
+        mrc_t mrc = mrc_create(0.1, 10);
+        mrc_read(mrc, k, 0);
+        uint64_t sizes[] = {0};
+        double ratios[1];
+        bool got = mrc_curve(mrc, sizes, ratios, 1) > 0;
+        mrc_destroy(mrc);
+        if (got == sampled) {
+            return k;
+        }
+    }
+}
+
+static double miss_ratio_with_hot_key(uint64_t hot)
+{
+    // every other read is of the hot key, which an LRU cache of a few
+    // values holds on to, so that cache misses half the reads
+    const uint64_t keys = 2000;
+    const uint64_t size = 100;
+    mrc_t mrc = mrc_create(0.1, 10000);
+    uint64_t state = 88172645463325252ull;
+    for (uint64_t i = 0; i < 50 * keys; ++i) {
+        mrc_read(mrc, hot, size);
+        mrc_read(mrc, 1 + next_random(&state) % keys, size);
+    }
+    uint64_t sizes[] = {30 * size};
+    double ratios[1];
+    mrc_curve(mrc, sizes, ratios, 1);
+    mrc_destroy(mrc);
+    return ratios[0];
+}
+
+static void test_mrc_adjust()
+{
+    printf("Running mrc adjust test\n");
+    // Scaled up, a hot key stands for a tenth of its reads if it isn't
+    // sampled and ten times them if it is; SHARDS_adj has to bring the
+    // curve back to the truth from either side
+    double unsampled = miss_ratio_with_hot_key(hot_key(false));
+    double sampled = miss_ratio_with_hot_key(hot_key(true));
+    my_assert(fabs(unsampled - 0.5) < 0.1, "mrc missed the reads of a hot key it didn't sample");
+    my_assert(fabs(sampled - 0.5) < 0.1, "mrc overcounted the reads of a hot key it sampled");
+}
+
+void mrc_tests()
+{
+    printf("***Running mrc tests***\n");
+    test_mrc_loop();
+    test_mrc_fixed_size();
+    test_mrc_uniform();
+    test_mrc_delete();
+    test_mrc_adjust();
+}
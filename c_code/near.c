@@ -0,0 +1,121 @@
+/*
+ * near.c: a per-thread near cache, see near.h
+ *
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "near.h"
+
+// a near hit is sent on to the main cache once every this many hits
+const uint32_t NEAR_REFRESH_EVERY = 64;
+
+struct near_entry
+{
+    uint64_t hash;
+    uint64_t stamp;
+    uint8_t *key; // NULL if the slot is empty
+    void *val;
+    uint32_t val_size;
+    uint32_t hits;
+};
+
+struct near_obj
+{
+    uint32_t mask; // number of slots - 1
+    uint32_t max_val_size;
+    uint64_t hits;
+    struct near_entry *entries;
+    uint64_t *offered; // hash last offered for each slot, for admission
+};
+
+static void clear_entry(struct near_entry *e)
+{
+    free(e->key);
+    free(e->val);
+    e->key = NULL;
+    e->val = NULL;
+}
+
+near_t near_create(uint32_t num_entries, uint32_t max_val_size)
+{
+    near_t near = calloc(1, sizeof(struct near_obj));
+    assert(near && "memory");
+    uint32_t n = 1;
+    while (n < num_entries) {
+        n *= 2;
+    }
+    near->mask = n - 1;
+    near->max_val_size = max_val_size;
+    near->entries = calloc(n, sizeof(struct near_entry));
+    near->offered = calloc(n, sizeof(uint64_t));
+    assert(near->entries && near->offered && "memory");
+    return near;
+}
+
+void near_destroy(near_t near)
+{
+    for (uint32_t i = 0; i <= near->mask; ++i) {
+        clear_entry(&near->entries[i]);
+    }
+    free(near->entries);
+    free(near->offered);
+    free(near);
+}
+
+void *near_get(near_t near, key_type key, uint64_t hash, uint64_t stamp,
+        uint32_t *val_size, bool *refresh)
+{
+    struct near_entry *e = &near->entries[hash & near->mask];
+    *refresh = false;
+    if (e->key == NULL || e->hash != hash ||
+            strcmp((const char*) e->key, (const char*) key) != 0) {
+        return NULL;
+    }
+    if (e->stamp != stamp) {
+        // the key (or one sharing its stamp) changed since we copied it
+        clear_entry(e);
+        return NULL;
+    }
+
+    ++e->hits;
+    ++near->hits;
+    *refresh = e->hits % NEAR_REFRESH_EVERY == 0;
+    void *res = calloc(1, e->val_size);
+    memcpy(res, e->val, e->val_size);
+    *val_size = e->val_size;
+    return res;
+}
+
+void near_offer(near_t near, key_type key, uint64_t hash, uint64_t stamp,
+        val_type val, uint32_t val_size)
+{
+    if (val_size > near->max_val_size) {
+        return;
+    }
+    uint32_t slot = hash & near->mask;
+    if (near->offered[slot] != hash) {
+        near->offered[slot] = hash;
+        return;
+    }
+
+    struct near_entry *e = &near->entries[slot];
+    clear_entry(e);
+    e->key = calloc(strlen((const char*) key) + 1, sizeof(uint8_t));
+    strcpy((char*) e->key, (const char*) key);
+    e->val = calloc(1, val_size);
+    memcpy(e->val, val, val_size);
+    e->val_size = val_size;
+    e->hash = hash;
+    e->stamp = stamp;
+    e->hits = 0;
+}
+
+uint64_t near_hits(near_t near)
+{
+    return near->hits;
+}
@@ -0,0 +1,41 @@
+/*
+ * near.h: header file for a small per-thread near cache of hot entries
+ *
+ */
+#pragma once
+
+#include <stdbool.h>
+
+#include "node.h"
+
+// A near cache is a direct-mapped table of copies of recently read
+// entries. It belongs to one thread, so it has no locks.
+//
+// Every entry remembers the stamp its owner handed in when the entry was
+// filled. The owner bumps its stamps whenever a key is set, deleted or
+// evicted, and an entry is only returned if its stamp is still current.
+//
+// Entries are only admitted on the second offer of the same key in a
+// row, so one-off reads don't push out hot keys.
+typedef struct near_obj *near_t;
+
+// create a near cache with num_entries slots (rounded up to a power of
+// two) that holds values of at most max_val_size bytes
+near_t near_create(uint32_t num_entries, uint32_t max_val_size);
+
+void near_destroy(near_t near);
+
+// Return a copy of the value for key if it is cached under stamp, or NULL.
+// The caller frees the copy. *refresh is set on every so many hits of an
+// entry, to tell the owner to go to the main cache anyway (so its
+// eviction policy still sees that the key is hot).
+void *near_get(near_t near, key_type key, uint64_t hash, uint64_t stamp,
+        uint32_t *val_size, bool *refresh);
+
+// Offer a value just read from the main cache, where stamp was read
+// before the main cache was looked at.
+void near_offer(near_t near, key_type key, uint64_t hash, uint64_t stamp,
+        val_type val, uint32_t val_size);
+
+// number of lookups answered by this near cache
+uint64_t near_hits(near_t near);
@@ -38,6 +38,84 @@ node_t *new_node(key_type key, val_type val, uint32_t val_size)
     return node;
 }
 
+node_t *new_node_owning(key_type key, void *val, uint64_t val_size)
+{
+    node_t *node = (node_t *)calloc(1, sizeof(node_t));
+
+    node->val_size = val_size;
+    node->val = val;
+
+    node->key= calloc(strlen((const char*) key) + 1, sizeof(uint8_t));
+    strcpy((char *) node->key, (const char*) key);
+
+    return node;
+}
+
+node_t *new_chunked_node(key_type key, chunks_t chunks)
+{
+    node_t *node = (node_t *)calloc(1, sizeof(node_t));
+
+    node->val_size = chunks_size(chunks);
+    node->chunked = true;
+    node->val = chunks;
+
+    node->key= calloc(strlen((const char*) key) + 1, sizeof(uint8_t));
+    strcpy((char *) node->key, (const char*) key);
+
+    return node;
+}
+
+node_t *new_slab_node(slab_t slab, key_type key, val_type val, uint32_t val_size)
+{
+    size_t key_len = strlen((const char*) key) + 1;
+    node_t *node = slab_alloc(slab, sizeof(node_t) + key_len + val_size);
+    if (node == NULL) {
+        return NULL;
+    }
+    memset(node, 0, sizeof(node_t));
+    node->slab = true;
+    node->val_size = val_size;
+
+    // the key and value follow the node
+    uint8_t *key_buf = (uint8_t *) (node + 1);
+    memcpy(key_buf, key, key_len);
+    node->key = key_buf;
+    memcpy(key_buf + key_len, val, val_size);
+    node->val = key_buf + key_len;
+    return node;
+}
+
+node_t *move_slab_node(slab_t slab, node_t *node)
+{
+    node_t *copy = new_slab_node(slab, node->key, node->val, (uint32_t) node->val_size);
+    if (copy == NULL) {
+        return NULL;
+    }
+    key_type key = copy->key;
+    val_type val = copy->val;
+    *copy = *node;
+    copy->key = key;
+    copy->val = val;
+    copy->next = NULL;
+    copy->prev = NULL;
+    return copy;
+}
+
+void free_node(node_t *node)
+{
+    if (node->slab) {
+        slab_free(node);
+        return;
+    }
+    free((void *)node->key);
+    if (node->chunked) {
+        chunks_destroy((chunks_t) node->val);
+    } else {
+        free((void *)node->val);
+    }
+    free(node);
+}
+
 void set_next(node_t *node, node_t *next_node)
 {
     node->next = next_node;
@@ -62,6 +140,10 @@ void rep_node(node_t *node)
     printf("key: ");
     print_key(node->key);
     printf(", value: ");
+    if (node->chunked) {
+        printf("%" PRIu64 " bytes in chunks\n", node->val_size);
+        return;
+    }
     for (uint32_t i = 0; i < node->val_size; i++) {
         printf("%" PRIu8 ", ", ((uint8_t*) node->val)[i]);
     }
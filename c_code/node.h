@@ -11,16 +11,33 @@
 #include <string.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdbool.h>
+
+#include "chunks.h"
+#include "slab.h"
 
 typedef const uint8_t *key_type;
 typedef const void *val_type;
 
 typedef struct _node_t node_t;
+struct tag_link;
 struct _node_t
 {
     key_type key;
-    val_type val;
-    uint32_t val_size;
+    val_type val; // a chunks_t if chunked
+    uint64_t val_size;
+    bool chunked;
+    bool slab; // node, key and val are one slab allocation, see new_slab_node
+    uint64_t hash; // full hash of key, filled in by the cache
+    uint64_t version; // changes on every write to the key, see cache_cas
+    uint32_t ns; // namespace the key was set in, see cache_namespace_create
+    uint32_t generation; // the namespace's generation then; older ones were flushed
+    uint32_t atime; // access clock at the last set/get, for sampled eviction
+    // GreedyDual-Size-Frequency state, see gdsf.h
+    double cost; // what it takes to recompute val, from cache_set_with_cost
+    uint32_t freq;
+    uint32_t heap_index; // or its place among its namespace's members for sampled eviction
+    struct tag_link *tags; // the tags it carries, see tags.h
     node_t *next;
     node_t *prev;
 };
@@ -31,10 +48,31 @@ struct _node_t
 //create a new node with a key, value, and the size of the value
 node_t *new_node(key_type key, val_type val, uint32_t val_size);
 
+//create a new node with a key, taking over val, a malloc'd buffer of
+//val_size bytes
+node_t *new_node_owning(key_type key, void *val, uint64_t val_size);
+
+//create a new node with a key and a value already split into chunks,
+//which the node takes over
+node_t *new_chunked_node(key_type key, chunks_t chunks);
+
+//create a new node with a key and a copy of the value, with the node,
+//key and value all in one allocation from slab. Returns NULL if they
+//don't fit in a slab slot.
+node_t *new_slab_node(slab_t slab, key_type key, val_type val, uint32_t val_size);
+
+//copy a slab node to a new place in slab, along with everything the cache
+//keeps in it but its links, e.g. to move it off a sparse page. Returns
+//NULL if slab is out of room for it.
+node_t *move_slab_node(slab_t slab, node_t *node);
+
 // set node's next and prev pointers to next and prev respectively
 void set_next(node_t *node, node_t *next);
 void set_prev(node_t *node, node_t *prev);
 
+// free the node along with its key and value buffers
+void free_node(node_t *node);
+
 //represent the node (print it)
 void rep_node(node_t *node); 
 
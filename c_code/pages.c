@@ -0,0 +1,169 @@
+/*
+ * pages.c: huge page and NUMA aware allocation, see pages.h
+ *
+ */
+
+#define _GNU_SOURCE // CPU_SET and friends
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "pages.h"
+
+#define PAGES_2MB (2UL << 20)
+#define PAGES_1GB (1UL << 30)
+// from linux/mman.h, the log2 of the huge page size goes in these bits
+#define PAGES_HUGE_SHIFT 26
+// from numaif.h, which would also pull in libnuma
+#define PAGES_MPOL_PREFERRED 1
+// the header in front of every allocation; keeps the memory after it
+// aligned for anything
+#define PAGES_HEADER 64
+
+struct pages_header
+{
+    size_t mapped; // length of the mapping, 0 for calloc
+    enum page_backing backing;
+};
+
+static size_t round_up(size_t bytes, size_t to)
+{
+    return (bytes + to - 1) / to * to;
+}
+
+static void prefer_node(void *addr, size_t len, int numa_node)
+{
+    // best effort: mbind fails without CONFIG_NUMA or inside some
+    // sandboxes, and the memory is still good then
+    if (numa_node < 0 || numa_node >= 64) {
+        return;
+    }
+    unsigned long mask = 1UL << numa_node;
+    syscall(SYS_mbind, addr, len, PAGES_MPOL_PREFERRED, &mask, 64, 0);
+}
+
+static void *map_pages(size_t len, int flags)
+{
+    void *addr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+    return addr == MAP_FAILED ? NULL : addr;
+}
+
+void *pages_alloc(const struct page_policy *policy, size_t bytes)
+{
+    struct pages_header *h = NULL;
+    size_t huge = 0;
+    if (policy && policy->size == PAGES_HUGE_2MB) {
+        huge = PAGES_2MB;
+    } else if (policy && policy->size == PAGES_HUGE_1GB) {
+        huge = PAGES_1GB;
+    }
+
+    // anything under half a huge page would mostly be waste
+    if (huge && bytes + PAGES_HEADER >= huge / 2) {
+        size_t len = round_up(bytes + PAGES_HEADER, huge);
+        int shift = huge == PAGES_1GB ? 30 : 21;
+        h = map_pages(len, MAP_HUGETLB | (shift << PAGES_HUGE_SHIFT));
+        if (h) {
+            h->backing = PAGES_BACKED_HUGETLB;
+        } else if (huge == PAGES_1GB && (h = map_pages(round_up(len, PAGES_2MB),
+                        MAP_HUGETLB | (21 << PAGES_HUGE_SHIFT)))) {
+            h->backing = PAGES_BACKED_HUGETLB;
+        } else {
+            // no reserved huge pages; let the kernel back it with
+            // transparent ones if it can
+            h = map_pages(len, 0);
+            if (h) {
+                madvise(h, len, MADV_HUGEPAGE);
+                h->backing = PAGES_BACKED_MMAP;
+            }
+        }
+        if (h) {
+            // the header page is already touched, so bind what's left
+            prefer_node(h, len, policy->numa_node);
+            h->mapped = len;
+            return (uint8_t *) h + PAGES_HEADER;
+        }
+    }
+
+    if (policy && policy->numa_node >= 0 && bytes >= PAGES_2MB) {
+        // big enough that placement matters: map it to be able to bind it
+        size_t len = round_up(bytes + PAGES_HEADER, (size_t) sysconf(_SC_PAGESIZE));
+        h = map_pages(len, 0);
+        if (h) {
+            prefer_node(h, len, policy->numa_node);
+            h->mapped = len;
+            h->backing = PAGES_BACKED_MMAP;
+            return (uint8_t *) h + PAGES_HEADER;
+        }
+    }
+
+    h = calloc(1, bytes + PAGES_HEADER);
+    assert(h && "memory");
+    h->backing = PAGES_BACKED_HEAP;
+    return (uint8_t *) h + PAGES_HEADER;
+}
+
+void pages_free(void *ptr)
+{
+    if (ptr == NULL) {
+        return;
+    }
+    struct pages_header *h = (struct pages_header *) ((uint8_t *) ptr - PAGES_HEADER);
+    if (h->mapped) {
+        munmap(h, h->mapped);
+    } else {
+        free(h);
+    }
+}
+
+enum page_backing pages_backing(const void *ptr)
+{
+    const struct pages_header *h = (const struct pages_header *) ((const uint8_t *) ptr - PAGES_HEADER);
+    return h->backing;
+}
+
+int pages_current_node(void)
+{
+    unsigned cpu = 0, node = 0;
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0) {
+        return 0;
+    }
+    return (int) node;
+}
+
+bool pages_node_cpus(int numa_node, cpu_set_t *cpus)
+{
+    // the kernel lists a node's cpus as ranges, like "0-3,8-11"
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", numa_node);
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return false;
+    }
+    CPU_ZERO(cpus);
+    int lo, hi;
+    bool any = false;
+    while (fscanf(f, "%d", &lo) == 1) {
+        hi = lo;
+        int c = fgetc(f);
+        if (c == '-') {
+            if (fscanf(f, "%d", &hi) != 1) {
+                break;
+            }
+            c = fgetc(f);
+        }
+        for (int cpu = lo; cpu <= hi && cpu < CPU_SETSIZE; ++cpu) {
+            CPU_SET(cpu, cpus);
+            any = true;
+        }
+        if (c != ',') {
+            break;
+        }
+    }
+    fclose(f);
+    return any;
+}
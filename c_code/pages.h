@@ -0,0 +1,63 @@
+/*
+ * pages.h: header file for huge page and NUMA aware allocation
+ *
+ */
+#pragma once
+
+#include <inttypes.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Large arrays (bucket arrays of the table engines) can ask for huge pages
+// to cut TLB misses, and for a NUMA node to live on. Everything falls
+// back quietly: MAP_HUGETLB needs pages reserved in
+// /proc/sys/vm/nr_hugepages, so without them we map normal pages and
+// madvise them for transparent huge pages, and allocations too small to
+// fill a huge page just come from calloc. NUMA placement is a preference,
+// not a binding, so memory still comes from another node if the local one
+// is full.
+enum page_size
+{
+    PAGES_DEFAULT, // plain calloc
+    PAGES_HUGE_2MB,
+    PAGES_HUGE_1GB,
+};
+
+struct page_policy
+{
+    enum page_size size;
+    int numa_node; // preferred node, or -1 for anywhere
+};
+
+// what an allocation actually ended up backed by
+enum page_backing
+{
+    PAGES_BACKED_HEAP, // calloc
+    PAGES_BACKED_MMAP, // anonymous mapping, transparent huge pages asked for
+    PAGES_BACKED_HUGETLB, // reserved huge pages
+};
+
+// allocate bytes of zeroed memory following policy (NULL means
+// PAGES_DEFAULT on any node). Never returns NULL.
+void *pages_alloc(const struct page_policy *policy, size_t bytes);
+
+// free memory from pages_alloc
+void pages_free(void *ptr);
+
+enum page_backing pages_backing(const void *ptr);
+
+// NUMA node the calling thread is running on, 0 if unknown
+int pages_current_node(void);
+
+// fill cpus with the cpus of a NUMA node. Returns false if the node is
+// unknown.
+bool pages_node_cpus(int numa_node, cpu_set_t *cpus);
+
+#ifdef __cplusplus
+}
+#endif
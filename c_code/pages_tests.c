@@ -0,0 +1,80 @@
+#define _GNU_SOURCE // CPU_COUNT
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pages.h"
+#include "pages_tests.h"
+
+#define my_assert(value, string) \
+{if (!(value)) { printf("!!!FAILURE!!! %s\n", string);}}
+
+static bool check_zeroed_and_writable(uint8_t *mem, size_t bytes)
+{
+    for (size_t i = 0; i < bytes; i += 4096) {
+        if (mem[i] != 0) {
+            return false;
+        }
+        mem[i] = 1;
+    }
+    return mem[bytes - 1] == 0;
+}
+
+static void test_pages_fallbacks()
+{
+    printf("Running pages fallback test\n");
+    // small or default allocations come from the heap
+    uint8_t *mem = pages_alloc(NULL, 1000);
+    my_assert(pages_backing(mem) == PAGES_BACKED_HEAP, "default allocation was mapped");
+    my_assert(check_zeroed_and_writable(mem, 1000), "default allocation not zeroed");
+    pages_free(mem);
+
+    struct page_policy policy = {PAGES_HUGE_2MB, -1};
+    mem = pages_alloc(&policy, 1000);
+    my_assert(pages_backing(mem) == PAGES_BACKED_HEAP, "tiny allocation used a huge page");
+    pages_free(mem);
+
+    // big ones are mapped, with reserved huge pages if the host has any
+    size_t bytes = 5 << 20;
+    mem = pages_alloc(&policy, bytes);
+    my_assert(pages_backing(mem) != PAGES_BACKED_HEAP, "huge page allocation came from the heap");
+    my_assert(check_zeroed_and_writable(mem, bytes), "huge page allocation not zeroed");
+    pages_free(mem);
+
+    // 1GB pages fall back to 2MB ones, then to normal pages
+    policy.size = PAGES_HUGE_1GB;
+    bytes = 600 << 20;
+    mem = pages_alloc(&policy, bytes);
+    my_assert(pages_backing(mem) != PAGES_BACKED_HEAP, "1GB page allocation came from the heap");
+    // only touch the ends, not all 600MB
+    my_assert(mem[0] == 0 && mem[bytes - 1] == 0, "1GB page allocation not zeroed");
+    mem[0] = mem[bytes - 1] = 1;
+    pages_free(mem);
+
+    // NUMA placement is only a preference
+    policy.size = PAGES_DEFAULT;
+    policy.numa_node = pages_current_node();
+    bytes = 4 << 20;
+    mem = pages_alloc(&policy, bytes);
+    my_assert(pages_backing(mem) == PAGES_BACKED_MMAP, "node-bound allocation was not mapped");
+    my_assert(check_zeroed_and_writable(mem, bytes), "node-bound allocation not zeroed");
+    pages_free(mem);
+}
+
+static void test_pages_node_cpus()
+{
+    printf("Running pages node cpus test\n");
+    cpu_set_t cpus;
+    if (pages_node_cpus(pages_current_node(), &cpus)) {
+        my_assert(CPU_COUNT(&cpus) > 0, "local node has no cpus");
+    }
+    my_assert(!pages_node_cpus(100000, &cpus), "found cpus for a node that doesn't exist");
+}
+
+void pages_tests()
+{
+    printf("***Running pages tests***\n");
+    test_pages_fallbacks();
+    test_pages_node_cpus();
+}
@@ -0,0 +1,60 @@
+/*
+ * parallel.c: running one job across threads, see parallel.h
+ *
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "parallel.h"
+
+struct parallel_part
+{
+    void (*fn)(uint32_t part, uint32_t parts, void *arg);
+    void *arg;
+    uint32_t part;
+    uint32_t parts;
+};
+
+static void *run_part(void *arg)
+{
+    struct parallel_part *p = arg;
+    p->fn(p->part, p->parts, p->arg);
+    return NULL;
+}
+
+void parallel_run(uint32_t parts, void (*fn)(uint32_t part, uint32_t parts, void *arg), void *arg)
+{
+    assert(parts > 0 && "no parts to run");
+    if (parts == 1) {
+        fn(0, 1, arg);
+        return;
+    }
+    struct parallel_part *ps = calloc(parts, sizeof(struct parallel_part));
+    pthread_t *threads = calloc(parts, sizeof(pthread_t));
+    assert(ps && threads && "memory");
+    for (uint32_t i = 0; i < parts; ++i) {
+        ps[i].fn = fn;
+        ps[i].arg = arg;
+        ps[i].part = i;
+        ps[i].parts = parts;
+    }
+    for (uint32_t i = 1; i < parts; ++i) {
+        int rc = pthread_create(&threads[i], NULL, run_part, &ps[i]);
+        assert(rc == 0 && "could not start a worker thread");
+    }
+    run_part(&ps[0]);
+    for (uint32_t i = 1; i < parts; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    free(ps);
+}
+
+uint32_t parallel_cpus(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (uint32_t) n : 1;
+}
@@ -0,0 +1,16 @@
+/*
+ * parallel.h: header file for running one job across threads
+ *
+ */
+#pragma once
+
+#include <inttypes.h>
+
+// Run fn(part, parts, arg) for every part in [0, parts), each on its own
+// thread (part 0 on the caller's), and return once all of them are done.
+// Jobs split their own work by part, so they need no locking as long as
+// no two parts touch the same data.
+void parallel_run(uint32_t parts, void (*fn)(uint32_t part, uint32_t parts, void *arg), void *arg);
+
+// number of CPUs we can run on, at least 1
+uint32_t parallel_cpus(void);
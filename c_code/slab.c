@@ -0,0 +1,360 @@
+/*
+ * slab.c: a size-class slab allocator, see slab.h
+ *
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "slab.h"
+
+// the page header; slots start after it
+#define SLAB_HEADER 64
+// bytes at the start of a page that stay resident when it is released
+#define SLAB_KEEP 4096
+#define SLAB_MAX_CLASSES 64
+#define SLAB_NO_CLASS UINT32_MAX
+
+struct slab_page
+{
+    slab_t slab;
+    struct slab_page *next; // in its class's partial list, or the free pool
+    struct slab_page *prev;
+    struct slab_page *all_next; // every page of the slab, for slab_destroy
+    uint32_t cls; // SLAB_NO_CLASS while in the free pool
+    uint32_t used; // slots holding an object
+    uint32_t carved; // slots handed out since the page was taken
+    bool draining; // picked by slab_plan_defrag; on no list meanwhile
+    void *free; // freed slots, linked through their first word
+};
+
+_Static_assert(sizeof(struct slab_page) <= SLAB_HEADER, "slab page header");
+
+struct slab_class
+{
+    uint32_t size;
+    uint32_t slots; // per page
+    uint64_t pages;
+    uint64_t used; // slots in use over all its pages
+    struct slab_page *current; // where allocations go
+    struct slab_page *partial; // other pages with free slots; full ones are on no list
+    uint64_t num_partial;
+};
+
+struct slab_obj
+{
+    pthread_mutex_t lock;
+    uint32_t num_classes;
+    struct slab_class classes[SLAB_MAX_CLASSES];
+    struct slab_page *free_pages;
+    struct slab_page *all;
+    uint64_t pages;
+    uint64_t num_free_pages;
+    uint64_t pages_released;
+};
+
+static struct slab_page *page_of(const void *ptr)
+{
+    return (struct slab_page *) ((uintptr_t) ptr & ~(uintptr_t) (SLAB_PAGE_SIZE - 1));
+}
+
+static void list_push(struct slab_page **list, struct slab_page *page)
+{
+    page->prev = NULL;
+    page->next = *list;
+    if (*list) {
+        (*list)->prev = page;
+    }
+    *list = page;
+}
+
+static void list_unlink(struct slab_page **list, struct slab_page *page)
+{
+    if (page->prev) {
+        page->prev->next = page->next;
+    } else {
+        *list = page->next;
+    }
+    if (page->next) {
+        page->next->prev = page->prev;
+    }
+    page->next = page->prev = NULL;
+}
+
+slab_t slab_create(void)
+{
+    slab_t slab = calloc(1, sizeof(struct slab_obj));
+    assert(slab && "memory");
+    pthread_mutex_init(&slab->lock, NULL);
+    // sizes grow by a quarter, in multiples of 16 so slots stay aligned
+    uint32_t size = SLAB_MIN_SIZE;
+    for (;;) {
+        assert(slab->num_classes < SLAB_MAX_CLASSES && "too many size classes");
+        struct slab_class *c = &slab->classes[slab->num_classes++];
+        c->size = size < SLAB_MAX_SIZE ? size : SLAB_MAX_SIZE;
+        c->slots = (SLAB_PAGE_SIZE - SLAB_HEADER) / c->size;
+        if (c->size == SLAB_MAX_SIZE) {
+            break;
+        }
+        size = (size + size / 4 + 15) & ~15u;
+    }
+    return slab;
+}
+
+void slab_destroy(slab_t slab)
+{
+    struct slab_page *page = slab->all;
+    while (page) {
+        struct slab_page *next = page->all_next;
+        munmap(page, SLAB_PAGE_SIZE);
+        page = next;
+    }
+    pthread_mutex_destroy(&slab->lock);
+    free(slab);
+}
+
+static struct slab_page *map_page(slab_t slab)
+{
+    // map twice the size and trim the ends, for a page aligned to its
+    // size, so page_of can find it from any pointer into it
+    size_t len = 2 * (size_t) SLAB_PAGE_SIZE;
+    void *addr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    assert(addr != MAP_FAILED && "memory");
+    uintptr_t start = ((uintptr_t) addr + SLAB_PAGE_SIZE - 1) & ~(uintptr_t) (SLAB_PAGE_SIZE - 1);
+    uintptr_t end = start + SLAB_PAGE_SIZE;
+    if (start > (uintptr_t) addr) {
+        munmap(addr, start - (uintptr_t) addr);
+    }
+    if (end < (uintptr_t) addr + len) {
+        munmap((void *) end, (uintptr_t) addr + len - end);
+    }
+    struct slab_page *page = (struct slab_page *) start;
+    page->slab = slab;
+    page->all_next = slab->all;
+    slab->all = page;
+    ++slab->pages;
+    return page;
+}
+
+static struct slab_page *take_page(slab_t slab, uint32_t cls)
+{
+    // an empty page for cls, from the pool if there is one
+    struct slab_page *page = slab->free_pages;
+    if (page) {
+        list_unlink(&slab->free_pages, page);
+        --slab->num_free_pages;
+    } else {
+        page = map_page(slab);
+    }
+    page->cls = cls;
+    page->used = 0;
+    page->carved = 0;
+    page->free = NULL;
+    ++slab->classes[cls].pages;
+    return page;
+}
+
+static void partial_push(struct slab_class *c, struct slab_page *page)
+{
+    list_push(&c->partial, page);
+    ++c->num_partial;
+}
+
+static void partial_unlink(struct slab_class *c, struct slab_page *page)
+{
+    list_unlink(&c->partial, page);
+    --c->num_partial;
+}
+
+static void release_page(slab_t slab, struct slab_class *c, struct slab_page *page)
+{
+    // page has no objects left: give its memory back and pool it
+    c->pages--;
+    page->cls = SLAB_NO_CLASS;
+    page->draining = false;
+    madvise((uint8_t *) page + SLAB_KEEP, SLAB_PAGE_SIZE - SLAB_KEEP, MADV_DONTNEED);
+    list_push(&slab->free_pages, page);
+    ++slab->num_free_pages;
+    ++slab->pages_released;
+}
+
+static struct slab_page *next_current(slab_t slab, struct slab_class *c)
+{
+    // the fullest page with room, so the emptier ones get a chance to drain
+    struct slab_page *best = NULL;
+    for (struct slab_page *page = c->partial; page; page = page->next) {
+        if (best == NULL || page->used > best->used) {
+            best = page;
+        }
+    }
+    if (best) {
+        partial_unlink(c, best);
+        return best;
+    }
+    return take_page(slab, (uint32_t) (c - slab->classes));
+}
+
+void *slab_alloc(slab_t slab, size_t bytes)
+{
+    if (bytes > SLAB_MAX_SIZE) {
+        return NULL;
+    }
+    pthread_mutex_lock(&slab->lock);
+    struct slab_class *c = slab->classes;
+    while (c->size < bytes) {
+        ++c;
+    }
+    struct slab_page *page = c->current;
+    if (page == NULL || page->used == c->slots) {
+        // a full current page leaves every list until a slot is freed
+        page = c->current = next_current(slab, c);
+    }
+    void *ptr;
+    if (page->free) {
+        ptr = page->free;
+        page->free = *(void **) ptr;
+    } else {
+        ptr = (uint8_t *) page + SLAB_HEADER + (size_t) page->carved++ * c->size;
+    }
+    ++page->used;
+    ++c->used;
+    pthread_mutex_unlock(&slab->lock);
+    return ptr;
+}
+
+void slab_free(void *ptr)
+{
+    struct slab_page *page = page_of(ptr);
+    slab_t slab = page->slab;
+    pthread_mutex_lock(&slab->lock);
+    struct slab_class *c = &slab->classes[page->cls];
+    bool was_full = page->used == c->slots;
+    *(void **) ptr = page->free;
+    page->free = ptr;
+    --page->used;
+    --c->used;
+    if (page->used == 0) {
+        if (page == c->current) {
+            c->current = NULL;
+        } else if (!was_full && !page->draining) {
+            partial_unlink(c, page);
+        }
+        release_page(slab, c, page);
+    } else if (was_full && page != c->current) {
+        partial_push(c, page);
+    }
+    pthread_mutex_unlock(&slab->lock);
+}
+
+static int by_used(const void *a, const void *b)
+{
+    const struct slab_page *x = *(struct slab_page * const *) a;
+    const struct slab_page *y = *(struct slab_page * const *) b;
+    return x->used < y->used ? -1 : x->used > y->used;
+}
+
+static uint64_t plan_class(struct slab_class *c)
+{
+    // drain the emptiest partial pages, as many as the free slots of the
+    // pages kept can take the objects of
+    if (c->num_partial == 0) {
+        return 0;
+    }
+    struct slab_page **pages = calloc(c->num_partial, sizeof(struct slab_page *));
+    assert(pages && "memory");
+    uint64_t n = 0;
+    uint64_t room = c->current ? c->slots - c->current->used : 0;
+    for (struct slab_page *page = c->partial; page; page = page->next) {
+        pages[n++] = page;
+        room += c->slots - page->used;
+    }
+    qsort(pages, n, sizeof(struct slab_page *), by_used);
+
+    uint64_t moving = 0;
+    uint64_t drained = 0;
+    for (; drained < n; ++drained) {
+        struct slab_page *page = pages[drained];
+        if (moving + page->used > room - (c->slots - page->used)) {
+            break;
+        }
+        moving += page->used;
+        room -= c->slots - page->used;
+        partial_unlink(c, page);
+        page->draining = true;
+    }
+    free(pages);
+    return drained;
+}
+
+uint64_t slab_plan_defrag(slab_t slab)
+{
+    pthread_mutex_lock(&slab->lock);
+    uint64_t drained = 0;
+    for (uint32_t i = 0; i < slab->num_classes; ++i) {
+        drained += plan_class(&slab->classes[i]);
+    }
+    pthread_mutex_unlock(&slab->lock);
+    return drained;
+}
+
+void slab_end_defrag(slab_t slab)
+{
+    // pages that kept some objects (ones whose owner didn't move them)
+    // go back to being allocated from
+    pthread_mutex_lock(&slab->lock);
+    for (struct slab_page *page = slab->all; page; page = page->all_next) {
+        if (page->draining) {
+            page->draining = false;
+            partial_push(&slab->classes[page->cls], page);
+        }
+    }
+    pthread_mutex_unlock(&slab->lock);
+}
+
+bool slab_should_move(void *ptr)
+{
+    struct slab_page *page = page_of(ptr);
+    pthread_mutex_lock(&page->slab->lock);
+    bool draining = page->draining;
+    pthread_mutex_unlock(&page->slab->lock);
+    return draining;
+}
+
+static void collect_stats(slab_t slab, struct slab_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->pages = slab->pages;
+    stats->free_pages = slab->num_free_pages;
+    stats->pages_released = slab->pages_released;
+    for (uint32_t i = 0; i < slab->num_classes; ++i) {
+        struct slab_class *c = &slab->classes[i];
+        stats->used_bytes += c->used * c->size;
+        // a page's worth of free slots can't be given back however the
+        // objects are packed; past that a defrag pass can always empty
+        // a page
+        uint64_t free_slots = c->pages * c->slots - c->used;
+        if (free_slots > c->slots) {
+            stats->slack_bytes += (free_slots - c->slots) * c->size;
+        }
+    }
+}
+
+double slab_fragmentation(slab_t slab)
+{
+    pthread_mutex_lock(&slab->lock);
+    struct slab_stats stats;
+    collect_stats(slab, &stats);
+    pthread_mutex_unlock(&slab->lock);
+    uint64_t in_use = stats.pages - stats.free_pages;
+    return in_use ? (double) stats.slack_bytes / ((double) in_use * SLAB_PAGE_SIZE) : 0;
+}
+
+void slab_get_stats(slab_t slab, struct slab_stats *stats)
+{
+    pthread_mutex_lock(&slab->lock);
+    collect_stats(slab, stats);
+    pthread_mutex_unlock(&slab->lock);
+}
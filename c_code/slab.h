@@ -0,0 +1,80 @@
+/*
+ * slab.h: header file for a size-class slab allocator
+ *
+ */
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Small allocations of many sizes, made and freed all the time, leave a
+// malloc heap full of holes: after the mix of sizes shifts, most pages
+// hold a few live objects and the process keeps its peak RSS. A slab
+// allocator gives the cache control over that. Memory is mapped in
+// SLAB_PAGE_SIZE pages, each cut into equal slots of one size class
+// (classes grow by about a quarter from SLAB_MIN_SIZE to SLAB_MAX_SIZE).
+//
+//  - A page whose last slot is freed is handed back to the kernel with
+//    madvise(MADV_DONTNEED) and goes into a pool shared by all classes,
+//    so memory flows from classes that shrank to the ones that grow.
+//  - Allocations fill the fullest page of their class first, so live
+//    objects collect on few pages and the rest drain.
+//  - To compact, slab_plan_defrag picks the emptiest pages of each class,
+//    as many as the free slots of its other pages can take the objects
+//    of, and stops allocating from them. The owner of the objects (who
+//    alone knows where the pointers to them are) then moves every object
+//    slab_should_move points out: slab_alloc a copy, fix up the pointers,
+//    slab_free the old one. The picked pages empty out and are released.
+//    slab_end_defrag puts back whatever is left.
+//
+// Objects only ever move within their class, so memory goes from one
+// class to another through the page pool alone, a whole empty page at a
+// time. That is also the limit of the fragmentation measure: a page's
+// worth of free slots per class can't be given back by any packing, so
+// only slack past that counts. A class down to one page reports none
+// however empty the page is, and the page stays mapped until its last
+// object is freed.
+//
+// All calls are thread safe.
+#define SLAB_PAGE_SIZE (1 << 20)
+#define SLAB_MIN_SIZE 96
+#define SLAB_MAX_SIZE (SLAB_PAGE_SIZE / 8)
+
+typedef struct slab_obj *slab_t;
+
+struct slab_stats
+{
+    uint64_t pages; // mapped, in use or not
+    uint64_t free_pages; // emptied and handed back to the kernel
+    uint64_t used_bytes; // slots holding an object
+    uint64_t slack_bytes; // free slots on pages in use, past a page's worth per class
+    uint64_t pages_released; // times a page was emptied, over the slab's life
+};
+
+slab_t slab_create(void);
+
+// unmaps every page, whether or not its objects were freed
+void slab_destroy(slab_t slab);
+
+// Allocate bytes (at most SLAB_MAX_SIZE, or this returns NULL), aligned
+// for anything. The memory is not zeroed.
+void *slab_alloc(slab_t slab, size_t bytes);
+
+// free ptr from slab_alloc of any slab
+void slab_free(void *ptr);
+
+// pick the pages to empty, see above, and return how many were picked
+uint64_t slab_plan_defrag(slab_t slab);
+
+// true if ptr, from slab_alloc, is on a page picked by slab_plan_defrag
+bool slab_should_move(void *ptr);
+
+// allocate from the picked pages again
+void slab_end_defrag(slab_t slab);
+
+// slack_bytes (see slab_stats) as a fraction of the memory of the pages
+// in use
+double slab_fragmentation(slab_t slab);
+
+void slab_get_stats(slab_t slab, struct slab_stats *stats);
@@ -0,0 +1,236 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "slab.h"
+#include "slab_tests.h"
+
+#define my_assert(value, string) \
+{if (!(value)) { printf("!!!FAILURE!!! %s\n", string);}}
+
+static bool resident(const void *addr)
+{
+    // is the OS page at addr backed by memory right now?
+    long os_page = sysconf(_SC_PAGESIZE);
+    unsigned char vec;
+    void *start = (void *) ((uintptr_t) addr & ~(uintptr_t) (os_page - 1));
+    return mincore(start, os_page, &vec) == 0 && (vec & 1);
+}
+
+static void test_slab_alloc_free()
+{
+    printf("Running slab alloc/free test\n");
+    slab_t slab = slab_create();
+    my_assert(slab_alloc(slab, SLAB_MAX_SIZE + 1) == NULL, "slab took an allocation past its biggest class");
+
+    // objects of every size stay apart and aligned
+    const uint32_t n = 2000;
+    uint8_t **objs = calloc(n, sizeof(uint8_t *));
+    bool ok = true;
+    for (uint32_t i = 0; i < n; i++) {
+        size_t size = 1 + (i * 37) % 2000;
+        objs[i] = slab_alloc(slab, size);
+        ok = ok && objs[i] && (uintptr_t) objs[i] % 16 == 0;
+        memset(objs[i], (int) (i & 0xff), size);
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        size_t size = 1 + (i * 37) % 2000;
+        ok = ok && objs[i][0] == (i & 0xff) && objs[i][size - 1] == (i & 0xff);
+    }
+    my_assert(ok, "slab objects overlapped or were misaligned");
+
+    struct slab_stats stats;
+    slab_get_stats(slab, &stats);
+    my_assert(stats.used_bytes >= n && stats.free_pages == 0, "slab stats are off");
+
+    for (uint32_t i = 0; i < n; i++) {
+        slab_free(objs[i]);
+    }
+    slab_get_stats(slab, &stats);
+    my_assert(stats.used_bytes == 0 && stats.free_pages == stats.pages, "freed pages were not pooled");
+    my_assert(slab_fragmentation(slab) == 0, "an empty slab is fragmented");
+    free(objs);
+    slab_destroy(slab);
+}
+
+static void test_slab_release_and_reuse()
+{
+    printf("Running slab release test\n");
+    slab_t slab = slab_create();
+    // fill a few pages of small objects, then empty one of them
+    const uint32_t n = 3 * SLAB_PAGE_SIZE / SLAB_MIN_SIZE;
+    void **objs = calloc(n, sizeof(void *));
+    for (uint32_t i = 0; i < n; i++) {
+        objs[i] = slab_alloc(slab, SLAB_MIN_SIZE);
+        memset(objs[i], 1, SLAB_MIN_SIZE);
+    }
+    uint8_t *first = objs[0];
+    uint8_t *far = first + SLAB_PAGE_SIZE / 2; // an object in the middle of the first page
+    my_assert(resident(far), "touched slab memory is not resident");
+    for (uint32_t i = 0; i < n; i++) {
+        if ((uintptr_t) objs[i] / SLAB_PAGE_SIZE == (uintptr_t) first / SLAB_PAGE_SIZE) {
+            slab_free(objs[i]);
+            objs[i] = NULL;
+        }
+    }
+    struct slab_stats stats;
+    slab_get_stats(slab, &stats);
+    my_assert(stats.free_pages == 1 && stats.pages_released == 1, "emptied page was not released");
+    my_assert(!resident(far), "released page is still resident");
+
+    // another size class takes the pooled page instead of mapping one
+    uint64_t pages = stats.pages;
+    void *big = slab_alloc(slab, SLAB_MAX_SIZE);
+    slab_get_stats(slab, &stats);
+    my_assert(stats.pages == pages && stats.free_pages == 0, "pooled page was not reused");
+    slab_free(big);
+
+    for (uint32_t i = 0; i < n; i++) {
+        if (objs[i]) {
+            slab_free(objs[i]);
+        }
+    }
+    free(objs);
+    slab_destroy(slab);
+}
+
+static void test_slab_defrag()
+{
+    printf("Running slab defrag test\n");
+    slab_t slab = slab_create();
+    // six pages' worth, then free most of every page but the last
+    const uint32_t per_page = (SLAB_PAGE_SIZE - 64) / SLAB_MIN_SIZE;
+    const uint32_t n = 6 * per_page;
+    void **objs = calloc(n, sizeof(void *));
+    for (uint32_t i = 0; i < n; i++) {
+        objs[i] = slab_alloc(slab, SLAB_MIN_SIZE);
+    }
+    for (uint32_t i = 0; i < 5 * per_page; i++) {
+        if (i % 10 != 0) {
+            slab_free(objs[i]);
+            objs[i] = NULL;
+        }
+    }
+    // 4.5 pages of free slots, less the page's worth that can't be given
+    // back, over 6 pages
+    my_assert(slab_fragmentation(slab) > 0.5, "sparse pages don't show as fragmented");
+
+    // four of the sparse pages can go into the fifth
+    struct slab_stats before;
+    slab_get_stats(slab, &before);
+    my_assert(slab_plan_defrag(slab) == 4, "picked the wrong number of pages to empty");
+    my_assert(!slab_should_move(objs[n - 1]), "object on the full page should stay");
+    uint32_t moved = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        if (objs[i] && slab_should_move(objs[i])) {
+            void *copy = slab_alloc(slab, SLAB_MIN_SIZE);
+            my_assert(!slab_should_move(copy), "a copy went onto a page being emptied");
+            slab_free(objs[i]);
+            objs[i] = copy;
+            ++moved;
+        }
+    }
+    slab_end_defrag(slab);
+    struct slab_stats after;
+    slab_get_stats(slab, &after);
+    my_assert(moved > 0, "nothing was worth moving");
+    my_assert(after.free_pages == before.free_pages + 4, "defrag didn't empty the pages it picked");
+    my_assert(after.used_bytes == before.used_bytes, "defrag lost objects");
+    my_assert(slab_fragmentation(slab) < 0.1, "still fragmented after defrag");
+
+    for (uint32_t i = 0; i < n; i++) {
+        if (objs[i]) {
+            slab_free(objs[i]);
+        }
+    }
+    free(objs);
+    slab_destroy(slab);
+}
+
+static void test_slab_unreclaimable_slack()
+{
+    printf("Running slab unreclaimable slack test\n");
+    // three full pages with 30% freed from two of them: 0.6 of a page is
+    // free, and no packing of the objects empties a page, so that is not
+    // fragmentation and a defrag pass has nothing to do
+    slab_t slab = slab_create();
+    const uint32_t per_page = (SLAB_PAGE_SIZE - 64) / SLAB_MIN_SIZE;
+    const uint32_t n = 3 * per_page;
+    void **objs = calloc(n, sizeof(void *));
+    for (uint32_t i = 0; i < n; i++) {
+        objs[i] = slab_alloc(slab, SLAB_MIN_SIZE);
+    }
+    for (uint32_t i = 0; i < 2 * per_page; i++) {
+        if (i % 10 < 3) {
+            slab_free(objs[i]);
+            objs[i] = NULL;
+        }
+    }
+    my_assert(slab_fragmentation(slab) == 0, "slack no pass can give back counted as fragmentation");
+    my_assert(slab_plan_defrag(slab) == 0, "planned to empty a page that can't be emptied");
+    slab_end_defrag(slab);
+
+    for (uint32_t i = 0; i < n; i++) {
+        if (objs[i]) {
+            slab_free(objs[i]);
+        }
+    }
+    free(objs);
+    slab_destroy(slab);
+}
+
+static void test_slab_single_page()
+{
+    printf("Running slab single page test\n");
+    // a class with one half-empty page next to a full class: the page
+    // can't be emptied into anything, so it counts as no fragmentation,
+    // isn't picked, and keeps its memory
+    slab_t slab = slab_create();
+    const uint32_t per_page = (SLAB_PAGE_SIZE - 64) / SLAB_MIN_SIZE;
+    void **objs = calloc(per_page, sizeof(void *));
+    for (uint32_t i = 0; i < per_page; i++) {
+        objs[i] = slab_alloc(slab, SLAB_MIN_SIZE);
+    }
+    for (uint32_t i = 0; i < per_page; i += 2) {
+        slab_free(objs[i]);
+        objs[i] = NULL;
+    }
+    const uint32_t big_per_page = (SLAB_PAGE_SIZE - 64) / SLAB_MAX_SIZE;
+    void *full[8];
+    for (uint32_t i = 0; i < big_per_page; i++) {
+        full[i] = slab_alloc(slab, SLAB_MAX_SIZE);
+    }
+    struct slab_stats stats;
+    slab_get_stats(slab, &stats);
+    my_assert(stats.pages == 2 && stats.free_pages == 0, "slab didn't map one page per class");
+    my_assert(stats.slack_bytes == 0 && slab_fragmentation(slab) == 0, "a lone half-empty page counted as fragmentation");
+    my_assert(slab_plan_defrag(slab) == 0, "planned to empty a class's only page");
+    slab_end_defrag(slab);
+    slab_get_stats(slab, &stats);
+    my_assert(stats.free_pages == 0 && stats.pages_released == 0, "a page with live objects was released");
+
+    for (uint32_t i = 0; i < per_page; i++) {
+        if (objs[i]) {
+            slab_free(objs[i]);
+        }
+    }
+    for (uint32_t i = 0; i < big_per_page; i++) {
+        slab_free(full[i]);
+    }
+    free(objs);
+    slab_destroy(slab);
+}
+
+void slab_tests()
+{
+    printf("***Running slab tests***\n");
+    test_slab_alloc_free();
+    test_slab_release_and_reuse();
+    test_slab_defrag();
+    test_slab_unreclaimable_slack();
+    test_slab_single_page();
+}
@@ -0,0 +1,221 @@
+/*
+ * tags.c: the tag index, see tags.h
+ *
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tags.h"
+
+#define TAGS_MIN_BUCKETS 64
+
+struct tag
+{
+    char *name;
+    uint64_t hash;
+    uint64_t count;
+    struct tag_link *nodes;
+    struct tag *next; // in its bucket
+};
+
+struct tag_link
+{
+    struct tag *tag;
+    node_t *node;
+    struct tag_link *next; // the tag's other nodes
+    struct tag_link *prev;
+    struct tag_link *node_next; // the node's other tags
+};
+
+struct tags_obj
+{
+    struct tag **buckets;
+    uint64_t num_buckets;
+    uint64_t num_tags;
+};
+
+static uint64_t tag_hash(const char *name)
+{
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (; *name; ++name) {
+        hash = (hash ^ (uint8_t) *name) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+tags_t tags_create(void)
+{
+    tags_t tags = calloc(1, sizeof(struct tags_obj));
+    assert(tags && "memory");
+    tags->num_buckets = TAGS_MIN_BUCKETS;
+    tags->buckets = calloc(tags->num_buckets, sizeof(struct tag *));
+    assert(tags->buckets && "memory");
+    return tags;
+}
+
+void tags_destroy(tags_t tags)
+{
+    for (uint64_t i = 0; i < tags->num_buckets; ++i) {
+        struct tag *tag = tags->buckets[i];
+        while (tag) {
+            struct tag *next = tag->next;
+            struct tag_link *link = tag->nodes;
+            while (link) {
+                struct tag_link *next_link = link->next;
+                free(link);
+                link = next_link;
+            }
+            free(tag->name);
+            free(tag);
+            tag = next;
+        }
+    }
+    free(tags->buckets);
+    free(tags);
+}
+
+static struct tag **find_tag(tags_t tags, const char *name, uint64_t hash)
+{
+    // the link pointing at the tag, or at the NULL ending its bucket
+    struct tag **link = &tags->buckets[hash & (tags->num_buckets - 1)];
+    while (*link && ((*link)->hash != hash || strcmp((*link)->name, name) != 0)) {
+        link = &(*link)->next;
+    }
+    return link;
+}
+
+static void grow(tags_t tags)
+{
+    uint64_t num_buckets = 2 * tags->num_buckets;
+    struct tag **buckets = calloc(num_buckets, sizeof(struct tag *));
+    assert(buckets && "memory");
+    for (uint64_t i = 0; i < tags->num_buckets; ++i) {
+        struct tag *tag = tags->buckets[i];
+        while (tag) {
+            struct tag *next = tag->next;
+            struct tag **bucket = &buckets[tag->hash & (num_buckets - 1)];
+            tag->next = *bucket;
+            *bucket = tag;
+            tag = next;
+        }
+    }
+    free(tags->buckets);
+    tags->buckets = buckets;
+    tags->num_buckets = num_buckets;
+}
+
+static struct tag *get_tag(tags_t tags, const char *name)
+{
+    // the tag called name, made if there isn't one yet
+    uint64_t hash = tag_hash(name);
+    struct tag **link = find_tag(tags, name, hash);
+    if (*link) {
+        return *link;
+    }
+    if (tags->num_tags >= tags->num_buckets) {
+        grow(tags);
+        link = find_tag(tags, name, hash);
+    }
+    struct tag *tag = calloc(1, sizeof(struct tag));
+    assert(tag && "memory");
+    tag->name = strdup(name);
+    assert(tag->name && "memory");
+    tag->hash = hash;
+    *link = tag;
+    ++tags->num_tags;
+    return tag;
+}
+
+static bool has_tag(node_t *node, struct tag *tag)
+{
+    for (struct tag_link *link = node->tags; link; link = link->node_next) {
+        if (link->tag == tag) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void tags_add(tags_t tags, node_t *node, const char *const *names, uint32_t n)
+{
+    for (uint32_t i = 0; i < n; ++i) {
+        struct tag *tag = get_tag(tags, names[i]);
+        if (has_tag(node, tag)) {
+            continue;
+        }
+        struct tag_link *link = calloc(1, sizeof(struct tag_link));
+        assert(link && "memory");
+        link->tag = tag;
+        link->node = node;
+        link->next = tag->nodes;
+        if (tag->nodes) {
+            tag->nodes->prev = link;
+        }
+        tag->nodes = link;
+        ++tag->count;
+        link->node_next = node->tags;
+        node->tags = link;
+    }
+}
+
+void tags_remove(tags_t tags, node_t *node)
+{
+    struct tag_link *link = node->tags;
+    node->tags = NULL;
+    while (link) {
+        struct tag_link *node_next = link->node_next;
+        struct tag *tag = link->tag;
+        if (link->prev) {
+            link->prev->next = link->next;
+        } else {
+            tag->nodes = link->next;
+        }
+        if (link->next) {
+            link->next->prev = link->prev;
+        }
+        free(link);
+        if (--tag->count == 0) {
+            *find_tag(tags, tag->name, tag->hash) = tag->next;
+            --tags->num_tags;
+            free(tag->name);
+            free(tag);
+        }
+        link = node_next;
+    }
+}
+
+void tags_move(tags_t tags, node_t *old, node_t *node)
+{
+    (void) tags;
+    node->tags = old->tags;
+    old->tags = NULL;
+    for (struct tag_link *link = node->tags; link; link = link->node_next) {
+        link->node = node;
+    }
+}
+
+uint64_t tags_nodes(tags_t tags, const char *name, node_t ***nodes)
+{
+    struct tag *tag = *find_tag(tags, name, tag_hash(name));
+    *nodes = NULL;
+    if (tag == NULL) {
+        return 0;
+    }
+    *nodes = malloc(tag->count * sizeof(node_t *));
+    assert(*nodes && "memory");
+    uint64_t n = 0;
+    for (struct tag_link *link = tag->nodes; link; link = link->next) {
+        (*nodes)[n++] = link->node;
+    }
+    return n;
+}
+
+uint64_t tags_count(tags_t tags, const char *name)
+{
+    struct tag *tag = *find_tag(tags, name, tag_hash(name));
+    return tag ? tag->count : 0;
+}
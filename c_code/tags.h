@@ -0,0 +1,42 @@
+/*
+ * tags.h: header file for the tag index
+ *
+ */
+#pragma once
+
+#include <inttypes.h>
+
+#include "node.h"
+
+// A secondary index from tags (strings like "user:42") to the nodes that
+// carry them, so everything derived from one upstream object can be
+// found without knowing its keys. A node can carry any number of tags,
+// and node->tags lists its links, one per tag.
+//
+// Each tag is a hash table entry with a doubly linked list of links, and
+// each link is on both its tag's list and its node's. Adding, moving and
+// removing a node are O(its tags); a tag with no nodes left is freed.
+//
+// The index never frees nodes, and callers serialize all calls.
+typedef struct tags_obj *tags_t;
+
+tags_t tags_create(void);
+
+// frees the index and every link, but not the nodes (which may be gone)
+void tags_destroy(tags_t tags);
+
+// attach node to each of names[0..n); a tag it already has is skipped
+void tags_add(tags_t tags, node_t *node, const char *const *names, uint32_t n);
+
+// node is leaving the cache: take it off every tag
+void tags_remove(tags_t tags, node_t *node);
+
+// node took old's place as a copy of it (same key), with old's tags
+void tags_move(tags_t tags, node_t *old, node_t *node);
+
+// Set *nodes to a malloc'd array of the nodes carrying name (NULL if
+// none), and return how many there are
+uint64_t tags_nodes(tags_t tags, const char *name, node_t ***nodes);
+
+// number of nodes carrying name
+uint64_t tags_count(tags_t tags, const char *name);
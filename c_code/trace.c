@@ -0,0 +1,116 @@
+/*
+ * trace.c: latency histograms for tracing, see trace.h
+ *
+ */
+
+#include <stdatomic.h>
+
+#include "trace.h"
+
+// values below 2^TRACE_SUB_BITS get a bucket each; above that every power
+// of two is split into 2^TRACE_SUB_BITS buckets
+#define TRACE_SUB_BITS 4
+#define TRACE_SUB_BUCKETS (1 << TRACE_SUB_BITS)
+#define TRACE_MAX_BITS 48 // about three days in ns; longer is clamped
+#define TRACE_BUCKETS ((TRACE_MAX_BITS - TRACE_SUB_BITS + 1) * TRACE_SUB_BUCKETS)
+
+const char *const trace_phase_names[TRACE_PHASES] = {
+    "set", "get", "delete", "hash", "lookup", "policy", "resize", "evict",
+};
+
+static _Atomic uint64_t histograms[TRACE_PHASES][TRACE_BUCKETS];
+static _Atomic uint32_t sample_every = 64;
+
+_Thread_local bool trace_sampling;
+static _Thread_local uint32_t op_count;
+
+static uint32_t bucket_of(uint64_t ns)
+{
+    if (ns < TRACE_SUB_BUCKETS) {
+        return (uint32_t) ns;
+    }
+    uint32_t msb = 63 - __builtin_clzll(ns);
+    if (msb >= TRACE_MAX_BITS) {
+        return TRACE_BUCKETS - 1;
+    }
+    uint32_t sub = (ns >> (msb - TRACE_SUB_BITS)) & (TRACE_SUB_BUCKETS - 1);
+    return (msb - TRACE_SUB_BITS + 1) * TRACE_SUB_BUCKETS + sub;
+}
+
+static uint64_t bucket_value(uint32_t bucket)
+{
+    // the middle of the range of values that land in bucket
+    if (bucket < TRACE_SUB_BUCKETS) {
+        return bucket;
+    }
+    uint32_t msb = bucket / TRACE_SUB_BUCKETS + TRACE_SUB_BITS - 1;
+    uint64_t sub = bucket % TRACE_SUB_BUCKETS;
+    uint64_t width = 1ULL << (msb - TRACE_SUB_BITS);
+    return ((TRACE_SUB_BUCKETS + sub) << (msb - TRACE_SUB_BITS)) + width / 2;
+}
+
+void trace_record(enum trace_phase phase, uint64_t ns)
+{
+    atomic_fetch_add_explicit(&histograms[phase][bucket_of(ns)], 1, memory_order_relaxed);
+}
+
+uint64_t trace_count(enum trace_phase phase)
+{
+    uint64_t count = 0;
+    for (uint32_t b = 0; b < TRACE_BUCKETS; ++b) {
+        count += atomic_load_explicit(&histograms[phase][b], memory_order_relaxed);
+    }
+    return count;
+}
+
+uint64_t trace_percentile(enum trace_phase phase, double p)
+{
+    uint64_t count = trace_count(phase);
+    if (count == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t) (p / 100 * count + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (uint32_t b = 0; b < TRACE_BUCKETS; ++b) {
+        seen += atomic_load_explicit(&histograms[phase][b], memory_order_relaxed);
+        if (seen >= rank) {
+            return bucket_value(b);
+        }
+    }
+    return bucket_value(TRACE_BUCKETS - 1);
+}
+
+void trace_reset(void)
+{
+    for (uint32_t phase = 0; phase < TRACE_PHASES; ++phase) {
+        for (uint32_t b = 0; b < TRACE_BUCKETS; ++b) {
+            atomic_store_explicit(&histograms[phase][b], 0, memory_order_relaxed);
+        }
+    }
+}
+
+void trace_set_sample_every(uint32_t n)
+{
+    atomic_store(&sample_every, n ? n : 1);
+}
+
+bool trace_should_sample(void)
+{
+    return ++op_count % atomic_load_explicit(&sample_every, memory_order_relaxed) == 0;
+}
+
+void trace_report(FILE *out)
+{
+    for (uint32_t phase = 0; phase < TRACE_PHASES; ++phase) {
+        uint64_t count = trace_count(phase);
+        if (count == 0) {
+            continue;
+        }
+        fprintf(out, "%-8s n=%-10" PRIu64 " p50=%-8" PRIu64 " p99=%-8" PRIu64 " p99.9=%" PRIu64 " ns\n",
+                trace_phase_names[phase], count, trace_percentile(phase, 50),
+                trace_percentile(phase, 99), trace_percentile(phase, 99.9));
+    }
+}
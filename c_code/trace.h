@@ -0,0 +1,105 @@
+/*
+ * trace.h: header file for compile-time optional latency tracing
+ *
+ */
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+
+// The cache marks the boundaries of each phase of an operation with
+// TRACE_BEGIN/TRACE_END. Built with -DCACHE_TRACING (make TRACE=1) these
+//
+//   * fire static tracepoints hash_it_out:phase_begin and
+//     hash_it_out:phase_end (argument: the phase) when <sys/sdt.h> is
+//     available, for perf probe / bpftrace, and
+//   * time one in every trace_sample_every operations per thread into a
+//     histogram per phase, readable with trace_percentile.
+//
+// Built without it, the macros expand to nothing.
+enum trace_phase
+{
+    TRACE_SET, // whole cache_set
+    TRACE_GET, // whole cache_get
+    TRACE_DELETE, // whole cache_delete
+    TRACE_HASH, // hashing the key
+    TRACE_LOOKUP, // finding the key in the table (chain walk or cuckoo probe)
+    TRACE_POLICY, // eviction policy bookkeeping on get and set
+    TRACE_RESIZE, // cache_dynamic_resize in cache_set
+    TRACE_EVICT, // the eviction loop in cache_set
+    TRACE_PHASES,
+};
+
+extern const char *const trace_phase_names[TRACE_PHASES];
+
+// add a latency in nanoseconds to a phase's histogram. The histograms are
+// log-linear (16 sub-buckets per power of two), so values are kept within
+// about 6%.
+void trace_record(enum trace_phase phase, uint64_t ns);
+
+// number of latencies recorded for phase
+uint64_t trace_count(enum trace_phase phase);
+
+// the latency at or below which p (0 to 100) percent of the phase's
+// recorded latencies fall, 0 if there are none
+uint64_t trace_percentile(enum trace_phase phase, double p);
+
+// clear all histograms
+void trace_reset(void);
+
+// time 1 in every n operations (1 times all of them). The default is 64.
+void trace_set_sample_every(uint32_t n);
+
+// print count, p50, p99 and p99.9 of every phase that has any
+void trace_report(FILE *out);
+
+#ifdef CACHE_TRACING
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define TRACE_PROBE(name, phase) STAP_PROBE1(hash_it_out, name, phase)
+#endif
+#endif
+#ifndef TRACE_PROBE
+#define TRACE_PROBE(name, phase) ((void) (phase))
+#endif
+
+extern _Thread_local bool trace_sampling;
+bool trace_should_sample(void);
+
+static inline uint64_t trace_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline uint64_t trace_begin(enum trace_phase phase)
+{
+    TRACE_PROBE(phase_begin, phase);
+    return trace_sampling ? trace_now() : 0;
+}
+
+static inline void trace_end(enum trace_phase phase, uint64_t start)
+{
+    TRACE_PROBE(phase_end, phase);
+    if (start) {
+        trace_record(phase, trace_now() - start);
+    }
+}
+
+// start of a public operation: decides whether this one is timed
+#define TRACE_OP() (trace_sampling = trace_should_sample())
+#define TRACE_BEGIN(phase) uint64_t trace_start_##phase = trace_begin(phase)
+#define TRACE_END(phase) trace_end(phase, trace_start_##phase)
+
+#else
+
+#define TRACE_OP() ((void) 0)
+#define TRACE_BEGIN(phase) ((void) 0)
+#define TRACE_END(phase) ((void) 0)
+
+#endif
@@ -0,0 +1,79 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cache.h"
+#include "trace.h"
+#include "trace_tests.h"
+
+#define my_assert(value, string) \
+{if (!(value)) { printf("!!!FAILURE!!! %s\n", string);}}
+
+static bool close_to(uint64_t got, uint64_t want)
+{
+    // histogram buckets are within about 6% of their values
+    return got >= want * 0.93 && got <= want * 1.07;
+}
+
+static void test_trace_histogram()
+{
+    printf("Running trace histogram test\n");
+    trace_reset();
+    for (uint64_t ns = 1; ns <= 100000; ns++) {
+        trace_record(TRACE_LOOKUP, ns);
+    }
+    trace_record(TRACE_RESIZE, 5);
+    my_assert(trace_count(TRACE_LOOKUP) == 100000, "trace lost samples");
+    my_assert(close_to(trace_percentile(TRACE_LOOKUP, 50), 50000), "trace p50 is off");
+    my_assert(close_to(trace_percentile(TRACE_LOOKUP, 99), 99000), "trace p99 is off");
+    my_assert(close_to(trace_percentile(TRACE_LOOKUP, 99.9), 99900), "trace p99.9 is off");
+    my_assert(trace_percentile(TRACE_RESIZE, 50) == 5, "small latencies should be exact");
+    my_assert(trace_percentile(TRACE_EVICT, 50) == 0, "empty phase should report 0");
+    trace_record(TRACE_EVICT, UINT64_MAX);
+    my_assert(trace_count(TRACE_EVICT) == 1, "huge latency was not clamped");
+    trace_reset();
+    my_assert(trace_count(TRACE_LOOKUP) == 0, "trace reset left samples");
+}
+
+static void test_trace_cache_phases()
+{
+    printf("Running trace cache phases test\n");
+    trace_reset();
+    trace_set_sample_every(1);
+    cache_t c = create_cache(100);
+    uint8_t val[10] = {0};
+    char key[24];
+    for (uint32_t i = 0; i < 100; i++) {
+        snprintf(key, sizeof(key), "traced%" PRIu32, i);
+        cache_set(c, (key_type) key, val, sizeof(val));
+        uint32_t size;
+        free((void *) cache_get(c, (key_type) key, &size));
+    }
+    cache_delete(c, (key_type) key);
+    destroy_cache(c);
+    trace_set_sample_every(64);
+
+#ifdef CACHE_TRACING
+    my_assert(trace_count(TRACE_SET) == 100 && trace_count(TRACE_GET) == 100 &&
+            trace_count(TRACE_DELETE) == 1, "traced build missed operations");
+    my_assert(trace_count(TRACE_HASH) == 200 && trace_count(TRACE_LOOKUP) == 100,
+            "traced build missed phases");
+    my_assert(trace_count(TRACE_EVICT) == 100 && trace_count(TRACE_RESIZE) == 100,
+            "traced build missed set phases");
+    my_assert(trace_percentile(TRACE_SET, 99) >= trace_percentile(TRACE_SET, 50),
+            "percentiles out of order");
+#else
+    for (uint32_t phase = 0; phase < TRACE_PHASES; phase++) {
+        my_assert(trace_count(phase) == 0, "untraced build recorded latencies");
+    }
+#endif
+    trace_reset();
+}
+
+void trace_tests()
+{
+    printf("***Running trace tests***\n");
+    test_trace_histogram();
+    test_trace_cache_phases();
+}